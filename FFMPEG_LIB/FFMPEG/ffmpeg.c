@@ -45,6 +45,10 @@
 #undef time //needed because HAVE_AV_CONFIG_H is defined on top
 #include <time.h>
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "version.h"
 #include "cmdutils.h"
 
@@ -163,6 +167,8 @@ static char *str_copyright = NULL;
 static char *str_comment = NULL;
 static char *str_album = NULL;
 static int do_benchmark = 0;
+static int do_pipeline = 0;
+static int no_scale_tree = 0;
 static int do_hex_dump = 0;
 static int do_pkt_dump = 0;
 static int do_psnr = 0;
@@ -236,6 +242,8 @@ typedef struct AVOutputStream {
     AVFrame pict_tmp;      /* temporary image for resampling */
     struct SwsContext *img_resample_ctx; /* for image resampling */
     int resample_height;
+    struct AVOutputStream *resample_src; /* scaled output we downscale from, NULL for the decoded picture */
+    unsigned int resample_serial; /* decoded picture pict_tmp was last scaled from */
 
     int video_crop;
     int topBand;             /* cropping area sizes */
@@ -252,12 +260,18 @@ typedef struct AVOutputStream {
     ReSampleContext *resample; /* for audio resampling */
     AVFifoBuffer fifo;     /* for compression: one audio fifo per codec */
     FILE *logfile;
+
+    struct FrameQueue *encode_queue; /* pictures waiting for the encoder thread, -pipeline only */
+    int report_quality;      /* last coded picture of the encoder thread, for print_report() */
+    uint64_t report_error[3];
 } AVOutputStream;
 
 typedef struct AVInputStream {
     int file_index;
     int index;
     AVStream *st;
+    AVCodecContext *dec;     /* decoder context, with -pipeline st->codec is
+                                a copy used by the demuxer thread */
     int discard;             /* true if stream data should be discarded */
     int decoding_needed;     /* true if the packets must be decoded in 'raw_fifo' */
     int64_t sample_index;      /* current sample */
@@ -268,6 +282,7 @@ typedef struct AVInputStream {
                                 is not defined */
     int64_t       pts;       /* current pts */
     int is_start;            /* is 1 at the start and after a discontinuity */
+    unsigned int decoded_frames; /* number of decoded pictures */
 } AVInputStream;
 
 typedef struct AVInputFile {
@@ -398,7 +413,109 @@ get_sync_ipts(const AVOutputStream *ost)
     return (double)(ist->pts + input_files_ts_offset[ist->file_index] - start_time)/AV_TIME_BASE;
 }
 
-static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
+/* time spent in each transcoding stage, for print_report() */
+enum {
+    STAGE_DEMUX,
+    STAGE_DECODE,
+    STAGE_FILTER,
+    STAGE_ENCODE,
+    STAGE_MUX,
+    STAGE_NB
+};
+
+static const char *stage_names[STAGE_NB]= {"demux", "decode", "filter", "encode", "mux"};
+static int64_t stage_time[STAGE_NB];
+
+#ifdef HAVE_PTHREADS
+#define PIPELINE_PACKETS 64 /* packets buffered between demuxer/muxer and the rest */
+#define PIPELINE_FRAMES  4  /* pictures buffered in front of each video encoder */
+
+typedef struct QueuedPacket {
+    AVPacket pkt;
+    AVFormatContext *s;      /* destination, mux queue only */
+    AVCodecContext *avctx;
+    AVBitStreamFilterContext *bsfc;
+} QueuedPacket;
+
+typedef struct PacketQueue {
+    QueuedPacket entry[PIPELINE_PACKETS];
+    int rindex, windex, size;
+    int eof;                 /* no more packets will be put */
+    int abort;               /* no more packets will be taken */
+    AVFormatContext *ic;     /* input read by the demuxer thread */
+    AVCodecContext *dec[MAX_STREAMS]; /* decoder contexts of ic, the demuxer uses copies */
+    int nb_dec;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+} PacketQueue;
+
+typedef struct FrameQueue {
+    AVFrame frame[PIPELINE_FRAMES];
+    int rindex, windex, size;
+    int eof;
+    uint8_t *bit_buffer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+} FrameQueue;
+
+static pthread_mutex_t pipeline_lock= PTHREAD_MUTEX_INITIALIZER;
+static PacketQueue *mux_queue;
+static PacketQueue *input_queue[MAX_FILES];
+
+/* output progress as of the last muxed packet, for print_report() */
+static int64_t mux_size[MAX_FILES];
+static int64_t mux_pts[MAX_FILES][MAX_STREAMS];
+#endif
+
+static void stage_add(int stage, int64_t start)
+{
+    int64_t t= av_gettime() - start;
+
+#ifdef HAVE_PTHREADS
+    if (mux_queue) {
+        pthread_mutex_lock(&pipeline_lock);
+        stage_time[stage] += t;
+        pthread_mutex_unlock(&pipeline_lock);
+        return;
+    }
+#endif
+    stage_time[stage] += t;
+}
+
+/* with a mux thread, the muxer state may only be read as published by it */
+static int64_t output_stream_pts(AVOutputStream *ost)
+{
+#ifdef HAVE_PTHREADS
+    if (mux_queue) {
+        int64_t pts;
+        pthread_mutex_lock(&pipeline_lock);
+        pts= mux_pts[ost->file_index][ost->index];
+        pthread_mutex_unlock(&pipeline_lock);
+        return pts;
+    }
+#endif
+    return ost->st->pts.val;
+}
+
+static int64_t output_file_pos(int file_index)
+{
+#ifdef HAVE_PTHREADS
+    if (mux_queue) {
+        int64_t pos;
+        pthread_mutex_lock(&pipeline_lock);
+        pos= mux_size[file_index];
+        pthread_mutex_unlock(&pipeline_lock);
+        return pos;
+    }
+#endif
+    return url_ftell(&output_files[file_index]->pb);
+}
+
+static void mux_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
+    int64_t t= av_gettime();
+
     while(bsfc){
         AVPacket new_pkt= *pkt;
         int a= av_bitstream_filter_filter(bsfc, avctx, NULL,
@@ -415,6 +532,214 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
     }
 
     av_interleaved_write_frame(s, pkt);
+    stage_add(STAGE_MUX, t);
+}
+
+#ifdef HAVE_PTHREADS
+static PacketQueue *packet_queue_new(void)
+{
+    PacketQueue *q= av_mallocz(sizeof(PacketQueue));
+
+    if (!q)
+        return NULL;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return q;
+}
+
+/* takes ownership of the packet, returns -1 if the consumer is gone */
+static int packet_queue_put(PacketQueue *q, QueuedPacket *qp)
+{
+    pthread_mutex_lock(&q->mutex);
+    while (q->size == PIPELINE_PACKETS && !q->abort)
+        pthread_cond_wait(&q->cond, &q->mutex);
+    if (q->abort) {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    q->entry[q->windex]= *qp;
+    q->windex= (q->windex + 1) % PIPELINE_PACKETS;
+    q->size++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+/* returns 0 once the queue is empty and ended */
+static int packet_queue_get(PacketQueue *q, QueuedPacket *qp)
+{
+    int ret= 0;
+
+    pthread_mutex_lock(&q->mutex);
+    while (!q->size && !q->eof)
+        pthread_cond_wait(&q->cond, &q->mutex);
+    if (q->size) {
+        *qp= q->entry[q->rindex];
+        q->rindex= (q->rindex + 1) % PIPELINE_PACKETS;
+        q->size--;
+        pthread_cond_broadcast(&q->cond);
+        ret= 1;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return ret;
+}
+
+static void packet_queue_end(PacketQueue *q, int abort)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->eof= 1;
+    q->abort |= abort;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+/* gives the parsers of the demuxer thread their own codec contexts,
+   so they do not update the parameters the decoders are using */
+static int packet_queue_copy_codecs(PacketQueue *q)
+{
+    AVStream *st;
+    AVCodecContext *avctx;
+
+    for(q->nb_dec=0; q->nb_dec<q->ic->nb_streams; q->nb_dec++) {
+        st= q->ic->streams[q->nb_dec];
+        avctx= avcodec_alloc_context();
+        if (!avctx)
+            return -1;
+        *avctx= *st->codec;
+        q->dec[q->nb_dec]= st->codec;
+        st->codec= avctx;
+    }
+    return 0;
+}
+
+static void packet_queue_free(PacketQueue *q)
+{
+    int i;
+
+    while (q->size) {
+        av_free_packet(&q->entry[q->rindex].pkt);
+        q->rindex= (q->rindex + 1) % PIPELINE_PACKETS;
+        q->size--;
+    }
+    for(i=0;i<q->nb_dec;i++) {
+        av_free(q->ic->streams[i]->codec);
+        q->ic->streams[i]->codec= q->dec[i];
+    }
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+    av_free(q);
+}
+
+static void *demux_thread(void *arg)
+{
+    PacketQueue *q= arg;
+    QueuedPacket qp;
+
+    memset(&qp, 0, sizeof(qp));
+    for(;;) {
+        int64_t t= av_gettime();
+        int ret= av_read_frame(q->ic, &qp.pkt);
+
+        stage_add(STAGE_DEMUX, t);
+        if (ret < 0)
+            break;
+        if (av_dup_packet(&qp.pkt) < 0 || packet_queue_put(q, &qp) < 0) {
+            av_free_packet(&qp.pkt);
+            break;
+        }
+    }
+    packet_queue_end(q, 0);
+    return NULL;
+}
+
+static void *mux_thread(void *arg)
+{
+    PacketQueue *q= arg;
+    QueuedPacket qp;
+    int i, j;
+
+    while (packet_queue_get(q, &qp)) {
+        mux_frame(qp.s, &qp.pkt, qp.avctx, qp.bsfc);
+        av_free_packet(&qp.pkt);
+
+        pthread_mutex_lock(&pipeline_lock);
+        for(i=0; output_files[i] != qp.s; i++);
+        mux_size[i]= url_ftell(&qp.s->pb);
+        for(j=0;j<qp.s->nb_streams;j++)
+            mux_pts[i][j]= qp.s->streams[j]->pts.val;
+        pthread_mutex_unlock(&pipeline_lock);
+    }
+    return NULL;
+}
+
+/* copies the picture into the encoder queue, waits while it is full */
+static void encode_queue_put(AVOutputStream *ost, AVFrame *picture)
+{
+    FrameQueue *q= ost->encode_queue;
+    AVCodecContext *enc= ost->st->codec;
+    AVFrame *slot;
+
+    pthread_mutex_lock(&q->mutex);
+    while (q->size == PIPELINE_FRAMES)
+        pthread_cond_wait(&q->cond, &q->mutex);
+    pthread_mutex_unlock(&q->mutex);
+
+    slot= &q->frame[q->windex];
+    av_picture_copy((AVPicture *)slot, (AVPicture *)picture, enc->pix_fmt, enc->width, enc->height);
+    slot->interlaced_frame= picture->interlaced_frame;
+    slot->top_field_first = picture->top_field_first;
+    slot->quality         = picture->quality;
+    slot->pict_type       = picture->pict_type;
+    slot->pts             = picture->pts;
+
+    pthread_mutex_lock(&q->mutex);
+    q->windex= (q->windex + 1) % PIPELINE_FRAMES;
+    q->size++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+#endif
+
+static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
+#ifdef HAVE_PTHREADS
+    if (mux_queue) {
+        QueuedPacket qp;
+
+        /* the caller keeps its packet, the mux thread gets a private copy */
+        qp.pkt= *pkt;
+        qp.pkt.destruct= NULL;
+        qp.s= s;
+        qp.avctx= avctx;
+        qp.bsfc= bsfc;
+        if (av_dup_packet(&qp.pkt) < 0 || packet_queue_put(mux_queue, &qp) < 0) {
+            fprintf(stderr, "Could not queue packet for muxing\n");
+            exit(1);
+        }
+        return;
+    }
+#endif
+    mux_frame(s, pkt, avctx, bsfc);
+}
+
+static int read_packet(int file_index, AVPacket *pkt)
+{
+    int64_t t;
+    int ret;
+
+#ifdef HAVE_PTHREADS
+    if (input_queue[file_index]) {
+        QueuedPacket qp;
+
+        if (!packet_queue_get(input_queue[file_index], &qp))
+            return -1;
+        *pkt= qp.pkt;
+        return 0;
+    }
+#endif
+    t= av_gettime();
+    ret= av_read_frame(input_files[file_index], pkt);
+    stage_add(STAGE_DEMUX, t);
+    return ret;
 }
 
 #define MAX_AUDIO_PACKET_SIZE (128 * 1024)
@@ -430,6 +755,7 @@ static void do_audio_out(AVFormatContext *s,
     const int audio_out_size= 4*MAX_AUDIO_PACKET_SIZE;
 
     int size_out, frame_bytes, ret;
+    int64_t t;
     AVCodecContext *enc= ost->st->codec;
 
     /* SC: dynamic allocation of buffers */
@@ -443,8 +769,8 @@ static void do_audio_out(AVFormatContext *s,
     if(audio_sync_method){
         double delta = get_sync_ipts(ost) * enc->sample_rate - ost->sync_opts
                 - av_fifo_size(&ost->fifo)/(ost->st->codec->channels * 2);
-        double idelta= delta*ist->st->codec->sample_rate / enc->sample_rate;
-        int byte_delta= ((int)idelta)*2*ist->st->codec->channels;
+        double idelta= delta*ist->dec->sample_rate / enc->sample_rate;
+        int byte_delta= ((int)idelta)*2*ist->dec->channels;
 
         //FIXME resample delay
         if(fabs(delta) > 50){
@@ -488,11 +814,13 @@ static void do_audio_out(AVFormatContext *s,
                         - av_fifo_size(&ost->fifo)/(ost->st->codec->channels * 2); //FIXME wrong
 
     if (ost->audio_resample) {
+        t = av_gettime();
         buftmp = audio_buf;
         size_out = audio_resample(ost->resample,
                                   (short *)buftmp, (short *)buf,
-                                  size / (ist->st->codec->channels * 2));
+                                  size / (ist->dec->channels * 2));
         size_out = size_out * enc->channels * 2;
+        stage_add(STAGE_FILTER, t);
     } else {
         buftmp = buf;
         size_out = size;
@@ -509,8 +837,10 @@ static void do_audio_out(AVFormatContext *s,
             AVPacket pkt;
             av_init_packet(&pkt);
 
+            t = av_gettime();
             ret = avcodec_encode_audio(enc, audio_out, audio_out_size,
                                        (short *)audio_buf);
+            stage_add(STAGE_ENCODE, t);
             audio_size += ret;
             pkt.stream_index= ost->index;
             pkt.data= audio_out;
@@ -553,8 +883,10 @@ static void do_audio_out(AVFormatContext *s,
             size_out = size_out >> 1;
             break;
         }
+        t = av_gettime();
         ret = avcodec_encode_audio(enc, audio_out, size_out,
                                    (short *)buftmp);
+        stage_add(STAGE_ENCODE, t);
         audio_size += ret;
         pkt.stream_index= ost->index;
         pkt.data= audio_out;
@@ -573,7 +905,7 @@ static void pre_process_video_frame(AVInputStream *ist, AVPicture *picture, void
     AVPicture picture_tmp;
     uint8_t *buf = 0;
 
-    dec = ist->st->codec;
+    dec = ist->dec;
 
     /* deinterlace : must be done before any resize */
     if (do_deinterlace || using_vhook) {
@@ -669,6 +1001,76 @@ static void do_subtitle_out(AVFormatContext *s,
 static int bit_buffer_size= 1024*256;
 static uint8_t *bit_buffer= NULL;
 
+/* encodes one picture, NULL flushes the delayed ones, returns the frame size */
+static int encode_video_frame(AVFormatContext *s, AVOutputStream *ost,
+                              AVFrame *picture, uint8_t *buf)
+{
+    AVCodecContext *enc= ost->st->codec;
+    AVPacket pkt;
+    int64_t t;
+    int ret;
+
+    av_init_packet(&pkt);
+    pkt.stream_index= ost->index;
+
+    t = av_gettime();
+    ret = avcodec_encode_video(enc, buf, bit_buffer_size, picture);
+    stage_add(STAGE_ENCODE, t);
+    if (ret == -1) {
+        fprintf(stderr, "Video encoding failed\n");
+        exit(1);
+    }
+    //enc->frame_number = enc->real_pict_num;
+    if(ret>0){
+        pkt.data= buf;
+        pkt.size= ret;
+        if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+            pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
+/*av_log(NULL, AV_LOG_DEBUG, "encoder -> %"PRId64"/%"PRId64"\n",
+   pkt.pts != AV_NOPTS_VALUE ? av_rescale(pkt.pts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1,
+   pkt.dts != AV_NOPTS_VALUE ? av_rescale(pkt.dts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1);*/
+
+        if(enc->coded_frame && enc->coded_frame->key_frame)
+            pkt.flags |= PKT_FLAG_KEY;
+        write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
+        //fprintf(stderr,"\nFrame: %3d %3d size: %5d type: %d",
+        //        enc->frame_number-1, enc->real_pict_num, ret,
+        //        enc->pict_type);
+        /* if two pass, output log */
+        if (ost->logfile && enc->stats_out) {
+            fprintf(ost->logfile, "%s", enc->stats_out);
+        }
+    }
+    return ret;
+}
+
+/**
+ * scales the current decoded picture for ost, from the picture of its
+ * resample_src if it has one. each output is scaled at most once per
+ * decoded picture, so the sources are shared between their children.
+ * returns the scaled picture, which is dst unless it is shared as is
+ */
+static AVFrame *resample_video_frame(AVOutputStream *ost, AVInputStream *ist,
+                                     AVFrame *in_picture, AVFrame *dst)
+{
+    AVFrame *src= in_picture;
+
+    if (ost->resample_src) {
+        AVOutputStream *src_ost= ost->resample_src;
+
+        src= resample_video_frame(src_ost, ist, in_picture, &src_ost->pict_tmp);
+        /* same size and format as the source output */
+        if (!ost->img_resample_ctx)
+            return src;
+    }
+    if (ost->resample_serial != ist->decoded_frames) {
+        sws_scale(ost->img_resample_ctx, src->data, src->linesize,
+                  0, ost->resample_height, dst->data, dst->linesize);
+        ost->resample_serial= ist->decoded_frames;
+    }
+    return dst;
+}
+
 static void do_video_out(AVFormatContext *s,
                          AVOutputStream *ost,
                          AVInputStream *ist,
@@ -679,12 +1081,13 @@ static void do_video_out(AVFormatContext *s,
     AVFrame *final_picture, *formatted_picture, *resampling_dst, *padding_src;
     AVFrame picture_crop_temp, picture_pad_temp;
     AVCodecContext *enc, *dec;
+    int64_t t;
 
     avcodec_get_frame_defaults(&picture_crop_temp);
     avcodec_get_frame_defaults(&picture_pad_temp);
 
     enc = ost->st->codec;
-    dec = ist->st->codec;
+    dec = ist->dec;
 
     /* by default, we output a single frame */
     nb_frames = 1;
@@ -716,6 +1119,7 @@ static void do_video_out(AVFormatContext *s,
     if (nb_frames <= 0)
         return;
 
+    t = av_gettime();
     if (ost->video_crop) {
         if (av_picture_crop((AVPicture *)&picture_crop_temp, (AVPicture *)in_picture, dec->pix_fmt, ost->topBand, ost->leftBand) < 0) {
             av_log(NULL, AV_LOG_ERROR, "error cropping picture\n");
@@ -742,9 +1146,9 @@ static void do_video_out(AVFormatContext *s,
 
     if (ost->video_resample) {
         padding_src = NULL;
-        final_picture = &ost->pict_tmp;
-        sws_scale(ost->img_resample_ctx, formatted_picture->data, formatted_picture->linesize,
-              0, ost->resample_height, resampling_dst->data, resampling_dst->linesize);
+        final_picture = resample_video_frame(ost, ist, formatted_picture, resampling_dst);
+        if (ost->video_pad)
+            final_picture = &ost->pict_tmp;
     }
 
     if (ost->video_pad) {
@@ -752,6 +1156,7 @@ static void do_video_out(AVFormatContext *s,
                 enc->height, enc->width, enc->pix_fmt,
                 ost->padtop, ost->padbottom, ost->padleft, ost->padright, padcolor);
     }
+    stage_add(STAGE_FILTER, t);
 
     /* duplicates frame if needed */
     for(i=0;i<nb_frames;i++) {
@@ -800,34 +1205,16 @@ static void do_video_out(AVFormatContext *s,
             big_picture.pts= ost->sync_opts;
 //            big_picture.pts= av_rescale(ost->sync_opts, AV_TIME_BASE*(int64_t)enc->time_base.num, enc->time_base.den);
 //av_log(NULL, AV_LOG_DEBUG, "%"PRId64" -> encoder\n", ost->sync_opts);
-            ret = avcodec_encode_video(enc,
-                                       bit_buffer, bit_buffer_size,
-                                       &big_picture);
-            if (ret == -1) {
-                fprintf(stderr, "Video encoding failed\n");
-                exit(1);
-            }
-            //enc->frame_number = enc->real_pict_num;
-            if(ret>0){
-                pkt.data= bit_buffer;
-                pkt.size= ret;
-                if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
-                    pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
-/*av_log(NULL, AV_LOG_DEBUG, "encoder -> %"PRId64"/%"PRId64"\n",
-   pkt.pts != AV_NOPTS_VALUE ? av_rescale(pkt.pts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1,
-   pkt.dts != AV_NOPTS_VALUE ? av_rescale(pkt.dts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1);*/
-
-                if(enc->coded_frame && enc->coded_frame->key_frame)
-                    pkt.flags |= PKT_FLAG_KEY;
-                write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
-                *frame_size = ret;
-                //fprintf(stderr,"\nFrame: %3d %3d size: %5d type: %d",
-                //        enc->frame_number-1, enc->real_pict_num, ret,
-                //        enc->pict_type);
-                /* if two pass, output log */
-                if (ost->logfile && enc->stats_out) {
-                    fprintf(ost->logfile, "%s", enc->stats_out);
-                }
+#ifdef HAVE_PTHREADS
+            if (ost->encode_queue) {
+                /* the encoder thread accounts the frame size itself */
+                encode_queue_put(ost, &big_picture);
+            } else
+#endif
+            {
+                ret = encode_video_frame(s, ost, &big_picture, bit_buffer);
+                if (ret > 0)
+                    *frame_size = ret;
             }
         }
         ost->sync_opts++;
@@ -879,6 +1266,196 @@ static void do_video_stats(AVFormatContext *os, AVOutputStream *ost,
     }
 }
 
+#ifdef HAVE_PTHREADS
+static void *encode_thread(void *arg)
+{
+    AVOutputStream *ost= arg;
+    FrameQueue *q= ost->encode_queue;
+    AVFormatContext *os= output_files[ost->file_index];
+    AVFrame *picture;
+    int frame_size;
+
+    for(;;) {
+        pthread_mutex_lock(&q->mutex);
+        while (!q->size && !q->eof)
+            pthread_cond_wait(&q->cond, &q->mutex);
+        picture= q->size ? &q->frame[q->rindex] : NULL;
+        pthread_mutex_unlock(&q->mutex);
+
+        /* once the queue has ended, NULL flushes the delayed frames */
+        frame_size= encode_video_frame(os, ost, picture, q->bit_buffer);
+
+        pthread_mutex_lock(&pipeline_lock);
+        video_size += frame_size;
+        if (vstats_filename && frame_size)
+            do_video_stats(os, ost, frame_size);
+        if (ost->st->codec->coded_frame) {
+            ost->report_quality= ost->st->codec->coded_frame->quality;
+            memcpy(ost->report_error, ost->st->codec->coded_frame->error, sizeof(ost->report_error));
+        }
+        pthread_mutex_unlock(&pipeline_lock);
+
+        if (!picture) {
+            if (frame_size <= 0)
+                break;
+            continue;
+        }
+        pthread_mutex_lock(&q->mutex);
+        q->rindex= (q->rindex + 1) % PIPELINE_FRAMES;
+        q->size--;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->mutex);
+    }
+    return NULL;
+}
+
+static void encode_queue_free(FrameQueue *q)
+{
+    int i;
+
+    for(i=0; i<PIPELINE_FRAMES; i++)
+        av_free(q->frame[i].data[0]);
+    av_free(q->bit_buffer);
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+    av_free(q);
+}
+
+static int encode_queue_open(AVOutputStream *ost)
+{
+    AVCodecContext *enc= ost->st->codec;
+    FrameQueue *q= av_mallocz(sizeof(FrameQueue));
+    int i;
+
+    if (!q)
+        return -1;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+
+    q->bit_buffer= av_malloc(bit_buffer_size);
+    if (!q->bit_buffer)
+        goto fail;
+    for(i=0; i<PIPELINE_FRAMES; i++) {
+        avcodec_get_frame_defaults(&q->frame[i]);
+        if (avpicture_alloc((AVPicture *)&q->frame[i], enc->pix_fmt, enc->width, enc->height))
+            goto fail;
+    }
+
+    ost->encode_queue= q;
+    if (pthread_create(&q->thread, NULL, encode_thread, ost)) {
+        ost->encode_queue= NULL;
+        goto fail;
+    }
+    return 0;
+ fail:
+    encode_queue_free(q);
+    return -1;
+}
+
+/* ends the queue and waits until the encoder thread has flushed the encoder */
+static void encode_queue_close(AVOutputStream *ost)
+{
+    FrameQueue *q= ost->encode_queue;
+
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->mutex);
+    q->eof= 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    pthread_join(q->thread, NULL);
+    encode_queue_free(q);
+    ost->encode_queue= NULL;
+}
+
+static void pipeline_stop_input(void)
+{
+    int i;
+
+    for(i=0;i<nb_input_files;i++) {
+        PacketQueue *q= input_queue[i];
+
+        if (!q)
+            continue;
+        packet_queue_end(q, 1);
+        pthread_join(q->thread, NULL);
+        packet_queue_free(q);
+        input_queue[i]= NULL;
+    }
+}
+
+static void pipeline_stop(AVOutputStream **ost_table, int nb_ostreams)
+{
+    int i;
+
+    pipeline_stop_input();
+    for(i=0;i<nb_ostreams;i++)
+        encode_queue_close(ost_table[i]);
+
+    if (mux_queue) {
+        packet_queue_end(mux_queue, 0);
+        pthread_join(mux_queue->thread, NULL);
+        packet_queue_free(mux_queue);
+        mux_queue= NULL;
+    }
+}
+
+/**
+ * runs each demuxer, each video encoder and the muxing in their own
+ * thread, decoding and filtering stay in the main loop
+ */
+static int pipeline_start(AVOutputStream **ost_table, int nb_ostreams)
+{
+    PacketQueue *q;
+    int i;
+
+    for(i=0;i<nb_output_files;i++) {
+        if (output_files[i]->oformat->flags & AVFMT_RAWPICTURE) {
+            fprintf(stderr, "Warning: pipelining is not supported with raw picture output\n");
+            return 0;
+        }
+    }
+
+    q= packet_queue_new();
+    if (!q || pthread_create(&q->thread, NULL, mux_thread, q)) {
+        if (q)
+            packet_queue_free(q);
+        goto fail;
+    }
+    mux_queue= q;
+
+    for(i=0;i<nb_input_files;i++) {
+        q= packet_queue_new();
+        if (!q)
+            goto fail;
+        q->ic= input_files[i];
+        if (packet_queue_copy_codecs(q) < 0 ||
+            pthread_create(&q->thread, NULL, demux_thread, q)) {
+            packet_queue_free(q);
+            goto fail;
+        }
+        input_queue[i]= q;
+    }
+
+    /* motion vector reuse needs the decoder's tables at encoding time */
+    if (me_threshold)
+        return 0;
+    for(i=0;i<nb_ostreams;i++) {
+        AVOutputStream *ost= ost_table[i];
+
+        if (ost->encoding_needed && ost->st->codec->codec_type == CODEC_TYPE_VIDEO
+            && encode_queue_open(ost) < 0)
+            goto fail;
+    }
+    return 0;
+ fail:
+    fprintf(stderr, "Could not start the pipeline threads\n");
+    pipeline_stop(ost_table, nb_ostreams);
+    return -1;
+}
+#endif
+
 static void print_report(AVFormatContext **output_files,
                          AVOutputStream **ost_table, int nb_ostreams,
                          int is_last_report)
@@ -888,8 +1465,10 @@ static void print_report(AVFormatContext **output_files,
     AVFormatContext *oc, *os;
     int64_t total_size;
     AVCodecContext *enc;
+    AVFrame *coded_frame, report_frame;
     int frame_number, vid, i;
     double bitrate, ti1, pts;
+    int64_t pts_val;
     static int64_t last_time = -1;
     static int qp_histogram[52];
 
@@ -909,9 +1488,19 @@ static void print_report(AVFormatContext **output_files,
 
     oc = output_files[0];
 
-    total_size = url_fsize(&oc->pb);
-    if(total_size<0) // FIXME improve url_fsize() so it works with non seekable output too
-        total_size= url_ftell(&oc->pb);
+#ifdef HAVE_PTHREADS
+    /* the muxer and the video encoders may run in their own threads,
+       then only what they published under pipeline_lock can be read */
+    if (mux_queue) {
+        pthread_mutex_lock(&pipeline_lock);
+        total_size= mux_size[0];
+    } else
+#endif
+    {
+        total_size = url_fsize(&oc->pb);
+        if(total_size<0) // FIXME improve url_fsize() so it works with non seekable output too
+            total_size= url_ftell(&oc->pb);
+    }
 
     buf[0] = '\0';
     ti1 = 1e10;
@@ -920,9 +1509,21 @@ static void print_report(AVFormatContext **output_files,
         ost = ost_table[i];
         os = output_files[ost->file_index];
         enc = ost->st->codec;
+        coded_frame = enc->coded_frame;
+        pts_val = ost->st->pts.val;
+#ifdef HAVE_PTHREADS
+        if (mux_queue) {
+            pts_val = mux_pts[ost->file_index][ost->index];
+            if (ost->encode_queue) {
+                report_frame.quality = ost->report_quality;
+                memcpy(report_frame.error, ost->report_error, sizeof(ost->report_error));
+                coded_frame = &report_frame;
+            }
+        }
+#endif
         if (vid && enc->codec_type == CODEC_TYPE_VIDEO) {
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "q=%2.1f ",
-                    enc->coded_frame->quality/(float)FF_QP2LAMBDA);
+                    coded_frame->quality/(float)FF_QP2LAMBDA);
         }
         if (!vid && enc->codec_type == CODEC_TYPE_VIDEO) {
             float t = (av_gettime()-timer_start) / 1000000.0;
@@ -930,12 +1531,12 @@ static void print_report(AVFormatContext **output_files,
             frame_number = ost->frame_number;
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "frame=%5d fps=%3d q=%3.1f ",
                      frame_number, (t>1)?(int)(frame_number/t+0.5) : 0,
-                     enc->coded_frame ? enc->coded_frame->quality/(float)FF_QP2LAMBDA : -1);
+                     coded_frame ? coded_frame->quality/(float)FF_QP2LAMBDA : -1);
             if(is_last_report)
                 snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "L");
-            if(qp_hist && enc->coded_frame){
+            if(qp_hist && coded_frame){
                 int j;
-                int qp= lrintf(enc->coded_frame->quality/(float)FF_QP2LAMBDA);
+                int qp= lrintf(coded_frame->quality/(float)FF_QP2LAMBDA);
                 if(qp>=0 && qp<sizeof(qp_histogram)/sizeof(int))
                     qp_histogram[qp]++;
                 for(j=0; j<32; j++)
@@ -952,7 +1553,7 @@ static void print_report(AVFormatContext **output_files,
                         error= enc->error[j];
                         scale= enc->width*enc->height*255.0*255.0*frame_number;
                     }else{
-                        error= enc->coded_frame->error[j];
+                        error= coded_frame->error[j];
                         scale= enc->width*enc->height*255.0*255.0;
                     }
                     if(j) scale/=4;
@@ -965,10 +1566,14 @@ static void print_report(AVFormatContext **output_files,
             vid = 1;
         }
         /* compute min output value */
-        pts = (double)ost->st->pts.val * ost->st->time_base.num / ost->st->time_base.den;
+        pts = (double)pts_val * ost->st->time_base.num / ost->st->time_base.den;
         if ((pts < ti1) && (pts > 0))
             ti1 = pts;
     }
+#ifdef HAVE_PTHREADS
+    if (mux_queue)
+        pthread_mutex_unlock(&pipeline_lock);
+#endif
     if (ti1 < 0.01)
         ti1 = 0.01;
 
@@ -998,6 +1603,12 @@ static void print_report(AVFormatContext **output_files,
                 extra_size/1024.0,
                 100.0*(total_size - raw)/raw
         );
+        if (do_pipeline || do_benchmark) {
+            fprintf(stderr, "stage times:");
+            for(i=0;i<STAGE_NB;i++)
+                fprintf(stderr, " %s=%0.3fs", stage_names[i], stage_time[i] / 1000000.0);
+            fprintf(stderr, "\n");
+        }
     }
 }
 
@@ -1018,6 +1629,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
     static short *samples= NULL;
     AVSubtitle subtitle, *subtitle_to_free;
     int got_subtitle;
+    int64_t t;
 
     if(!pkt){
         ist->pts= ist->next_pts; // needed for last packet if vsync=0
@@ -1043,15 +1655,17 @@ static int output_packet(AVInputStream *ist, int ist_index,
         data_size = 0;
         subtitle_to_free = NULL;
         if (ist->decoding_needed) {
-            switch(ist->st->codec->codec_type) {
+            switch(ist->dec->codec_type) {
             case CODEC_TYPE_AUDIO:{
                 if(pkt)
                     samples= av_fast_realloc(samples, &samples_size, FFMAX(pkt->size*sizeof(*samples), AVCODEC_MAX_AUDIO_FRAME_SIZE));
                 data_size= samples_size;
                     /* XXX: could avoid copy if PCM 16 bits with same
                        endianness as CPU */
-                ret = avcodec_decode_audio2(ist->st->codec, samples, &data_size,
+                t = av_gettime();
+                ret = avcodec_decode_audio2(ist->dec, samples, &data_size,
                                            ptr, len);
+                stage_add(STAGE_DECODE, t);
                 if (ret < 0)
                     goto fail_decode;
                 ptr += ret;
@@ -1064,15 +1678,17 @@ static int output_packet(AVInputStream *ist, int ist_index,
                 }
                 data_buf = (uint8_t *)samples;
                 ist->next_pts += ((int64_t)AV_TIME_BASE/2 * data_size) /
-                    (ist->st->codec->sample_rate * ist->st->codec->channels);
+                    (ist->dec->sample_rate * ist->dec->channels);
                 break;}
             case CODEC_TYPE_VIDEO:
-                    data_size = (ist->st->codec->width * ist->st->codec->height * 3) / 2;
+                    data_size = (ist->dec->width * ist->dec->height * 3) / 2;
                     /* XXX: allocate picture correctly */
                     avcodec_get_frame_defaults(&picture);
 
-                    ret = avcodec_decode_video(ist->st->codec,
+                    t = av_gettime();
+                    ret = avcodec_decode_video(ist->dec,
                                                &picture, &got_picture, ptr, len);
+                    stage_add(STAGE_DECODE, t);
                     ist->st->quality= picture.quality;
                     if (ret < 0)
                         goto fail_decode;
@@ -1080,15 +1696,16 @@ static int output_packet(AVInputStream *ist, int ist_index,
                         /* no picture yet */
                         goto discard_packet;
                     }
-                    if (ist->st->codec->time_base.num != 0) {
+                    ist->decoded_frames++;
+                    if (ist->dec->time_base.num != 0) {
                         ist->next_pts += ((int64_t)AV_TIME_BASE *
-                                          ist->st->codec->time_base.num) /
-                            ist->st->codec->time_base.den;
+                                          ist->dec->time_base.num) /
+                            ist->dec->time_base.den;
                     }
                     len = 0;
                     break;
             case CODEC_TYPE_SUBTITLE:
-                ret = avcodec_decode_subtitle(ist->st->codec,
+                ret = avcodec_decode_subtitle(ist->dec,
                                               &subtitle, &got_subtitle, ptr, len);
                 if (ret < 0)
                     goto fail_decode;
@@ -1102,16 +1719,16 @@ static int output_packet(AVInputStream *ist, int ist_index,
                 goto fail_decode;
             }
         } else {
-            switch(ist->st->codec->codec_type) {
+            switch(ist->dec->codec_type) {
             case CODEC_TYPE_AUDIO:
-                ist->next_pts += ((int64_t)AV_TIME_BASE * ist->st->codec->frame_size) /
-                    (ist->st->codec->sample_rate * ist->st->codec->channels);
+                ist->next_pts += ((int64_t)AV_TIME_BASE * ist->dec->frame_size) /
+                    (ist->dec->sample_rate * ist->dec->channels);
                 break;
             case CODEC_TYPE_VIDEO:
-                if (ist->st->codec->time_base.num != 0) {
+                if (ist->dec->time_base.num != 0) {
                     ist->next_pts += ((int64_t)AV_TIME_BASE *
-                                      ist->st->codec->time_base.num) /
-                        ist->st->codec->time_base.den;
+                                      ist->dec->time_base.num) /
+                        ist->dec->time_base.den;
                 }
                 break;
             }
@@ -1122,13 +1739,15 @@ static int output_packet(AVInputStream *ist, int ist_index,
         }
 
         buffer_to_free = NULL;
-        if (ist->st->codec->codec_type == CODEC_TYPE_VIDEO) {
+        if (ist->dec->codec_type == CODEC_TYPE_VIDEO) {
+            t = av_gettime();
             pre_process_video_frame(ist, (AVPicture *)&picture,
                                     &buffer_to_free);
+            stage_add(STAGE_FILTER, t);
         }
 
         // preprocess audio (volume)
-        if (ist->st->codec->codec_type == CODEC_TYPE_AUDIO) {
+        if (ist->dec->codec_type == CODEC_TYPE_AUDIO) {
             if (audio_volume != 256) {
                 short *volp;
                 volp = samples;
@@ -1142,8 +1761,8 @@ static int output_packet(AVInputStream *ist, int ist_index,
         }
 
         /* frame rate emulation */
-        if (ist->st->codec->rate_emu) {
-            int64_t pts = av_rescale((int64_t) ist->frame * ist->st->codec->time_base.num, 1000000, ist->st->codec->time_base.den);
+        if (ist->dec->rate_emu) {
+            int64_t pts = av_rescale((int64_t) ist->frame * ist->dec->time_base.num, 1000000, ist->dec->time_base.den);
             int64_t now = av_gettime() - ist->start;
             if (pts > now)
                 usleep(pts - now);
@@ -1155,8 +1774,8 @@ static int output_packet(AVInputStream *ist, int ist_index,
         /* mpeg PTS deordering : if it is a P or I frame, the PTS
            is the one of the next displayed one */
         /* XXX: add mpeg4 too ? */
-        if (ist->st->codec->codec_id == CODEC_ID_MPEG1VIDEO) {
-            if (ist->st->codec->pict_type != B_TYPE) {
+        if (ist->dec->codec_id == CODEC_ID_MPEG1VIDEO) {
+            if (ist->dec->pict_type != B_TYPE) {
                 int64_t tmp;
                 tmp = ist->last_ip_pts;
                 ist->last_ip_pts  = ist->frac_pts.val;
@@ -1275,6 +1894,13 @@ static int output_packet(AVInputStream *ist, int ist_index,
                     continue;
                 if(ost->st->codec->codec_type == CODEC_TYPE_VIDEO && (os->oformat->flags & AVFMT_RAWPICTURE))
                     continue;
+#ifdef HAVE_PTHREADS
+                /* the encoder thread flushes its encoder when its queue ends */
+                if (ost->encode_queue) {
+                    encode_queue_close(ost);
+                    continue;
+                }
+#endif
 
                 if (ost->encoding_needed) {
                     for(;;) {
@@ -1334,6 +1960,71 @@ static int output_packet(AVInputStream *ist, int ist_index,
 }
 
 
+/**
+ * lets each scaled video output downscale from the smallest other scaled
+ * output of the same input that is at least as large, instead of from the
+ * full size decoded picture. outputs of the same size and format share
+ * one scaled picture.
+ */
+static void build_scaler_tree(AVInputStream **ist_table,
+                              AVOutputStream **ost_table, int nb_ostreams)
+{
+    int i, j;
+
+    for(i=0;i<nb_ostreams;i++) {
+        AVOutputStream *ost= ost_table[i], *best= NULL;
+        AVCodecContext *enc= ost->st->codec;
+        AVCodecContext *icodec= ist_table[ost->source_index]->dec;
+        int in_w= icodec->width  - (frame_leftBand + frame_rightBand);
+        int in_h= icodec->height - (frame_topBand + frame_bottomBand);
+        int w= enc->width  - (ost->padleft + ost->padright);
+        int h= enc->height - (ost->padtop + ost->padbottom);
+        int best_area= INT_MAX;
+
+        if (enc->codec_type != CODEC_TYPE_VIDEO || !ost->video_resample)
+            continue;
+
+        for(j=0;j<nb_ostreams;j++) {
+            AVOutputStream *src= ost_table[j];
+            AVCodecContext *senc= src->st->codec;
+            int area= senc->width * senc->height;
+
+            if (j == i || senc->codec_type != CODEC_TYPE_VIDEO
+                || !src->video_resample || src->video_pad
+                || src->source_index != ost->source_index
+                || src->video_crop != ost->video_crop
+                || senc->pix_fmt != enc->pix_fmt)
+                continue;
+            /* only downscaled sources, and no cycles between equal sizes */
+            if (senc->width < w || senc->height < h
+                || senc->width > in_w || senc->height > in_h
+                || (area == w*h && j > i))
+                continue;
+            if (area < best_area) {
+                best= src;
+                best_area= area;
+            }
+        }
+        if (!best)
+            continue;
+
+        sws_freeContext(ost->img_resample_ctx);
+        ost->img_resample_ctx= NULL;
+        if (best_area != w*h || ost->video_pad) {
+            ost->img_resample_ctx = sws_getContext(
+                    best->st->codec->width, best->st->codec->height, enc->pix_fmt,
+                    w, h, enc->pix_fmt,
+                    sws_flags, NULL, NULL, NULL);
+            if (ost->img_resample_ctx == NULL) {
+                fprintf(stderr, "Cannot get resampling context\n");
+                exit(1);
+            }
+        }
+        ost->resample_height= best->st->codec->height;
+        ost->resample_src= best;
+    }
+}
+
 /*
  * The following code is the main loop of the file converter
  */
@@ -1381,12 +2072,13 @@ static int av_encode(AVFormatContext **output_files,
         for(k=0;k<is->nb_streams;k++) {
             ist = ist_table[j++];
             ist->st = is->streams[k];
+            ist->dec = ist->st->codec;
             ist->file_index = i;
             ist->index = k;
             ist->discard = 1; /* the stream is discarded by default
                                  (changed later) */
 
-            if (ist->st->codec->rate_emu) {
+            if (ist->dec->rate_emu) {
                 ist->start = av_gettime();
                 ist->frame = 0;
             }
@@ -1451,7 +2143,7 @@ static int av_encode(AVFormatContext **output_files,
                     stream_maps[n-1].stream_index;
 
                 /* Sanity check that the stream types match */
-                if (ist_table[ost->source_index]->st->codec->codec_type != ost->st->codec->codec_type) {
+                if (ist_table[ost->source_index]->dec->codec_type != ost->st->codec->codec_type) {
                     fprintf(stderr, "Codec type mismatch for mapping #%d.%d -> #%d.%d\n",
                         stream_maps[n-1].file_index, stream_maps[n-1].stream_index,
                         ost->file_index, ost->index);
@@ -1464,7 +2156,7 @@ static int av_encode(AVFormatContext **output_files,
                 for(j=0;j<nb_istreams;j++) {
                     ist = ist_table[j];
                     if (ist->discard &&
-                        ist->st->codec->codec_type == ost->st->codec->codec_type) {
+                        ist->dec->codec_type == ost->st->codec->codec_type) {
                         ost->source_index = j;
                         found = 1;
                         break;
@@ -1475,7 +2167,7 @@ static int av_encode(AVFormatContext **output_files,
                     /* try again and reuse existing stream */
                     for(j=0;j<nb_istreams;j++) {
                         ist = ist_table[j];
-                        if (ist->st->codec->codec_type == ost->st->codec->codec_type) {
+                        if (ist->dec->codec_type == ost->st->codec->codec_type) {
                             ost->source_index = j;
                             found = 1;
                         }
@@ -1501,7 +2193,7 @@ static int av_encode(AVFormatContext **output_files,
         ist = ist_table[ost->source_index];
 
         codec = ost->st->codec;
-        icodec = ist->st->codec;
+        icodec = ist->dec;
 
         if (ost->st->stream_copy) {
             /* if stream_copy is selected, no need to decode or encode */
@@ -1688,6 +2380,9 @@ static int av_encode(AVFormatContext **output_files,
     if (!bit_buffer)
         goto fail;
 
+    if (!no_scale_tree)
+        build_scaler_tree(ist_table, ost_table, nb_ostreams);
+
     /* dump the file output parameters - cannot be done before in case
        of stream copy */
     for(i=0;i<nb_output_files;i++) {
@@ -1708,6 +2403,10 @@ static int av_encode(AVFormatContext **output_files,
                 fprintf(stderr, " [sync #%d.%d]",
                         ost->sync_ist->file_index,
                         ost->sync_ist->index);
+            if (ost->resample_src)
+                fprintf(stderr, " [scaled from #%d.%d]",
+                        ost->resample_src->file_index,
+                        ost->resample_src->index);
             fprintf(stderr, "\n");
         }
     }
@@ -1737,19 +2436,19 @@ static int av_encode(AVFormatContext **output_files,
         ist = ist_table[i];
         if (ist->decoding_needed) {
             AVCodec *codec;
-            codec = avcodec_find_decoder(ist->st->codec->codec_id);
+            codec = avcodec_find_decoder(ist->dec->codec_id);
             if (!codec) {
                 fprintf(stderr, "Unsupported codec (id=%d) for input stream #%d.%d\n",
-                        ist->st->codec->codec_id, ist->file_index, ist->index);
+                        ist->dec->codec_id, ist->file_index, ist->index);
                 exit(1);
             }
-            if (avcodec_open(ist->st->codec, codec) < 0) {
+            if (avcodec_open(ist->dec, codec) < 0) {
                 fprintf(stderr, "Error while opening codec for input stream #%d.%d\n",
                         ist->file_index, ist->index);
                 exit(1);
             }
-            //if (ist->st->codec->codec_type == CODEC_TYPE_VIDEO)
-            //    ist->st->codec->flags |= CODEC_FLAG_REPEAT_FIELD;
+            //if (ist->dec->codec_type == CODEC_TYPE_VIDEO)
+            //    ist->dec->flags |= CODEC_FLAG_REPEAT_FIELD;
         }
     }
 
@@ -1807,6 +2506,15 @@ static int av_encode(AVFormatContext **output_files,
         }
     }
 
+    if (do_pipeline) {
+#ifdef HAVE_PTHREADS
+        if (pipeline_start(ost_table, nb_ostreams) < 0)
+            goto fail;
+#else
+        fprintf(stderr, "Warning: not compiled with thread support, -pipeline ignored\n");
+#endif
+    }
+
     if ( !using_stdin && verbose >= 0) {
         fprintf(stderr, "Press [q] to stop encoding\n");
         url_set_interrupt_cb(decode_interrupt_cb);
@@ -1846,7 +2554,7 @@ static int av_encode(AVFormatContext **output_files,
             if(ost->st->codec->codec_type == CODEC_TYPE_VIDEO)
                 opts = ost->sync_opts * av_q2d(ost->st->codec->time_base);
             else
-                opts = ost->st->pts.val * av_q2d(ost->st->time_base);
+                opts = output_stream_pts(ost) * av_q2d(ost->st->time_base);
             ipts = (double)ist->pts;
             if (!file_table[ist->file_index].eof_reached){
                 if(ipts < ipts_min) {
@@ -1873,12 +2581,11 @@ static int av_encode(AVFormatContext **output_files,
             break;
 
         /* finish if limit size exhausted */
-        if (limit_filesize != 0 && limit_filesize < url_ftell(&output_files[0]->pb))
+        if (limit_filesize != 0 && limit_filesize < output_file_pos(0))
             break;
 
         /* read a frame from it and output it in the fifo */
-        is = input_files[file_index];
-        if (av_read_frame(is, &pkt) < 0) {
+        if (read_packet(file_index, &pkt) < 0) {
             file_table[file_index].eof_reached = 1;
             if (opt_shortest) break; else continue; //
         }
@@ -1895,7 +2602,7 @@ static int av_encode(AVFormatContext **output_files,
         if (ist->discard)
             goto discard_packet;
 
-//        fprintf(stderr, "next:%"PRId64" dts:%"PRId64" off:%"PRId64" %d\n", ist->next_pts, pkt.dts, input_files_ts_offset[ist->file_index], ist->st->codec->codec_type);
+//        fprintf(stderr, "next:%"PRId64" dts:%"PRId64" off:%"PRId64" %d\n", ist->next_pts, pkt.dts, input_files_ts_offset[ist->file_index], ist->dec->codec_type);
         if (pkt.dts != AV_NOPTS_VALUE && ist->next_pts != AV_NOPTS_VALUE) {
             int64_t delta= av_rescale_q(pkt.dts, ist->st->time_base, AV_TIME_BASE_Q) - ist->next_pts;
             if(FFABS(delta) > 1LL*dts_delta_threshold*AV_TIME_BASE && !copy_ts){
@@ -1928,6 +2635,10 @@ static int av_encode(AVFormatContext **output_files,
         print_report(output_files, ost_table, nb_ostreams, 0);
     }
 
+#ifdef HAVE_PTHREADS
+    pipeline_stop_input();
+#endif
+
     /* at the end of stream, we must flush the decoder buffers */
     for(i=0;i<nb_istreams;i++) {
         ist = ist_table[i];
@@ -1936,6 +2647,11 @@ static int av_encode(AVFormatContext **output_files,
         }
     }
 
+#ifdef HAVE_PTHREADS
+    /* wait for the encoders and the muxer to catch up */
+    pipeline_stop(ost_table, nb_ostreams);
+#endif
+
     term_exit();
 
     /* write the trailer if needed and close file */
@@ -1960,7 +2676,7 @@ static int av_encode(AVFormatContext **output_files,
     for(i=0;i<nb_istreams;i++) {
         ist = ist_table[i];
         if (ist->decoding_needed) {
-            avcodec_close(ist->st->codec);
+            avcodec_close(ist->dec);
         }
     }
 
@@ -2422,6 +3138,7 @@ const char *motion_str[] = {
     "hex",
     "umh",
     "iter",
+    "hier",
     NULL,
 };
 
@@ -3587,6 +4304,8 @@ const OptionDef options[] = {
     { "album", HAS_ARG | OPT_STRING, {(void*)&str_album}, "set the album", "string" },
     { "benchmark", OPT_BOOL | OPT_EXPERT, {(void*)&do_benchmark},
       "add timings for benchmarking" },
+    { "pipeline", OPT_BOOL | OPT_EXPERT, {(void*)&do_pipeline},
+      "run demuxing, video encoding and muxing in separate threads" },
     { "dump", OPT_BOOL | OPT_EXPERT, {(void*)&do_pkt_dump},
       "dump each input packet" },
     { "hex", OPT_BOOL | OPT_EXPERT, {(void*)&do_hex_dump},
@@ -3636,6 +4355,7 @@ const OptionDef options[] = {
       "use same video quality as source (implies VBR)" },
     { "pass", HAS_ARG | OPT_VIDEO, {(void*)&opt_pass}, "select the pass number (1 or 2)", "n" },
     { "passlogfile", HAS_ARG | OPT_STRING | OPT_VIDEO, {(void*)&pass_logfilename}, "select two pass log file name", "file" },
+    { "noscaletree", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&no_scale_tree}, "scale every output from the decoded picture" },
     { "deinterlace", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&do_deinterlace},
       "deinterlace pictures" },
     { "psnr", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&do_psnr}, "calculate PSNR of compressed frames" },
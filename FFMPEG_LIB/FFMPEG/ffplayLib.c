@@ -66,11 +66,23 @@
    A/V sync as SDL does not have hardware buffer fullness info. */
 #define SDL_AUDIO_BUFFER_SIZE 1024
 
+/* low latency output starts with short device buffers and adapts their
+   size, in samples, to the measured jitter of the audio callback */
+#define SDL_AUDIO_MIN_BUFFER_SIZE 256
+#define SDL_AUDIO_MAX_BUFFER_SIZE 4096
+/* we use about AUDIO_JITTER_AVG_NB callback periods to make the average */
+#define AUDIO_JITTER_AVG_NB 32
+
 /* no AV sync correction is done if below the AV sync threshold */
 #define AV_SYNC_THRESHOLD 0.01
 /* no AV correction is done if too big error */
 #define AV_NOSYNC_THRESHOLD 10.0
 
+/* number of consecutive late frames after which the decoding quality is lowered */
+#define DEGRADE_LATE_FRAMES 5
+/* number of consecutive frames in time after which the decoding quality is raised again */
+#define DEGRADE_RECOVER_FRAMES 100
+
 /* maximum audio speed change to get correct sync */
 #define SAMPLE_CORRECTION_PERCENT_MAX 10
 
@@ -87,6 +99,7 @@ typedef struct PacketQueue {
     int nb_packets;
     int size;
     int abort_request;
+    int nowait;                 ///< packet_queue_get() returns instead of waiting
     SDL_mutex *mutex;
     SDL_cond *cond;
 } PacketQueue;
@@ -94,11 +107,28 @@ typedef struct PacketQueue {
 #define VIDEO_PICTURE_QUEUE_SIZE 1
 #define SUBPICTURE_QUEUE_SIZE 4
 
+#define DR_OVERLAY_COUNT 4      ///< overlays the decoder may render into directly
+#define DR_BUFFER_COUNT 20      ///< overlays plus heap buffers with the same layout
+
+typedef struct DRBuffer {
+    SDL_Overlay *bmp;           ///< overlay holding the planes, NULL for a heap buffer
+    uint8_t *data[3];           ///< Y, U and V planes
+    int decoder_ref;            ///< between get_buffer() and release_buffer()
+    int display_ref;            ///< shown by a VideoPicture
+} DRBuffer;
+
 typedef struct VideoPicture {
     double pts;                                  ///<presentation time stamp for this picture
     SDL_Overlay *bmp;
     int width, height; /* source height & width */
     int allocated;
+    int full_update;        ///< the whole overlay must be refreshed on the next display
+    int mb_size;            ///< height of one row of dirty[] in pixels
+    int *dirty;             ///< changed pixel span [dirty[2*row], dirty[2*row+1]) of each MB row
+    SDL_Rect *dirty_rects;
+    SDL_Rect last_rect;     ///< screen rectangle of the last display
+    DRBuffer *dr;           ///< direct rendered picture shown instead of bmp
+    int bmp_outdated;       ///< bmp does not hold the previous picture
 } VideoPicture;
 
 typedef struct SubPicture {
@@ -140,6 +170,14 @@ typedef struct VideoState {
     AVStream *audio_st;
     PacketQueue audioq;
     int audio_hw_buf_size;
+    int audio_hw_samples;                        ///< device buffer size in samples
+    int audio_hw_fixed;                          ///< the device ignored the requested buffer size
+    int audio_resize_req;                        ///< wanted device buffer size in samples, 0 if none
+    int64_t audio_cb_time;                       ///< time (av_gettime) of the previous callback
+    double audio_cb_jitter;                      ///< average deviation of the callback period, in s
+    int audio_cb_count;                          ///< callbacks since the device was opened
+    int audio_hw_latency;                        ///< sample frames queued in the device after the last callback, -1 if unknown
+    int64_t audio_hw_latency_time;               ///< time (av_gettime) audio_hw_latency was measured
     /* samples output by the codec. we reserve more space for avsync
        compensation */
     DECLARE_ALIGNED(16,uint8_t,audio_buf[(AVCODEC_MAX_AUDIO_FRAME_SIZE * 3) / 2]);
@@ -172,12 +210,20 @@ typedef struct VideoState {
     AVStream *video_st;
     PacketQueue videoq;
     double video_current_pts;                    ///<current displayed pts (different from video_clock if frame fifos are used)
+    int degrade_level;                           ///< index in degrade_levels[], 0 if the user settings are used as is
+    int late_count;                              ///< consecutive frames displayed behind the master clock
+    int ontime_count;                            ///< consecutive frames displayed in time
     int64_t video_current_pts_time;              ///<time (av_gettime) at which we updated video_current_pts - used to have running video pts
     VideoPicture pictq[VIDEO_PICTURE_QUEUE_SIZE];
     int pictq_size, pictq_rindex, pictq_windex;
     SDL_mutex *pictq_mutex;
     SDL_cond *pictq_cond;
 
+    DRBuffer dr_buf[DR_BUFFER_COUNT];
+    int dr_state;                                ///< 0 undecided, 1 direct rendering, -1 disabled
+    int dr_width, dr_height;
+    int dr_linesize[3];
+
     //    QETimer *video_timer;
     char filename[1024];
     int width, height, xleft, ytop;
@@ -219,6 +265,22 @@ static enum AVDiscard skip_loop_filter= AVDISCARD_DEFAULT;
 static int error_resilience = FF_ER_CAREFUL;
 static int error_concealment = 3;
 static int decoder_reorder_pts= 0;
+static int no_direct_render = 0;
+static int low_latency = 0;
+static int no_auto_skip = 0;
+
+/* decoder settings used when the video falls behind, from mild to severe;
+   never below what the user asked for */
+static const struct {
+    enum AVDiscard loop_filter;
+    enum AVDiscard idct;
+} degrade_levels[] = {
+    { AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_NONREF,  AVDISCARD_DEFAULT },
+    { AVDISCARD_ALL,     AVDISCARD_DEFAULT },
+    { AVDISCARD_ALL,     AVDISCARD_NONREF  },
+    { AVDISCARD_ALL,     AVDISCARD_NONKEY  },
+};
 
 /* current context */
 static int is_full_screen;
@@ -239,8 +301,10 @@ AVPacket flush_pkt;
 #define FF_ALLOC_EVENT   (SDL_USEREVENT)
 #define FF_REFRESH_EVENT (SDL_USEREVENT + 1)
 #define FF_QUIT_EVENT    (SDL_USEREVENT + 2)
+#define FF_DR_ALLOC_EVENT (SDL_USEREVENT + 3)
 
 SDL_Surface *screen;
+static int screen_refresh = 1; ///< screen content was lost, next display must be complete
 
 //////////////////////////////////////////////////////////////////////////////////////
 //Player interface 
@@ -333,6 +397,18 @@ static void packet_queue_abort(PacketQueue *q)
     SDL_UnlockMutex(q->mutex);
 }
 
+/* make blocking gets return 0 instead of waiting, and wake up a waiting one */
+static void packet_queue_set_nowait(PacketQueue *q, int nowait)
+{
+    SDL_LockMutex(q->mutex);
+
+    q->nowait = nowait;
+
+    SDL_CondSignal(q->cond);
+
+    SDL_UnlockMutex(q->mutex);
+}
+
 /* return < 0 if aborted, 0 if no packet and > 0 if packet.  */
 static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
 {
@@ -358,7 +434,7 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
             av_free(pkt1);
             ret = 1;
             break;
-        } else if (!block) {
+        } else if (!block || q->nowait) {
             ret = 0;
             break;
         } else {
@@ -647,6 +723,16 @@ static void video_image_display(VideoState *is)
 
     vp = &is->pictq[is->pictq_rindex];
     if (vp->bmp) {
+        SDL_Overlay *bmp;
+        DRBuffer *dr;
+        int blended = 0;
+
+        /* the decode thread sets vp->dr under the queue lock */
+        SDL_LockMutex(is->pictq_mutex);
+        dr = vp->dr;
+        bmp = dr ? dr->bmp : vp->bmp;
+        SDL_UnlockMutex(is->pictq_mutex);
+
         /* XXX: use variable in the frame */
         if (is->video_st->codec->sample_aspect_ratio.num == 0)
             aspect_ratio = 0;
@@ -660,7 +746,8 @@ static void video_image_display(VideoState *is)
            mpeg format */
 
 
-        if (is->subtitle_st)
+        /* never draw into a picture the decoder may still reference */
+        if (is->subtitle_st && !dr)
         {
             if (is->subpq_size > 0)
             {
@@ -682,6 +769,7 @@ static void video_image_display(VideoState *is)
                         blend_subrect(&pict, &sp->sub.rects[i]);
 
                     SDL_UnlockYUVOverlay (vp->bmp);
+                    blended = 1;
                 }
             }
         }
@@ -706,7 +794,32 @@ static void video_image_display(VideoState *is)
         rect.y = is->ytop  + y;
         rect.w = width;
         rect.h = height;
-        SDL_DisplayYUVOverlay(vp->bmp, &rect);
+        if (screen_refresh || vp->full_update || blended ||
+            memcmp(&rect, &vp->last_rect, sizeof(rect))) {
+            SDL_DisplayYUVOverlay(bmp, &rect);
+        } else {
+            int n = 0;
+            for (i = 0; i * vp->mb_size < vp->height; i++) {
+                int x0 = vp->dirty[2 * i], x1 = vp->dirty[2 * i + 1];
+                if (x0 >= x1)
+                    continue;
+                vp->dirty_rects[n].x = x0;
+                vp->dirty_rects[n].y = i * vp->mb_size;
+                vp->dirty_rects[n].w = x1 - x0;
+                vp->dirty_rects[n].h = FFMIN(vp->mb_size, vp->height - i * vp->mb_size);
+                n++;
+            }
+            SDL_DisplayYUVOverlayRects(bmp, &rect, n, vp->dirty_rects);
+        }
+        for (i = 0; i * vp->mb_size < vp->height; i++) {
+            vp->dirty[2 * i]     = vp->width;
+            vp->dirty[2 * i + 1] = 0;
+        }
+        vp->last_rect = rect;
+        /* the subtitles are now part of the overlay, the next picture
+           cannot be copied over it partially */
+        vp->full_update = blended;
+        screen_refresh = 0;
     } else {
 #if 0
         fill_rectangle(screen,
@@ -847,6 +960,7 @@ static int video_open(VideoState *is){
 
     is->width = screen->w;
     is->height = screen->h;
+    screen_refresh = 1;
 
     return 0;
 }
@@ -881,7 +995,7 @@ static void schedule_refresh(VideoState *is, int delay)
 static double get_audio_clock(VideoState *is)
 {
     double pts;
-    int hw_buf_size, bytes_per_sec;
+    int hw_buf_size, bytes_per_sec, latency;
     pts = is->audio_clock;
     hw_buf_size = audio_write_get_buf_size(is);
     bytes_per_sec = 0;
@@ -889,8 +1003,18 @@ static double get_audio_clock(VideoState *is)
         bytes_per_sec = is->audio_st->codec->sample_rate *
             2 * is->audio_st->codec->channels;
     }
-    if (bytes_per_sec)
+    if (bytes_per_sec) {
         pts -= (double)hw_buf_size / bytes_per_sec;
+        /* what was already handed to the device is not audible yet. The
+           callback measures it, the device may be closed at any time here */
+        latency = is->audio_hw_latency;
+        if (latency > 0) {
+            latency -= (av_gettime() - is->audio_hw_latency_time) *
+                is->audio_st->codec->sample_rate / 1000000;
+            if (latency > 0)
+                pts -= (double)latency / is->audio_st->codec->sample_rate;
+        }
+    }
     return pts;
 }
 
@@ -957,6 +1081,28 @@ static void stream_pause(VideoState *is)
     }
 }
 
+/* lower the decoding quality when frames are late for a while and raise it
+   again once the decoder keeps up; applied by video_thread() */
+static void update_degrade_level(VideoState *is, int late)
+{
+    if (late) {
+        is->ontime_count = 0;
+        if (++is->late_count >= DEGRADE_LATE_FRAMES &&
+            is->degrade_level < sizeof(degrade_levels)/sizeof(degrade_levels[0]) - 1) {
+            is->degrade_level++;
+            is->late_count = 0;
+            av_log(NULL, AV_LOG_DEBUG, "video late, decoding quality level %d\n", is->degrade_level);
+        }
+    } else {
+        is->late_count = 0;
+        if (++is->ontime_count >= DEGRADE_RECOVER_FRAMES && is->degrade_level > 0) {
+            is->degrade_level--;
+            is->ontime_count = 0;
+            av_log(NULL, AV_LOG_DEBUG, "video in time, decoding quality level %d\n", is->degrade_level);
+        }
+    }
+}
+
 /* called to display each frame */
 static void video_refresh_timer(void *opaque)
 {
@@ -1006,6 +1152,8 @@ static void video_refresh_timer(void *opaque)
                         delay = 0;
                     else if (diff >= sync_threshold)
                         delay = 2 * delay;
+                    if (!no_auto_skip)
+                        update_degrade_level(is, diff <= -sync_threshold);
                 }
             }
 
@@ -1133,6 +1281,8 @@ static void alloc_picture(void *opaque)
 
     if (vp->bmp)
         SDL_FreeYUVOverlay(vp->bmp);
+    av_freep(&vp->dirty);
+    av_freep(&vp->dirty_rects);
 
 #if 0
     /* XXX: use generic function */
@@ -1157,6 +1307,10 @@ static void alloc_picture(void *opaque)
                                    screen);
     vp->width = is->video_st->codec->width;
     vp->height = is->video_st->codec->height;
+    vp->mb_size = 16 >> is->video_st->codec->lowres;
+    vp->dirty = av_mallocz(2 * sizeof(int) * (vp->height / vp->mb_size + 1));
+    vp->dirty_rects = av_mallocz(sizeof(SDL_Rect) * (vp->height / vp->mb_size + 1));
+    vp->full_update = 1;
 
     SDL_LockMutex(is->pictq_mutex);
     vp->allocated = 1;
@@ -1164,6 +1318,99 @@ static void alloc_picture(void *opaque)
     SDL_UnlockMutex(is->pictq_mutex);
 }
 
+static DRBuffer *find_dr_buffer(VideoState *is, uint8_t *data)
+{
+    int i;
+
+    for (i = 0; i < DR_BUFFER_COUNT; i++)
+        if (is->dr_buf[i].data[0] && is->dr_buf[i].data[0] == data)
+            return &is->dr_buf[i];
+    return NULL;
+}
+
+static void free_dr_buffers(VideoState *is)
+{
+    int i;
+
+    for (i = 0; i < DR_BUFFER_COUNT; i++) {
+        DRBuffer *buf = &is->dr_buf[i];
+        if (buf->bmp)
+            SDL_FreeYUVOverlay(buf->bmp);
+        else
+            av_free(buf->data[0]);
+    }
+    memset(is->dr_buf, 0, sizeof(is->dr_buf));
+}
+
+/* allocate the overlays the decoder renders into (needs to be done in
+   the main thread like alloc_picture) */
+static void alloc_dr_buffers(void *opaque)
+{
+    VideoState *is = opaque;
+    AVCodecContext *avctx = is->video_st->codec;
+    int i, state = 1;
+
+    if (!screen)
+        video_open(is);
+
+    for (i = 0; i < DR_OVERLAY_COUNT; i++) {
+        DRBuffer *buf = &is->dr_buf[i];
+        SDL_Overlay *bmp;
+
+        bmp = buf->bmp = SDL_CreateYUVOverlay(avctx->width, avctx->height,
+                                              SDL_YV12_OVERLAY, screen);
+        /* the decoder needs plain memory and the same aligned strides
+           in every picture */
+        if (!bmp || bmp->hw_overlay || bmp->planes != 3 ||
+            bmp->pitches[0] != is->dr_buf[0].bmp->pitches[0] ||
+            bmp->pitches[1] != is->dr_buf[0].bmp->pitches[1] ||
+            bmp->pitches[1] != bmp->pitches[2] ||
+            (bmp->pitches[0] & 15) || (bmp->pitches[1] & 7)) {
+            state = -1;
+            break;
+        }
+        buf->data[0] = bmp->pixels[0];
+        buf->data[1] = bmp->pixels[2];
+        buf->data[2] = bmp->pixels[1];
+    }
+    if (state > 0) {
+        is->dr_width  = avctx->width;
+        is->dr_height = avctx->height;
+        is->dr_linesize[0] = is->dr_buf[0].bmp->pitches[0];
+        is->dr_linesize[1] = is->dr_buf[0].bmp->pitches[2];
+        is->dr_linesize[2] = is->dr_buf[0].bmp->pitches[1];
+    } else {
+        free_dr_buffers(is);
+    }
+
+    SDL_LockMutex(is->pictq_mutex);
+    is->dr_state = state;
+    SDL_CondSignal(is->pictq_cond);
+    SDL_UnlockMutex(is->pictq_mutex);
+}
+
+/* add the macroblocks the decoder changed to the area to be displayed */
+static void mark_dirty(VideoPicture *vp, AVFrame *src_frame)
+{
+    int mb_size = vp->mb_size;
+    int mb_width = (vp->width + mb_size - 1) / mb_size;
+    int mb_x, mb_y;
+
+    if (!src_frame->mb_changed_stride) {
+        vp->full_update = 1;
+        return;
+    }
+    for (mb_y = 0; mb_y * mb_size < vp->height; mb_y++) {
+        uint8_t *changed = src_frame->mb_changed + mb_y * src_frame->mb_changed_stride;
+        for (mb_x = 0; mb_x < mb_width; mb_x++) {
+            if (changed[mb_x]) {
+                vp->dirty[2 * mb_y]     = FFMIN(vp->dirty[2 * mb_y], mb_x * mb_size);
+                vp->dirty[2 * mb_y + 1] = FFMAX(vp->dirty[2 * mb_y + 1], FFMIN((mb_x + 1) * mb_size, vp->width));
+            }
+        }
+    }
+}
+
 /**
  *
  * @param pts the dts of the pkt / pts of the frame and guessed if not known
@@ -1215,6 +1462,26 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts)
 
     /* if the frame is not skipped, then display it */
     if (vp->bmp) {
+        AVCodecContext *avctx = is->video_st->codec;
+        DRBuffer *dr = find_dr_buffer(is, src_frame->data[0]);
+
+        SDL_LockMutex(is->pictq_mutex);
+        if (vp->dr)
+            vp->dr->display_ref = 0;
+        vp->dr = NULL;
+        if (dr && dr->bmp) {
+            /* the decoder rendered straight into an overlay, show it */
+            dr->display_ref = 1;
+            vp->dr = dr;
+        }
+        SDL_UnlockMutex(is->pictq_mutex);
+
+        if (vp->dr) {
+            vp->bmp_outdated = 1;
+            mark_dirty(vp, src_frame);
+            goto queued;
+        }
+
         /* get a pointer on the bitmap */
         SDL_LockYUVOverlay (vp->bmp);
 
@@ -1226,21 +1493,67 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts)
         pict.linesize[0] = vp->bmp->pitches[0];
         pict.linesize[1] = vp->bmp->pitches[2];
         pict.linesize[2] = vp->bmp->pitches[1];
-        if (img_convert_ctx == NULL) {
-            img_convert_ctx = sws_getContext(is->video_st->codec->width,
-                    is->video_st->codec->height, is->video_st->codec->pix_fmt,
-                    is->video_st->codec->width, is->video_st->codec->height,
+
+        if (!vp->full_update && !vp->bmp_outdated && src_frame->mb_changed_stride &&
+            avctx->pix_fmt == dst_pix_fmt) {
+            /* the overlay still holds the previous picture, only copy
+               the macroblocks the decoder changed */
+            int mb_size = vp->mb_size;
+            int mb_width = (vp->width + mb_size - 1) / mb_size;
+            int mb_x, mb_y, x, w, h, i;
+
+            for (mb_y = 0; mb_y * mb_size < vp->height; mb_y++) {
+                uint8_t *changed = src_frame->mb_changed + mb_y * src_frame->mb_changed_stride;
+                h = FFMIN(mb_size, vp->height - mb_y * mb_size);
+                for (mb_x = 0; mb_x < mb_width; mb_x++) {
+                    if (!changed[mb_x])
+                        continue;
+                    x = mb_x;
+                    while (mb_x < mb_width && changed[mb_x])
+                        mb_x++;
+                    w = FFMIN(mb_x * mb_size, vp->width) - x * mb_size;
+                    x *= mb_size;
+                    for (i = 0; i < 3; i++) {
+                        int s = !!i;
+                        int y = mb_y * mb_size >> s;
+                        uint8_t *src = src_frame->data[i] + y * src_frame->linesize[i] + (x >> s);
+                        uint8_t *dst = pict.data[i] + y * pict.linesize[i] + (x >> s);
+                        int j;
+                        for (j = 0; j < (h + s) >> s; j++) {
+                            memcpy(dst, src, (w + s) >> s);
+                            src += src_frame->linesize[i];
+                            dst += pict.linesize[i];
+                        }
+                    }
+                    vp->dirty[2 * mb_y]     = FFMIN(vp->dirty[2 * mb_y], x);
+                    vp->dirty[2 * mb_y + 1] = FFMAX(vp->dirty[2 * mb_y + 1], x + w);
+                }
+            }
+            SDL_UnlockYUVOverlay(vp->bmp);
+            goto queued;
+        }
+        if (avctx->pix_fmt == dst_pix_fmt) {
+            /* same format, pict only swaps the chroma planes */
+            av_picture_copy(&pict, (AVPicture *)src_frame, dst_pix_fmt,
+                            avctx->width, avctx->height);
+        } else {
+            img_convert_ctx = sws_getCachedContext(img_convert_ctx,
+                    avctx->width, avctx->height, avctx->pix_fmt,
+                    avctx->width, avctx->height,
                     dst_pix_fmt, sws_flags, NULL, NULL, NULL);
             if (img_convert_ctx == NULL) {
                 fprintf(stderr, "Cannot initialize the conversion context\n");
                 exit(1);
             }
+            sws_scale(img_convert_ctx, src_frame->data, src_frame->linesize,
+                      0, avctx->height, pict.data, pict.linesize);
         }
-        sws_scale(img_convert_ctx, src_frame->data, src_frame->linesize,
-                  0, is->video_st->codec->height, pict.data, pict.linesize);
         /* update the bitmap content */
         SDL_UnlockYUVOverlay(vp->bmp);
+        vp->bmp_outdated = 0;
+        mark_dirty(vp, src_frame);
 
+    queued:
         vp->pts = pts;
 
         /* now we can update the picture count */
@@ -1294,16 +1607,115 @@ static int output_picture2(VideoState *is, AVFrame *src_frame, double pts1)
 
 static uint64_t global_video_pkt_pts= AV_NOPTS_VALUE;
 
+/**
+ * Hand out overlay planes to the decoder so that queue_picture() does not
+ * have to copy the picture. Once the overlays are in use, all pictures of
+ * the stream must share their strides, heap buffers with the same layout
+ * are used while all overlays are busy or when subtitles are blended.
+ */
+static int dr_get_buffer(VideoState *is, AVCodecContext *c, AVFrame *pic){
+    DRBuffer *buf = NULL;
+    int w = c->width, h = c->height;
+    int i;
+
+    avcodec_align_dimensions(c, &w, &h);
+    if (c->pix_fmt != PIX_FMT_YUV420P || !(c->flags & CODEC_FLAG_EMU_EDGE) ||
+        !(c->codec->capabilities & CODEC_CAP_DR1) ||
+        w != c->width || h != c->height ||
+        (is->dr_state > 0 && (w != is->dr_width || h != is->dr_height))) {
+        is->dr_state = -1;
+        return avcodec_default_get_buffer(c, pic);
+    }
+
+    if (!is->dr_state) {
+        SDL_Event event;
+
+        event.type = FF_DR_ALLOC_EVENT;
+        event.user.data1 = is;
+        SDL_PushEvent(&event);
+
+        SDL_LockMutex(is->pictq_mutex);
+        while (!is->dr_state && !is->videoq.abort_request) {
+            SDL_CondWait(is->pictq_cond, is->pictq_mutex);
+        }
+        SDL_UnlockMutex(is->pictq_mutex);
+
+        if (is->dr_state < 0)
+            return avcodec_default_get_buffer(c, pic);
+        if (!is->dr_state)
+            return -1;
+    }
+
+    SDL_LockMutex(is->pictq_mutex);
+    for (i = is->subtitle_st ? DR_OVERLAY_COUNT : 0; i < DR_BUFFER_COUNT; i++) {
+        if (!is->dr_buf[i].decoder_ref && !is->dr_buf[i].display_ref &&
+            (is->dr_buf[i].data[0] || i >= DR_OVERLAY_COUNT)) {
+            buf = &is->dr_buf[i];
+            buf->decoder_ref = 1;
+            break;
+        }
+    }
+    SDL_UnlockMutex(is->pictq_mutex);
+
+    if (!buf) {
+        av_log(c, AV_LOG_ERROR, "out of direct rendering buffers\n");
+        return -1;
+    }
+    if (!buf->data[0]) {
+        int size = is->dr_linesize[0] * h;
+        int csize = is->dr_linesize[1] * (h >> 1);
+
+        buf->data[0] = av_malloc(size + 2 * csize + 16);
+        if (!buf->data[0]) {
+            buf->decoder_ref = 0;
+            return -1;
+        }
+        buf->data[1] = buf->data[0] + size;
+        buf->data[2] = buf->data[1] + csize;
+    }
+
+    for (i = 0; i < 3; i++) {
+        pic->base[i] = pic->data[i] = buf->data[i];
+        pic->linesize[i] = is->dr_linesize[i];
+    }
+    pic->type = FF_BUFFER_TYPE_USER;
+    pic->age = 256*256*256*64;
+    return 0;
+}
+
 static int my_get_buffer(struct AVCodecContext *c, AVFrame *pic){
-    int ret= avcodec_default_get_buffer(c, pic);
-    uint64_t *pts= av_malloc(sizeof(uint64_t));
+    VideoState *is = c->opaque;
+    int ret;
+    uint64_t *pts;
+
+    if (is && is->dr_state >= 0)
+        ret= dr_get_buffer(is, c, pic);
+    else
+        ret= avcodec_default_get_buffer(c, pic);
+    if (ret < 0)
+        return ret;
+    pts= av_malloc(sizeof(uint64_t));
     *pts= global_video_pkt_pts;
     pic->opaque= pts;
     return ret;
 }
 
 static void my_release_buffer(struct AVCodecContext *c, AVFrame *pic){
-    if(pic) av_freep(&pic->opaque);
+    VideoState *is = c->opaque;
+
+    av_freep(&pic->opaque);
+    if (pic->type == FF_BUFFER_TYPE_USER) {
+        DRBuffer *buf = find_dr_buffer(is, pic->data[0]);
+        int i;
+
+        SDL_LockMutex(is->pictq_mutex);
+        if (buf)
+            buf->decoder_ref = 0;
+        SDL_UnlockMutex(is->pictq_mutex);
+        for (i = 0; i < 4; i++)
+            pic->data[i] = NULL;
+        return;
+    }
     avcodec_default_release_buffer(c, pic);
 }
 
@@ -1327,6 +1739,12 @@ static int video_thread(void *arg)
             continue;
         }
 
+        if (!no_auto_skip) {
+            AVCodecContext *enc = is->video_st->codec;
+            enc->skip_loop_filter = FFMAX(skip_loop_filter, degrade_levels[is->degrade_level].loop_filter);
+            enc->skip_idct        = FFMAX(skip_idct,        degrade_levels[is->degrade_level].idct);
+        }
+
         /* NOTE: ipts is the PTS of the _first_ picture beginning in
            this packet, if any */
         global_video_pkt_pts= pkt->pts;
@@ -1582,8 +2000,8 @@ static int audio_decode_frame(VideoState *is, uint8_t *audio_buf, int buf_size,
             return -1;
         }
 
-        /* read next packet */
-        if (packet_queue_get(&is->audioq, pkt, 1) < 0)
+        /* read next packet, none while the device is being reopened */
+        if (packet_queue_get(&is->audioq, pkt, 1) <= 0)
             return -1;
         if(pkt->data == flush_pkt.data){
             avcodec_flush_buffers(is->audio_st->codec);
@@ -1608,14 +2026,40 @@ static int audio_write_get_buf_size(VideoState *is)
 }
 
 
+/* measure how regularly the device asks for data and request a bigger
+   buffer if the callback comes too late, or a smaller one if it is on time */
+static void update_audio_jitter(VideoState *is)
+{
+    int64_t time = av_gettime();
+    double period, dev;
+
+    period = (double)is->audio_hw_samples / is->audio_st->codec->sample_rate;
+    if (is->audio_cb_time && !is->audio_resize_req) {
+        dev = fabs((time - is->audio_cb_time) / 1000000.0 - period);
+        is->audio_cb_jitter += (dev - is->audio_cb_jitter) / AUDIO_JITTER_AVG_NB;
+        if (++is->audio_cb_count >= AUDIO_JITTER_AVG_NB && !is->audio_hw_fixed) {
+            if (is->audio_cb_jitter > period / 2 &&
+                is->audio_hw_samples < SDL_AUDIO_MAX_BUFFER_SIZE)
+                is->audio_resize_req = is->audio_hw_samples * 2;
+            else if (is->audio_cb_jitter < period / 8 &&
+                     is->audio_hw_samples > SDL_AUDIO_MIN_BUFFER_SIZE)
+                is->audio_resize_req = is->audio_hw_samples / 2;
+        }
+    }
+    is->audio_cb_time = time;
+}
+
 /* prepare a new audio buffer */
 void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
 {
     VideoState *is = opaque;
-    int audio_size, len1;
+    int audio_size, len1, latency;
+    int frames = len / (2 * is->audio_st->codec->channels);
     double pts;
 
     audio_callback_time = av_gettime();
+    if (low_latency)
+        update_audio_jitter(is);
 
     while (len > 0) {
         if (is->audio_buf_index >= is->audio_buf_size) {
@@ -1641,6 +2085,65 @@ void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
         stream += len1;
         is->audio_buf_index += len1;
     }
+
+    /* the stream just filled is queued once the callback returns */
+    latency = SDL_GetAudioLatency();
+    is->audio_hw_latency_time = av_gettime();
+    is->audio_hw_latency = latency < 0 ? -1 : latency + frames;
+}
+
+/* open the audio device with a buffer of 'samples' samples. Return 0 if OK */
+static int audio_open(VideoState *is, AVCodecContext *enc, int samples)
+{
+    SDL_AudioSpec wanted_spec, spec;
+
+    wanted_spec.freq = enc->sample_rate;
+    wanted_spec.format = AUDIO_S16SYS;
+    wanted_spec.channels = enc->channels;
+    wanted_spec.silence = 0;
+    wanted_spec.samples = samples;
+    wanted_spec.callback = sdl_audio_callback;
+    wanted_spec.userdata = is;
+    if (SDL_OpenAudio(&wanted_spec, &spec) < 0) {
+        fprintf(stderr, "SDL_OpenAudio: %s\n", SDL_GetError());
+        return -1;
+    }
+    is->audio_hw_buf_size = spec.size;
+    is->audio_hw_samples = spec.samples;
+    is->audio_hw_fixed = spec.samples != samples;
+    is->audio_resize_req = 0;
+    is->audio_cb_time = 0;
+    is->audio_cb_jitter = 0;
+    is->audio_cb_count = 0;
+    is->audio_hw_latency = -1;
+    /* since we do not have a precise anough audio fifo fullness,
+       we correct audio sync only if larger than this threshold */
+    is->audio_diff_threshold = 2.0 * spec.samples / enc->sample_rate;
+    return 0;
+}
+
+/* reopen the audio device with the buffer size requested by the callback,
+   must not be called from the audio thread. SDL_CloseAudio() waits for the
+   callback, which may be waiting for packets from the caller, so the audio
+   queue stops blocking until the device is open again */
+static void audio_resize(VideoState *is)
+{
+    int samples = is->audio_resize_req;
+    int ret;
+
+    is->audio_resize_req = 0;
+    if (!is->audio_st)
+        return;
+    packet_queue_set_nowait(&is->audioq, 1);
+    SDL_CloseAudio();
+    ret = audio_open(is, is->audio_st->codec, samples);
+    if (ret < 0)
+        ret = audio_open(is, is->audio_st->codec, is->audio_hw_samples);
+    packet_queue_set_nowait(&is->audioq, 0);
+    if (ret < 0)
+        return;
+    SDL_SetVolume(cur_stream_volume);
+    SDL_PauseAudio(0);
 }
 
 /* open a given stream. Return 0 if OK */
@@ -1649,7 +2152,6 @@ static int stream_component_open(VideoState *is, int stream_index)
     AVFormatContext *ic = is->ic;
     AVCodecContext *enc;
     AVCodec *codec;
-    SDL_AudioSpec wanted_spec, spec;
 
     if (stream_index < 0 || stream_index >= ic->nb_streams)
         return -1;
@@ -1658,21 +2160,13 @@ static int stream_component_open(VideoState *is, int stream_index)
     /* prepare audio output */
     if (enc->codec_type == CODEC_TYPE_AUDIO) {
 		SDL_CloseAudio();
-        wanted_spec.freq = enc->sample_rate;
-        wanted_spec.format = AUDIO_S16SYS;
         /* hack for AC3. XXX: suppress that */
         if (enc->channels > 2)
             enc->channels = 2;
-        wanted_spec.channels = enc->channels;
-        wanted_spec.silence = 0;
-        wanted_spec.samples = SDL_AUDIO_BUFFER_SIZE;
-        wanted_spec.callback = sdl_audio_callback;
-        wanted_spec.userdata = is;
-        if (SDL_OpenAudio(&wanted_spec, &spec) < 0) {
-            fprintf(stderr, "SDL_OpenAudio: %s\n", SDL_GetError());
+        SDL_putenv(low_latency ? "SDL_AUDIO_LOWLATENCY=1" : "SDL_AUDIO_LOWLATENCY=0");
+        if (audio_open(is, enc, low_latency ? 2 * SDL_AUDIO_MIN_BUFFER_SIZE
+                                            : SDL_AUDIO_BUFFER_SIZE) < 0)
             return -1;
-        }
-        is->audio_hw_buf_size = spec.size;
     }
 
     codec = avcodec_find_decoder(enc->codec_id);
@@ -1681,6 +2175,10 @@ static int stream_component_open(VideoState *is, int stream_index)
     enc->workaround_bugs = workaround_bugs;
     enc->lowres = lowres;
     if(lowres) enc->flags |= CODEC_FLAG_EMU_EDGE;
+    /* direct rendering into the overlays needs pictures without edges */
+    if(!no_direct_render && enc->codec_type == CODEC_TYPE_VIDEO &&
+       codec && (codec->capabilities & CODEC_CAP_DR1))
+        enc->flags |= CODEC_FLAG_EMU_EDGE;
     enc->idct_algo= idct;
     if(fast) enc->flags2 |= CODEC_FLAG2_FAST;
     enc->skip_frame= skip_frame;
@@ -1704,9 +2202,6 @@ static int stream_component_open(VideoState *is, int stream_index)
         /* init averaging filter */
         is->audio_diff_avg_coef = exp(log(0.01) / AUDIO_DIFF_AVG_NB);
         is->audio_diff_avg_count = 0;
-        /* since we do not have a precise anough audio fifo fullness,
-           we correct audio sync only if larger than this threshold */
-        is->audio_diff_threshold = 2.0 * SDL_AUDIO_BUFFER_SIZE / enc->sample_rate;
 
         memset(&is->audio_pkt, 0, sizeof(is->audio_pkt));
         packet_queue_init(&is->audioq);
@@ -1723,6 +2218,8 @@ static int stream_component_open(VideoState *is, int stream_index)
         packet_queue_init(&is->videoq);
         is->video_tid = SDL_CreateThread(video_thread, is);
 
+        is->dr_state = no_direct_render ? -1 : 0;
+        enc->opaque = is;
         enc->    get_buffer=     my_get_buffer;
         enc->release_buffer= my_release_buffer;
         break;
@@ -2005,6 +2502,8 @@ static int decode_thread(void *arg)
             }
             is->seek_req = 0;
         }
+        if (is->audio_resize_req)
+            audio_resize(is);
 
         /* if the queue are full, no need to read more */
         if (is->audioq.size > MAX_AUDIOQ_SIZE ||
@@ -2112,7 +2611,11 @@ static void stream_close(VideoState *is)
             SDL_FreeYUVOverlay(vp->bmp);
             vp->bmp = NULL;
         }
+        av_freep(&vp->dirty);
+        av_freep(&vp->dirty_rects);
+        vp->dr = NULL;
     }
+    free_dr_buffers(is);
     SDL_DestroyMutex(is->pictq_mutex);
     SDL_DestroyCond(is->pictq_cond);
     SDL_DestroyMutex(is->subpq_mutex);
@@ -2215,6 +2718,7 @@ static void toggle_audio_display(void)
 {
     if (cur_stream) {
         cur_stream->show_audio = !cur_stream->show_audio;
+        screen_refresh = 1;
     }
 }
 
@@ -2346,8 +2850,12 @@ static void event_loop(void)
                                           SDL_HWSURFACE|SDL_RESIZABLE|SDL_ASYNCBLIT|SDL_HWACCEL);
                 screen_width = cur_stream->width = event.resize.w;
                 screen_height= cur_stream->height= event.resize.h;
+                screen_refresh = 1;
             }
             break;
+        case SDL_VIDEOEXPOSE:
+            screen_refresh = 1;
+            break;
         case SDL_QUIT:
         case FF_QUIT_EVENT:
             do_exit();
@@ -2356,6 +2864,9 @@ static void event_loop(void)
             video_open(event.user.data1);
             alloc_picture(event.user.data1);
             break;
+        case FF_DR_ALLOC_EVENT:
+            alloc_dr_buffers(event.user.data1);
+            break;
         case FF_REFRESH_EVENT:
             video_refresh_timer(event.user.data1);
             break;
@@ -2477,10 +2988,13 @@ const OptionDef options[] = {
     { "fast", OPT_BOOL | OPT_EXPERT, {(void*)&fast}, "non spec compliant optimizations", "" },
     { "genpts", OPT_BOOL | OPT_EXPERT, {(void*)&genpts}, "generate pts", "" },
     { "drp", OPT_BOOL |OPT_EXPERT, {(void*)&decoder_reorder_pts}, "let decoder reorder pts", ""},
+    { "nodr", OPT_BOOL | OPT_EXPERT, {(void*)&no_direct_render}, "do not decode directly into the overlays", "" },
+    { "lowlat", OPT_BOOL | OPT_EXPERT, {(void*)&low_latency}, "low latency audio output with adaptive buffer size", "" },
     { "lowres", OPT_INT | HAS_ARG | OPT_EXPERT, {(void*)&lowres}, "", "" },
     { "skiploop", OPT_INT | HAS_ARG | OPT_EXPERT, {(void*)&skip_loop_filter}, "", "" },
     { "skipframe", OPT_INT | HAS_ARG | OPT_EXPERT, {(void*)&skip_frame}, "", "" },
     { "skipidct", OPT_INT | HAS_ARG | OPT_EXPERT, {(void*)&skip_idct}, "", "" },
+    { "noautoskip", OPT_BOOL | OPT_EXPERT, {(void*)&no_auto_skip}, "do not lower decoding quality when video is late", "" },
     { "idct", OPT_INT | HAS_ARG | OPT_EXPERT, {(void*)&idct}, "set idct algo",  "algo" },
     { "er", OPT_INT | HAS_ARG | OPT_EXPERT, {(void*)&error_resilience}, "set error detection threshold (0-4)",  "threshold" },
     { "ec", OPT_INT | HAS_ARG | OPT_EXPERT, {(void*)&error_concealment}, "set error concealment options",  "bit_mask" },
@@ -2958,6 +3472,20 @@ enFFPlayResult ffplay_set_volume(int nProcent) {
 }
 
 
+//Enable or disable low latency audio output for the next opened stream
+enFFPlayResult ffplay_set_low_latency(int nEnable) {
+	low_latency = nEnable;
+	return FFPLAY_OK;
+}
+
+
+//Enable or disable automatic decoding quality reduction
+enFFPlayResult ffplay_set_auto_skip(int nEnable) {
+	no_auto_skip = !nEnable;
+	return FFPLAY_OK;
+}
+
+
 //Init the use of FFPLAY library 
 enFFPlayResult ffplay_init() {
 	int flags;
@@ -3272,6 +3800,8 @@ static int ffplay_decode_thread(void *arg)
             }
             is->seek_req = 0;
         }
+        if (is->audio_resize_req)
+            audio_resize(is);
 
 
         /* if the queue are full, no need to read more */
@@ -3439,4 +3969,4 @@ SDL_Thread* GetCurrentParserThread()
 
 	}
 	return NULL;
-}
\ No newline at end of file
+}
@@ -81,6 +81,14 @@ enFFPlayResult ffplay_get_status(stFFPlayStreamStatus* pStatus);
 //Set current stream volume in percent 
 enFFPlayResult ffplay_set_volume(int nProcent); 
 
+//Enable or disable low latency audio output for the next opened stream.
+// The device buffer then starts small and adapts to the callback jitter
+enFFPlayResult ffplay_set_low_latency(int nEnable);
+
+//Enable or disable automatic decoding quality reduction (loop filter and
+// residual skipping) while the video is late on the audio clock
+enFFPlayResult ffplay_set_auto_skip(int nEnable);
+
 SDL_Thread* GetCurrentParserThread();
 
 
@@ -28,12 +28,23 @@
 #ifdef HAVE_SYS_POLL_H
 #include <sys/poll.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <sys/time.h>
 #undef time //needed because HAVE_AV_CONFIG_H is defined on top
 #include <time.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <sched.h>
 #ifdef HAVE_DLFCN_H
 #include <dlfcn.h>
 #endif
@@ -45,9 +56,12 @@
 
 #undef exit
 
-/* maximum number of simultaneous HTTP connections */
+/* maximum number of simultaneous HTTP connections per worker */
 #define HTTP_MAX_CONNECTIONS 2000
 
+/* maximum number of server processes sharing the listening sockets */
+#define MAX_WORKERS 32
+
 enum HTTPState {
     HTTPSTATE_WAIT_REQUEST,
     HTTPSTATE_SEND_HEADER,
@@ -81,6 +95,10 @@ const char *http_state[] = {
 
 #define IOBUFFER_INIT_SIZE 8192
 
+/* maximum size sent at once from a file, so that one client cannot
+   hold the server loop */
+#define FILE_CHUNK_SIZE (256 * 1024)
+
 /* timeouts are in ms */
 #define HTTP_REQUEST_TIMEOUT (15 * 1000)
 #define RTSP_REQUEST_TIMEOUT (3600 * 24 * 1000)
@@ -98,6 +116,7 @@ typedef struct HTTPContext {
     int fd; /* socket file descriptor */
     struct sockaddr_in from_addr; /* origin */
     struct pollfd *poll_entry; /* used when polling */
+    struct pollfd poll_fd; /* events registered with epoll and their result */
     int64_t timeout;
     uint8_t *buffer_ptr, *buffer_end;
     int http_error;
@@ -109,6 +128,11 @@ typedef struct HTTPContext {
     int feed_fd;
     /* input format handling */
     AVFormatContext *fmt_in;
+    int cached;                    /* true if the output comes from the stream cache */
+    struct CacheChunk *cache_chunk; /* chunk being sent, if cached */
+    /* file sent as it is */
+    int file_fd;                   /* -1 if the output is muxed */
+    int64_t file_pos, file_end;    /* byte range still to be sent */
     int64_t start_time;            /* In milliseconds - this wraps fairly often */
     int64_t first_pts;            /* initial pts value */
     int64_t cur_pts;             /* current pts value from the stream in us */
@@ -212,19 +236,57 @@ typedef struct FFStream {
     int multicast_port; /* first port used for multicast */
     int multicast_ttl;
     int loop; /* if true, send the stream in loops (only meaningful if file) */
+    int no_shared_output; /* if true, every client demuxes and muxes the feed itself */
+    int passthrough; /* if true, the file is already in the output format */
+    struct StreamCache *cache; /* output shared by the HTTP clients of a live stream */
 
     /* feed specific */
-    int feed_opened;     /* true if someone is writing to the feed */
+    struct FeedState *feed_state; /* shared with the other workers */
+    int64_t feed_seen_index;    /* write index the waiting connections have seen */
     int is_feed;         /* true if it is a feed */
     int readonly;        /* True if writing is prohibited to the file */
     int conns_served;
     int64_t bytes_served;
     int64_t feed_max_size;      /* maximum storage size, zero means unlimited */
-    int64_t feed_write_index;   /* current write position in feed (it wraps round) */
-    int64_t feed_size;          /* current size of feed */
     struct FFStream *next_feed;
 } FFStream;
 
+/* state of a feed, in memory shared by all the worker processes */
+typedef struct FeedState {
+    int opened;                 /* true if someone is writing to the feed */
+    volatile int lock;          /* protects write_index and size */
+    int64_t write_index;        /* current write position in feed (it wraps round) */
+    int64_t size;               /* current size of feed */
+} FeedState;
+
+/* muxed bytes kept for the clients of a live stream */
+#define STREAM_CACHE_SIZE (1024 * 1024)
+
+/* one chunk of muxed output, shared by the clients of a stream */
+typedef struct CacheChunk {
+    uint8_t *data;
+    int size;
+    int key;          /* true if a client can start sending here */
+    int evicted;      /* true if no longer in the cache: next is invalid */
+    int refcount;     /* clients sending it, plus one while in the cache */
+    struct CacheChunk *next;
+} CacheChunk;
+
+/* input and output of a live stream, demuxed and muxed once for all its
+   HTTP clients. The clients only differ by the chunk they are sending */
+typedef struct StreamCache {
+    AVFormatContext *fmt_in;
+    AVFormatContext fmt_ctx;
+    uint8_t *header;
+    int header_size;
+    int key_stream;   /* stream whose key frames start a chunk, -1 for all */
+    int key_pending;  /* a key frame was muxed but gave no output yet */
+    CacheChunk *first, *last, *last_key;
+    int size;
+    int nb_clients;
+    int64_t hits, misses, evictions;
+} StreamCache;
+
 typedef struct FeedData {
     long long data_count;
     float avg_frame_size;   /* frame size averraged over last frames with exponential mean */
@@ -247,8 +309,14 @@ static int http_parse_request(HTTPContext *c);
 static int http_send_data(HTTPContext *c);
 static void compute_stats(HTTPContext *c);
 static int open_input_stream(HTTPContext *c, const char *info);
+static void close_output_stream(AVFormatContext *ctx);
+static int stream_cache_usable(HTTPContext *c, const char *info);
+static int stream_cache_open(FFStream *stream);
+static void cache_chunk_unref(CacheChunk *chunk);
+static void stream_cache_close(StreamCache *cache);
 static int http_start_receive_data(HTTPContext *c);
 static int http_receive_data(HTTPContext *c);
+static void wake_feed_waiters(FFStream *feed);
 
 /* RTSP handling */
 static int rtsp_parse_request(HTTPContext *c);
@@ -285,6 +353,10 @@ static int nb_connections;
 static int max_bandwidth;
 static int current_bandwidth;
 
+static int nb_workers = 1;
+static int worker_index;           /* 0 in the process that started the others */
+static pid_t master_pid;
+
 static int64_t cur_time;           // Making this global saves on passing it around everywhere
 
 static AVRandomState random_state;
@@ -413,6 +485,60 @@ static void start_children(FFStream *feed)
     }
 }
 
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* allocate zeroed memory that stays shared with the worker processes */
+static void *mallocz_shared(size_t size)
+{
+    void *ptr;
+
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+    return ptr;
+}
+
+/* the feed writer updates write_index and size while the other workers
+   read them. 64 bit stores are not atomic everywhere, so take a spinlock
+   that lives next to them in the shared memory */
+static void feed_lock(FeedState *fs)
+{
+    while (__sync_lock_test_and_set(&fs->lock, 1))
+        sched_yield();
+}
+
+static void feed_unlock(FeedState *fs)
+{
+    __sync_lock_release(&fs->lock);
+}
+
+static void feed_get_index(FeedState *fs, int64_t *write_index, int64_t *size)
+{
+    feed_lock(fs);
+    *write_index = fs->write_index;
+    if (size)
+        *size = fs->size;
+    feed_unlock(fs);
+}
+
+static void feed_set_index(FeedState *fs, int64_t write_index, int64_t size)
+{
+    feed_lock(fs);
+    fs->write_index = write_index;
+    fs->size = size;
+    feed_unlock(fs);
+}
+
+/* keep our descriptors out of the feeder processes started by
+   start_children(), which only close the low ones */
+static void set_cloexec(int fd)
+{
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
 /* open a listening socket */
 static int socket_open_listen(struct sockaddr_in *my_addr)
 {
@@ -423,6 +549,7 @@ static int socket_open_listen(struct sockaddr_in *my_addr)
         perror ("socket");
         return -1;
     }
+    set_cloexec(server_fd);
 
     tmp = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &tmp, sizeof(tmp));
@@ -435,7 +562,7 @@ static int socket_open_listen(struct sockaddr_in *my_addr)
         return -1;
     }
 
-    if (listen (server_fd, 5) < 0) {
+    if (listen (server_fd, SOMAXCONN) < 0) {
         perror ("listen");
         closesocket(server_fd);
         return -1;
@@ -500,12 +627,122 @@ static void start_multicast(void)
     }
 }
 
+/* fork the worker processes. They share the listening sockets and the
+   feed states, and each one serves its share of the connections */
+static int start_workers(void)
+{
+    int i;
+    pid_t pid;
+
+    master_pid = getpid();
+    nb_max_connections = (nb_max_connections + nb_workers - 1) / nb_workers;
+    max_bandwidth = (max_bandwidth + nb_workers - 1) / nb_workers;
+    if (nb_max_connections > HTTP_MAX_CONNECTIONS) {
+        http_log("MaxClients limited to %d per worker\n", HTTP_MAX_CONNECTIONS);
+        nb_max_connections = HTTP_MAX_CONNECTIONS;
+    }
+
+    for(i = 1; i < nb_workers; i++) {
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return -1;
+        }
+        if (pid == 0) {
+            worker_index = i;
+            /* RTSP session ids must differ between workers */
+            av_init_random(av_gettime() + (getpid() << 16), &random_state);
+            break;
+        }
+    }
+    return 0;
+}
+
+/* return the poll events needed by a connection in its current state and
+   lower *delay if the connection must be handled on a timer */
+static int connection_events(HTTPContext *c, int *delay)
+{
+    switch(c->state) {
+    case HTTPSTATE_SEND_HEADER:
+    case RTSPSTATE_SEND_REPLY:
+    case RTSPSTATE_SEND_PACKET:
+        return POLLOUT;
+    case HTTPSTATE_SEND_DATA_HEADER:
+    case HTTPSTATE_SEND_DATA:
+    case HTTPSTATE_SEND_DATA_TRAILER:
+        if (!c->is_packetized) {
+            /* for TCP, we output as much as we can (may need to put a limit) */
+            return POLLOUT;
+        } else {
+            /* when ffserver is doing the timing, we work by
+               looking at which packet need to be sent every
+               10 ms */
+            if (*delay > 10)
+                *delay = 10; /* one tick wait XXX: 10 ms assumed */
+        }
+        return 0;
+    case HTTPSTATE_WAIT_FEED:
+        /* the feed may be written by another worker, which cannot
+           wake us up */
+        if (nb_workers > 1 && *delay > 10)
+            *delay = 10;
+        /* fall through */
+    case HTTPSTATE_WAIT_REQUEST:
+    case HTTPSTATE_RECEIVE_DATA:
+    case RTSPSTATE_WAIT_REQUEST:
+        /* need to catch errors */
+        return POLLIN;/* Maybe this will work */
+    default:
+        return 0;
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int epoll_fd = -1;
+
+/* keep the epoll registration of a connection in sync with the events
+   its state needs. Only state changes cost a system call */
+static void epoll_update(int epoll_fd, HTTPContext *c, int events)
+{
+    struct epoll_event ev;
+    int op;
+
+    c->poll_fd.revents = 0;
+    c->poll_entry = &c->poll_fd;
+    if (events == c->poll_fd.events || c->fd < 0)
+        return;
+
+    if (!events)
+        op = EPOLL_CTL_DEL;
+    else if (!c->poll_fd.events)
+        op = EPOLL_CTL_ADD;
+    else
+        op = EPOLL_CTL_MOD;
+    ev.events = 0;
+    if (events & POLLIN)
+        ev.events |= EPOLLIN;
+    if (events & POLLOUT)
+        ev.events |= EPOLLOUT;
+    ev.data.ptr = c;
+    epoll_ctl(epoll_fd, op, c->fd, &ev);
+    c->poll_fd.events = events;
+}
+#endif
+
 /* main loop of the http server */
 static int http_server(void)
 {
-    int server_fd, ret, rtsp_server_fd, delay, delay1;
-    struct pollfd poll_table[HTTP_MAX_CONNECTIONS + 2], *poll_entry;
+    int server_fd, ret, rtsp_server_fd, delay;
     HTTPContext *c, *c_next;
+    FFStream *feed;
+    int new_http, new_rtsp;
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[256], ev;
+    int i;
+#else
+    struct pollfd poll_table[HTTP_MAX_CONNECTIONS + 2], *poll_entry;
+    int events;
+#endif
 
     server_fd = socket_open_listen(&my_http_addr);
     if (server_fd < 0)
@@ -515,16 +752,36 @@ static int http_server(void)
     if (rtsp_server_fd < 0)
         return -1;
 
+    if (start_workers() < 0)
+        return -1;
+
     http_log("ffserver started.\n");
 
-    start_children(first_feed);
+    if (!worker_index)
+        start_children(first_feed);
 
     first_http_ctx = NULL;
     nb_connections = 0;
 
-    start_multicast();
+    if (!worker_index)
+        start_multicast();
+
+#ifdef HAVE_SYS_EPOLL_H
+    epoll_fd = epoll_create(HTTP_MAX_CONNECTIONS + 2);
+    if (epoll_fd < 0) {
+        perror("epoll_create");
+        return -1;
+    }
+    set_cloexec(epoll_fd);
+    ev.events = EPOLLIN;
+    ev.data.ptr = &server_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+    ev.data.ptr = &rtsp_server_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, rtsp_server_fd, &ev);
+#endif
 
     for(;;) {
+#ifndef HAVE_SYS_EPOLL_H
         poll_entry = poll_table;
         poll_entry->fd = server_fd;
         poll_entry->events = POLLIN;
@@ -533,59 +790,57 @@ static int http_server(void)
         poll_entry->fd = rtsp_server_fd;
         poll_entry->events = POLLIN;
         poll_entry++;
+#endif
 
         /* wait for events on each HTTP handle */
         c = first_http_ctx;
         delay = 1000;
         while (c != NULL) {
-            int fd;
-            fd = c->fd;
-            switch(c->state) {
-            case HTTPSTATE_SEND_HEADER:
-            case RTSPSTATE_SEND_REPLY:
-            case RTSPSTATE_SEND_PACKET:
-                c->poll_entry = poll_entry;
-                poll_entry->fd = fd;
-                poll_entry->events = POLLOUT;
-                poll_entry++;
-                break;
-            case HTTPSTATE_SEND_DATA_HEADER:
-            case HTTPSTATE_SEND_DATA:
-            case HTTPSTATE_SEND_DATA_TRAILER:
-                if (!c->is_packetized) {
-                    /* for TCP, we output as much as we can (may need to put a limit) */
-                    c->poll_entry = poll_entry;
-                    poll_entry->fd = fd;
-                    poll_entry->events = POLLOUT;
-                    poll_entry++;
-                } else {
-                    /* when ffserver is doing the timing, we work by
-                       looking at which packet need to be sent every
-                       10 ms */
-                    delay1 = 10; /* one tick wait XXX: 10 ms assumed */
-                    if (delay1 < delay)
-                        delay = delay1;
-                }
-                break;
-            case HTTPSTATE_WAIT_REQUEST:
-            case HTTPSTATE_RECEIVE_DATA:
-            case HTTPSTATE_WAIT_FEED:
-            case RTSPSTATE_WAIT_REQUEST:
-                /* need to catch errors */
+#ifdef HAVE_SYS_EPOLL_H
+            epoll_update(epoll_fd, c, connection_events(c, &delay));
+#else
+            events = connection_events(c, &delay);
+            if (events) {
                 c->poll_entry = poll_entry;
-                poll_entry->fd = fd;
-                poll_entry->events = POLLIN;/* Maybe this will work */
+                poll_entry->fd = c->fd;
+                poll_entry->events = events;
                 poll_entry++;
-                break;
-            default:
+            } else {
                 c->poll_entry = NULL;
-                break;
             }
+#endif
             c = c->next;
         }
 
         /* wait for an event on one connection. We poll at least every
            second to handle timeouts */
+        new_http = new_rtsp = 0;
+#ifdef HAVE_SYS_EPOLL_H
+        do {
+            ret = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), delay);
+            if (ret < 0 && ff_neterrno() != FF_NETERROR(EAGAIN) &&
+                ff_neterrno() != FF_NETERROR(EINTR))
+                return -1;
+        } while (ret < 0);
+
+        for(i = 0; i < ret; i++) {
+            if (events[i].data.ptr == &server_fd) {
+                new_http = 1;
+            } else if (events[i].data.ptr == &rtsp_server_fd) {
+                new_rtsp = 1;
+            } else {
+                c = events[i].data.ptr;
+                if (events[i].events & EPOLLIN)
+                    c->poll_fd.revents |= POLLIN;
+                if (events[i].events & EPOLLOUT)
+                    c->poll_fd.revents |= POLLOUT;
+                if (events[i].events & EPOLLERR)
+                    c->poll_fd.revents |= POLLERR;
+                if (events[i].events & EPOLLHUP)
+                    c->poll_fd.revents |= POLLHUP;
+            }
+        }
+#else
         do {
             ret = poll(poll_table, poll_entry - poll_table, delay);
             if (ret < 0 && ff_neterrno() != FF_NETERROR(EAGAIN) &&
@@ -593,6 +848,10 @@ static int http_server(void)
                 return -1;
         } while (ret < 0);
 
+        new_http = poll_table[0].revents & POLLIN;
+        new_rtsp = poll_table[1].revents & POLLIN;
+#endif
+
         cur_time = av_gettime() / 1000;
 
         if (need_to_start_children) {
@@ -600,6 +859,20 @@ static int http_server(void)
             start_children(first_feed);
         }
 
+        if (nb_workers > 1) {
+            /* exit with the process that started us */
+            if (worker_index && getppid() != master_pid)
+                return 0;
+            /* data may have been written to a feed by another worker */
+            for(feed = first_feed; feed; feed = feed->next_feed) {
+                int64_t write_index;
+
+                feed_get_index(feed->feed_state, &write_index, NULL);
+                if (feed->feed_seen_index != write_index)
+                    wake_feed_waiters(feed);
+            }
+        }
+
         /* now handle the events */
         for(c = first_http_ctx; c != NULL; c = c_next) {
             c_next = c->next;
@@ -610,16 +883,12 @@ static int http_server(void)
             }
         }
 
-        poll_entry = poll_table;
         /* new HTTP connection request ? */
-        if (poll_entry->revents & POLLIN) {
+        if (new_http)
             new_connection(server_fd, 0);
-        }
-        poll_entry++;
         /* new RTSP connection request ? */
-        if (poll_entry->revents & POLLIN) {
+        if (new_rtsp)
             new_connection(rtsp_server_fd, 1);
-        }
     }
 }
 
@@ -649,6 +918,7 @@ static void new_connection(int server_fd, int is_rtsp)
                 &len);
     if (fd < 0)
         return;
+    set_cloexec(fd);
     ff_socket_nonblock(fd, 1);
 
     /* XXX: should output a warning page when coming
@@ -662,6 +932,7 @@ static void new_connection(int server_fd, int is_rtsp)
         goto fail;
 
     c->fd = fd;
+    c->file_fd = -1;
     c->poll_entry = NULL;
     c->from_addr = from_addr;
     c->buffer_size = IOBUFFER_INIT_SIZE;
@@ -710,9 +981,27 @@ static void close_connection(HTTPContext *c)
             c1->rtsp_c = NULL;
     }
 
+    /* leave the shared output */
+    if (c->cached) {
+        StreamCache *cache = c->stream->cache;
+
+        if (c->cache_chunk)
+            cache_chunk_unref(c->cache_chunk);
+        if (--cache->nb_clients == 0)
+            stream_cache_close(cache);
+    }
+
     /* remove connection associated resources */
-    if (c->fd >= 0)
+    if (c->fd >= 0) {
+#ifdef HAVE_SYS_EPOLL_H
+        /* the registration outlives close() while a child still shares
+           the socket */
+        epoll_update(epoll_fd, c, 0);
+#endif
         closesocket(c->fd);
+    }
+    if (c->file_fd >= 0)
+        close(c->file_fd);
     if (c->fmt_in) {
         /* close each frame parser */
         for(i=0;i<c->fmt_in->nb_streams;i++) {
@@ -753,15 +1042,14 @@ static void close_connection(HTTPContext *c)
         }
     }
 
-    for(i=0; i<ctx->nb_streams; i++)
-        av_free(ctx->streams[i]) ;
+    close_output_stream(ctx);
 
     if (c->stream && !c->post && c->stream->stream_type == STREAM_TYPE_LIVE)
         current_bandwidth -= c->stream->bandwidth;
 
     /* signal that there is no feed if we are the feeder socket */
     if (c->state == HTTPSTATE_RECEIVE_DATA && c->stream) {
-        c->stream->feed_opened = 0;
+        c->stream->feed_state->opened = 0;
         close(c->feed_fd);
     }
 
@@ -998,6 +1286,51 @@ static int extract_rates(char *rates, int ratelen, const char *request)
     return 0;
 }
 
+/* parse a "Range: bytes=first-last" header. A missing bound is
+   returned as -1. Return 1 if a single range was requested: a list of
+   ranges would need a multipart reply, so it gets the whole file */
+static int extract_range(int64_t *first, int64_t *last, const char *request)
+{
+    const char *p;
+    char *q;
+
+    for (p = request; *p && *p != '\r' && *p != '\n'; ) {
+        if (strncasecmp(p, "Range:", 6) == 0) {
+            p += 6;
+            while (*p == ' ' || *p == '\t')
+                p++;
+            if (strncasecmp(p, "bytes=", 6) != 0)
+                return 0;
+            p += 6;
+            *first = -1;
+            *last = -1;
+            if (isdigit(*p)) {
+                *first = strtoll(p, &q, 10);
+                p = q;
+            }
+            if (*p != '-')
+                return 0;
+            p++;
+            if (isdigit(*p)) {
+                *last = strtoll(p, &q, 10);
+                p = q;
+            }
+            while (*p == ' ' || *p == '\t')
+                p++;
+            if (*p == ',')
+                return 0;
+            return *first >= 0 || *last >= 0;
+        }
+        p = strchr(p, '\n');
+        if (!p)
+            break;
+
+        p++;
+    }
+
+    return 0;
+}
+
 static int find_stream_in_feed(FFStream *feed, AVCodecContext *codec, int bit_rate)
 {
     int i;
@@ -1160,6 +1493,86 @@ static void compute_real_filename(char *filename, int max_size)
     }
 }
 
+/* a file already in the output format can be sent as it is, unless
+   the client asks for a time position or the stream is altered */
+static int file_passthrough_usable(HTTPContext *c, const char *info)
+{
+    FFStream *stream = c->stream;
+    char buf[128];
+
+    if (!stream->passthrough || stream->feed || stream->loop || stream->max_time)
+        return 0;
+    if (find_info_tag(buf, sizeof(buf), "date", info))
+        return 0;
+    return 1;
+}
+
+/* open the file of the stream and prepare the http header for the
+   requested byte range. Return -1 if the file cannot be opened */
+static int http_start_file(HTTPContext *c)
+{
+    struct stat st;
+    int64_t first, last, size;
+    const char *mime_type;
+    char *q;
+    int fd;
+
+    fd = open(c->stream->feed_filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    set_cloexec(fd);
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    size = st.st_size;
+
+    mime_type = c->stream->fmt->mime_type;
+    if (!mime_type)
+        mime_type = "application/x-octet-stream";
+
+    q = c->buffer;
+    if (extract_range(&first, &last, c->buffer)) {
+        if (first < 0) {
+            /* suffix range: the last bytes of the file */
+            first = FFMAX(size - last, 0);
+            last = size - 1;
+        } else if (last < 0 || last >= size) {
+            last = size - 1;
+        }
+        if (first > last) {
+            close(fd);
+            c->http_error = 416;
+            q += snprintf(q, c->buffer_size, "HTTP/1.0 416 Requested Range Not Satisfiable\r\n");
+            q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Content-Range: bytes */%"PRId64"\r\n", size);
+            q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "\r\n");
+            goto done;
+        }
+        q += snprintf(q, c->buffer_size, "HTTP/1.0 206 Partial Content\r\n");
+        q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Content-Range: bytes %"PRId64"-%"PRId64"/%"PRId64"\r\n",
+                      first, last, size);
+    } else {
+        first = 0;
+        last = size - 1;
+        q += snprintf(q, c->buffer_size, "HTTP/1.0 200 OK\r\n");
+    }
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Accept-Ranges: bytes\r\n");
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Content-Length: %"PRId64"\r\n", last + 1 - first);
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Content-Type: %s\r\n", mime_type);
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "\r\n");
+
+    c->http_error = 0;
+    c->file_fd = fd;
+    c->file_pos = first;
+    c->file_end = last + 1;
+    c->start_time = cur_time;
+ done:
+    c->buffer_ptr = c->buffer;
+    c->buffer_end = q;
+    c->state = HTTPSTATE_SEND_HEADER;
+    return 0;
+}
+
 enum RedirType {
     REDIR_NONE,
     REDIR_ASX,
@@ -1300,7 +1713,7 @@ static int http_parse_request(HTTPContext *c)
     }
 
     /* If already streaming this feed, dont let start an another feeder */
-    if (stream->feed_opened) {
+    if (stream->feed_state && stream->feed_state->opened) {
         snprintf(msg, sizeof(msg), "This feed is already being received.");
         goto send_error;
     }
@@ -1531,8 +1944,20 @@ static int http_parse_request(HTTPContext *c)
     if (c->stream->stream_type == STREAM_TYPE_STATUS)
         goto send_stats;
 
+    /* send the file as it is if no remuxing is needed */
+    if (file_passthrough_usable(c, info) && http_start_file(c) == 0)
+        return 0;
+
     /* open input stream */
-    if (open_input_stream(c, info) < 0) {
+    if (stream_cache_usable(c, info)) {
+        if (stream_cache_open(c->stream) < 0) {
+            snprintf(msg, sizeof(msg), "Input stream corresponding to '%s' not found", url);
+            goto send_error;
+        }
+        c->stream->cache->nb_clients++;
+        c->cached = 1;
+        c->start_time = cur_time;
+    } else if (open_input_stream(c, info) < 0) {
         snprintf(msg, sizeof(msg), "Input stream corresponding to '%s' not found", url);
         goto send_error;
     }
@@ -1815,9 +2240,34 @@ static void compute_stats(HTTPContext *c)
     }
 #endif
 
+    /* shared output status */
+    url_fprintf(pb, "<H2>Shared Output</H2>\n");
+    url_fprintf(pb, "<TABLE>\n");
+    url_fprintf(pb, "<TR><th>Path<th>Clients<th>Chunks<th>Cached<th>Hits<th>Misses<th>Evictions\n");
+    for(stream = first_stream; stream != NULL; stream = stream->next) {
+        StreamCache *cache = stream->cache;
+        CacheChunk *chunk;
+
+        if (!cache)
+            continue;
+        i = 0;
+        for(chunk = cache->first; chunk; chunk = chunk->next)
+            i++;
+        url_fprintf(pb, "<TR><TD>%s<TD align=right>%d<TD align=right>%d<TD align=right>",
+                     stream->filename, cache->nb_clients, i);
+        fmt_bytecount(pb, cache->size);
+        url_fprintf(pb, "<TD align=right>%"PRId64"<TD align=right>%"PRId64"<TD align=right>%"PRId64"\n",
+                     cache->hits, cache->misses, cache->evictions);
+    }
+    url_fprintf(pb, "</TABLE>\n");
+
     /* connection status */
     url_fprintf(pb, "<H2>Connection Status</H2>\n");
 
+    if (nb_workers > 1)
+        url_fprintf(pb, "Worker %d of %d (counts are per worker)<BR>\n",
+                     worker_index + 1, nb_workers);
+
     url_fprintf(pb, "Number of connections: %d / %d<BR>\n",
                  nb_connections, nb_max_connections);
 
@@ -1988,80 +2438,376 @@ static int64_t get_packet_send_clock(HTTPContext *c)
     }
 }
 
+/* set up a muxer for the output of a stream and write its header in
+   *pbuffer. Return the header size or -1 */
+static int open_output_stream(AVFormatContext *ctx, FFStream *stream,
+                              uint8_t **pbuffer)
+{
+    int i;
+
+    memset(ctx, 0, sizeof(*ctx));
+    pstrcpy(ctx->author, sizeof(ctx->author), stream->author);
+    pstrcpy(ctx->comment, sizeof(ctx->comment), stream->comment);
+    pstrcpy(ctx->copyright, sizeof(ctx->copyright), stream->copyright);
+    pstrcpy(ctx->title, sizeof(ctx->title), stream->title);
+
+    /* open output stream by using specified codecs */
+    ctx->oformat = stream->fmt;
+    ctx->nb_streams = stream->nb_streams;
+    for(i=0;i<ctx->nb_streams;i++) {
+        AVStream *st;
+        AVStream *src;
+        AVCodecContext *codec;
+        st = av_mallocz(sizeof(AVStream));
+        codec = avcodec_alloc_context();
+        ctx->streams[i] = st;
+        /* if file or feed, then just take streams from FFStream struct */
+        if (!stream->feed ||
+            stream->feed == stream)
+            src = stream->streams[i];
+        else
+            src = stream->feed->streams[stream->feed_streams[i]];
+
+        *st = *src;
+        st->priv_data = 0;
+        /* each output counts its own frames */
+        *codec = *src->codec;
+        st->codec = codec;
+        st->codec->frame_number = 0; /* XXX: should be done in
+                                       AVStream, not in codec */
+        /* I'm pretty sure that this is not correct...
+         * However, without it, we crash
+         */
+        st->codec->coded_frame = &dummy_frame;
+    }
 
-static int http_prepare_data(HTTPContext *c)
+    /* prepare header and save header data in a stream */
+    if (url_open_dyn_buf(&ctx->pb) < 0) {
+        /* XXX: potential leak */
+        return -1;
+    }
+    ctx->pb.is_streamed = 1;
+
+    av_set_parameters(ctx, NULL);
+    if (av_write_header(ctx) < 0)
+        return -1;
+
+    return url_close_dyn_buf(&ctx->pb, pbuffer);
+}
+
+/* free what open_output_stream() and the muxer allocated */
+static void close_output_stream(AVFormatContext *ctx)
+{
+    int i;
+
+    for(i=0;i<ctx->nb_streams;i++) {
+        av_freep(&ctx->streams[i]->priv_data);
+        av_free(ctx->streams[i]->codec);
+        av_freep(&ctx->streams[i]);
+    }
+    ctx->nb_streams = 0;
+    av_freep(&ctx->priv_data);
+}
+
+/********************************************************************/
+/* output shared by the HTTP clients of a live stream */
+
+/* a client can use the shared output if it wants the stream as
+   configured and from the current time */
+static int stream_cache_usable(HTTPContext *c, const char *info)
+{
+    FFStream *stream = c->stream;
+    char buf[128];
+
+    if (stream->no_shared_output || !stream->feed || stream->feed == stream)
+        return 0;
+    /* asf clients have their own ids and can switch streams */
+    if (!strcmp(stream->fmt->name, "asf_stream"))
+        return 0;
+    if (memcmp(c->feed_streams, stream->feed_streams, sizeof(c->feed_streams)))
+        return 0;
+    if (find_info_tag(buf, sizeof(buf), "date", info) ||
+        find_info_tag(buf, sizeof(buf), "buffer", info))
+        return 0;
+    return 1;
+}
+
+static void cache_chunk_unref(CacheChunk *chunk)
+{
+    if (--chunk->refcount == 0) {
+        av_free(chunk->data);
+        av_free(chunk);
+    }
+}
+
+/* drop the oldest chunk. Its clients keep it until they have sent it */
+static void stream_cache_evict(StreamCache *cache)
 {
+    CacheChunk *chunk = cache->first;
+
+    cache->first = chunk->next;
+    if (!cache->first)
+        cache->last = NULL;
+    if (cache->last_key == chunk)
+        cache->last_key = NULL;
+    cache->size -= chunk->size;
+    chunk->evicted = 1;
+    cache_chunk_unref(chunk);
+}
+
+static void stream_cache_close(StreamCache *cache)
+{
+    AVFormatContext *ctx = &cache->fmt_ctx;
+    uint8_t *buf;
+    int i;
+
+    while (cache->first)
+        stream_cache_evict(cache);
+    if (cache->fmt_in) {
+        /* close each frame parser */
+        for(i=0;i<cache->fmt_in->nb_streams;i++) {
+            AVStream *st = cache->fmt_in->streams[i];
+            if (st->codec->codec)
+                avcodec_close(st->codec);
+        }
+        av_close_input_file(cache->fmt_in);
+        cache->fmt_in = NULL;
+    }
+    /* nobody is left to receive the trailer */
+    if (cache->header && ctx->oformat) {
+        if (url_open_dyn_buf(&ctx->pb) >= 0) {
+            av_write_trailer(ctx);
+            url_close_dyn_buf(&ctx->pb, &buf);
+            av_free(buf);
+        }
+    }
+    close_output_stream(ctx);
+    av_freep(&cache->header);
+}
+
+/* open the shared input and output of a stream, if not done yet */
+static int stream_cache_open(FFStream *stream)
+{
+    StreamCache *cache = stream->cache;
+    int64_t stream_pos;
+    int i, len;
+
+    if (!cache) {
+        cache = av_mallocz(sizeof(StreamCache));
+        if (!cache)
+            return -1;
+        stream->cache = cache;
+    }
+    if (cache->fmt_in)
+        return 0;
+
+    if (av_open_input_file(&cache->fmt_in, stream->feed->feed_filename,
+                           stream->ifmt, FFM_PACKET_SIZE, stream->ap_in) < 0) {
+        http_log("%s not found", stream->feed->feed_filename);
+        cache->fmt_in = NULL;
+        return -1;
+    }
+    for(i=0;i<cache->fmt_in->nb_streams;i++)
+        open_parser(cache->fmt_in, i);
+
+    stream_pos = av_gettime() - stream->prebuffer * (int64_t)1000;
+    if (cache->fmt_in->iformat->read_seek)
+        cache->fmt_in->iformat->read_seek(cache->fmt_in, 0, stream_pos, 0);
+
+    /* new clients start at key frames of the video stream, if any */
+    cache->key_stream = -1;
+    for(i=0;i<stream->nb_streams;i++) {
+        if (cache->key_stream < 0 &&
+            stream->streams[i]->codec->codec_type == CODEC_TYPE_VIDEO)
+            cache->key_stream = i;
+    }
+    cache->key_pending = 0;
+
+    len = open_output_stream(&cache->fmt_ctx, stream, &cache->header);
+    if (len < 0) {
+        stream_cache_close(cache);
+        return -1;
+    }
+    cache->header_size = len;
+    return 0;
+}
+
+/* demux and mux the feed until one more chunk of output is cached.
+   Return 1 if the feed has no data yet, -1 at the end of the feed */
+static int stream_cache_read(FFStream *stream)
+{
+    StreamCache *cache = stream->cache;
+    AVFormatContext *ctx = &cache->fmt_ctx;
+    AVCodecContext *codec;
+    CacheChunk *chunk;
+    AVPacket pkt;
+    uint8_t *data;
+    int64_t write_index, size;
     int i, len, ret;
-    AVFormatContext *ctx;
 
-    av_freep(&c->pb_buffer);
-    switch(c->state) {
-    case HTTPSTATE_SEND_DATA_HEADER:
-        memset(&c->fmt_ctx, 0, sizeof(c->fmt_ctx));
-        pstrcpy(c->fmt_ctx.author, sizeof(c->fmt_ctx.author),
-                c->stream->author);
-        pstrcpy(c->fmt_ctx.comment, sizeof(c->fmt_ctx.comment),
-                c->stream->comment);
-        pstrcpy(c->fmt_ctx.copyright, sizeof(c->fmt_ctx.copyright),
-                c->stream->copyright);
-        pstrcpy(c->fmt_ctx.title, sizeof(c->fmt_ctx.title),
-                c->stream->title);
-
-        /* open output stream by using specified codecs */
-        c->fmt_ctx.oformat = c->stream->fmt;
-        c->fmt_ctx.nb_streams = c->stream->nb_streams;
-        for(i=0;i<c->fmt_ctx.nb_streams;i++) {
-            AVStream *st;
-            AVStream *src;
-            st = av_mallocz(sizeof(AVStream));
-            st->codec= avcodec_alloc_context();
-            c->fmt_ctx.streams[i] = st;
-            /* if file or feed, then just take streams from FFStream struct */
-            if (!c->stream->feed ||
-                c->stream->feed == c->stream)
-                src = c->stream->streams[i];
-            else
-                src = c->stream->feed->streams[c->stream->feed_streams[i]];
-
-            *st = *src;
-            st->priv_data = 0;
-            st->codec->frame_number = 0; /* XXX: should be done in
-                                           AVStream, not in codec */
-            /* I'm pretty sure that this is not correct...
-             * However, without it, we crash
-             */
-            st->codec->coded_frame = &dummy_frame;
+    feed_get_index(stream->feed->feed_state, &write_index, &size);
+    ffm_set_write_index(cache->fmt_in, write_index, size);
+    for(;;) {
+        if (av_read_frame(cache->fmt_in, &pkt) < 0)
+            return stream->feed->feed_state->opened ? 1 : -1;
+
+        /* select the right stream */
+        for(i=0;i<stream->nb_streams;i++) {
+            if (stream->feed_streams[i] == pkt.stream_index)
+                break;
+        }
+        if (i == stream->nb_streams) {
+            av_free_packet(&pkt);
+            continue;
         }
-        c->got_key_frame = 0;
+        if (pkt.dts != AV_NOPTS_VALUE)
+            pkt.dts = av_rescale_q(pkt.dts,
+                cache->fmt_in->streams[pkt.stream_index]->time_base,
+                ctx->streams[i]->time_base);
+        if (pkt.pts != AV_NOPTS_VALUE)
+            pkt.pts = av_rescale_q(pkt.pts,
+                cache->fmt_in->streams[pkt.stream_index]->time_base,
+                ctx->streams[i]->time_base);
+        pkt.stream_index = i;
+
+        codec = ctx->streams[i]->codec;
+        codec->coded_frame->key_frame = ((pkt.flags & PKT_FLAG_KEY) != 0);
+        if ((pkt.flags & PKT_FLAG_KEY) &&
+            (cache->key_stream < 0 || cache->key_stream == i))
+            cache->key_pending = 1;
 
-        /* prepare header and save header data in a stream */
-        if (url_open_dyn_buf(&c->fmt_ctx.pb) < 0) {
-            /* XXX: potential leak */
+        if (url_open_dyn_buf(&ctx->pb) < 0) {
+            av_free_packet(&pkt);
             return -1;
         }
-        c->fmt_ctx.pb.is_streamed = 1;
+        ret = av_write_frame(ctx, &pkt);
+        len = url_close_dyn_buf(&ctx->pb, &data);
+        codec->frame_number++;
+        av_free_packet(&pkt);
+        if (ret || len == 0) {
+            av_free(data);
+            if (ret)
+                return -1;
+            continue;
+        }
 
-        av_set_parameters(&c->fmt_ctx, NULL);
-        if (av_write_header(&c->fmt_ctx) < 0)
+        chunk = av_mallocz(sizeof(CacheChunk));
+        if (!chunk) {
+            av_free(data);
             return -1;
+        }
+        chunk->data = data;
+        chunk->size = len;
+        chunk->key = cache->key_pending;
+        chunk->refcount = 1;
+        cache->key_pending = 0;
+
+        if (cache->last)
+            cache->last->next = chunk;
+        else
+            cache->first = chunk;
+        cache->last = chunk;
+        if (chunk->key)
+            cache->last_key = chunk;
+        cache->size += len;
+
+        /* keep at least the chunks from the last key frame on */
+        while (cache->size > STREAM_CACHE_SIZE &&
+               cache->first != cache->last_key)
+            stream_cache_evict(cache);
+        return 0;
+    }
+}
 
-        len = url_close_dyn_buf(&c->fmt_ctx.pb, &c->pb_buffer);
-        c->buffer_ptr = c->pb_buffer;
-        c->buffer_end = c->pb_buffer + len;
+/* move a client to its next chunk of output. Return 1 if it must wait
+   for the feed */
+static int stream_cache_next(HTTPContext *c)
+{
+    StreamCache *cache = c->stream->cache;
+    CacheChunk *chunk = c->cache_chunk, *next;
+    int ret;
+
+    if (chunk && chunk->evicted) {
+        /* too slow for the stream: skip to the newest key frame */
+        cache->evictions++;
+        cache_chunk_unref(chunk);
+        chunk = c->cache_chunk = NULL;
+    }
+
+    next = chunk ? chunk->next : cache->last_key;
+    if (next) {
+        cache->hits++;
+    } else {
+        /* nobody has read this part of the feed yet */
+        cache->misses++;
+        ret = stream_cache_read(c->stream);
+        if (ret > 0) {
+            c->state = HTTPSTATE_WAIT_FEED;
+            return 1;
+        } else if (ret < 0) {
+            c->state = HTTPSTATE_SEND_DATA_TRAILER;
+            return 0;
+        }
+        next = chunk ? chunk->next : cache->last_key;
+        /* still waiting for a key frame to start with */
+        if (!next)
+            return 0;
+    }
+
+    next->refcount++;
+    if (chunk)
+        cache_chunk_unref(chunk);
+    c->cache_chunk = next;
+    c->buffer_ptr = next->data;
+    c->buffer_end = next->data + next->size;
+    return 0;
+}
+
+static int http_prepare_data(HTTPContext *c)
+{
+    int i, len, ret;
+    AVFormatContext *ctx;
+
+    av_freep(&c->pb_buffer);
+    switch(c->state) {
+    case HTTPSTATE_SEND_DATA_HEADER:
+        if (c->cached) {
+            /* the shared muxer wrote the header once for all */
+            c->buffer_ptr = c->stream->cache->header;
+            c->buffer_end = c->buffer_ptr + c->stream->cache->header_size;
+        } else {
+            len = open_output_stream(&c->fmt_ctx, c->stream, &c->pb_buffer);
+            if (len < 0)
+                return -1;
+            c->got_key_frame = 0;
+            c->buffer_ptr = c->pb_buffer;
+            c->buffer_end = c->pb_buffer + len;
+        }
 
         c->state = HTTPSTATE_SEND_DATA;
         c->last_packet_sent = 0;
         break;
     case HTTPSTATE_SEND_DATA:
+        if (c->cached) {
+            if (c->stream->max_time &&
+                c->stream->max_time + c->start_time - cur_time < 0) {
+                /* We have timed out */
+                c->state = HTTPSTATE_SEND_DATA_TRAILER;
+            } else if (stream_cache_next(c) > 0) {
+                return 1; /* state changed */
+            }
+            break;
+        }
         /* find a new packet */
         {
             AVPacket pkt;
 
             /* read a packet from the input stream */
             if (c->stream->feed) {
-                ffm_set_write_index(c->fmt_in,
-                                    c->stream->feed->feed_write_index,
-                                    c->stream->feed->feed_size);
+                int64_t write_index, size;
+
+                feed_get_index(c->stream->feed->feed_state, &write_index, &size);
+                ffm_set_write_index(c->fmt_in, write_index, size);
             }
 
             if (c->stream->max_time &&
@@ -2071,7 +2817,7 @@ static int http_prepare_data(HTTPContext *c)
             } else {
             redo:
                 if (av_read_frame(c->fmt_in, &pkt) < 0) {
-                    if (c->stream->feed && c->stream->feed->feed_opened) {
+                    if (c->stream->feed && c->stream->feed->feed_state->opened) {
                         /* if coming from feed, it means we reached the end of the
                            ffm file, so must wait for more data */
                         c->state = HTTPSTATE_WAIT_FEED;
@@ -2213,7 +2959,7 @@ static int http_prepare_data(HTTPContext *c)
     default:
     case HTTPSTATE_SEND_DATA_TRAILER:
         /* last packet test ? */
-        if (c->last_packet_sent || c->is_packetized)
+        if (c->last_packet_sent || c->is_packetized || c->cached)
             return -1;
         ctx = &c->fmt_ctx;
         /* prepare header */
@@ -2232,6 +2978,52 @@ static int http_prepare_data(HTTPContext *c)
     return 0;
 }
 
+/* send the next part of a file sent as it is. The kernel copies the
+   data directly to the socket when sendfile() is available */
+static int http_send_file(HTTPContext *c)
+{
+    int64_t left;
+    int len;
+
+    left = c->file_end - c->file_pos;
+    if (left > FILE_CHUNK_SIZE)
+        left = FILE_CHUNK_SIZE;
+    if (left <= 0) {
+        c->state = HTTPSTATE_SEND_DATA_TRAILER;
+        return 0;
+    }
+#ifdef HAVE_SYS_SENDFILE_H
+    {
+        off_t offset = c->file_pos;
+        len = sendfile(c->fd, c->file_fd, &offset, left);
+    }
+#else
+    if (left > c->buffer_size)
+        left = c->buffer_size;
+    len = pread(c->file_fd, c->buffer, left, c->file_pos);
+    if (len > 0)
+        len = send(c->fd, c->buffer, len, 0);
+#endif
+    if (len < 0) {
+        if (ff_neterrno() != FF_NETERROR(EAGAIN) &&
+            ff_neterrno() != FF_NETERROR(EINTR))
+            return -1;
+        return 0;
+    }
+    if (len == 0) {
+        /* the file was truncated */
+        c->state = HTTPSTATE_SEND_DATA_TRAILER;
+        return 0;
+    }
+    c->file_pos += len;
+    c->data_count += len;
+    update_datarate(&c->datarate, c->data_count);
+    c->stream->bytes_served += len;
+    if (c->file_pos >= c->file_end)
+        c->state = HTTPSTATE_SEND_DATA_TRAILER;
+    return 0;
+}
+
 /* should convert the format at the same time */
 /* send data starting at c->buffer_ptr to the output connection
    (either UDP or TCP connection) */
@@ -2239,6 +3031,9 @@ static int http_send_data(HTTPContext *c)
 {
     int len, ret;
 
+    if (c->file_fd >= 0)
+        return http_send_file(c);
+
     for(;;) {
         if (c->buffer_ptr >= c->buffer_end) {
             ret = http_prepare_data(c);
@@ -2276,9 +3071,9 @@ static int http_send_data(HTTPContext *c)
 
                 if (c->rtp_protocol == RTSP_PROTOCOL_RTP_TCP) {
                     /* RTP packets are sent inside the RTSP TCP connection */
-                    ByteIOContext pb1, *pb = &pb1;
                     int interleaved_index, size;
-                    uint8_t header[4];
+                    uint8_t header[4], *q;
+                    struct iovec iov[2];
                     HTTPContext *rtsp_c;
 
                     rtsp_c = c->rtsp_c;
@@ -2289,8 +3084,6 @@ static int http_send_data(HTTPContext *c)
                     if (rtsp_c->state != RTSPSTATE_WAIT_REQUEST) {
                         break;
                     }
-                    if (url_open_dyn_buf(pb) < 0)
-                        goto fail1;
                     interleaved_index = c->packet_stream_index * 2;
                     /* RTCP packets are sent at odd indexes */
                     if (c->buffer_ptr[1] == 200)
@@ -2300,32 +3093,39 @@ static int http_send_data(HTTPContext *c)
                     header[1] = interleaved_index;
                     header[2] = len >> 8;
                     header[3] = len;
-                    put_buffer(pb, header, 4);
-                    /* write RTP packet data */
                     c->buffer_ptr += 4;
-                    put_buffer(pb, c->buffer_ptr, len);
-                    size = url_close_dyn_buf(pb, &c->packet_buffer);
-                    /* prepare asynchronous TCP sending */
-                    rtsp_c->packet_buffer_ptr = c->packet_buffer;
-                    rtsp_c->packet_buffer_end = c->packet_buffer + size;
-                    c->buffer_ptr += len;
 
-                    /* send everything we can NOW */
-                    len = send(rtsp_c->fd, rtsp_c->packet_buffer_ptr,
-                                rtsp_c->packet_buffer_end - rtsp_c->packet_buffer_ptr, 0);
-                    if (len > 0) {
-                        rtsp_c->packet_buffer_ptr += len;
-                    }
-                    if (rtsp_c->packet_buffer_ptr < rtsp_c->packet_buffer_end) {
+                    /* send everything we can NOW, header and RTP packet
+                       data in one call */
+                    iov[0].iov_base = header;
+                    iov[0].iov_len = 4;
+                    iov[1].iov_base = c->buffer_ptr;
+                    iov[1].iov_len = len;
+                    size = writev(rtsp_c->fd, iov, 2);
+                    if (size < 0)
+                        size = 0;
+                    if (size < len + 4) {
                         /* if we could not send all the data, we will
-                           send it later, so a new state is needed to
-                           "lock" the RTSP TCP connection */
+                           send the rest later, so a new state is needed
+                           to "lock" the RTSP TCP connection */
+                        av_freep(&c->packet_buffer);
+                        c->packet_buffer = av_malloc(len + 4 - size);
+                        if (!c->packet_buffer)
+                            return -1;
+                        q = c->packet_buffer;
+                        if (size < 4) {
+                            memcpy(q, header + size, 4 - size);
+                            q += 4 - size;
+                            size = 4;
+                        }
+                        memcpy(q, c->buffer_ptr + size - 4, len + 4 - size);
+                        rtsp_c->packet_buffer_ptr = c->packet_buffer;
+                        rtsp_c->packet_buffer_end = q + len + 4 - size;
                         rtsp_c->state = RTSPSTATE_SEND_PACKET;
+                        c->buffer_ptr += len;
                         break;
-                    } else {
-                        /* all data has been sent */
-                        av_freep(&c->packet_buffer);
                     }
+                    c->buffer_ptr += len;
                 } else {
                     /* send RTP packet directly in UDP */
                     c->buffer_ptr += 4;
@@ -2363,7 +3163,7 @@ static int http_start_receive_data(HTTPContext *c)
 {
     int fd;
 
-    if (c->stream->feed_opened)
+    if (c->stream->feed_state->opened)
         return -1;
 
     /* Don't permit writing to this one */
@@ -2374,23 +3174,41 @@ static int http_start_receive_data(HTTPContext *c)
     fd = open(c->stream->feed_filename, O_RDWR);
     if (fd < 0)
         return -1;
+    /* another worker may be accepting a feeder at the same time */
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        close(fd);
+        return -1;
+    }
+    set_cloexec(fd);
     c->feed_fd = fd;
 
-    c->stream->feed_write_index = ffm_read_write_index(fd);
-    c->stream->feed_size = lseek(fd, 0, SEEK_END);
+    feed_set_index(c->stream->feed_state, ffm_read_write_index(fd),
+                   lseek(fd, 0, SEEK_END));
     lseek(fd, 0, SEEK_SET);
 
     /* init buffer input */
     c->buffer_ptr = c->buffer;
     c->buffer_end = c->buffer + FFM_PACKET_SIZE;
-    c->stream->feed_opened = 1;
+    c->stream->feed_state->opened = 1;
     return 0;
 }
 
-static int http_receive_data(HTTPContext *c)
+/* wake up the connections waiting for data from this feed */
+static void wake_feed_waiters(FFStream *feed)
 {
-    HTTPContext *c1;
+    HTTPContext *c;
+
+    feed_get_index(feed->feed_state, &feed->feed_seen_index, NULL);
+    for(c = first_http_ctx; c != NULL; c = c->next) {
+        if (c->state == HTTPSTATE_WAIT_FEED &&
+            c->stream->feed == feed) {
+            c->state = HTTPSTATE_SEND_DATA;
+        }
+    }
+}
 
+static int http_receive_data(HTTPContext *c)
+{
     if (c->buffer_end > c->buffer_ptr) {
         int len;
 
@@ -2421,34 +3239,35 @@ static int http_receive_data(HTTPContext *c)
 
     if (c->buffer_ptr >= c->buffer_end) {
         FFStream *feed = c->stream;
+        FeedState *fs = feed->feed_state;
         /* a packet has been received : write it in the store, except
            if header */
         if (c->data_count > FFM_PACKET_SIZE) {
+            int64_t write_index, size;
 
-            //            printf("writing pos=0x%"PRIx64" size=0x%"PRIx64"\n", feed->feed_write_index, feed->feed_size);
+            /* we are the only writer of this feed */
+            write_index = fs->write_index;
+            size = fs->size;
+            //            printf("writing pos=0x%"PRIx64" size=0x%"PRIx64"\n", write_index, size);
             /* XXX: use llseek or url_seek */
-            lseek(c->feed_fd, feed->feed_write_index, SEEK_SET);
+            lseek(c->feed_fd, write_index, SEEK_SET);
             write(c->feed_fd, c->buffer, FFM_PACKET_SIZE);
 
-            feed->feed_write_index += FFM_PACKET_SIZE;
+            write_index += FFM_PACKET_SIZE;
             /* update file size */
-            if (feed->feed_write_index > c->stream->feed_size)
-                feed->feed_size = feed->feed_write_index;
+            if (write_index > size)
+                size = write_index;
 
             /* handle wrap around if max file size reached */
-            if (c->stream->feed_max_size && feed->feed_write_index >= c->stream->feed_max_size)
-                feed->feed_write_index = FFM_PACKET_SIZE;
+            if (feed->feed_max_size && write_index >= feed->feed_max_size)
+                write_index = FFM_PACKET_SIZE;
+            feed_set_index(fs, write_index, size);
 
             /* write index */
-            ffm_write_write_index(c->feed_fd, feed->feed_write_index);
+            ffm_write_write_index(c->feed_fd, write_index);
 
             /* wake up any waiting connections */
-            for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
-                if (c1->state == HTTPSTATE_WAIT_FEED &&
-                    c1->stream->feed == c->stream->feed) {
-                    c1->state = HTTPSTATE_SEND_DATA;
-                }
-            }
+            wake_feed_waiters(feed->feed);
         } else {
             /* We have a header in our hands that contains useful data */
             AVFormatContext s;
@@ -2495,7 +3314,7 @@ static int http_receive_data(HTTPContext *c)
 
     return 0;
  fail:
-    c->stream->feed_opened = 0;
+    c->stream->feed_state->opened = 0;
     close(c->feed_fd);
     return -1;
 }
@@ -3107,6 +3926,7 @@ static HTTPContext *rtp_new_connection(struct sockaddr_in *from_addr,
         goto fail;
 
     c->fd = -1;
+    c->file_fd = -1;
     c->poll_entry = NULL;
     c->from_addr = *from_addr;
     c->buffer_size = IOBUFFER_INIT_SIZE;
@@ -3419,6 +4239,12 @@ static void build_file_streams(void)
                 for(i=0;i<infile->nb_streams;i++) {
                     add_av_stream1(stream, infile->streams[i]->codec);
                 }
+                /* the file can be sent as it is if neither the format
+                   nor the stream information change */
+                stream->passthrough = stream->fmt != &rtp_muxer &&
+                    !strcmp(infile->iformat->name, stream->fmt->name) &&
+                    !stream->author[0] && !stream->comment[0] &&
+                    !stream->copyright[0] && !stream->title[0];
                 av_close_input_file(infile);
             }
         }
@@ -3574,11 +4400,17 @@ static void build_feed_streams(void)
             exit(1);
         }
 
-        feed->feed_write_index = ffm_read_write_index(fd);
-        feed->feed_size = lseek(fd, 0, SEEK_END);
+        feed->feed_state = mallocz_shared(sizeof(FeedState));
+        if (!feed->feed_state) {
+            fprintf(stderr, "Could not allocate feed state\n");
+            exit(1);
+        }
+        feed->feed_state->write_index = ffm_read_write_index(fd);
+        feed->feed_state->size = lseek(fd, 0, SEEK_END);
+        feed->feed_seen_index = feed->feed_state->write_index;
         /* ensure that we do not wrap before the end of file */
-        if (feed->feed_max_size && feed->feed_max_size < feed->feed_size)
-            feed->feed_max_size = feed->feed_size;
+        if (feed->feed_max_size && feed->feed_max_size < feed->feed_state->size)
+            feed->feed_max_size = feed->feed_state->size;
 
         close(fd);
     }
@@ -3852,7 +4684,7 @@ static int parse_ffconfig(const char *filename)
         } else if (!strcasecmp(cmd, "MaxClients")) {
             get_arg(arg, sizeof(arg), &p);
             val = atoi(arg);
-            if (val < 1 || val > HTTP_MAX_CONNECTIONS) {
+            if (val < 1 || val > HTTP_MAX_CONNECTIONS * MAX_WORKERS) {
                 fprintf(stderr, "%s:%d: Invalid MaxClients: %s\n",
                         filename, line_num, arg);
                 errors++;
@@ -3869,6 +4701,16 @@ static int parse_ffconfig(const char *filename)
             } else {
                 max_bandwidth = val;
             }
+        } else if (!strcasecmp(cmd, "Workers")) {
+            get_arg(arg, sizeof(arg), &p);
+            val = atoi(arg);
+            if (val < 1 || val > MAX_WORKERS) {
+                fprintf(stderr, "%s:%d: Invalid Workers: %s\n",
+                        filename, line_num, arg);
+                errors++;
+            } else {
+                nb_workers = val;
+            }
         } else if (!strcasecmp(cmd, "CustomLog")) {
             get_arg(logfilename, sizeof(logfilename), &p);
         } else if (!strcasecmp(cmd, "<Feed")) {
@@ -4358,6 +5200,10 @@ static int parse_ffconfig(const char *filename)
             if (stream) {
                 stream->loop = 0;
             }
+        } else if (!strcasecmp(cmd, "NoSharedOutput")) {
+            if (stream) {
+                stream->no_shared_output = 1;
+            }
         } else if (!strcasecmp(cmd, "</Stream>")) {
             if (!stream) {
                 fprintf(stderr, "%s:%d: No corresponding <Stream> for </Stream>\n",
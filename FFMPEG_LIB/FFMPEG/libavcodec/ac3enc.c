@@ -27,11 +27,18 @@
 //#define DEBUG_BITALLOC
 #include "avcodec.h"
 #include "bitstream.h"
+#include "dsputil.h"
 #include "crc.h"
 #include "ac3.h"
 #include "internal.h"
 #include <math.h>
 
+#define MDCT_NBITS 9
+#define N         (1 << MDCT_NBITS)
+
+/* largest fixed-point coefficient, mantissas are 24 bit fractions */
+#define COEF_MAX  ((1 << 24) - 1)
+
 typedef struct AC3EncodeContext {
     PutBitContext pb;
     int nb_channels;
@@ -62,188 +69,24 @@ typedef struct AC3EncodeContext {
     int fsnroffst[AC3_MAX_CHANNELS];
     /* mantissa encoding */
     int mant1_cnt, mant2_cnt, mant4_cnt;
-} AC3EncodeContext;
 
-static int16_t costab[64];
-static int16_t sintab[64];
-static int16_t fft_rev[512];
-static int16_t xcos1[128];
-static int16_t xsin1[128];
+    DSPContext dsp;
+    MDCTContext mdct;
+    /* MDCT window, with the scale to 24 bit fixed-point coefficients
+       folded in */
+    DECLARE_ALIGNED_16(float, window[N]);
 
-#define MDCT_NBITS 9
-#define N         (1 << MDCT_NBITS)
+    /* analysis of the current frame, filled by the channel jobs */
+    const int16_t *samples;
+    int32_t mdct_coef[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
+    uint8_t exp[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
+    uint8_t exp_strategy[NB_BLOCKS][AC3_MAX_CHANNELS];
+    uint8_t encoded_exp[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
+} AC3EncodeContext;
 
 /* new exponents are sent if their Norm 1 exceed this number */
 #define EXP_DIFF_THRESHOLD 1000
 
-static void fft_init(int ln);
-
-static inline int16_t fix15(float a)
-{
-    int v;
-    v = (int)(a * (float)(1 << 15));
-    if (v < -32767)
-        v = -32767;
-    else if (v > 32767)
-        v = 32767;
-    return v;
-}
-
-typedef struct IComplex {
-    short re,im;
-} IComplex;
-
-static void fft_init(int ln)
-{
-    int i, j, m, n;
-    float alpha;
-
-    n = 1 << ln;
-
-    for(i=0;i<(n/2);i++) {
-        alpha = 2 * M_PI * (float)i / (float)n;
-        costab[i] = fix15(cos(alpha));
-        sintab[i] = fix15(sin(alpha));
-    }
-
-    for(i=0;i<n;i++) {
-        m=0;
-        for(j=0;j<ln;j++) {
-            m |= ((i >> j) & 1) << (ln-j-1);
-        }
-        fft_rev[i]=m;
-    }
-}
-
-/* butter fly op */
-#define BF(pre, pim, qre, qim, pre1, pim1, qre1, qim1) \
-{\
-  int ax, ay, bx, by;\
-  bx=pre1;\
-  by=pim1;\
-  ax=qre1;\
-  ay=qim1;\
-  pre = (bx + ax) >> 1;\
-  pim = (by + ay) >> 1;\
-  qre = (bx - ax) >> 1;\
-  qim = (by - ay) >> 1;\
-}
-
-#define MUL16(a,b) ((a) * (b))
-
-#define CMUL(pre, pim, are, aim, bre, bim) \
-{\
-   pre = (MUL16(are, bre) - MUL16(aim, bim)) >> 15;\
-   pim = (MUL16(are, bim) + MUL16(bre, aim)) >> 15;\
-}
-
-
-/* do a 2^n point complex fft on 2^ln points. */
-static void fft(IComplex *z, int ln)
-{
-    int        j, l, np, np2;
-    int        nblocks, nloops;
-    register IComplex *p,*q;
-    int tmp_re, tmp_im;
-
-    np = 1 << ln;
-
-    /* reverse */
-    for(j=0;j<np;j++) {
-        int k;
-        IComplex tmp;
-        k = fft_rev[j];
-        if (k < j) {
-            tmp = z[k];
-            z[k] = z[j];
-            z[j] = tmp;
-        }
-    }
-
-    /* pass 0 */
-
-    p=&z[0];
-    j=(np >> 1);
-    do {
-        BF(p[0].re, p[0].im, p[1].re, p[1].im,
-           p[0].re, p[0].im, p[1].re, p[1].im);
-        p+=2;
-    } while (--j != 0);
-
-    /* pass 1 */
-
-    p=&z[0];
-    j=np >> 2;
-    do {
-        BF(p[0].re, p[0].im, p[2].re, p[2].im,
-           p[0].re, p[0].im, p[2].re, p[2].im);
-        BF(p[1].re, p[1].im, p[3].re, p[3].im,
-           p[1].re, p[1].im, p[3].im, -p[3].re);
-        p+=4;
-    } while (--j != 0);
-
-    /* pass 2 .. ln-1 */
-
-    nblocks = np >> 3;
-    nloops = 1 << 2;
-    np2 = np >> 1;
-    do {
-        p = z;
-        q = z + nloops;
-        for (j = 0; j < nblocks; ++j) {
-
-            BF(p->re, p->im, q->re, q->im,
-               p->re, p->im, q->re, q->im);
-
-            p++;
-            q++;
-            for(l = nblocks; l < np2; l += nblocks) {
-                CMUL(tmp_re, tmp_im, costab[l], -sintab[l], q->re, q->im);
-                BF(p->re, p->im, q->re, q->im,
-                   p->re, p->im, tmp_re, tmp_im);
-                p++;
-                q++;
-            }
-            p += nloops;
-            q += nloops;
-        }
-        nblocks = nblocks >> 1;
-        nloops = nloops << 1;
-    } while (nblocks != 0);
-}
-
-/* do a 512 point mdct */
-static void mdct512(int32_t *out, int16_t *in)
-{
-    int i, re, im, re1, im1;
-    int16_t rot[N];
-    IComplex x[N/4];
-
-    /* shift to simplify computations */
-    for(i=0;i<N/4;i++)
-        rot[i] = -in[i + 3*N/4];
-    for(i=N/4;i<N;i++)
-        rot[i] = in[i - N/4];
-
-    /* pre rotation */
-    for(i=0;i<N/4;i++) {
-        re = ((int)rot[2*i] - (int)rot[N-1-2*i]) >> 1;
-        im = -((int)rot[N/2+2*i] - (int)rot[N/2-1-2*i]) >> 1;
-        CMUL(x[i].re, x[i].im, re, im, -xcos1[i], xsin1[i]);
-    }
-
-    fft(x, MDCT_NBITS - 2);
-
-    /* post rotation */
-    for(i=0;i<N/4;i++) {
-        re = x[i].re;
-        im = x[i].im;
-        CMUL(re1, im1, re, im, xsin1[i], xcos1[i]);
-        out[2*i] = im1;
-        out[N/2-1-2*i] = re1;
-    }
-}
-
 /* XXX: use another norm ? */
 static int calc_exp_diff(uint8_t *exp1, uint8_t *exp2, int n)
 {
@@ -466,6 +309,7 @@ static int bit_alloc(AC3EncodeContext *s,
                      int16_t mask[NB_BLOCKS][AC3_MAX_CHANNELS][50],
                      int16_t psd[NB_BLOCKS][AC3_MAX_CHANNELS][N/2],
                      uint8_t bap[NB_BLOCKS][AC3_MAX_CHANNELS][N/2],
+                     uint8_t exp_strategy[NB_BLOCKS][AC3_MAX_CHANNELS],
                      int frame_bits, int csnroffst, int fsnroffst)
 {
     int i, ch;
@@ -479,9 +323,14 @@ static int bit_alloc(AC3EncodeContext *s,
         s->mant2_cnt = 0;
         s->mant4_cnt = 0;
         for(ch=0;ch<s->nb_all_channels;ch++) {
-            ff_ac3_bit_alloc_calc_bap(mask[i][ch], psd[i][ch], 0,
-                                      s->nb_coefs[ch], snroffset,
-                                      s->bit_alloc.floor, bap[i][ch]);
+            /* psd and mask are shared with the previous block, so is
+               the allocation */
+            if (exp_strategy[i][ch] == EXP_REUSE)
+                memcpy(bap[i][ch], bap[i-1][ch], s->nb_coefs[ch]);
+            else
+                ff_ac3_bit_alloc_calc_bap(mask[i][ch], psd[i][ch], 0,
+                                          s->nb_coefs[ch], snroffset,
+                                          s->bit_alloc.floor, bap[i][ch]);
             frame_bits += compute_mantissa_size(s, bap[i][ch],
                                                  s->nb_coefs[ch]);
         }
@@ -494,8 +343,6 @@ static int bit_alloc(AC3EncodeContext *s,
     return 16 * s->frame_size - frame_bits;
 }
 
-#define SNR_INC1 4
-
 static int compute_bit_allocation(AC3EncodeContext *s,
                                   uint8_t bap[NB_BLOCKS][AC3_MAX_CHANNELS][N/2],
                                   uint8_t encoded_exp[NB_BLOCKS][AC3_MAX_CHANNELS][N/2],
@@ -503,8 +350,7 @@ static int compute_bit_allocation(AC3EncodeContext *s,
                                   int frame_bits)
 {
     int i, ch;
-    int csnroffst, fsnroffst;
-    uint8_t bap1[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
+    int snr_min, snr_max, snr;
     int16_t psd[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
     int16_t mask[NB_BLOCKS][AC3_MAX_CHANNELS][50];
     static int frame_bits_inc[8] = { 0, 0, 2, 2, 2, 4, 2, 4 };
@@ -567,46 +413,30 @@ static int compute_bit_allocation(AC3EncodeContext *s,
     /* calculate psd and masking curve before doing bit allocation */
     bit_alloc_masking(s, encoded_exp, exp_strategy, psd, mask);
 
-    /* now the big work begins : do the bit allocation. Modify the snr
-       offset until we can pack everything in the requested frame size */
-
-    csnroffst = s->csnroffst;
-    while (csnroffst >= 0 &&
-           bit_alloc(s, mask, psd, bap, frame_bits, csnroffst, 0) < 0)
-        csnroffst -= SNR_INC1;
-    if (csnroffst < 0) {
+    /* now the big work begins : do the bit allocation. The number of
+       mantissa bits grows with the snr offset, so bisect on the combined
+       (csnroffst << 4) + fsnroffst value for the largest one that still
+       fits in the requested frame size */
+    if (bit_alloc(s, mask, psd, bap, exp_strategy, frame_bits, 0, 0) < 0) {
         av_log(NULL, AV_LOG_ERROR, "Bit allocation failed, try increasing the bitrate, -ab 384 for example!\n");
         return -1;
     }
-    while ((csnroffst + SNR_INC1) <= 63 &&
-           bit_alloc(s, mask, psd, bap1, frame_bits,
-                     csnroffst + SNR_INC1, 0) >= 0) {
-        csnroffst += SNR_INC1;
-        memcpy(bap, bap1, sizeof(bap1));
-    }
-    while ((csnroffst + 1) <= 63 &&
-           bit_alloc(s, mask, psd, bap1, frame_bits, csnroffst + 1, 0) >= 0) {
-        csnroffst++;
-        memcpy(bap, bap1, sizeof(bap1));
-    }
-
-    fsnroffst = 0;
-    while ((fsnroffst + SNR_INC1) <= 15 &&
-           bit_alloc(s, mask, psd, bap1, frame_bits,
-                     csnroffst, fsnroffst + SNR_INC1) >= 0) {
-        fsnroffst += SNR_INC1;
-        memcpy(bap, bap1, sizeof(bap1));
-    }
-    while ((fsnroffst + 1) <= 15 &&
-           bit_alloc(s, mask, psd, bap1, frame_bits,
-                     csnroffst, fsnroffst + 1) >= 0) {
-        fsnroffst++;
-        memcpy(bap, bap1, sizeof(bap1));
+    snr_min = 0;            /* fits */
+    snr_max = 64 << 4;      /* out of range */
+    while (snr_max - snr_min > 1) {
+        snr = (snr_min + snr_max) >> 1;
+        if (bit_alloc(s, mask, psd, bap, exp_strategy, frame_bits,
+                      snr >> 4, snr & 15) >= 0)
+            snr_min = snr;
+        else
+            snr_max = snr;
     }
+    bit_alloc(s, mask, psd, bap, exp_strategy, frame_bits,
+              snr_min >> 4, snr_min & 15);
 
-    s->csnroffst = csnroffst;
+    s->csnroffst = snr_min >> 4;
     for(ch=0;ch<s->nb_all_channels;ch++)
-        s->fsnroffst[ch] = fsnroffst;
+        s->fsnroffst[ch] = snr_min & 15;
 #if defined(DEBUG_BITALLOC)
     {
         int j;
@@ -633,7 +463,6 @@ static int AC3_encode_init(AVCodecContext *avctx)
     int channels = avctx->channels;
     AC3EncodeContext *s = avctx->priv_data;
     int i, j, ch;
-    float alpha;
     static const uint8_t acmod_defs[6] = {
         0x01, /* C */
         0x02, /* L R */
@@ -699,12 +528,13 @@ static int AC3_encode_init(AVCodecContext *avctx)
     /* initial snr offset */
     s->csnroffst = 40;
 
-    /* mdct init */
-    fft_init(MDCT_NBITS - 2);
-    for(i=0;i<N/4;i++) {
-        alpha = 2 * M_PI * (i + 1.0 / 8.0) / (float)N;
-        xcos1[i] = fix15(-cos(alpha));
-        xsin1[i] = fix15(-sin(alpha));
+    /* mdct init. ff_mdct_calc() gives -2^23 times the normalized
+       coefficient for 16 bit input, the window scales it to 24 bits */
+    dsputil_init(&s->dsp, avctx);
+    if (ff_mdct_init(&s->mdct, MDCT_NBITS, 0) < 0)
+        return -1;
+    for(i=0;i<N/2;i++) {
+        s->window[i] = s->window[N-1-i] = ff_ac3_window[i] * (-2.0 / 32768.0);
     }
 
     avctx->coded_frame= avcodec_alloc_frame();
@@ -787,7 +617,6 @@ static void output_audio_block(AC3EncodeContext *s,
                                uint8_t encoded_exp[AC3_MAX_CHANNELS][N/2],
                                uint8_t bap[AC3_MAX_CHANNELS][N/2],
                                int32_t mdct_coefs[AC3_MAX_CHANNELS][N/2],
-                               int8_t global_exp[AC3_MAX_CHANNELS],
                                int block_num)
 {
     int ch, nb_groups, group_size, i, baie, rbnd;
@@ -935,7 +764,7 @@ static void output_audio_block(AC3EncodeContext *s,
 
         for(i=0;i<s->nb_coefs[ch];i++) {
             c = mdct_coefs[ch][i];
-            e = encoded_exp[ch][i] - global_exp[ch];
+            e = encoded_exp[ch][i];
             b = bap[ch][i];
             switch(b) {
             case 0:
@@ -1087,34 +916,6 @@ static unsigned int pow_poly(unsigned int a, unsigned int n, unsigned int poly)
 }
 
 
-/* compute log2(max(abs(tab[]))) */
-static int log2_tab(int16_t *tab, int n)
-{
-    int i, v;
-
-    v = 0;
-    for(i=0;i<n;i++) {
-        v |= abs(tab[i]);
-    }
-    return av_log2(v);
-}
-
-static void lshift_tab(int16_t *tab, int n, int lshift)
-{
-    int i;
-
-    if (lshift > 0) {
-        for(i=0;i<n;i++) {
-            tab[i] <<= lshift;
-        }
-    } else if (lshift < 0) {
-        lshift = -lshift;
-        for(i=0;i<n;i++) {
-            tab[i] >>= lshift;
-        }
-    }
-}
-
 /* fill the end of the frame and compute the two crcs */
 static int output_frame_end(AC3EncodeContext *s)
 {
@@ -1147,99 +948,103 @@ static int output_frame_end(AC3EncodeContext *s)
     return frame_size * 2;
 }
 
-static int AC3_encode_frame(AVCodecContext *avctx,
-                            unsigned char *frame, int buf_size, void *data)
+/* convert the coefficients of all the blocks of a channel to fixed-point
+   and compute their "exponents" in one pass */
+static void extract_exponents(AC3EncodeContext *s, int ch,
+                              float coef[NB_BLOCKS][N/2])
+{
+    int blk, i, c, v;
+
+    for(blk=0;blk<NB_BLOCKS;blk++) {
+        int32_t *fixed = s->mdct_coef[blk][ch];
+        uint8_t *exp = s->exp[blk][ch];
+        for(i=0;i<N/2;i++) {
+            c = av_clip(lrintf(coef[blk][i]), -COEF_MAX, COEF_MAX);
+            v = FFABS(c);
+            fixed[i] = c;
+            /* 24 for a zero coefficient */
+            exp[i] = 24 - av_log2(2*v + 1);
+        }
+    }
+}
+
+/* MDCT and exponent coding of the six blocks of one channel. Channels are
+   independent, so this runs as one job per channel. Returns the number of
+   bits used by the exponents. */
+static int analyze_channel(AVCodecContext *avctx, void *arg)
 {
     AC3EncodeContext *s = avctx->priv_data;
-    int16_t *samples = data;
-    int i, j, k, v, ch;
-    int16_t input_samples[N];
-    int32_t mdct_coef[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
-    uint8_t exp[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
-    uint8_t exp_strategy[NB_BLOCKS][AC3_MAX_CHANNELS];
-    uint8_t encoded_exp[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
-    uint8_t bap[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
-    int8_t exp_samples[NB_BLOCKS][AC3_MAX_CHANNELS];
-    int frame_bits;
+    int ch = (short (*)[256])arg - s->last_samples;
+    DECLARE_ALIGNED_16(float, input[N]);
+    DECLARE_ALIGNED_16(float, coef[NB_BLOCKS][N/2]);
+    DECLARE_ALIGNED_16(FFTSample, tmp[N/2]);
+    const int16_t *sptr;
+    int i, j, k, sinc, frame_bits;
+
+    sinc = s->nb_all_channels;
+    for(i=0;i<NB_BLOCKS;i++) {
+        /* compute input samples */
+        sptr = s->samples + (sinc * (N/2) * i) + ch;
+        for(j=0;j<N/2;j++) {
+            input[j] = s->last_samples[ch][j];
+            input[j + N/2] = s->last_samples[ch][j] = sptr[sinc * j];
+        }
 
-    frame_bits = 0;
-    for(ch=0;ch<s->nb_all_channels;ch++) {
-        /* fixed mdct to the six sub blocks & exponent computation */
-        for(i=0;i<NB_BLOCKS;i++) {
-            int16_t *sptr;
-            int sinc;
-
-            /* compute input samples */
-            memcpy(input_samples, s->last_samples[ch], N/2 * sizeof(int16_t));
-            sinc = s->nb_all_channels;
-            sptr = samples + (sinc * (N/2) * i) + ch;
-            for(j=0;j<N/2;j++) {
-                v = *sptr;
-                input_samples[j + N/2] = v;
-                s->last_samples[ch][j] = v;
-                sptr += sinc;
-            }
+        /* apply the MDCT window and do the MDCT */
+        s->dsp.vector_fmul(input, s->window, N);
+        ff_mdct_calc(&s->mdct, coef[i], input, tmp);
+    }
 
-            /* apply the MDCT window */
-            for(j=0;j<N/2;j++) {
-                input_samples[j] = MUL16(input_samples[j],
-                                         ff_ac3_window[j]) >> 15;
-                input_samples[N-j-1] = MUL16(input_samples[N-j-1],
-                                             ff_ac3_window[j]) >> 15;
-            }
+    extract_exponents(s, ch, coef);
 
-            /* Normalize the samples to use the maximum available
-               precision */
-            v = 14 - log2_tab(input_samples, N);
-            if (v < 0)
-                v = 0;
-            exp_samples[i][ch] = v - 9;
-            lshift_tab(input_samples, N, v);
-
-            /* do the MDCT */
-            mdct512(mdct_coef[i][ch], input_samples);
-
-            /* compute "exponents". We take into account the
-               normalization there */
-            for(j=0;j<N/2;j++) {
-                int e;
-                v = abs(mdct_coef[i][ch][j]);
-                if (v == 0)
-                    e = 24;
-                else {
-                    e = 23 - av_log2(v) + exp_samples[i][ch];
-                    if (e >= 24) {
-                        e = 24;
-                        mdct_coef[i][ch][j] = 0;
-                    }
-                }
-                exp[i][ch][j] = e;
-            }
-        }
+    compute_exp_strategy(s->exp_strategy, s->exp, ch, ch == s->lfe_channel);
 
-        compute_exp_strategy(exp_strategy, exp, ch, ch == s->lfe_channel);
-
-        /* compute the exponents as the decoder will see them. The
-           EXP_REUSE case must be handled carefully : we select the
-           min of the exponents */
-        i = 0;
-        while (i < NB_BLOCKS) {
-            j = i + 1;
-            while (j < NB_BLOCKS && exp_strategy[j][ch] == EXP_REUSE) {
-                exponent_min(exp[i][ch], exp[j][ch], s->nb_coefs[ch]);
-                j++;
-            }
-            frame_bits += encode_exp(encoded_exp[i][ch],
-                                     exp[i][ch], s->nb_coefs[ch],
-                                     exp_strategy[i][ch]);
-            /* copy encoded exponents for reuse case */
-            for(k=i+1;k<j;k++) {
-                memcpy(encoded_exp[k][ch], encoded_exp[i][ch],
-                       s->nb_coefs[ch] * sizeof(uint8_t));
-            }
-            i = j;
+    /* compute the exponents as the decoder will see them. The
+       EXP_REUSE case must be handled carefully : we select the
+       min of the exponents */
+    frame_bits = 0;
+    i = 0;
+    while (i < NB_BLOCKS) {
+        j = i + 1;
+        while (j < NB_BLOCKS && s->exp_strategy[j][ch] == EXP_REUSE) {
+            exponent_min(s->exp[i][ch], s->exp[j][ch], s->nb_coefs[ch]);
+            j++;
+        }
+        frame_bits += encode_exp(s->encoded_exp[i][ch],
+                                 s->exp[i][ch], s->nb_coefs[ch],
+                                 s->exp_strategy[i][ch]);
+        /* copy encoded exponents for reuse case */
+        for(k=i+1;k<j;k++) {
+            memcpy(s->encoded_exp[k][ch], s->encoded_exp[i][ch],
+                   s->nb_coefs[ch] * sizeof(uint8_t));
         }
+        i = j;
+    }
+    return frame_bits;
+}
+
+static int AC3_encode_frame(AVCodecContext *avctx,
+                            unsigned char *frame, int buf_size, void *data)
+{
+    AC3EncodeContext *s = avctx->priv_data;
+    uint8_t bap[NB_BLOCKS][AC3_MAX_CHANNELS][N/2];
+    void *args[AC3_MAX_CHANNELS];
+    int exp_bits[AC3_MAX_CHANNELS];
+    int i, ch, jobs;
+    int frame_bits;
+
+    /* fixed mdct to the six sub blocks & exponent computation, one job
+       per channel */
+    s->samples = data;
+    for(ch=0;ch<s->nb_all_channels;ch++)
+        args[ch] = s->last_samples[ch];
+    for(ch=0;ch<s->nb_all_channels;ch+=jobs) {
+        jobs = FFMIN(s->nb_all_channels - ch, FFMAX(avctx->thread_count, 1));
+        avctx->execute(avctx, analyze_channel, args + ch, exp_bits + ch, jobs);
     }
+    frame_bits = 0;
+    for(ch=0;ch<s->nb_all_channels;ch++)
+        frame_bits += exp_bits[ch];
 
     /* adjust for fractional frame sizes */
     while(s->bits_written >= s->bit_rate*1000 && s->samples_written >= s->sample_rate) {
@@ -1250,19 +1055,22 @@ static int AC3_encode_frame(AVCodecContext *avctx,
     s->bits_written += s->frame_size * 16;
     s->samples_written += AC3_FRAME_SIZE;
 
-    compute_bit_allocation(s, bap, encoded_exp, exp_strategy, frame_bits);
+    compute_bit_allocation(s, bap, s->encoded_exp, s->exp_strategy, frame_bits);
     /* everything is known... let's output the frame */
     output_frame_header(s, frame);
 
     for(i=0;i<NB_BLOCKS;i++) {
-        output_audio_block(s, exp_strategy[i], encoded_exp[i],
-                           bap[i], mdct_coef[i], exp_samples[i], i);
+        output_audio_block(s, s->exp_strategy[i], s->encoded_exp[i],
+                           bap[i], s->mdct_coef[i], i);
     }
     return output_frame_end(s);
 }
 
 static int AC3_encode_close(AVCodecContext *avctx)
 {
+    AC3EncodeContext *s = avctx->priv_data;
+
+    ff_mdct_end(&s->mdct);
     av_freep(&avctx->coded_frame);
     return 0;
 }
@@ -1271,75 +1079,6 @@ static int AC3_encode_close(AVCodecContext *avctx)
 /*************************************************************************/
 /* TEST */
 
-#define FN (N/4)
-
-void fft_test(void)
-{
-    IComplex in[FN], in1[FN];
-    int k, n, i;
-    float sum_re, sum_im, a;
-
-    /* FFT test */
-
-    for(i=0;i<FN;i++) {
-        in[i].re = random() % 65535 - 32767;
-        in[i].im = random() % 65535 - 32767;
-        in1[i] = in[i];
-    }
-    fft(in, 7);
-
-    /* do it by hand */
-    for(k=0;k<FN;k++) {
-        sum_re = 0;
-        sum_im = 0;
-        for(n=0;n<FN;n++) {
-            a = -2 * M_PI * (n * k) / FN;
-            sum_re += in1[n].re * cos(a) - in1[n].im * sin(a);
-            sum_im += in1[n].re * sin(a) + in1[n].im * cos(a);
-        }
-        printf("%3d: %6d,%6d %6.0f,%6.0f\n",
-               k, in[k].re, in[k].im, sum_re / FN, sum_im / FN);
-    }
-}
-
-void mdct_test(void)
-{
-    int16_t input[N];
-    int32_t output[N/2];
-    float input1[N];
-    float output1[N/2];
-    float s, a, err, e, emax;
-    int i, k, n;
-
-    for(i=0;i<N;i++) {
-        input[i] = (random() % 65535 - 32767) * 9 / 10;
-        input1[i] = input[i];
-    }
-
-    mdct512(output, input);
-
-    /* do it by hand */
-    for(k=0;k<N/2;k++) {
-        s = 0;
-        for(n=0;n<N;n++) {
-            a = (2*M_PI*(2*n+1+N/2)*(2*k+1) / (4 * N));
-            s += input1[n] * cos(a);
-        }
-        output1[k] = -2 * s / N;
-    }
-
-    err = 0;
-    emax = 0;
-    for(i=0;i<N/2;i++) {
-        printf("%3d: %7d %7.0f\n", i, output[i], output1[i]);
-        e = output[i] - output1[i];
-        if (e > emax)
-            emax = e;
-        err += e * e;
-    }
-    printf("err2=%f emax=%f\n", err / (N/2), emax);
-}
-
 void test_ac3(void)
 {
     AC3EncodeContext ctx;
@@ -1349,9 +1088,6 @@ void test_ac3(void)
 
     AC3_encode_init(&ctx, 44100, 64000, 1);
 
-    fft_test();
-    mdct_test();
-
     for(i=0;i<AC3_FRAME_SIZE;i++)
         samples[i] = (int)(sin(2*M_PI*i*1000.0/44100) * 10000);
     ret = AC3_encode_frame(&ctx, frame, samples);
@@ -202,6 +202,69 @@ static void simple_idct_ipp_add(uint8_t *dest, int line_size, DCTELEM *block)
 }
 #endif
 
+#if defined(HAVE_ARMV6) && defined(CONFIG_VP6_DECODER)
+/* rt = ra.lo * rb.lo + ra.hi * rb.hi + acc */
+#define SMLAD(ra, rb, acc)                                              \
+    ({ int __rt;                                                        \
+     asm ("smlad %0, %1, %2, %3" : "=r" (__rt) : "r" (ra), "r" (rb), "r" (acc)); \
+     __rt; })
+/* av_clip_uint8(a >> 7) */
+#define USAT8_ASR7(a)                                                   \
+    ({ int __rt;                                                        \
+     asm ("usat %0, #8, %1, asr #7" : "=r" (__rt) : "r" (a));          \
+     __rt; })
+
+/**
+ * 8 pixels wide 4 tap filter, taps at src-delta, src, src+delta and
+ * src+2*delta, delta being 1 or src_stride. Pixels n-1 and n+1 along
+ * the filter direction are paired in one register, the output at n+1
+ * reuses that pair with the other two weights.
+ */
+static void vp6_filter4_armv6(uint8_t *dst, int dst_stride,
+                              uint8_t *src, int src_stride,
+                              int delta, const int16_t *weights, int h)
+{
+    int w02 = (uint16_t)weights[0] | (uint16_t)weights[2] << 16;
+    int w13 = (uint16_t)weights[1] | (uint16_t)weights[3] << 16;
+    int p[9];
+    int x, y;
+
+    if (delta == 1) {
+        for (y=0; y<h; y++) {
+            for (x=0; x<9; x++)
+                p[x] = src[x-1] | src[x+1] << 16;
+            for (x=0; x<8; x++)
+                dst[x] = USAT8_ASR7(SMLAD(p[x+1], w13, SMLAD(p[x], w02, 64)));
+            src += src_stride;
+            dst += dst_stride;
+        }
+    } else {
+        for (x=0; x<8; x++) {
+            for (y=0; y<=h; y++)
+                p[y] = src[x+(y-1)*delta] | src[x+(y+1)*delta] << 16;
+            for (y=0; y<h; y++)
+                dst[x+y*dst_stride] = USAT8_ASR7(SMLAD(p[y+1], w13, SMLAD(p[y], w02, 64)));
+        }
+    }
+}
+
+static void vp6_filter_hv4_armv6(uint8_t *dst, uint8_t *src, int stride,
+                                 int delta, const int16_t *weights)
+{
+    vp6_filter4_armv6(dst, stride, src, stride, delta, weights, 8);
+}
+
+static void vp6_filter_diag4_armv6(uint8_t *dst, uint8_t *src, int stride,
+                                   const int16_t *h_weights,
+                                   const int16_t *v_weights)
+{
+    uint8_t tmp[8*11];
+
+    vp6_filter4_armv6(tmp, 8, src - stride, stride, 1, h_weights, 11);
+    vp6_filter4_armv6(dst, stride, tmp + 8, 8, 8, v_weights, 8);
+}
+#endif
+
 void dsputil_init_armv4l(DSPContext* c, AVCodecContext *avctx)
 {
     int idct_algo= avctx->idct_algo;
@@ -271,6 +334,11 @@ void dsputil_init_armv4l(DSPContext* c, AVCodecContext *avctx)
     c->put_no_rnd_pixels_tab[1][2] = put_no_rnd_pixels8_y2_arm; //OK
 /*     c->put_no_rnd_pixels_tab[1][3] = put_no_rnd_pixels8_xy2_arm;//NG */
 
+#if defined(HAVE_ARMV6) && defined(CONFIG_VP6_DECODER)
+    c->vp6_filter_hv4 = vp6_filter_hv4_armv6;
+    c->vp6_filter_diag4 = vp6_filter_diag4_armv6;
+#endif
+
 #ifdef HAVE_IWMMXT
     dsputil_init_iwmmxt(c, avctx);
 #endif
@@ -147,6 +147,11 @@ static void nop(uint8_t *block, const uint8_t *pixels, int line_size, int h)
     return;
 }
 
+#if 0
+extern void ff_snow_horizontal_compose97i_iwmmxt(DWTELEM *b, int width);
+extern void ff_snow_vertical_compose97i_iwmmxt(DWTELEM *b0, DWTELEM *b1, DWTELEM *b2, DWTELEM *b3, DWTELEM *b4, DWTELEM *b5, int width);
+#endif
+
 /* A run time test is not simple. If this file is compiled in
  * then we should install the functions
  */
@@ -202,4 +207,9 @@ void dsputil_init_iwmmxt(DSPContext* c, AVCodecContext *avctx)
     c->avg_no_rnd_pixels_tab[1][1] = avg_no_rnd_pixels8_x2_iwmmxt;
     c->avg_no_rnd_pixels_tab[1][2] = avg_no_rnd_pixels8_y2_iwmmxt;
     c->avg_no_rnd_pixels_tab[1][3] = avg_no_rnd_pixels8_xy2_iwmmxt;
+
+#if 0 /* not verified on iWMMXt yet, see snowdsp_iwmmxt.c */
+    c->horizontal_compose97i = ff_snow_horizontal_compose97i_iwmmxt;
+    c->vertical_compose97i = ff_snow_vertical_compose97i_iwmmxt;
+#endif
 }
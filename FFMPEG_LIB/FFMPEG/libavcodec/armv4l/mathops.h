@@ -35,6 +35,12 @@
      asm ("smull %0, %1, %2, %3" : "=&r"(lo), "=&r"(hi) : "r"(b), "r"(a));\
      hi; })
 
+/* signed 32x32 -> 64 multiply add accumulate, there is no subtracting */
+/* form so MLS64 negates one operand */
+#define MAC64(d, a, b) \
+    asm ("smlal %Q0, %R0, %1, %2" : "+r"(d) : "r"(a), "r"(b))
+#define MLS64(d, a, b) MAC64(d, -(a), b)
+
 #if defined(HAVE_ARMV5TE)
 
 /* signed 16x16 -> 32 multiply add accumulate */
@@ -45,5 +51,7 @@
         ({ int __rt;                                                    \
          asm ("smulbb %0, %1, %2" : "=r" (__rt) : "r" (ra), "r" (rb));  \
          __rt; })
+/* signed 16x16 -> 32 multiply subtract accumulate */
+#   define MLS16(rt, ra, rb) MAC16(rt, -(ra), rb)
 
 #endif
@@ -0,0 +1,297 @@
+/*
+ * iWMMXt optimized snow DSP utils
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "dsputil.h"
+#include "snow.h"
+
+/*
+ * This code has not been assembled or run yet, so it is neither built nor
+ * installed by dsputil_init_iwmmxt(). Enable it once snow-test passes on an
+ * iWMMXt CPU or emulator.
+ *
+ * The lifting steps work on pairs of 32 bit coefficients. Rows coming from
+ * the slice buffer are 8 byte aligned, the half row references are read
+ * with walignr and the neighbour pair is built with waligni. The loops stop
+ * a few coefficients early so they never read past the row, the C lead out
+ * code finishes the row.
+ */
+
+void ff_snow_horizontal_compose97i_iwmmxt(DWTELEM *b, int width)
+{
+    const int w2= (width+1)>>1;
+    DECLARE_ALIGNED_8(DWTELEM, temp[width>>1]);
+    const int w_l= (width>>1);
+    const int w_r= w2 - 1;
+    int i, n;
+
+    if((long)b & 7){
+        ff_snow_horizontal_compose97i(b, width);
+        return;
+    }
+
+    asm volatile(
+        "mov r12, #1 \n\t"
+        "tmcr wcgr0, r12 \n\t"
+        "mov r12, #3 \n\t"
+        "tmcr wcgr3, r12 \n\t"
+        "mov r12, #4 \n\t"
+        "tbcstw wr15, r12 \n\t"
+        "mov r12, #8 \n\t"
+        "tbcstw wr14, r12 \n\t"
+        "wzero wr13 \n\t"
+        ::: "r12");
+
+    { // Lift 0
+        DWTELEM * const ref = b + w2 - 1;
+        DWTELEM b_0 = b[0];
+        DWTELEM *dst = b;
+        DWTELEM *src = (DWTELEM*)((long)ref & ~7);
+
+        i = 0;
+        n = (w_l - 4) >> 1;
+        if(n > 0){
+            asm volatile(
+                "tmcr wcgr1, %[off] \n\t"
+                "wldrd wr0, [%[src]], #8 \n\t"
+                "wldrd wr1, [%[src]], #8 \n\t"
+                "walignr1 wr2, wr0, wr1 \n\t"
+                "1: \n\t"
+                "wldrd wr0, [%[src]], #8 \n\t"
+                "walignr1 wr3, wr1, wr0 \n\t"
+                "waligni wr4, wr2, wr3, #4 \n\t"
+                "waddw wr5, wr2, wr4 \n\t"      /* ref[i] + ref[i+1] */
+                "wsllwg wr6, wr5, wcgr0 \n\t"
+                "waddw wr5, wr5, wr6 \n\t"
+                "waddw wr5, wr5, wr15 \n\t"
+                "wsrawg wr5, wr5, wcgr3 \n\t"   /* (3*x + 4) >> 3 */
+                "wldrd wr7, [%[dst]] \n\t"
+                "wsubw wr7, wr7, wr5 \n\t"
+                "wstrd wr7, [%[dst]], #8 \n\t"
+                "wor wr1, wr0, wr0 \n\t"
+                "wor wr2, wr3, wr3 \n\t"
+                "subs %[n], %[n], #1 \n\t"
+                "bne 1b \n\t"
+                : [dst]"+r"(dst), [src]"+r"(src), [n]"+r"(n)
+                : [off]"r"((long)ref & 7)
+                : "memory");
+            i = dst - b;
+        }
+
+        snow_horizontal_compose_lift_lead_out(i, b, b, ref, width, w_l, 0, W_DM, W_DO, W_DS);
+        b[0] = b_0 - ((W_DM * 2 * ref[1]+W_DO)>>W_DS);
+    }
+
+    { // Lift 1
+        DWTELEM * const dst = b+w2;
+
+        /* align the destination, b is then read with walignr */
+        for(i = 0; (((long)&dst[i]) & 7) && i<w_r; i++){
+            dst[i] = dst[i] - (b[i] + b[i + 1]);
+        }
+
+        n = (w_r - i - 6) >> 1;
+        if(n > 0){
+            DWTELEM *d = dst + i;
+            DWTELEM *src = (DWTELEM*)((long)(b + i) & ~7);
+
+            asm volatile(
+                "tmcr wcgr1, %[off] \n\t"
+                "wldrd wr0, [%[src]], #8 \n\t"
+                "wldrd wr1, [%[src]], #8 \n\t"
+                "walignr1 wr2, wr0, wr1 \n\t"
+                "1: \n\t"
+                "wldrd wr0, [%[src]], #8 \n\t"
+                "walignr1 wr3, wr1, wr0 \n\t"
+                "waligni wr4, wr2, wr3, #4 \n\t"
+                "waddw wr5, wr2, wr4 \n\t"      /* b[i] + b[i+1] */
+                "wldrd wr7, [%[d]] \n\t"
+                "wsubw wr7, wr7, wr5 \n\t"
+                "wstrd wr7, [%[d]], #8 \n\t"
+                "wor wr1, wr0, wr0 \n\t"
+                "wor wr2, wr3, wr3 \n\t"
+                "subs %[n], %[n], #1 \n\t"
+                "bne 1b \n\t"
+                : [d]"+r"(d), [src]"+r"(src), [n]"+r"(n)
+                : [off]"r"((long)(b + i) & 7)
+                : "memory");
+            i = d - dst;
+        }
+
+        snow_horizontal_compose_lift_lead_out(i, dst, dst, b, width, w_r, 1, W_CM, W_CO, W_CS);
+    }
+
+    { // Lift 2
+        DWTELEM * const ref = b+w2 - 1;
+        DWTELEM b_0 = b[0];
+        DWTELEM *dst = b;
+        DWTELEM *src = (DWTELEM*)((long)ref & ~7);
+
+        i = 0;
+        n = (w_l - 4) >> 1;
+        if(n > 0){
+            asm volatile(
+                "mov r12, #2 \n\t"
+                "tmcr wcgr2, r12 \n\t"
+                "mov r12, #4 \n\t"
+                "tmcr wcgr3, r12 \n\t"
+                "tmcr wcgr1, %[off] \n\t"
+                "wldrd wr0, [%[src]], #8 \n\t"
+                "wldrd wr1, [%[src]], #8 \n\t"
+                "walignr1 wr2, wr0, wr1 \n\t"
+                "1: \n\t"
+                "wldrd wr0, [%[src]], #8 \n\t"
+                "walignr1 wr3, wr1, wr0 \n\t"
+                "waligni wr4, wr2, wr3, #4 \n\t"
+                "waddw wr5, wr2, wr4 \n\t"      /* ref[i] + ref[i+1] */
+                "wsubw wr5, wr14, wr5 \n\t"
+                "wldrd wr7, [%[dst]] \n\t"
+                "wsllwg wr6, wr7, wcgr2 \n\t"
+                "wsubw wr5, wr5, wr6 \n\t"
+                "wsrawg wr5, wr5, wcgr3 \n\t"   /* ((8 - x) - 4*b[i]) >> 4 */
+                "wsubw wr7, wr7, wr5 \n\t"
+                "wstrd wr7, [%[dst]], #8 \n\t"
+                "wor wr1, wr0, wr0 \n\t"
+                "wor wr2, wr3, wr3 \n\t"
+                "subs %[n], %[n], #1 \n\t"
+                "bne 1b \n\t"
+                : [dst]"+r"(dst), [src]"+r"(src), [n]"+r"(n)
+                : [off]"r"((long)ref & 7)
+                : "memory", "r12");
+            i = dst - b;
+        }
+
+        snow_horizontal_compose_liftS_lead_out(i, b, b, ref, width, w_l);
+        b[0] = b_0 - (((-2 * ref[1] + W_BO) - 4 * b_0) >> W_BS);
+    }
+
+    { // Lift 3
+        DWTELEM * const src = b+w2;
+        DWTELEM *t = temp;
+        DWTELEM *ref = b;
+        DWTELEM *s = (DWTELEM*)((long)src & ~7);
+
+        i = 0;
+        n = (w_r - 6) >> 1;
+        if(n > 0){
+            asm volatile(
+                "tmcr wcgr1, %[off] \n\t"
+                "wldrd wr0, [%[s]], #8 \n\t"
+                "wldrd wr1, [%[s]], #8 \n\t"
+                "wldrd wr8, [%[ref]], #8 \n\t"
+                "1: \n\t"
+                "wldrd wr9, [%[ref]], #8 \n\t"
+                "waligni wr4, wr8, wr9, #4 \n\t"
+                "waddw wr5, wr8, wr4 \n\t"      /* b[i] + b[i+1] */
+                "wsllwg wr6, wr5, wcgr0 \n\t"
+                "waddw wr5, wr5, wr6 \n\t"
+                "wsubw wr5, wr13, wr5 \n\t"
+                "wsrawg wr5, wr5, wcgr0 \n\t"   /* (-3*x) >> 1 */
+                "walignr1 wr2, wr0, wr1 \n\t"
+                "wsubw wr2, wr2, wr5 \n\t"
+                "wstrd wr2, [%[t]], #8 \n\t"
+                "wor wr0, wr1, wr1 \n\t"
+                "wldrd wr1, [%[s]], #8 \n\t"
+                "wor wr8, wr9, wr9 \n\t"
+                "subs %[n], %[n], #1 \n\t"
+                "bne 1b \n\t"
+                : [t]"+r"(t), [s]"+r"(s), [ref]"+r"(ref), [n]"+r"(n)
+                : [off]"r"((long)src & 7)
+                : "memory");
+            i = t - temp;
+        }
+
+        snow_horizontal_compose_lift_lead_out(i, temp, src, b, width, w_r, 1, -W_AM, W_AO, W_AS);
+    }
+
+    { // Interleave
+        snow_interleave_line_header(&i, width, b, temp);
+        snow_interleave_line_footer(&i, b, temp);
+    }
+}
+
+void ff_snow_vertical_compose97i_iwmmxt(DWTELEM *b0, DWTELEM *b1, DWTELEM *b2, DWTELEM *b3, DWTELEM *b4, DWTELEM *b5, int width)
+{
+    int i = width & ~1;
+    int n = width >> 1;
+
+    if(((long)b0 | (long)b1 | (long)b2 | (long)b3 | (long)b4 | (long)b5) & 7){
+        ff_snow_vertical_compose97i(b0, b1, b2, b3, b4, b5, width);
+        return;
+    }
+
+    if(n){
+        DWTELEM *p0 = b0, *p1 = b1, *p2 = b2, *p3 = b3, *p4 = b4, *p5 = b5;
+
+        asm volatile(
+            "mov r12, #1 \n\t"
+            "tmcr wcgr0, r12 \n\t"
+            "mov r12, #2 \n\t"
+            "tmcr wcgr1, r12 \n\t"
+            "mov r12, #3 \n\t"
+            "tmcr wcgr2, r12 \n\t"
+            "mov r12, #4 \n\t"
+            "tmcr wcgr3, r12 \n\t"
+            "tbcstw wr15, r12 \n\t"
+            "mov r12, #8 \n\t"
+            "tbcstw wr14, r12 \n\t"
+            "1: \n\t"
+            "wldrd wr3, [%[b3]] \n\t"
+            "wldrd wr5, [%[b5]], #8 \n\t"
+            "wldrd wr4, [%[b4]] \n\t"
+            "waddw wr6, wr3, wr5 \n\t"
+            "wsllwg wr7, wr6, wcgr0 \n\t"
+            "waddw wr6, wr6, wr7 \n\t"
+            "waddw wr6, wr6, wr15 \n\t"
+            "wsrawg wr6, wr6, wcgr2 \n\t"
+            "wsubw wr4, wr4, wr6 \n\t"      /* b4 -= (3*(b3 + b5) + 4) >> 3 */
+            "wstrd wr4, [%[b4]], #8 \n\t"
+            "wldrd wr2, [%[b2]] \n\t"
+            "waddw wr6, wr2, wr4 \n\t"
+            "wsubw wr3, wr3, wr6 \n\t"      /* b3 -= b2 + b4 */
+            "wstrd wr3, [%[b3]], #8 \n\t"
+            "wldrd wr1, [%[b1]] \n\t"
+            "waddw wr6, wr1, wr3 \n\t"
+            "wsllwg wr7, wr2, wcgr1 \n\t"
+            "waddw wr6, wr6, wr7 \n\t"
+            "waddw wr6, wr6, wr14 \n\t"
+            "wsrawg wr6, wr6, wcgr3 \n\t"
+            "waddw wr2, wr2, wr6 \n\t"      /* b2 += (b1 + b3 + 4*b2 + 8) >> 4 */
+            "wstrd wr2, [%[b2]], #8 \n\t"
+            "wldrd wr0, [%[b0]], #8 \n\t"
+            "waddw wr6, wr0, wr2 \n\t"
+            "wsllwg wr7, wr6, wcgr0 \n\t"
+            "waddw wr6, wr6, wr7 \n\t"
+            "wsrawg wr6, wr6, wcgr0 \n\t"
+            "waddw wr1, wr1, wr6 \n\t"      /* b1 += (3*(b0 + b2)) >> 1 */
+            "wstrd wr1, [%[b1]], #8 \n\t"
+            "subs %[n], %[n], #1 \n\t"
+            "bne 1b \n\t"
+            : [b0]"+r"(p0), [b1]"+r"(p1), [b2]"+r"(p2), [b3]"+r"(p3), [b4]"+r"(p4), [b5]"+r"(p5), [n]"+r"(n)
+            :
+            : "memory", "r12");
+    }
+
+    for(; i<width; i++){
+        b4[i] -= (W_DM*(b3[i] + b5[i])+W_DO)>>W_DS;
+        b3[i] -= (W_CM*(b2[i] + b4[i])+W_CO)>>W_CS;
+        b2[i] += (W_BM*(b1[i] + b3[i])+4*b2[i]+W_BO)>>W_BS;
+        b1[i] += (W_AM*(b0[i] + b2[i])+W_AO)>>W_AS;
+    }
+}
@@ -78,8 +78,8 @@
 #define AV_STRINGIFY(s)         AV_TOSTRING(s)
 #define AV_TOSTRING(s) #s
 
-#define LIBAVCODEC_VERSION_INT  ((51<<16)+(40<<8)+4)
-#define LIBAVCODEC_VERSION      51.40.4
+#define LIBAVCODEC_VERSION_INT  ((51<<16)+(46<<8)+0)
+#define LIBAVCODEC_VERSION      51.46.0
 #define LIBAVCODEC_BUILD        LIBAVCODEC_VERSION_INT
 
 #define LIBAVCODEC_IDENT        "Lavc" AV_STRINGIFY(LIBAVCODEC_VERSION)
@@ -370,6 +370,7 @@ enum Motion_Est_ID {
     ME_HEX,
     ME_UMH,
     ME_ITER,
+    ME_HIER,
 };
 
 enum AVDiscard{
@@ -454,6 +455,7 @@ typedef struct RcOverride{
 #define CODEC_FLAG2_SKIP_RD       0x00004000 ///< RD optimal MB level residual skipping
 #define CODEC_FLAG2_CHUNKS        0x00008000 ///< Input bitstream might be truncated at a packet boundaries instead of only at frame boundaries.
 #define CODEC_FLAG2_NON_LINEAR_QUANT 0x00010000 ///< Use MPEG-2 nonlinear quantizer.
+#define CODEC_FLAG2_WAVEFRONT     0x00020000 ///< Thread motion estimation by macroblock rows and code one slice per picture.
 
 /* Unsupported options :
  *              Syntax Arithmetic coding (SAC)
@@ -743,7 +745,23 @@ typedef struct AVPanScan{
      * - encoding: Set by user.\
      * - decoding: Set by libavcodec.\
      */\
-    int8_t *ref_index[2];
+    int8_t *ref_index[2];\
+\
+    /**\
+     * macroblock change map, mb_changed[mb]==0 if the MB is identical to the\
+     * previously output picture, a MB covers 16x16 pixels (16>>lowres with lowres)\
+     * stride= mb_changed_stride\
+     * - encoding: unused\
+     * - decoding: Set by libavcodec.\
+     */\
+    uint8_t *mb_changed;\
+\
+    /**\
+     * mb_changed stride, 0 if the decoder cannot tell which MBs changed\
+     * - encoding: unused\
+     * - decoding: Set by libavcodec.\
+     */\
+    int mb_changed_stride;
 
 #define FF_QSCALE_TYPE_MPEG1 0
 #define FF_QSCALE_TYPE_MPEG2 1
@@ -1347,6 +1365,7 @@ typedef struct AVCodecContext {
     int error_concealment;
 #define FF_EC_GUESS_MVS   1
 #define FF_EC_DEBLOCK     2
+#define FF_EC_COPY_REF    4 ///< only copy damaged MBs from the previous frame, overrides the other flags
 
     /**
      * dsp_mask could be add used to disable unwanted CPU features
@@ -2169,6 +2188,27 @@ typedef struct AVCodecContext {
      * - decoding: unused
      */
     int64_t timecode_frame_start;
+
+    /**
+     * number of frames the 1-pass ratecontrol looks ahead to plan VBV usage
+     * - encoding: Set by user.
+     * - decoding: unused
+     */
+    int rc_lookahead;
+
+    /**
+     * number of macroblocks concealed in the last decoded frame
+     * - encoding: unused
+     * - decoding: Set by libavcodec.
+     */
+    int concealed_mbs;
+
+    /**
+     * number of macroblocks concealed since the decoder was opened
+     * - encoding: unused
+     * - decoding: Set by libavcodec.
+     */
+    int64_t concealed_mbs_total;
 } AVCodecContext;
 
 /**
@@ -2515,8 +2555,12 @@ ReSampleContext *audio_resample_init(int output_channels, int input_channels,
 int audio_resample(ReSampleContext *s, short *output, short *input, int nb_samples);
 void audio_resample_close(ReSampleContext *s);
 
+/** maximum number of interleaved channels av_resample_multi() accepts */
+#define MAX_RESAMPLE_CHANNELS 8
+
 struct AVResampleContext *av_resample_init(int out_rate, int in_rate, int filter_length, int log2_phase_count, int linear, double cutoff);
 int av_resample(struct AVResampleContext *c, short *dst, short *src, int *consumed, int src_size, int dst_size, int update_ctx);
+int av_resample_multi(struct AVResampleContext *c, short *dst, short *src, int *consumed, int src_size, int dst_size, int channels, int update_ctx);
 void av_resample_compensate(struct AVResampleContext *c, int sample_delta, int compensation_distance);
 void av_resample_close(struct AVResampleContext *c);
 
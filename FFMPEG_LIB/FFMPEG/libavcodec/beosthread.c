@@ -118,6 +118,18 @@ int avcodec_thread_execute(AVCodecContext *s, int (*func)(AVCodecContext *c2, vo
     return 0;
 }
 
+/* give up the rest of the time slice while waiting for another job */
+void ff_thread_yield(void){
+    snooze(0);
+}
+
+/* order the memory accesses before and after it for the other threads */
+void ff_memory_barrier(void){
+    static vint32 tmp;
+    /* atomic operations are full barriers */
+    atomic_add(&tmp, 0);
+}
+
 int avcodec_thread_init(AVCodecContext *s, int thread_count){
     int i;
     ThreadContext *c;
@@ -179,20 +179,136 @@ void ff_init_cabac_states(CABACContext *c){
     }
 }
 
-#if 0 //selftest
+#ifdef TEST
 #define SIZE 10240
+#define SIG_MAPS 4096
 
 #include "avcodec.h"
 
+static const uint8_t sig_off_8x8[63]= {
+  0, 1, 2, 3, 4, 5, 5, 4, 4, 3, 3, 4, 4, 4, 5, 5,
+  4, 4, 4, 4, 3, 3, 6, 7, 7, 7, 8, 9,10, 9, 8, 7,
+  7, 6,11,12,13,11, 6, 7, 8, 9,14,10, 9, 8, 6,11,
+ 12,13,11, 6, 9,14,10, 9,11,12,13,11,14,10,12
+};
+static const uint8_t last_off_8x8[63]= {
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+  5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8
+};
+
+/**
+ * the per bin significance map loop decode_cabac_residual() used before
+ * decode_significance_c().
+ */
+static int decode_significance_bins(CABACContext *c, int max_coeff,
+                                    uint8_t *significant_coeff_ctx_base, uint8_t *last_coeff_ctx_base,
+                                    const uint8_t *sig_off, const uint8_t *last_off, int *index){
+    int last, coeff_count= 0;
+
+    for(last= 0; last < max_coeff - 1; last++){
+        if(get_cabac(c, significant_coeff_ctx_base + (sig_off ? sig_off[last] : last))){
+            index[coeff_count++]= last;
+            if(get_cabac(c, last_coeff_ctx_base + (last_off ? last_off[last] : last))){
+                last= max_coeff;
+                break;
+            }
+        }
+    }
+    if(last == max_coeff - 1)
+        index[coeff_count++]= last;
+    return coeff_count;
+}
+
+static int sig_map_size(int i){
+    static const int max_coeff[4]= {4, 15, 16, 64};
+    return max_coeff[i&3];
+}
+
+/**
+ * encodes SIG_MAPS random significance maps and decodes them with
+ * decode_significance_bins() if old is set, decode_significance_c() otherwise.
+ * @return the number of maps which did not decode to the encoded coefficients
+ */
+static int test_significance(uint8_t *b, int old){
+    CABACContext c;
+    uint8_t state[2*64];
+    static int sig[SIG_MAPS][64];
+    int index[64], expected[64];
+    int i, j, n, last, coeff_count, errors= 0;
+
+    srandom(0x5eed);
+    for(i=0; i<SIG_MAPS; i++){
+        int max_coeff= sig_map_size(i);
+        int density= 5 + random()%60;
+
+        do{
+            for(j=last=0; j<max_coeff; j++){
+                sig[i][j]= random()%100 < density*(max_coeff-j)/max_coeff;
+                last|= sig[i][j];
+            }
+        }while(!last);
+    }
+
+    ff_init_cabac_encoder(&c, b, 9*SIZE);
+    for(i=0; i<2*64; i++)
+        state[i]= (i*37)%126;
+
+    for(i=0; i<SIG_MAPS; i++){
+        int max_coeff= sig_map_size(i);
+        const uint8_t *sig_off = max_coeff == 64 ? sig_off_8x8  : NULL;
+        const uint8_t *last_off= max_coeff == 64 ? last_off_8x8 : NULL;
+
+        for(last=max_coeff-1; !sig[i][last]; last--);
+        for(j=0; j<max_coeff-1; j++){
+            put_cabac(&c, state + (sig_off ? sig_off[j] : j), sig[i][j]);
+            if(sig[i][j]){
+                put_cabac(&c, state + 64 + (last_off ? last_off[j] : j), j == last);
+                if(j == last)
+                    break;
+            }
+        }
+    }
+    put_cabac_terminate(&c, 1);
+
+    ff_init_cabac_decoder(&c, b, 9*SIZE);
+    for(i=0; i<2*64; i++)
+        state[i]= (i*37)%126;
+
+    for(i=0; i<SIG_MAPS; i++){
+        int max_coeff= sig_map_size(i);
+        const uint8_t *sig_off = max_coeff == 64 ? sig_off_8x8  : NULL;
+        const uint8_t *last_off= max_coeff == 64 ? last_off_8x8 : NULL;
+
+START_TIMER
+        if(old)
+            coeff_count= decode_significance_bins(&c, max_coeff, state, state + 64, sig_off, last_off, index);
+        else
+            coeff_count= decode_significance_c(&c, max_coeff, state, state + 64, sig_off, last_off, index);
+STOP_TIMER(old ? "decode_significance_bins" : "decode_significance_c")
+
+        for(j=n=0; j<max_coeff; j++)
+            if(sig[i][j])
+                expected[n++]= j;
+        if(coeff_count != n || memcmp(index, expected, n*sizeof(int)))
+            errors++;
+    }
+    if(!get_cabac_terminate(&c))
+        errors++;
+
+    return errors;
+}
+
 int main(){
     CABACContext c;
     uint8_t b[9*SIZE];
     uint8_t r[9*SIZE];
-    int i;
+    int i, ret= 0;
     uint8_t state[10]= {0};
 
     ff_init_cabac_encoder(&c, b, SIZE);
-    ff_init_cabac_states(&c, ff_h264_lps_range, ff_h264_mps_state, ff_h264_lps_state, 64);
+    ff_init_cabac_states(&c);
 
     for(i=0; i<SIZE; i++){
         r[i]= random()%7;
@@ -230,36 +346,56 @@ STOP_TIMER("put_cabac_ueg")
 
     for(i=0; i<SIZE; i++){
 START_TIMER
-        if( (r[i]&1) != get_cabac_bypass(&c) )
+        if( (r[i]&1) != get_cabac_bypass(&c) ){
             av_log(NULL, AV_LOG_ERROR, "CABAC bypass failure at %d\n", i);
+            ret= 1;
+        }
 STOP_TIMER("get_cabac_bypass")
     }
 
     for(i=0; i<SIZE; i++){
 START_TIMER
-        if( (r[i]&1) != get_cabac(&c, state) )
+        if( (r[i]&1) != get_cabac(&c, state) ){
             av_log(NULL, AV_LOG_ERROR, "CABAC failure at %d\n", i);
+            ret= 1;
+        }
 STOP_TIMER("get_cabac")
     }
-#if 0
+
     for(i=0; i<SIZE; i++){
 START_TIMER
-        if( r[i] != get_cabac_u(&c, state, (i&1) ? 6 : 7, 3, i&1) )
+        if( r[i] != get_cabac_u(&c, state, (i&1) ? 6 : 7, 3, i&1) ){
             av_log(NULL, AV_LOG_ERROR, "CABAC unary (truncated) binarization failure at %d\n", i);
+            ret= 1;
+        }
 STOP_TIMER("get_cabac_u")
     }
 
     for(i=0; i<SIZE; i++){
 START_TIMER
-        if( r[i] != get_cabac_ueg(&c, state, 3, 0, 1, 2))
+        if( r[i] != get_cabac_ueg(&c, state, 3, 0, 1, 2)){
             av_log(NULL, AV_LOG_ERROR, "CABAC unary (truncated) binarization failure at %d\n", i);
+            ret= 1;
+        }
 STOP_TIMER("get_cabac_ueg")
     }
-#endif
-    if(!get_cabac_terminate(&c))
+
+    if(!get_cabac_terminate(&c)){
         av_log(NULL, AV_LOG_ERROR, "where's the Terminator?\n");
+        ret= 1;
+    }
+
+    for(i=0; i<2; i++){
+        int errors= test_significance(b, !i);
+
+        if(errors){
+            av_log(NULL, AV_LOG_ERROR, "%s: %d significance maps differ\n",
+                   i ? "decode_significance_c" : "per bin loop", errors);
+            ret= 1;
+        }
+    }
 
-    return 0;
+    return ret;
 }
 
 #endif
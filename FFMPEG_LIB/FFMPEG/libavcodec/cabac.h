@@ -60,6 +60,26 @@ extern uint8_t ff_h264_mps_state[2*64];     ///< transIdxMPS
 extern uint8_t ff_h264_lps_state[2*64];     ///< transIdxLPS
 extern const uint8_t ff_h264_norm_shift[512];
 
+/* The ARMv5TE get_cabac and clz renormalization have only been checked
+ * against a C emulation, not run on ARM. Enable them once cabac-test passes
+ * on an ARMv5TE CPU or emulator. */
+#if 0 && defined(ARCH_ARMV4L) && defined(HAVE_ARMV5TE)
+#define CABAC_ARMV5TE 1
+#endif
+
+#ifdef CABAC_ARMV5TE
+/**
+ * number of left shifts which bring x to 0x100-0x1FF, same as
+ * ff_h264_norm_shift[x] but clz is cheaper than the table load.
+ */
+static av_always_inline int cabac_norm_shift(int x){
+    int shift;
+    asm("clz %0, %1" : "=r"(shift) : "r"(x));
+    return shift - 23;
+}
+#else
+#define cabac_norm_shift(x) ff_h264_norm_shift[x]
+#endif
 
 void ff_init_cabac_encoder(CABACContext *c, uint8_t *buf, int buf_size);
 void ff_init_cabac_decoder(CABACContext *c, const uint8_t *buf, int buf_size);
@@ -100,7 +120,11 @@ static void put_cabac(CABACContext *c, uint8_t * const state, int bit){
     }else{
         c->low += c->range - RangeLPS;
         c->range = RangeLPS;
+#ifdef BRANCHLESS_CABAC_DECODER
+        *state= ff_h264_mlps_state[127-*state];
+#else
         *state= ff_h264_lps_state[*state];
+#endif
     }
 
     renorm_cabac_encoder(c);
@@ -275,7 +299,7 @@ static void refill2(CABACContext *c){
     int i, x;
 
     x= c->low ^ (c->low-1);
-    i= 7 - ff_h264_norm_shift[x>>(CABAC_BITS-1)];
+    i= 7 - cabac_norm_shift(x>>(CABAC_BITS-1));
 
     x= -CABAC_MASK;
 
@@ -536,6 +560,37 @@ static av_always_inline int get_cabac_inline(CABACContext *c, uint8_t * const st
     );
     bit&=1;
 #endif /* BRANCHLESS_CABAC_DECODER */
+#elif defined(CABAC_ARMV5TE)
+    int bit, tmp, lps;
+    int low= c->low, range= c->range;
+
+    asm(
+        "ldrb   %[bit]  , %[state]                      \n\t"
+        "and    %[tmp]  , %[range], #0xC0               \n\t"
+        "add    %[tmp]  , %[bit]  , %[tmp], lsl #1      \n\t"
+        "ldrb   %[lps]  , [%[lps_range], %[tmp]]        \n\t" /*RangeLPS*/
+        "sub    %[range], %[range], %[lps]              \n\t"
+        "cmp    %[low]  , %[range], lsl #17             \n\t"
+        "subgt  %[low]  , %[low]  , %[range], lsl #17   \n\t"
+        "movgt  %[range], %[lps]                        \n\t"
+        "mvngt  %[bit]  , %[bit]                        \n\t" /*s^lps_mask*/
+        "ldrb   %[tmp]  , [%[mlps_state], %[bit]]       \n\t"
+        "strb   %[tmp]  , %[state]                      \n\t"
+        "and    %[bit]  , %[bit]  , #1                  \n\t"
+        "clz    %[tmp]  , %[range]                      \n\t"
+        "sub    %[tmp]  , %[tmp]  , #23                 \n\t" /*norm shift*/
+        "mov    %[range], %[range], lsl %[tmp]          \n\t"
+        "mov    %[low]  , %[low]  , lsl %[tmp]          \n\t"
+        : [bit]"=&r"(bit), [tmp]"=&r"(tmp), [lps]"=&r"(lps),
+          [low]"+r"(low), [range]"+r"(range), [state]"+m"(*state)
+        : [lps_range]"r"(ff_h264_lps_range), [mlps_state]"r"(ff_h264_mlps_state+128)
+        : "cc"
+    );
+
+    c->low  = low;
+    c->range= range;
+    if(!(low & CABAC_MASK))
+        refill2(c);
 #else /* defined(ARCH_X86) && defined(CONFIG_7REGS) && defined(HAVE_EBX_AVAILABLE) && !defined(BROKEN_RELOCATIONS) */
     int s = *state;
     int RangeLPS= ff_h264_lps_range[2*(c->range&0xC0) + s];
@@ -569,7 +624,7 @@ static av_always_inline int get_cabac_inline(CABACContext *c, uint8_t * const st
     *state= (ff_h264_mlps_state+128)[s];
     bit= s&1;
 
-    lps_mask= ff_h264_norm_shift[c->range];
+    lps_mask= cabac_norm_shift(c->range);
     c->range<<= lps_mask;
     c->low  <<= lps_mask;
     if(!(c->low & CABAC_MASK))
@@ -792,6 +847,41 @@ static int decode_significance_8x8_x86(CABACContext *c, uint8_t *significant_coe
 }
 #endif /* defined(ARCH_X86) && && defined(CONFIG_7REGS) && defined(HAVE_EBX_AVAILABLE) && !defined(BROKEN_RELOCATIONS) */
 
+/**
+ * decodes a significance map, C counterpart of decode_significance_x86() and
+ * decode_significance_8x8_x86(). The coder state is kept in a local copy for
+ * the whole map, so low and range stay in registers between the bins.
+ * @param sig_off  context offsets of the significant_coeff_flags, NULL for 0..max_coeff-2
+ * @param last_off context offsets of the last_significant_coeff_flags, NULL for 0..max_coeff-2
+ * @param index    receives the positions of the significant coefficients
+ * @return the number of significant coefficients
+ */
+static av_always_inline int decode_significance_c(CABACContext *c, int max_coeff,
+                                                  uint8_t *significant_coeff_ctx_base, uint8_t *last_coeff_ctx_base,
+                                                  const uint8_t *sig_off, const uint8_t *last_off, int *index){
+    CABACContext cc;
+    int last, coeff_count= 0;
+
+    cc.range     = c->range;
+    cc.low       = c->low;
+    cc.bytestream= c->bytestream;
+
+    for(last= 0; last < max_coeff - 1; last++){
+        if(get_cabac_inline(&cc, significant_coeff_ctx_base + (sig_off ? sig_off[last] : last))){
+            index[coeff_count++]= last;
+            if(get_cabac_inline(&cc, last_coeff_ctx_base + (last_off ? last_off[last] : last)))
+                goto end;
+        }
+    }
+    /* the last coefficient is significant if no earlier one was the last */
+    index[coeff_count++]= last;
+end:
+    c->range     = cc.range;
+    c->low       = cc.low;
+    c->bytestream= cc.bytestream;
+    return coeff_count;
+}
+
 /**
  *
  * @return the number of bytes read or 0 if no end
@@ -51,6 +51,7 @@
 #include "dsputil.h"
 #include "bytestream.h"
 #include "random.h"
+#include "mathops.h"
 
 #include "cookdata.h"
 #include "internal.h"
@@ -65,11 +66,23 @@
 #define SUBBAND_SIZE    20
 //#define COOKDEBUG
 
+/* Fixed point mode. The mlt coefficients of a frame share one exponent
+ * (block floating point), the time domain samples have TIME_FRAC_BITS
+ * fractional bits. Window, twiddle and coupling factors are 1.31, gain
+ * ramps 2.30 and the quantization centroids 4.28. */
+#define fixed32         int32_t
+#define TIME_FRAC_BITS  8
+#define CENTROID_BITS   28
+
 typedef struct {
     int *now;
     int *previous;
 } cook_gains;
 
+typedef struct {
+    fixed32 re, im;
+} cook_complex;
+
 typedef struct {
     GetBitContext       gb;
     /* stream data */
@@ -95,6 +108,14 @@ typedef struct {
     DECLARE_ALIGNED_16(FFTSample, mdct_tmp[1024]);  /* temporary storage for imlt */
     float*              mlt_window;
 
+    /* fixed point transform data */
+    int                 fixed_point;
+    fixed32*            mlt_window_fix;
+    fixed32             mdct_cos_fix[512];
+    fixed32             mdct_sin_fix[512];
+    cook_complex        fft_exptab_fix[256];
+    cook_complex        mdct_tmp_fix[512];
+
     /* gain buffers */
     cook_gains          gains1;
     cook_gains          gains2;
@@ -114,6 +135,10 @@ typedef struct {
     float               gain_table[23];
     float               pow2tab[127];
     float               rootpow2tab[127];
+    fixed32             gain_table_fix[23];
+    fixed32             cplscale_fix[63];
+    fixed32             quant_centroid_fix[2][7][14]; //[quant_index&1]: times sqrt(2)
+    fixed32             dither_fix[2][8];
 
     /* data buffers */
 
@@ -123,6 +148,11 @@ typedef struct {
     float               mono_previous_buffer2[1024];
     float               decode_buffer_1[1024];
     float               decode_buffer_2[1024];
+    fixed32             mono_mdct_output_fix[2048];
+    fixed32             mono_previous_fix1[1024];
+    fixed32             mono_previous_fix2[1024];
+    fixed32             decode_fix_1[1024];
+    fixed32             decode_fix_2[1024];
 } COOKContext;
 
 /* debug functions */
@@ -241,8 +271,227 @@ static int init_cook_mlt(COOKContext *q) {
     return 0;
 }
 
+/* float to fixed point with bits fractional bits, saturated */
+static fixed32 ftofix(double x, int bits)
+{
+    double v = x * (double)((int64_t)1 << bits);
+
+    if (v >= 2147483647.0)
+        return 0x7fffffff;
+    if (v <= -2147483647.0)
+        return -0x7fffffff;
+    return lrint(v);
+}
+
+/**
+ * Fixed point tables, converted from the float ones.
+ * Has to be called once the stream parameters are validated.
+ */
+static int init_cook_fixed(COOKContext *q) {
+    int i, j;
+    int mlt_size = q->samples_per_channel;
+    int n4 = mlt_size >> 1;     // quarter of the imdct size
+    float alpha;
+
+    if ((q->mlt_window_fix = av_malloc(sizeof(fixed32)*mlt_size)) == 0)
+        return -1;
+    for (i=0 ; i<mlt_size ; i++)
+        q->mlt_window_fix[i] = ftofix(q->mlt_window[i], 31);
+
+    for (i=0 ; i<n4 ; i++) {
+        q->mdct_cos_fix[i] = ftofix(q->mdct_ctx.tcos[i], 31);
+        q->mdct_sin_fix[i] = ftofix(q->mdct_ctx.tsin[i], 31);
+    }
+    /* inverse fft of n4 points */
+    for (i=0 ; i<n4/2 ; i++) {
+        alpha = 2 * M_PI * (float)i / (float)n4;
+        q->fft_exptab_fix[i].re = ftofix(cos(alpha), 31);
+        q->fft_exptab_fix[i].im = ftofix(sin(alpha), 31);
+    }
+
+    for (i=0 ; i<23 ; i++)
+        q->gain_table_fix[i] = ftofix(q->gain_table[i], 30);
+
+    for (i=0 ; i<7 ; i++) {
+        for (j=0 ; j<14 ; j++) {
+            q->quant_centroid_fix[0][i][j] = ftofix(quant_centroid_tab[i][j], CENTROID_BITS);
+            q->quant_centroid_fix[1][i][j] = ftofix(quant_centroid_tab[i][j] * M_SQRT2, CENTROID_BITS);
+        }
+    }
+    for (i=0 ; i<8 ; i++) {
+        q->dither_fix[0][i] = ftofix(dither_tab[i], CENTROID_BITS);
+        q->dither_fix[1][i] = ftofix(dither_tab[i] * M_SQRT2, CENTROID_BITS);
+    }
+
+    if (q->joint_stereo && q->js_vlc_bits >= 2) {
+        for (i=0 ; i<(1<<q->js_vlc_bits)-1 ; i++)
+            q->cplscale_fix[i] = ftofix(cplscales[q->js_vlc_bits-2][i], 31);
+    }
+    return 0;
+}
+
 /*************** init functions end ***********/
 
+/*************** fixed point helpers ***************/
+
+/* (x * y) >> shift, rounded, with a 64 bit product; 1 <= shift <= 63 */
+static inline fixed32 fixmul_shift(fixed32 x, fixed32 y, int shift)
+{
+    return (MUL64(x, y) + ((int64_t)1 << (shift - 1))) >> shift;
+}
+
+#define fixmul31(x, y)  fixmul_shift(x, y, 31)
+#define fixmul30(x, y)  fixmul_shift(x, y, 30)
+
+/* x * 2^shift, rounded when shifting right */
+static inline fixed32 fix_shift(fixed32 x, int shift)
+{
+    if (shift >= 0)
+        return x << shift;
+    if (shift < -31)
+        return 0;
+    return ((x >> (-shift - 1)) + 1) >> 1;
+}
+
+/* butter fly op */
+#define BF_FIX(pre, pim, qre, qim, pre1, pim1, qre1, qim1) \
+{\
+    fixed32 ax, ay, bx, by;\
+    bx=pre1;\
+    by=pim1;\
+    ax=qre1;\
+    ay=qim1;\
+    pre = (bx + ax);\
+    pim = (by + ay);\
+    qre = (bx - ax);\
+    qim = (by - ay);\
+}
+
+/* complex multiplication by a 1.31 factor: p = a * b */
+#define CMUL_FIX(pre, pim, are, aim, bre, bim) \
+{\
+    fixed32 _are = (are);\
+    fixed32 _aim = (aim);\
+    fixed32 _bre = (bre);\
+    fixed32 _bim = (bim);\
+    (pre) = (MUL64(_are, _bre) - MUL64(_aim, _bim) + (1 << 30)) >> 31;\
+    (pim) = (MUL64(_are, _bim) + MUL64(_aim, _bre) + (1 << 30)) >> 31;\
+}
+
+/**
+ * Inverse complex FFT of the fixed point imdct, see ff_fft_calc_c().
+ * Unscaled, the input must leave log2(size)+1 bits of headroom.
+ */
+static void fft_calc_fixed(COOKContext *q, cook_complex *z)
+{
+    int ln = q->mdct_ctx.fft.nbits;
+    int j, np, np2;
+    int nblocks, nloops;
+    register cook_complex *p, *r;
+    const cook_complex *exptab = q->fft_exptab_fix;
+    int l;
+    fixed32 tmp_re, tmp_im;
+
+    np = 1 << ln;
+
+    /* pass 0 */
+    p=&z[0];
+    j=(np >> 1);
+    do {
+        BF_FIX(p[0].re, p[0].im, p[1].re, p[1].im,
+               p[0].re, p[0].im, p[1].re, p[1].im);
+        p+=2;
+    } while (--j != 0);
+
+    /* pass 1 */
+    p=&z[0];
+    j=np >> 2;
+    do {
+        BF_FIX(p[0].re, p[0].im, p[2].re, p[2].im,
+               p[0].re, p[0].im, p[2].re, p[2].im);
+        BF_FIX(p[1].re, p[1].im, p[3].re, p[3].im,
+               p[1].re, p[1].im, -p[3].im, p[3].re);
+        p+=4;
+    } while (--j != 0);
+
+    /* pass 2 .. ln-1 */
+    nblocks = np >> 3;
+    nloops = 1 << 2;
+    np2 = np >> 1;
+    do {
+        p = z;
+        r = z + nloops;
+        for (j = 0; j < nblocks; ++j) {
+            BF_FIX(p->re, p->im, r->re, r->im,
+                   p->re, p->im, r->re, r->im);
+            p++;
+            r++;
+            for(l = nblocks; l < np2; l += nblocks) {
+                CMUL_FIX(tmp_re, tmp_im, exptab[l].re, exptab[l].im, r->re, r->im);
+                BF_FIX(p->re, p->im, r->re, r->im,
+                       p->re, p->im, tmp_re, tmp_im);
+                p++;
+                r++;
+            }
+            p += nloops;
+            r += nloops;
+        }
+        nblocks = nblocks >> 1;
+        nloops = nloops << 1;
+    } while (nblocks != 0);
+}
+
+/**
+ * Fixed point inverse MDCT, same output as ff_imdct_calc().
+ * @param output 2*samples_per_channel samples
+ * @param input  samples_per_channel coefficients, below 2^(31-nbits)
+ */
+static void imdct_fixed(COOKContext *q, fixed32 *output, const fixed32 *input)
+{
+    int k, n8, n4, n2, n, j;
+    const uint16_t *revtab = q->mdct_ctx.fft.revtab;
+    const fixed32 *tcos = q->mdct_cos_fix;
+    const fixed32 *tsin = q->mdct_sin_fix;
+    const fixed32 *in1, *in2;
+    cook_complex *z = q->mdct_tmp_fix;
+
+    n = 1 << q->mdct_ctx.nbits;
+    n2 = n >> 1;
+    n4 = n >> 2;
+    n8 = n >> 3;
+
+    /* pre rotation */
+    in1 = input;
+    in2 = input + n2 - 1;
+    for(k = 0; k < n4; k++) {
+        j=revtab[k];
+        CMUL_FIX(z[j].re, z[j].im, *in2, *in1, tcos[k], tsin[k]);
+        in1 += 2;
+        in2 -= 2;
+    }
+    fft_calc_fixed(q, z);
+
+    /* post rotation + reordering */
+    for(k = 0; k < n4; k++) {
+        CMUL_FIX(z[k].re, z[k].im, z[k].re, z[k].im, tcos[k], tsin[k]);
+    }
+    for(k = 0; k < n8; k++) {
+        output[2*k] = -z[n8 + k].im;
+        output[n2-1-2*k] = z[n8 + k].im;
+
+        output[2*k+1] = z[n8-1-k].re;
+        output[n2-1-2*k-1] = -z[n8-1-k].re;
+
+        output[n2 + 2*k]=-z[k+n8].re;
+        output[n-1- 2*k]=-z[k+n8].re;
+
+        output[n2 + 2*k+1]=z[n8-k-1].im;
+        output[n-2 - 2 * k] = z[n8-k-1].im;
+    }
+}
+
+/*************** fixed point helpers end ***********/
+
 /**
  * Cook indata decoding, every 32 bits are XORed with 0x37c511f2.
  * Why? No idea, some checksum/error detection method maybe.
@@ -299,6 +548,7 @@ static int cook_decode_close(AVCodecContext *avctx)
 
     /* Free allocated memory buffers. */
     av_free(q->mlt_window);
+    av_free(q->mlt_window_fix);
     av_free(q->decoded_bytes_buffer);
 
     /* Free the transform. */
@@ -521,6 +771,50 @@ static void scalar_dequant(COOKContext *q, int index, int quant_index,
         mlt_p[i] = f1 * q->rootpow2tab[quant_index+63];
     }
 }
+
+/**
+ * Fixed point scalar_dequant(), the result is scaled by 2^-scale.
+ *
+ * @param scale                 exponent of the frame, see fixed_scale()
+ */
+
+static void scalar_dequant_fixed(COOKContext *q, int index, int quant_index,
+                                 int* subband_coef_index, int* subband_coef_sign,
+                                 fixed32* mlt_p, int scale){
+    int i, shift;
+    fixed32 f1;
+
+    /* 2^(quant_index/2) is a shift, and a factor sqrt(2) in the tables */
+    shift = CENTROID_BITS + scale - (quant_index >> 1);
+    for(i=0 ; i<SUBBAND_SIZE ; i++) {
+        if (subband_coef_index[i]) {
+            f1 = q->quant_centroid_fix[quant_index & 1][index][subband_coef_index[i]];
+            if (subband_coef_sign[i]) f1 = -f1;
+        } else {
+            /* noise coding if subband_coef_index[i] == 0 */
+            f1 = q->dither_fix[quant_index & 1][index];
+            if (av_random(&q->random_state) < 0x80000000) f1 = -f1;
+        }
+        mlt_p[i] = fix_shift(f1, -shift);
+    }
+}
+
+/**
+ * Exponent of the fixed point mlt coefficients of a frame. It is chosen
+ * from the largest quantization index so that the coefficients stay below
+ * 2^(31-nbits), which is the headroom the fixed point imdct needs.
+ *
+ * @param quant_index_table     pointer to the array
+ * @param bands                 number of used entries
+ */
+
+static int fixed_scale(COOKContext *q, int* quant_index_table, int bands){
+    int i, qmax = quant_index_table[0];
+
+    for(i=1 ; i<bands ; i++)
+        qmax = FFMAX(qmax, quant_index_table[i]);
+    return (qmax >> 1) + q->mdct_ctx.nbits - CENTROID_BITS;
+}
 /**
  * Unpack the subband_coef_index and subband_coef_sign vectors.
  *
@@ -565,6 +859,35 @@ static int unpack_SQVH(COOKContext *q, int category, int* subband_coef_index,
 }
 
 
+/**
+ * Unpack the coefficients of one subband.
+ *
+ * @param q                     pointer to the COOKContext
+ * @param category              pointer to the category array
+ * @param band                  subband
+ * @param subband_coef_index    array of indexes to quant_centroid_tab
+ * @param subband_coef_sign     signs of coefficients
+ * @return                      index for the dequantization
+ */
+
+static int unpack_band(COOKContext* q, int* category, int band,
+                       int* subband_coef_index, int* subband_coef_sign){
+    int j;
+    int index = category[band];
+
+    if(category[band] < 7){
+        if(unpack_SQVH(q, category[band], subband_coef_index, subband_coef_sign)){
+            index=7;
+            for(j=0 ; j<q->total_subbands ; j++) category[band+j]=7;
+        }
+    }
+    if(index==7) {
+        memset(subband_coef_index, 0, SUBBAND_SIZE*sizeof(int));
+        memset(subband_coef_sign, 0, SUBBAND_SIZE*sizeof(int));
+    }
+    return index;
+}
+
 /**
  * Fill the mlt_buffer with mlt coefficients.
  *
@@ -583,21 +906,11 @@ static void decode_vectors(COOKContext* q, int* category,
     /* A zero in this table means that the subband coefficient is a
        positive multiplicator. */
     int subband_coef_sign[SUBBAND_SIZE];
-    int band, j;
+    int band;
     int index=0;
 
     for(band=0 ; band<q->total_subbands ; band++){
-        index = category[band];
-        if(category[band] < 7){
-            if(unpack_SQVH(q, category[band], subband_coef_index, subband_coef_sign)){
-                index=7;
-                for(j=0 ; j<q->total_subbands ; j++) category[band+j]=7;
-            }
-        }
-        if(index==7) {
-            memset(subband_coef_index, 0, sizeof(subband_coef_index));
-            memset(subband_coef_sign, 0, sizeof(subband_coef_sign));
-        }
+        index = unpack_band(q, category, band, subband_coef_index, subband_coef_sign);
         scalar_dequant(q, index, quant_index_table[band],
                        subband_coef_index, subband_coef_sign,
                        &mlt_buffer[band * 20]);
@@ -610,28 +923,75 @@ static void decode_vectors(COOKContext* q, int* category,
 
 
 /**
- * function for decoding mono data
+ * Fixed point decode_vectors().
  *
- * @param q                 pointer to the COOKContext
- * @param mlt_buffer        pointer to mlt coefficients
+ * @return                  exponent of the mlt coefficients
  */
 
-static void mono_decode(COOKContext *q, float* mlt_buffer) {
+static int decode_vectors_fixed(COOKContext* q, int* category,
+                                int *quant_index_table, fixed32* mlt_buffer){
+    int subband_coef_index[SUBBAND_SIZE];
+    int subband_coef_sign[SUBBAND_SIZE];
+    int band, index, scale;
+
+    scale = fixed_scale(q, quant_index_table, q->total_subbands);
+    for(band=0 ; band<q->total_subbands ; band++){
+        index = unpack_band(q, category, band, subband_coef_index, subband_coef_sign);
+        scalar_dequant_fixed(q, index, quant_index_table[band],
+                             subband_coef_index, subband_coef_sign,
+                             &mlt_buffer[band * 20], scale);
+    }
+    return scale;
+}
 
+
+/**
+ * Decode the envelope and the category of every subband.
+ *
+ * @param q                 pointer to the COOKContext
+ * @param quant_index_table pointer to the array
+ * @param category          pointer to the category array
+ */
+
+static void decode_categories(COOKContext *q, int* quant_index_table,
+                              int* category) {
     int category_index[128];
-    int quant_index_table[102];
-    int category[128];
 
-    memset(&category, 0, 128*sizeof(int));
+    memset(category, 0, 128*sizeof(int));
     memset(&category_index, 0, 128*sizeof(int));
 
     decode_envelope(q, quant_index_table);
     q->num_vectors = get_bits(&q->gb,q->log2_numvector_size);
     categorize(q, quant_index_table, category, category_index);
     expand_category(q, category, category_index);
+}
+
+
+/**
+ * function for decoding mono data
+ *
+ * @param q                 pointer to the COOKContext
+ * @param mlt_buffer        pointer to mlt coefficients
+ */
+
+static void mono_decode(COOKContext *q, float* mlt_buffer) {
+
+    int quant_index_table[102];
+    int category[128];
+
+    decode_categories(q, quant_index_table, category);
     decode_vectors(q, category, quant_index_table, mlt_buffer);
 }
 
+static int mono_decode_fixed(COOKContext *q, fixed32* mlt_buffer) {
+
+    int quant_index_table[102];
+    int category[128];
+
+    decode_categories(q, quant_index_table, category);
+    return decode_vectors_fixed(q, category, quant_index_table, mlt_buffer);
+}
+
 
 /**
  * the actual requantization of the timedomain samples
@@ -663,6 +1023,36 @@ static void interpolate(COOKContext *q, float* buffer,
     }
 }
 
+static void interpolate_fixed(COOKContext *q, fixed32* buffer,
+                              int gain_index, int gain_index_next){
+    int i, exp;
+    fixed32 fc1, fc2;
+
+    if(gain_index == gain_index_next){              //static gain
+        for(i=0 ; i<q->gain_size_factor ; i++){
+            buffer[i] = fix_shift(buffer[i], gain_index);
+        }
+        return;
+    } else {                                        //smooth gain
+        /* fc1 = 2^exp * [0.5, 1) in 2.30 */
+        fc1 = 1 << 29;
+        exp = gain_index + 1;
+        fc2 = q->gain_table_fix[11 + (gain_index_next-gain_index)];
+        for(i=0 ; i<q->gain_size_factor ; i++){
+            buffer[i] = fixmul_shift(buffer[i], fc1, 30 - exp);
+            fc1 = fixmul30(fc1, fc2);
+            if (fc1 >= 1 << 30) {
+                fc1 >>= 1;
+                exp++;
+            } else if (fc1 < 1 << 29) {
+                fc1 <<= 1;
+                exp--;
+            }
+        }
+        return;
+    }
+}
+
 
 /**
  * The modulated lapped transform, this takes transform coefficients
@@ -711,6 +1101,48 @@ static void imlt_gain(COOKContext *q, float *inbuffer,
     memcpy(previous_buffer, buffer0, sizeof(float)*q->samples_per_channel);
 }
 
+/**
+ * Fixed point imlt_gain(). The previous block is saved already windowed,
+ * in the time domain format, which needs no more range than the output.
+ *
+ * @param scale             exponent of the mlt coefficients
+ */
+
+static void imlt_gain_fixed(COOKContext *q, fixed32 *inbuffer, int scale,
+                            cook_gains *gains_ptr, fixed32* previous_buffer)
+{
+    fixed32 *buffer0 = q->mono_mdct_output_fix;
+    fixed32 *buffer1 = q->mono_mdct_output_fix + q->samples_per_channel;
+    const fixed32 *window = q->mlt_window_fix;
+    int n = q->samples_per_channel;
+    int i, shift0, shift1;
+
+    imdct_fixed(q, q->mono_mdct_output_fix, inbuffer);
+
+    /* The window is 1.31, fold the exponent and the gain, a power of 2,
+     * into the shift of the window multiplication. */
+    shift1 = av_clip(31 - scale - TIME_FRAC_BITS - gains_ptr->previous[0], 1, 63);
+    shift0 = av_clip(31 - scale - TIME_FRAC_BITS, 1, 63);
+
+    /* Apply window and overlap */
+    for(i = 0; i < n; i++){
+        buffer1[i] = fixmul_shift(buffer1[i], window[i], shift1) -
+                     previous_buffer[i];
+    }
+
+    /* Apply gain profile */
+    for (i = 0; i < 8; i++) {
+        if (gains_ptr->now[i] || gains_ptr->now[i + 1])
+            interpolate_fixed(q, &buffer1[q->gain_size_factor * i],
+                              gains_ptr->now[i], gains_ptr->now[i + 1]);
+    }
+
+    /* Save away the current to be previous block. */
+    for(i = 0; i < n; i++){
+        previous_buffer[i] = fixmul_shift(buffer0[i], window[n - 1 - i], shift0);
+    }
+}
+
 
 /**
  * function for getting the jointstereo coupling information
@@ -795,6 +1227,52 @@ static void joint_decode(COOKContext *q, float* mlt_buffer1,
     }
 }
 
+/**
+ * Fixed point joint_decode().
+ *
+ * @return                  exponent of both mlt buffers
+ */
+
+static int joint_decode_fixed(COOKContext *q, fixed32* mlt_buffer1,
+                              fixed32* mlt_buffer2) {
+    int i,j;
+    int decouple_tab[SUBBAND_SIZE];
+    fixed32 decode_buffer[1060];
+    int idx, cpl_tmp,tmp_idx, scale;
+    fixed32 f1,f2;
+
+    memset(decouple_tab, 0, sizeof(decouple_tab));
+    memset(decode_buffer, 0, sizeof(decode_buffer));
+
+    memset(mlt_buffer1,0, 1024*sizeof(fixed32));
+    memset(mlt_buffer2,0, 1024*sizeof(fixed32));
+    decouple_info(q, decouple_tab);
+    scale = mono_decode_fixed(q, decode_buffer);
+
+    for (i=0 ; i<q->js_subband_start ; i++) {
+        for (j=0 ; j<SUBBAND_SIZE ; j++) {
+            mlt_buffer1[i*20+j] = decode_buffer[i*40+j];
+            mlt_buffer2[i*20+j] = decode_buffer[i*40+20+j];
+        }
+    }
+
+    /* The coupling scales are at most 1, no change of exponent needed. */
+    idx = (1 << q->js_vlc_bits) - 1;
+    for (i=q->js_subband_start ; i<q->subbands ; i++) {
+        cpl_tmp = cplband[i];
+        idx -=decouple_tab[cpl_tmp];
+        f1 = q->cplscale_fix[decouple_tab[cpl_tmp]];
+        f2 = q->cplscale_fix[idx-1];
+        for (j=0 ; j<SUBBAND_SIZE ; j++) {
+            tmp_idx = ((q->js_subband_start + i)*20)+j;
+            mlt_buffer1[20*i + j] = fixmul31(f1, decode_buffer[tmp_idx]);
+            mlt_buffer2[20*i + j] = fixmul31(f2, decode_buffer[tmp_idx]);
+        }
+        idx = (1 << q->js_vlc_bits) - 1;
+    }
+    return scale;
+}
+
 /**
  * First part of subpacket decoding:
  *  decode raw stream bytes and read gain info.
@@ -851,6 +1329,23 @@ mlt_compensate_output(COOKContext *q, float *decode_buffer,
     }
 }
 
+static inline void
+mlt_compensate_output_fixed(COOKContext *q, fixed32 *decode_buffer, int scale,
+                            cook_gains *gains, fixed32 *previous_buffer,
+                            int16_t *out, int chan)
+{
+    fixed32 *output = q->mono_mdct_output_fix + q->samples_per_channel;
+    int j;
+
+    imlt_gain_fixed(q, decode_buffer, scale, gains, previous_buffer);
+
+    for (j = 0; j < q->samples_per_channel; j++) {
+        out[chan + q->nb_channels * j] =
+          av_clip((output[j] + (1 << (TIME_FRAC_BITS - 1))) >> TIME_FRAC_BITS,
+                  -32768, 32767);
+    }
+}
+
 
 /**
  * Cook subpacket decoding. This function returns one decoded subpacket,
@@ -899,6 +1394,38 @@ static int decode_subpacket(COOKContext *q, uint8_t *inbuffer,
     return q->samples_per_frame * sizeof(int16_t);
 }
 
+/**
+ * Fixed point decode_subpacket().
+ */
+
+static int decode_subpacket_fixed(COOKContext *q, uint8_t *inbuffer,
+                                  int sub_packet_size, int16_t *outbuffer) {
+    int scale1, scale2 = 0;
+
+    decode_bytes_and_gain(q, inbuffer, &q->gains1);
+
+    if (q->joint_stereo) {
+        scale1 = scale2 = joint_decode_fixed(q, q->decode_fix_1, q->decode_fix_2);
+    } else {
+        scale1 = mono_decode_fixed(q, q->decode_fix_1);
+
+        if (q->nb_channels == 2) {
+            decode_bytes_and_gain(q, inbuffer + sub_packet_size/2, &q->gains2);
+            scale2 = mono_decode_fixed(q, q->decode_fix_2);
+        }
+    }
+
+    mlt_compensate_output_fixed(q, q->decode_fix_1, scale1, &q->gains1,
+                                q->mono_previous_fix1, outbuffer, 0);
+
+    if (q->nb_channels == 2) {
+        mlt_compensate_output_fixed(q, q->decode_fix_2, scale2,
+                                    q->joint_stereo ? &q->gains1 : &q->gains2,
+                                    q->mono_previous_fix2, outbuffer, 1);
+    }
+    return q->samples_per_frame * sizeof(int16_t);
+}
+
 
 /**
  * Cook frame decoding
@@ -914,7 +1441,10 @@ static int cook_decode_frame(AVCodecContext *avctx,
     if (buf_size < avctx->block_align)
         return buf_size;
 
-    *data_size = decode_subpacket(q, buf, avctx->block_align, data);
+    if (q->fixed_point)
+        *data_size = decode_subpacket_fixed(q, buf, avctx->block_align, data);
+    else
+        *data_size = decode_subpacket(q, buf, avctx->block_align, data);
 
     /* Discard the first two frames: no valid audio. */
     if (avctx->frame_number < 2) *data_size = 0;
@@ -1099,6 +1629,16 @@ static int cook_decode_init(AVCodecContext *avctx)
         return -1;
     }
 
+    /* The integer pipeline is not bitexact with the float one. Floats are
+       emulated on our ARM targets, elsewhere it has to be asked for. */
+#ifdef ARCH_ARMV4L
+    q->fixed_point = 1;
+#else
+    q->fixed_point = !!(avctx->flags2 & CODEC_FLAG2_FAST);
+#endif
+    if (q->fixed_point && init_cook_fixed(q) != 0)
+        return -1;
+
 #ifdef COOKDEBUG
     dump_cook_context(q);
 #endif
@@ -1116,3 +1656,256 @@ AVCodec cook_decoder =
 	cook_decode_close,
 	cook_decode_frame,
 };
+
+#ifdef TEST
+#include <stdio.h>
+#undef printf
+#undef exit
+
+#define TEST_FRAMES 500
+#define TEST_MIN_PSNR 100.0
+
+/* Run the same random frames through the float and the fixed point
+   dequantization, IMLT and gain compensation and compare the output. */
+static double test_psnr(int samples_per_channel)
+{
+    COOKContext *q = av_mallocz(sizeof(COOKContext));
+    int quant_index_table[50];
+    int subband_coef_index[SUBBAND_SIZE], subband_coef_sign[SUBBAND_SIZE];
+    int16_t out_float[1024], out_fixed[1024];
+    AVRandomState rnd, state;
+    int64_t sse = 0;
+    int frame, band, i, scale, level;
+
+    q->samples_per_channel = samples_per_channel;
+    q->nb_channels = 1;
+    q->total_subbands = FFMIN(samples_per_channel / SUBBAND_SIZE, 50);
+    q->gains1.now      = q->gain_1;
+    q->gains1.previous = q->gain_2;
+    av_init_random(1, &q->random_state);
+    av_init_random(0x5eed, &rnd);
+
+    init_rootpow2table(q);
+    init_pow2table(q);
+    init_gain_table(q);
+    if (init_cook_mlt(q) || init_cook_fixed(q)) {
+        printf("init failed\n");
+        exit(1);
+    }
+
+    for (frame = 0; frame < TEST_FRAMES; frame++) {
+        memset(q->decode_buffer_1, 0, sizeof(q->decode_buffer_1));
+        memset(q->decode_fix_1, 0, sizeof(q->decode_fix_1));
+
+        /* falling spectrum, loud and quiet passages */
+        level = av_random(&rnd) % 28;
+        for (band = 0; band < q->total_subbands; band++)
+            quant_index_table[band] = level - band / 3 - (int)(av_random(&rnd) % 5);
+        scale = fixed_scale(q, quant_index_table, q->total_subbands);
+
+        for (band = 0; band < q->total_subbands; band++) {
+            int index = av_random(&rnd) % 8;
+            for (i = 0; i < SUBBAND_SIZE; i++) {
+                subband_coef_index[i] = index < 7 ? av_random(&rnd) % (kmax_tab[index] + 1) : 0;
+                subband_coef_sign[i]  = av_random(&rnd) & 1;
+            }
+            state = q->random_state;
+            scalar_dequant(q, index, quant_index_table[band],
+                           subband_coef_index, subband_coef_sign,
+                           &q->decode_buffer_1[band * SUBBAND_SIZE]);
+            q->random_state = state;
+            scalar_dequant_fixed(q, index, quant_index_table[band],
+                                 subband_coef_index, subband_coef_sign,
+                                 &q->decode_fix_1[band * SUBBAND_SIZE], scale);
+        }
+
+        /* occasional attacks */
+        for (i = 0; i < 9; i++)
+            q->gains1.now[i] = 0;
+        if (!(av_random(&rnd) & 3)) {
+            int gain = (int)(av_random(&rnd) % 7) - 3;
+            for (i = 0; i <= av_random(&rnd) % 9; i++)
+                q->gains1.now[i] = gain;
+        }
+        FFSWAP(int *, q->gains1.now, q->gains1.previous);
+
+        mlt_compensate_output(q, q->decode_buffer_1, &q->gains1,
+                              q->mono_previous_buffer1, out_float, 0);
+        mlt_compensate_output_fixed(q, q->decode_fix_1, scale, &q->gains1,
+                                    q->mono_previous_fix1, out_fixed, 0);
+
+        for (i = 0; i < samples_per_channel; i++)
+            sse += (out_float[i] - out_fixed[i]) * (out_float[i] - out_fixed[i]);
+    }
+
+    av_free(q->mlt_window);
+    av_free(q->mlt_window_fix);
+    ff_mdct_end(&q->mdct_ctx);
+    av_free(q);
+
+    if (!sse)
+        return 999.0;
+    return 10 * log10(65535.0 * 65535.0 * TEST_FRAMES * samples_per_channel / sse);
+}
+
+#define TEST_JS_MAX_BLOCK_ALIGN 512
+
+/* Write a random but valid joint stereo subpacket for q, reading it back
+   with the decoder where the syntax depends on what was decoded. */
+static void test_joint_packet(COOKContext *q, AVRandomState *rnd, uint8_t *buf)
+{
+    DECLARE_ALIGNED(8, uint8_t, bits[TEST_JS_MAX_BLOCK_ALIGN + 16]);
+    PutBitContext pb;
+    int quant_index_table[102], category[128], category_index[128];
+    int subband_coef_index[SUBBAND_SIZE];
+    const int limit = q->bits_per_subpacket;
+    int i, j, n, band, start, vlc_index, cat, vlc, tmp;
+
+    memset(bits, 0, sizeof(bits));
+    init_put_bits(&pb, bits, sizeof(bits));
+
+    /* gains */
+    n = av_random(rnd) % 3;
+    put_bits(&pb, n + 1, ((1 << n) - 1) << 1);
+    for (i = 0; i < n; i++) {
+        put_bits(&pb, 3, 4 * i + av_random(rnd) % 4);
+        put_bits(&pb, 1, 1);
+        put_bits(&pb, 4, 4 + av_random(rnd) % 7);
+    }
+
+    /* raw coupling indexes */
+    put_bits(&pb, 1, 0);
+    start = cplband[q->js_subband_start];
+    for (i = start; i <= cplband[q->subbands - 1]; i++)
+        put_bits(&pb, q->js_vlc_bits, av_random(rnd) % ((1 << q->js_vlc_bits) - 1));
+
+    /* falling envelope */
+    quant_index_table[0] = av_random(rnd) % 28;
+    put_bits(&pb, 6, quant_index_table[0] + 6);
+    for (i = 1; i < q->total_subbands; i++) {
+        vlc_index = i >= q->js_subband_start * 2 ? i - q->js_subband_start : FFMAX(i / 2, 1);
+        vlc_index = FFMIN(vlc_index, 13) - 1;
+        j = 11 + av_random(rnd) % 2;
+        put_bits(&pb, envelope_quant_index_huffbits[vlc_index][j],
+                 envelope_quant_index_huffcodes[vlc_index][j]);
+        quant_index_table[i] = quant_index_table[i - 1] + j - 12;
+    }
+
+    /* as many vectors as keep every category valid */
+    init_get_bits(&q->gb, bits, limit);
+    skip_bits_long(&q->gb, put_bits_count(&pb) + q->log2_numvector_size);
+    memset(category, 0, sizeof(category));
+    memset(category_index, 0, sizeof(category_index));
+    categorize(q, quant_index_table, category, category_index);
+    n = av_random(rnd) % q->numvector_size;
+    for (i = 0; i < n; i++) {
+        if (category[category_index[i]] == 7)
+            break;
+        category[category_index[i]]++;
+    }
+    put_bits(&pb, q->log2_numvector_size, i);
+
+    /* vectors and signs, as far as they fit */
+    for (band = 0; band < q->total_subbands; band++) {
+        cat = category[band];
+        if (cat == 7)
+            continue;
+        for (i = 0; i < vpr_tab[cat]; i++) {
+            /* mostly small values, which have the short codes */
+            do {
+                vlc = av_random(rnd) % (vhsize_tab[cat] / 8 + 1);
+            } while (!cvh_huffbits[cat][vlc]);
+            put_bits(&pb, cvh_huffbits[cat][vlc], cvh_huffcodes[cat][vlc]);
+            if (put_bits_count(&pb) > limit)
+                goto end;
+            for (j = vd_tab[cat] - 1; j >= 0; j--) {
+                tmp = (vlc * invradix_tab[cat]) / 0x100000;
+                subband_coef_index[j] = vlc - tmp * (kmax_tab[cat] + 1);
+                vlc = tmp;
+            }
+            for (j = 0; j < vd_tab[cat]; j++)
+                if (subband_coef_index[j] && put_bits_count(&pb) < limit)
+                    put_bits(&pb, 1, av_random(rnd) & 1);
+        }
+    }
+ end:
+    flush_put_bits(&pb);
+    decode_bytes(bits, buf, limit / 8 + 4);
+}
+
+/* Decode the same random joint stereo packets with the float and the
+   fixed point subpacket decoders and compare both channels. */
+static double test_joint_psnr(int samples_per_channel, int subbands,
+                              int js_subband_start)
+{
+    AVCodecContext avctx[2];
+    uint8_t extradata[16], *p = extradata;
+    DECLARE_ALIGNED(8, uint8_t, buf[TEST_JS_MAX_BLOCK_ALIGN + 16]);
+    int16_t out_float[2048], out_fixed[2048];
+    const int block_align = samples_per_channel / 2;
+    AVRandomState rnd;
+    int64_t sse = 0;
+    int frame, i;
+
+    bytestream_put_be32(&p, JOINT_STEREO);
+    bytestream_put_be16(&p, 2 * samples_per_channel);
+    bytestream_put_be16(&p, subbands);
+    bytestream_put_be32(&p, 0);
+    bytestream_put_be16(&p, js_subband_start);
+    bytestream_put_be16(&p, 5);
+
+    for (i = 0; i < 2; i++) {
+        memset(&avctx[i], 0, sizeof(avctx[i]));
+        avctx[i].priv_data      = av_mallocz(sizeof(COOKContext));
+        avctx[i].extradata      = extradata;
+        avctx[i].extradata_size = sizeof(extradata);
+        avctx[i].channels       = 2;
+        avctx[i].sample_rate    = 44100;
+        avctx[i].block_align    = block_align;
+        avctx[i].flags2         = i ? CODEC_FLAG2_FAST : 0;
+        if (cook_decode_init(&avctx[i])) {
+            printf("init failed\n");
+            exit(1);
+        }
+    }
+    av_init_random(0x5eed, &rnd);
+
+    for (frame = 0; frame < TEST_FRAMES; frame++) {
+        test_joint_packet(avctx[0].priv_data, &rnd, buf);
+        decode_subpacket(avctx[0].priv_data, buf, block_align, out_float);
+        decode_subpacket_fixed(avctx[1].priv_data, buf, block_align, out_fixed);
+
+        for (i = 0; i < 2 * samples_per_channel; i++)
+            sse += (out_float[i] - out_fixed[i]) * (out_float[i] - out_fixed[i]);
+    }
+
+    for (i = 0; i < 2; i++) {
+        cook_decode_close(&avctx[i]);
+        av_free(avctx[i].priv_data);
+    }
+
+    if (!sse)
+        return 999.0;
+    return 10 * log10(65535.0 * 65535.0 * TEST_FRAMES * 2 * samples_per_channel / sse);
+}
+
+int main(void)
+{
+    static const int sizes[] = { 256, 512, 1024 };
+    int i, ret = 0;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double psnr = test_psnr(sizes[i]);
+        printf("%4d samples: fixed vs float PSNR %5.2f dB\n", sizes[i], psnr);
+        if (psnr < TEST_MIN_PSNR)
+            ret = 1;
+    }
+    for (i = 1; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double psnr = test_joint_psnr(sizes[i], sizes[i] / 40, sizes[i] / 80);
+        printf("%4d samples joint stereo: fixed vs float PSNR %5.2f dB\n", sizes[i], psnr);
+        if (psnr < TEST_MIN_PSNR)
+            ret = 1;
+    }
+    return ret;
+}
+#endif
@@ -37,6 +37,7 @@
 #include "dcahuff.h"
 #include "dca.h"
 #include "internal.h"
+#include "mathops.h"
 
 //#define TRACE
 
@@ -72,6 +73,12 @@ enum DCAMode {
 
 #define DCA_MAX_FRAME_SIZE 16383
 
+/* fixed point decoding, subband samples are plain integers */
+#define COS_MOD_BITS  28        ///< fractional bits of cos_mod_fix[]
+#define FIR_HIST_BITS  2        ///< fractional bits of the fixed point QMF history
+#define PCM_FRAC_BITS  8        ///< fractional bits of the fixed point QMF output
+#define LFE_STEP_FIX   36700    ///< LFE quantization step size (0.035) in 12.20
+
 /** Bit allocation */
 typedef struct {
     int offset;                 ///< code values offset
@@ -88,6 +95,16 @@ static BitAlloc dca_smpl_bitalloc[11]; ///< samples VLCs
 /** Pre-calculated cosine modulation coefs for the QMF */
 static float cos_mod[544];
 
+/** Fixed point QMF and LFE tables, cos_mod in 4.28, the FIR coefs in 1.31
+ *  (with the 2/3 output scale folded into the 32 band ones) and the
+ *  downmix coefs in 2.30 */
+static int32_t cos_mod_fix[544];
+static int32_t fir_32bands_perfect_fix[512];
+static int32_t fir_32bands_nonperfect_fix[512];
+static int32_t lfe_fir_64_fix[512];
+static int32_t lfe_fir_128_fix[512];
+static int32_t dca_downmix_coeffs_fix[65];
+
 static av_always_inline int get_bitalloc(GetBitContext *gb, BitAlloc *ba, int idx)
 {
     return get_vlc2(gb, ba->vlc[idx].table, ba->vlc[idx].bits, ba->wrap) + ba->offset;
@@ -135,6 +152,7 @@ typedef struct {
     int bitalloc_huffman[DCA_PRIM_CHANNELS_MAX];    ///< bit allocation quantizer select
     int quant_index_huffman[DCA_PRIM_CHANNELS_MAX][DCA_ABITS_MAX]; ///< quantization index codebook select
     float scalefactor_adj[DCA_PRIM_CHANNELS_MAX][DCA_ABITS_MAX];   ///< scale factor adjustment
+    int scalefactor_adj_fix[DCA_PRIM_CHANNELS_MAX][DCA_ABITS_MAX]; ///< scale factor adjustment in 28.4
 
     /* Primary audio coding side information */
     int subsubframes;           ///< number of subsubframes
@@ -147,12 +165,16 @@ typedef struct {
     int joint_huff[DCA_PRIM_CHANNELS_MAX];                       ///< joint subband scale factors codebook
     int joint_scale_factor[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS]; ///< joint subband scale factors
     int downmix_coef[DCA_PRIM_CHANNELS_MAX][2];                  ///< stereo downmix coefficients
+    float downmix_matrix[DCA_PRIM_CHANNELS_MAX][2];              ///< stereo downmix applied to the subband samples
+    int32_t downmix_matrix_fix[DCA_PRIM_CHANNELS_MAX][2];        ///< downmix_matrix in 2.30
     int dynrange_coef;                                           ///< dynamic range coefficient
 
     int high_freq_vq[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS];       ///< VQ encoded high frequency subbands
 
     float lfe_data[2 * DCA_SUBSUBFAMES_MAX * DCA_LFE_MAX *
                    2 /*history */ ];    ///< Low frequency effect data
+    int32_t lfe_data_fix[2 * DCA_SUBSUBFAMES_MAX * DCA_LFE_MAX *
+                         2 /*history */ ];  ///< Low frequency effect data, fixed point
     int lfe_scale_factor;
 
     /* Subband samples history (for ADPCM) */
@@ -160,6 +182,12 @@ typedef struct {
     float subband_fir_hist[DCA_PRIM_CHANNELS_MAX][512];
     float subband_fir_noidea[DCA_PRIM_CHANNELS_MAX][64];
 
+    /* Same for the fixed point decoder */
+    int32_t subband_samples_hist_fix[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][4];
+    int32_t subband_fir_hist_fix[DCA_PRIM_CHANNELS_MAX][512];
+    int32_t subband_fir_noidea_fix[DCA_PRIM_CHANNELS_MAX][64];
+    int fixed_point;            ///< use the integer decoder, output goes straight to tsamples
+
     int output;                 ///< type of output
     int bias;                   ///< output bias
 
@@ -228,6 +256,7 @@ static int dca_parse_frame_header(DCAContext * s)
 {
     int i, j;
     static const float adj_table[4] = { 1.0, 1.1250, 1.2500, 1.4375 };
+    static const int adj_table_fix[4] = { 16, 18, 20, 23 };
     static const int bitlen[11] = { 0, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3 };
     static const int thr[11] = { 0, 1, 3, 3, 3, 3, 7, 7, 7, 7, 7 };
 
@@ -347,13 +376,18 @@ static int dca_parse_frame_header(DCAContext * s)
 
     /* Get scale factor adjustment */
     for (j = 0; j < 11; j++)
-        for (i = 0; i < s->prim_channels; i++)
+        for (i = 0; i < s->prim_channels; i++) {
             s->scalefactor_adj[i][j] = 1;
+            s->scalefactor_adj_fix[i][j] = 16;
+        }
 
     for (j = 1; j < 11; j++)
         for (i = 0; i < s->prim_channels; i++)
-            if (s->quant_index_huffman[i][j] < thr[j])
-                s->scalefactor_adj[i][j] = adj_table[get_bits(&s->gb, 2)];
+            if (s->quant_index_huffman[i][j] < thr[j]) {
+                int adj = get_bits(&s->gb, 2);
+                s->scalefactor_adj[i][j] = adj_table[adj];
+                s->scalefactor_adj_fix[i][j] = adj_table_fix[adj];
+            }
 
     if (s->crc_present) {
         /* Audio header CRC check */
@@ -389,6 +423,42 @@ static int dca_parse_frame_header(DCAContext * s)
 }
 
 
+/**
+ * Build the stereo downmix matrix from the downmix coefficients.
+ * The front channels of the 3F layouts are remixed into L/R, the rear
+ * channels are added to both.
+ */
+static void dca_downmix_matrix(DCAContext * s)
+{
+    int i, j, first, last;
+
+    memset(s->downmix_matrix, 0, sizeof(s->downmix_matrix));
+    memset(s->downmix_matrix_fix, 0, sizeof(s->downmix_matrix_fix));
+    s->downmix_matrix[0][0] = s->downmix_matrix[1][1] = 1.0;
+    s->downmix_matrix_fix[0][0] = s->downmix_matrix_fix[1][1] = 1 << 30;
+
+    switch (s->amode) {
+    case DCA_3F:   first = 0; last = 3; break;
+    case DCA_2F1R: first = 2; last = 3; break;
+    case DCA_3F1R: first = 0; last = 4; break;
+    case DCA_2F2R: first = 2; last = 4; break;
+    case DCA_3F2R: first = 0; last = 5; break;
+    case DCA_STEREO:
+        first = last = 0;
+        break;
+    default:
+        av_log(s->avctx, AV_LOG_ERROR, "Not implemented!\n");
+        first = last = 0;
+        break;
+    }
+
+    for (i = first; i < last; i++)
+        for (j = 0; j < 2; j++) {
+            s->downmix_matrix[i][j]     = dca_downmix_coeffs[s->downmix_coef[i][j]];
+            s->downmix_matrix_fix[i][j] = dca_downmix_coeffs_fix[s->downmix_coef[i][j]];
+        }
+}
+
 static inline int get_scale(GetBitContext *gb, int level, int value)
 {
    if (level < 5) {
@@ -528,6 +598,7 @@ static int dca_subframe_header(DCAContext * s)
                 s->downmix_coef[j][1] = dca_default_coeffs[am][j][1];
             }
         }
+        dca_downmix_matrix(s);
     }
 
     /* Dynamic range coefficient */
@@ -557,17 +628,23 @@ static int dca_subframe_header(DCAContext * s)
 
         for (j = lfe_samples; j < lfe_samples * 2; j++) {
             /* Signed 8 bits int */
-            s->lfe_data[j] = get_sbits(&s->gb, 8);
+            s->lfe_data_fix[j] = get_sbits(&s->gb, 8);
         }
 
         /* Scale factor index */
         s->lfe_scale_factor = scale_factor_quant7[get_bits(&s->gb, 8)];
 
         /* Quantization step size * scale factor */
-        lfe_scale = 0.035 * s->lfe_scale_factor;
+        if (s->fixed_point) {
+            for (j = lfe_samples; j < lfe_samples * 2; j++)
+                s->lfe_data_fix[j] = (MUL64(s->lfe_data_fix[j] * LFE_STEP_FIX,
+                                            s->lfe_scale_factor) + (1 << 19)) >> 20;
+        } else {
+            lfe_scale = 0.035 * s->lfe_scale_factor;
 
-        for (j = lfe_samples; j < lfe_samples * 2; j++)
-            s->lfe_data[j] *= lfe_scale;
+            for (j = lfe_samples; j < lfe_samples * 2; j++)
+                s->lfe_data[j] = s->lfe_data_fix[j] * lfe_scale;
+        }
     }
 
 #ifdef TRACE
@@ -643,7 +720,7 @@ static int dca_subframe_header(DCAContext * s)
     return 0;
 }
 
-static void qmf_32_subbands(DCAContext * s, int chans,
+static void qmf_32_subbands(DCAContext * s, int chans, int activity,
                             float samples_in[32][8], float *samples_out,
                             float scale, float bias)
 {
@@ -669,7 +746,7 @@ static void qmf_32_subbands(DCAContext * s, int chans,
         float t1, t2, sum[16], diff[16];
 
         /* Load in one sample from each subband and clear inactive subbands */
-        for (i = 0; i < s->subband_activity[chans]; i++)
+        for (i = 0; i < activity; i++)
             raXin[i] = samples_in[i][subindex];
         for (; i < 32; i++)
             raXin[i] = 0.0;
@@ -712,6 +789,86 @@ static void qmf_32_subbands(DCAContext * s, int chans,
     }
 }
 
+/**
+ * Fixed point version of qmf_32_subbands(), the 2/3 output scale is part
+ * of the filter coefficients and the samples are written as 16 bit PCM.
+ */
+static void qmf_32_subbands_fixed(DCAContext * s, int chans, int activity,
+                                  int32_t samples_in[32][8], int16_t *samples_out)
+{
+    const int32_t *prCoeff;
+    int i, j, k;
+    int32_t praXin[33], *raXin = &praXin[1];
+
+    int32_t *subband_fir_hist = s->subband_fir_hist_fix[chans];
+    int32_t *subband_fir_hist2 = s->subband_fir_noidea_fix[chans];
+
+    int chindex = 0, subindex;
+
+    praXin[0] = 0;
+
+    /* Select filter */
+    if (!s->multirate_inter)    /* Non-perfect reconstruction */
+        prCoeff = fir_32bands_nonperfect_fix;
+    else                        /* Perfect reconstruction */
+        prCoeff = fir_32bands_perfect_fix;
+
+    /* Reconstructed channel sample index */
+    for (subindex = 0; subindex < 8; subindex++) {
+        int64_t t1, t2;
+        int32_t sum[16], diff[16];
+
+        /* Load in one sample from each subband and clear inactive subbands */
+        for (i = 0; i < activity; i++)
+            raXin[i] = samples_in[i][subindex];
+        for (; i < 32; i++)
+            raXin[i] = 0;
+
+        /* Multiply by cosine modulation coefficients and
+         * create temporary arrays SUM and DIFF */
+        for (j = 0, k = 0; k < 16; k++) {
+            t1 = 0;
+            t2 = 0;
+            for (i = 0; i < 16; i++, j++){
+                MAC64(t1, raXin[2 * i] + raXin[2 * i + 1], cos_mod_fix[j]);
+                MAC64(t2, raXin[2 * i] + raXin[2 * i - 1], cos_mod_fix[j + 256]);
+            }
+            sum[k]  = (t1 + t2 + (1 << (COS_MOD_BITS - 1))) >> COS_MOD_BITS;
+            diff[k] = (t1 - t2 + (1 << (COS_MOD_BITS - 1))) >> COS_MOD_BITS;
+        }
+
+        j = 512;
+        /* Store history, FIR_HIST_BITS fractional bits */
+        for (k = 0; k < 16; k++, j++)
+            subband_fir_hist[k] = (MUL64(cos_mod_fix[j], sum[k]) +
+                (1 << (COS_MOD_BITS - FIR_HIST_BITS - 1))) >> (COS_MOD_BITS - FIR_HIST_BITS);
+        for (k = 0; k < 16; k++, j++)
+            subband_fir_hist[32-k-1] = (MUL64(cos_mod_fix[j], diff[k]) +
+                (1 << (COS_MOD_BITS - FIR_HIST_BITS - 1))) >> (COS_MOD_BITS - FIR_HIST_BITS);
+
+        /* Multiply by filter coefficients, PCM_FRAC_BITS fractional bits */
+        for (k = 31, i = 0; i < 32; i++, k--) {
+            int64_t a = 0, b = 0;
+            for (j = 0; j < 512; j += 64){
+                MAC64(a, prCoeff[i+j],    subband_fir_hist[i+j] - subband_fir_hist[j+k]);
+                MLS64(b, prCoeff[i+j+32], subband_fir_hist[i+j] + subband_fir_hist[j+k]);
+            }
+            subband_fir_hist2[i]    += (a + (1 << (30 + FIR_HIST_BITS - PCM_FRAC_BITS))) >> (31 + FIR_HIST_BITS - PCM_FRAC_BITS);
+            subband_fir_hist2[i+32] += (b + (1 << (30 + FIR_HIST_BITS - PCM_FRAC_BITS))) >> (31 + FIR_HIST_BITS - PCM_FRAC_BITS);
+        }
+
+        /* Create 32 PCM output samples */
+        for (i = 0; i < 32; i++)
+            samples_out[chindex++] = av_clip((subband_fir_hist2[i] + (1 << (PCM_FRAC_BITS - 1))) >> PCM_FRAC_BITS,
+                                             -32768, 32767);
+
+        /* Update working arrays */
+        memmove(&subband_fir_hist[32], &subband_fir_hist[0], (512 - 32) * sizeof(int32_t));
+        memmove(&subband_fir_hist2[0], &subband_fir_hist2[32], 32 * sizeof(int32_t));
+        memset(&subband_fir_hist2[32], 0, 32 * sizeof(int32_t));
+    }
+}
+
 static void lfe_interpolation_fir(int decimation_select,
                                   int num_deci_sample, float *samples_in,
                                   float *samples_out, float scale,
@@ -752,65 +909,88 @@ static void lfe_interpolation_fir(int decimation_select,
     }
 }
 
-/* downmixing routines */
-#define MIX_REAR1(samples, si1, rs, coef) \
-     samples[i]     += samples[si1] * coef[rs][0]; \
-     samples[i+256] += samples[si1] * coef[rs][1];
-
-#define MIX_REAR2(samples, si1, si2, rs, coef) \
-     samples[i]     += samples[si1] * coef[rs][0] + samples[si2] * coef[rs+1][0]; \
-     samples[i+256] += samples[si1] * coef[rs][1] + samples[si2] * coef[rs+1][1];
+/**
+ * Fixed point version of lfe_interpolation_fir(), the LFE samples are
+ * 24 bit PCM and are written as 16 bit.
+ */
+static void lfe_interpolation_fir_fixed(int decimation_select,
+                                        int num_deci_sample, int32_t *samples_in,
+                                        int16_t *samples_out)
+{
+    int decifactor, k, j;
+    const int32_t *prCoeff;
 
-#define MIX_FRONT3(samples, coef) \
-    t = samples[i]; \
-    samples[i]     = t * coef[0][0] + samples[i+256] * coef[1][0] + samples[i+512] * coef[2][0]; \
-    samples[i+256] = t * coef[0][1] + samples[i+256] * coef[1][1] + samples[i+512] * coef[2][1];
+    int interp_index = 0;       /* Index to the interpolated samples */
+    int deciindex;
 
-#define DOWNMIX_TO_STEREO(op1, op2) \
-    for(i = 0; i < 256; i++){ \
-        op1 \
-        op2 \
+    /* Select decimation filter */
+    if (decimation_select == 1) {
+        decifactor = 128;
+        prCoeff = lfe_fir_128_fix;
+    } else {
+        decifactor = 64;
+        prCoeff = lfe_fir_64_fix;
+    }
+    /* Interpolation */
+    for (deciindex = 0; deciindex < num_deci_sample; deciindex++) {
+        /* One decimated sample generates decifactor interpolated ones */
+        for (k = 0; k < decifactor; k++) {
+            int64_t rTmp = 0;
+            for (j = 0; j < 512 / decifactor; j++)
+                MAC64(rTmp, samples_in[deciindex - j], prCoeff[k + j * decifactor]);
+            samples_out[interp_index++] = av_clip((rTmp + ((int64_t)1 << 38)) >> 39,
+                                                  -32768, 32767);
+        }
     }
+}
 
-static void dca_downmix(float *samples, int srcfmt,
-                        int downmix_coef[DCA_PRIM_CHANNELS_MAX][2])
+/**
+ * Fold the primary channels into stereo on the subband samples, so that
+ * only the two output channels have to go through the QMF.
+ *
+ * @param activity  set to the number of active subbands of each output
+ */
+static void dca_downmix(DCAContext * s,
+                        float samples[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8],
+                        float out[2][DCA_SUBBANDS][8], int activity[2])
 {
-    int i;
-    float t;
-    float coef[DCA_PRIM_CHANNELS_MAX][2];
+    int i, k, l, m;
+
+    memset(out, 0, 2 * sizeof(out[0]));
+    for (i = 0; i < 2; i++) {
+        activity[i] = 0;
+        for (k = 0; k < s->prim_channels; k++) {
+            float coef = s->downmix_matrix[k][i];
 
-    for(i=0; i<DCA_PRIM_CHANNELS_MAX; i++) {
-        coef[i][0] = dca_downmix_coeffs[downmix_coef[i][0]];
-        coef[i][1] = dca_downmix_coeffs[downmix_coef[i][1]];
+            if (coef == 0.0)
+                continue;
+            for (l = 0; l < s->subband_activity[k]; l++)
+                for (m = 0; m < 8; m++)
+                    out[i][l][m] += samples[k][l][m] * coef;
+            activity[i] = FFMAX(activity[i], s->subband_activity[k]);
+        }
     }
+}
 
-    switch (srcfmt) {
-    case DCA_MONO:
-    case DCA_CHANNEL:
-    case DCA_STEREO_TOTAL:
-    case DCA_STEREO_SUMDIFF:
-    case DCA_4F2R:
-        av_log(NULL, 0, "Not implemented!\n");
-        break;
-    case DCA_STEREO:
-        break;
-    case DCA_3F:
-        DOWNMIX_TO_STEREO(MIX_FRONT3(samples, coef),);
-        break;
-    case DCA_2F1R:
-        DOWNMIX_TO_STEREO(MIX_REAR1(samples, i + 512, 2, coef),);
-        break;
-    case DCA_3F1R:
-        DOWNMIX_TO_STEREO(MIX_FRONT3(samples, coef),
-                          MIX_REAR1(samples, i + 768, 3, coef));
-        break;
-    case DCA_2F2R:
-        DOWNMIX_TO_STEREO(MIX_REAR2(samples, i + 512, i + 768, 2, coef),);
-        break;
-    case DCA_3F2R:
-        DOWNMIX_TO_STEREO(MIX_FRONT3(samples, coef),
-                          MIX_REAR2(samples, i + 768, i + 1024, 3, coef));
-        break;
+static void dca_downmix_fixed(DCAContext * s,
+                              int32_t samples[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8],
+                              int32_t out[2][DCA_SUBBANDS][8], int activity[2])
+{
+    int i, k, l, m;
+
+    memset(out, 0, 2 * sizeof(out[0]));
+    for (i = 0; i < 2; i++) {
+        activity[i] = 0;
+        for (k = 0; k < s->prim_channels; k++) {
+            int32_t coef = s->downmix_matrix_fix[k][i];
+
+            if (!coef)
+                continue;
+            for (l = 0; l < s->subband_activity[k]; l++)
+                for (m = 0; m < 8; m++)
+                    out[i][l][m] += (MUL64(samples[k][l][m], coef) + (1 << 29)) >> 30;
+            activity[i] = FFMAX(activity[i], s->subband_activity[k]);
+        }
     }
 }
 
@@ -838,9 +1018,24 @@ static int decode_blockcode(int code, int levels, int *values)
 static const uint8_t abits_sizes[7] = { 7, 10, 12, 13, 15, 17, 19 };
 static const uint8_t abits_levels[7] = { 3, 5, 7, 9, 13, 17, 25 };
 
-static int dca_subsubframe(DCAContext * s)
+/* Deal with transients */
+static inline int get_scale_factor(DCAContext * s, int k, int l)
 {
-    int k, l;
+    if (s->transition_mode[k][l] &&
+        s->current_subsubframe >= s->transition_mode[k][l])
+        return s->scale_factor[k][l][1];
+    return s->scale_factor[k][l][0];
+}
+
+/**
+ * Dequantize and synthesize one subsubframe in floating point
+ *
+ * @param quant     quantization indexes read from the bitstream
+ */
+static void dca_subsubframe_float(DCAContext * s,
+                                  int quant[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8])
+{
+    int k, l, m;
     int subsubframe = s->current_subsubframe;
 
     float *quant_step_table;
@@ -848,10 +1043,6 @@ static int dca_subsubframe(DCAContext * s)
     /* FIXME */
     float subband_samples[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8];
 
-    /*
-     * Audio data
-     */
-
     /* Select quantization step size table */
     if (s->bit_rate == 0x1f)
         quant_step_table = (float *) lossless_quant_d;
@@ -860,64 +1051,12 @@ static int dca_subsubframe(DCAContext * s)
 
     for (k = 0; k < s->prim_channels; k++) {
         for (l = 0; l < s->vq_start_subband[k]; l++) {
-            int m;
-
-            /* Select the mid-tread linear quantizer */
             int abits = s->bitalloc[k][l];
-
-            float quant_step_size = quant_step_table[abits];
-            float rscale;
-
-            /*
-             * Determine quantization index code book and its type
-             */
-
-            /* Select quantization index code book */
-            int sel = s->quant_index_huffman[k][abits];
-
-            /*
-             * Extract bits from the bit stream
-             */
-            if(!abits){
-                memset(subband_samples[k][l], 0, 8 * sizeof(subband_samples[0][0][0]));
-            }else if(abits >= 11 || !dca_smpl_bitalloc[abits].vlc[sel].table){
-                if(abits <= 7){
-                    /* Block code */
-                    int block_code1, block_code2, size, levels;
-                    int block[8];
-
-                    size = abits_sizes[abits-1];
-                    levels = abits_levels[abits-1];
-
-                    block_code1 = get_bits(&s->gb, size);
-                    /* FIXME Should test return value */
-                    decode_blockcode(block_code1, levels, block);
-                    block_code2 = get_bits(&s->gb, size);
-                    decode_blockcode(block_code2, levels, &block[4]);
-                    for (m = 0; m < 8; m++)
-                        subband_samples[k][l][m] = block[m];
-                }else{
-                    /* no coding */
-                    for (m = 0; m < 8; m++)
-                        subband_samples[k][l][m] = get_sbits(&s->gb, abits - 3);
-                }
-            }else{
-                /* Huffman coded */
-                for (m = 0; m < 8; m++)
-                    subband_samples[k][l][m] = get_bitalloc(&s->gb, &dca_smpl_bitalloc[abits], sel);
-            }
-
-            /* Deal with transients */
-            if (s->transition_mode[k][l] &&
-                subsubframe >= s->transition_mode[k][l])
-                rscale = quant_step_size * s->scale_factor[k][l][1];
-            else
-                rscale = quant_step_size * s->scale_factor[k][l][0];
-
-            rscale *= s->scalefactor_adj[k][sel];
+            float rscale = quant_step_table[abits] * get_scale_factor(s, k, l) *
+                           s->scalefactor_adj[k][s->quant_index_huffman[k][abits]];
 
             for (m = 0; m < 8; m++)
-                subband_samples[k][l][m] *= rscale;
+                subband_samples[k][l][m] = quant[k][l][m] * rscale;
 
             /*
              * Inverse ADPCM if in prediction mode
@@ -945,13 +1084,6 @@ static int dca_subsubframe(DCAContext * s)
         for (l = s->vq_start_subband[k]; l < s->subband_activity[k]; l++) {
             /* 1 vector -> 32 samples but we only need the 8 samples
              * for this subsubframe. */
-            int m;
-
-            if (!s->debug_flag & 0x01) {
-                av_log(s->avctx, AV_LOG_DEBUG, "Stream with high frequencies VQ coding\n");
-                s->debug_flag |= 0x01;
-            }
-
             for (m = 0; m < 8; m++) {
                 subband_samples[k][l][m] =
                     high_freq_vq[s->high_freq_vq[k][l]][subsubframe * 8 +
@@ -961,36 +1093,30 @@ static int dca_subsubframe(DCAContext * s)
         }
     }
 
-    /* Check for DSYNC after subsubframe */
-    if (s->aspf || subsubframe == s->subsubframes - 1) {
-        if (0xFFFF == get_bits(&s->gb, 16)) {   /* 0xFFFF */
-#ifdef TRACE
-            av_log(s->avctx, AV_LOG_DEBUG, "Got subframe DSYNC\n");
-#endif
-        } else {
-            av_log(s->avctx, AV_LOG_ERROR, "Didn't get subframe DSYNC\n");
-        }
-    }
-
     /* Backup predictor history for adpcm */
     for (k = 0; k < s->prim_channels; k++)
         for (l = 0; l < s->vq_start_subband[k]; l++)
             memcpy(s->subband_samples_hist[k][l], &subband_samples[k][l][4],
                         4 * sizeof(subband_samples[0][0][0]));
 
-    /* 32 subbands QMF */
-    for (k = 0; k < s->prim_channels; k++) {
+    /* 32 subbands QMF, downmixing before it if needed */
+    if (s->prim_channels > dca_channels[s->output & DCA_CHANNEL_MASK]) {
+        float downmix_samples[2][DCA_SUBBANDS][8];
+        int activity[2];
+
+        dca_downmix(s, subband_samples, downmix_samples, activity);
+        for (k = 0; k < 2; k++)
+            qmf_32_subbands(s, k, activity[k], downmix_samples[k],
+                            &s->samples[256 * k], 2.0 / 3, 0);
+    } else {
+        for (k = 0; k < s->prim_channels; k++) {
 /*        static float pcm_to_double[8] =
             {32768.0, 32768.0, 524288.0, 524288.0, 0, 8388608.0, 8388608.0};*/
-         qmf_32_subbands(s, k, subband_samples[k], &s->samples[256 * k],
+            qmf_32_subbands(s, k, s->subband_activity[k], subband_samples[k],
+                            &s->samples[256 * k],
                             2.0 / 3 /*pcm_to_double[s->source_pcm_res] */ ,
                             0 /*s->bias */ );
-    }
-
-    /* Down mixing */
-
-    if (s->prim_channels > dca_channels[s->output & DCA_CHANNEL_MASK]) {
-        dca_downmix(s->samples, s->amode, s->downmix_coef);
+        }
     }
 
     /* Generate LFE samples for this subsubframe FIXME!!! */
@@ -1002,9 +1128,193 @@ static int dca_subsubframe(DCAContext * s)
                               s->lfe_data + lfe_samples +
                               2 * s->lfe * subsubframe,
                               &s->samples[256 * i_channels],
-                              8388608.0, s->bias);
-        /* Outputs 20bits pcm samples */
+                              256.0, 0 /*s->bias */ );
+        /* Same 16 bit pcm scale as the QMF output */
     }
+}
+
+/**
+ * Dequantize and synthesize one subsubframe in fixed point, the subband
+ * samples are integers on the same scale as the float decoder's and the
+ * output goes straight to tsamples.
+ *
+ * @param quant     quantization indexes read from the bitstream
+ */
+static void dca_subsubframe_fixed(DCAContext * s,
+                                  int quant[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8])
+{
+    int k, l, m, n;
+    int subsubframe = s->current_subsubframe;
+
+    const uint32_t *quant_step_table;
+
+    int32_t subband_samples[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8];
+
+    /* Select quantization step size table (9.22) */
+    if (s->bit_rate == 0x1f)
+        quant_step_table = lossless_quant;
+    else
+        quant_step_table = lossy_quant;
+
+    for (k = 0; k < s->prim_channels; k++) {
+        for (l = 0; l < s->vq_start_subband[k]; l++) {
+            int abits = s->bitalloc[k][l];
+            /* step size * scale factor * adjustment, in 38.26 and then
+             * brought down to a 32 bit multiplier */
+            int64_t rscale = (int64_t)quant_step_table[abits] * get_scale_factor(s, k, l) *
+                             s->scalefactor_adj_fix[k][s->quant_index_huffman[k][abits]];
+            int shift = 26;
+
+            if (rscale >> 31) {
+                n = av_log2(rscale >> 31) + 1;
+                rscale >>= n;
+                shift -= n;
+            }
+            for (m = 0; m < 8; m++)
+                subband_samples[k][l][m] =
+                    (MUL64(quant[k][l][m], rscale) + (1 << (shift - 1))) >> shift;
+
+            /*
+             * Inverse ADPCM if in prediction mode, 3.13 coefs
+             */
+            if (s->prediction_mode[k][l]) {
+                const int16_t *coef = adpcm_vb[s->prediction_vq[k][l]];
+
+                for (m = 0; m < 8; m++) {
+                    int64_t pred = 0;
+
+                    for (n = 1; n <= 4; n++) {
+                        if (m >= n)
+                            MAC64(pred, coef[n - 1], subband_samples[k][l][m - n]);
+                        else if (s->predictor_history)
+                            MAC64(pred, coef[n - 1], s->subband_samples_hist_fix[k][l][m - n + 4]);
+                    }
+                    subband_samples[k][l][m] += (pred + 4096) >> 13;
+                }
+            }
+        }
+
+        /*
+         * Decode VQ encoded high frequencies
+         */
+        for (l = s->vq_start_subband[k]; l < s->subband_activity[k]; l++) {
+            for (m = 0; m < 8; m++)
+                subband_samples[k][l][m] =
+                    (high_freq_vq[s->high_freq_vq[k][l]][subsubframe * 8 + m] *
+                     s->scale_factor[k][l][0] + 8) >> 4;
+        }
+    }
+
+    /* Backup predictor history for adpcm */
+    for (k = 0; k < s->prim_channels; k++)
+        for (l = 0; l < s->vq_start_subband[k]; l++)
+            memcpy(s->subband_samples_hist_fix[k][l], &subband_samples[k][l][4],
+                        4 * sizeof(subband_samples[0][0][0]));
+
+    /* 32 subbands QMF, downmixing before it if needed */
+    if (s->prim_channels > dca_channels[s->output & DCA_CHANNEL_MASK]) {
+        int32_t downmix_samples[2][DCA_SUBBANDS][8];
+        int activity[2];
+
+        dca_downmix_fixed(s, subband_samples, downmix_samples, activity);
+        for (k = 0; k < 2; k++)
+            qmf_32_subbands_fixed(s, k, activity[k], downmix_samples[k],
+                                  &s->tsamples[256 * k]);
+    } else {
+        for (k = 0; k < s->prim_channels; k++)
+            qmf_32_subbands_fixed(s, k, s->subband_activity[k], subband_samples[k],
+                                  &s->tsamples[256 * k]);
+    }
+
+    /* Generate LFE samples for this subsubframe */
+    if (s->output & DCA_LFE) {
+        int lfe_samples = 2 * s->lfe * s->subsubframes;
+        int i_channels = dca_channels[s->output & DCA_CHANNEL_MASK];
+
+        lfe_interpolation_fir_fixed(s->lfe, 2 * s->lfe,
+                                    s->lfe_data_fix + lfe_samples +
+                                    2 * s->lfe * subsubframe,
+                                    &s->tsamples[256 * i_channels]);
+    }
+}
+
+static int dca_subsubframe(DCAContext * s)
+{
+    int k, l;
+    int subsubframe = s->current_subsubframe;
+
+    int quant[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8];
+
+    /*
+     * Audio data
+     */
+
+    for (k = 0; k < s->prim_channels; k++) {
+        for (l = 0; l < s->vq_start_subband[k]; l++) {
+            int m;
+
+            /* Select the mid-tread linear quantizer */
+            int abits = s->bitalloc[k][l];
+
+            /*
+             * Determine quantization index code book and its type
+             */
+
+            /* Select quantization index code book */
+            int sel = s->quant_index_huffman[k][abits];
+
+            /*
+             * Extract bits from the bit stream
+             */
+            if(!abits){
+                memset(quant[k][l], 0, 8 * sizeof(quant[0][0][0]));
+            }else if(abits >= 11 || !dca_smpl_bitalloc[abits].vlc[sel].table){
+                if(abits <= 7){
+                    /* Block code */
+                    int block_code1, block_code2, size, levels;
+
+                    size = abits_sizes[abits-1];
+                    levels = abits_levels[abits-1];
+
+                    block_code1 = get_bits(&s->gb, size);
+                    /* FIXME Should test return value */
+                    decode_blockcode(block_code1, levels, quant[k][l]);
+                    block_code2 = get_bits(&s->gb, size);
+                    decode_blockcode(block_code2, levels, &quant[k][l][4]);
+                }else{
+                    /* no coding */
+                    for (m = 0; m < 8; m++)
+                        quant[k][l][m] = get_sbits(&s->gb, abits - 3);
+                }
+            }else{
+                /* Huffman coded */
+                for (m = 0; m < 8; m++)
+                    quant[k][l][m] = get_bitalloc(&s->gb, &dca_smpl_bitalloc[abits], sel);
+            }
+        }
+
+        if (s->vq_start_subband[k] < s->subband_activity[k] &&
+            !s->debug_flag & 0x01) {
+            av_log(s->avctx, AV_LOG_DEBUG, "Stream with high frequencies VQ coding\n");
+            s->debug_flag |= 0x01;
+        }
+    }
+
+    /* Check for DSYNC after subsubframe */
+    if (s->aspf || subsubframe == s->subsubframes - 1) {
+        if (0xFFFF == get_bits(&s->gb, 16)) {   /* 0xFFFF */
+#ifdef TRACE
+            av_log(s->avctx, AV_LOG_DEBUG, "Got subframe DSYNC\n");
+#endif
+        } else {
+            av_log(s->avctx, AV_LOG_ERROR, "Didn't get subframe DSYNC\n");
+        }
+    }
+
+    if (s->fixed_point)
+        dca_subsubframe_fixed(s, quant);
+    else
+        dca_subsubframe_float(s, quant);
 
     return 0;
 }
@@ -1034,6 +1344,7 @@ static int dca_subframe_footer(DCAContext * s)
     lfe_samples = 2 * s->lfe * s->subsubframes;
     for (i = 0; i < lfe_samples; i++) {
         s->lfe_data[i] = s->lfe_data[i + lfe_samples];
+        s->lfe_data_fix[i] = s->lfe_data_fix[i + lfe_samples];
     }
 
     return 0;
@@ -1180,7 +1491,8 @@ static int dca_decode_frame(AVCodecContext * avctx,
     *data_size = 0;
     for (i = 0; i < (s->sample_blocks / 8); i++) {
         dca_decode_block(s);
-        s->dsp.float_to_int16(s->tsamples, s->samples, 256 * channels);
+        if (!s->fixed_point)
+            s->dsp.float_to_int16(s->tsamples, s->samples, 256 * channels);
         /* interleave samples */
         for (j = 0; j < 256; j++) {
             for (k = 0; k < channels; k++)
@@ -1224,6 +1536,48 @@ static void pre_calc_cosmod(DCAContext * s)
     cosmod_inited = 1;
 }
 
+/* float to fixed point with bits fractional bits */
+static int32_t ftofix(double x, int bits)
+{
+    return lrint(x * (double)((int64_t)1 << bits));
+}
+
+/**
+ * Build the fixed point QMF, LFE and downmix tables
+ */
+static void pre_calc_fixed(void)
+{
+    int i, j, k;
+    static int fixed_inited = 0;
+
+    if(fixed_inited) return;
+    for (j = 0, k = 0; k < 16; k++)
+        for (i = 0; i < 16; i++)
+            cos_mod_fix[j++] = ftofix(cos((2 * i + 1) * (2 * k + 1) * M_PI / 64), COS_MOD_BITS);
+
+    for (k = 0; k < 16; k++)
+        for (i = 0; i < 16; i++)
+            cos_mod_fix[j++] = ftofix(cos((i) * (2 * k + 1) * M_PI / 32), COS_MOD_BITS);
+
+    for (k = 0; k < 16; k++)
+        cos_mod_fix[j++] = ftofix(0.25 / (2 * cos((2 * k + 1) * M_PI / 128)), COS_MOD_BITS);
+
+    for (k = 0; k < 16; k++)
+        cos_mod_fix[j++] = ftofix(-0.25 / (2.0 * sin((2 * k + 1) * M_PI / 128)), COS_MOD_BITS);
+
+    for (i = 0; i < 512; i++) {
+        fir_32bands_perfect_fix[i]    = ftofix(fir_32bands_perfect[i]    * 2.0 / 3, 31);
+        fir_32bands_nonperfect_fix[i] = ftofix(fir_32bands_nonperfect[i] * 2.0 / 3, 31);
+        lfe_fir_64_fix[i]  = ftofix(lfe_fir_64[i],  31);
+        lfe_fir_128_fix[i] = ftofix(lfe_fir_128[i], 31);
+    }
+
+    for (i = 0; i < 65; i++)
+        dca_downmix_coeffs_fix[i] = ftofix(dca_downmix_coeffs[i], 30);
+
+    fixed_inited = 1;
+}
+
 
 /**
  * DCA initialization
@@ -1239,6 +1593,16 @@ static int dca_decode_init(AVCodecContext * avctx)
     dca_init_vlcs();
     pre_calc_cosmod(s);
 
+    /* Same choice as in cook, the integer decoder is not bitexact with
+       the float one and is only used where floats are emulated. */
+#ifdef ARCH_ARMV4L
+    s->fixed_point = 1;
+#else
+    s->fixed_point = !!(avctx->flags2 & CODEC_FLAG2_FAST);
+#endif
+    if (s->fixed_point)
+        pre_calc_fixed();
+
     dsputil_init(&s->dsp, avctx);
     return 0;
 }
@@ -1259,3 +1623,137 @@ AVCodec dca_decoder = {
 	0,
 	0,
 };
+
+#ifdef TEST
+#include <stdio.h>
+#include "random.h"
+#undef printf
+#undef exit
+
+#define TEST_SUBFRAMES 200
+#define TEST_MIN_PSNR 90.0
+
+static int16_t float_to_pcm(float v)
+{
+    return av_clip(lrintf(v), -32768, 32767);
+}
+
+/* Run the same random subframes through the float and the fixed point
+   dequantization, ADPCM, downmix, QMF and LFE interpolation and compare
+   the output. */
+static double test_psnr(int output, int multirate_inter)
+{
+    DCAContext *s = av_mallocz(sizeof(DCAContext));
+    int quant[DCA_PRIM_CHANNELS_MAX][DCA_SUBBANDS][8];
+    int16_t out_float[1536];
+    AVRandomState rnd;
+    int64_t sse = 0;
+    int subframe, channels, i, j, k, l, m;
+
+    av_init_random(0x5eed, &rnd);
+    pre_calc_cosmod(s);
+    pre_calc_fixed();
+
+    s->amode = DCA_3F2R;
+    s->output = output;
+    s->prim_channels = 5;
+    s->lfe = 1;
+    s->bit_rate = dca_bit_rates[0];
+    s->multirate_inter = multirate_inter;
+    s->predictor_history = 1;
+    s->subsubframes = DCA_SUBSUBFAMES_MAX;
+    s->debug_flag = 0x01;
+    for (k = 0; k < s->prim_channels; k++)
+        for (j = 0; j < 11; j++) {
+            s->scalefactor_adj[k][j]     = 1;
+            s->scalefactor_adj_fix[k][j] = 16;
+        }
+    channels = dca_channels[output & DCA_CHANNEL_MASK] + !!(output & DCA_LFE);
+
+    for (subframe = 0; subframe < TEST_SUBFRAMES; subframe++) {
+        int lfe_samples = 2 * s->lfe * s->subsubframes;
+        /* loud and quiet passages */
+        int level = 60 + av_random(&rnd) % 60;
+
+        for (k = 0; k < s->prim_channels; k++) {
+            s->subband_activity[k] = 2 + av_random(&rnd) % 31;
+            s->vq_start_subband[k] = 1 + av_random(&rnd) % s->subband_activity[k];
+            for (l = 0; l < s->subband_activity[k]; l++) {
+                int index = FFMAX(level - l - (int)(av_random(&rnd) % 8), 0);
+
+                s->bitalloc[k][l]        = av_random(&rnd) % 27;
+                s->prediction_mode[k][l] = !(av_random(&rnd) & 3);
+                s->prediction_vq[k][l]   = av_random(&rnd) % 4096;
+                s->transition_mode[k][l] = 0;
+                s->high_freq_vq[k][l]    = av_random(&rnd) % 1024;
+                s->scale_factor[k][l][0] = scale_factor_quant7[index];
+            }
+            for (j = 0; j < 2; j++)
+                s->downmix_coef[k][j] = av_random(&rnd) % 41;
+        }
+        dca_downmix_matrix(s);
+
+        for (j = lfe_samples; j < lfe_samples * 2; j++)
+            s->lfe_data_fix[j] = (int)(av_random(&rnd) % 256) - 128;
+        s->lfe_scale_factor = scale_factor_quant7[level];
+        for (j = lfe_samples; j < lfe_samples * 2; j++) {
+            s->lfe_data[j] = s->lfe_data_fix[j] * (0.035 * s->lfe_scale_factor);
+            s->lfe_data_fix[j] = (MUL64(s->lfe_data_fix[j] * LFE_STEP_FIX,
+                                        s->lfe_scale_factor) + (1 << 19)) >> 20;
+        }
+
+        for (s->current_subsubframe = 0; s->current_subsubframe < s->subsubframes;
+             s->current_subsubframe++) {
+            for (k = 0; k < s->prim_channels; k++)
+                for (l = 0; l < s->vq_start_subband[k]; l++) {
+                    int abits = s->bitalloc[k][l];
+                    int range = abits <= 7 ? abits_levels[FFMAX(abits, 1) - 1] / 2 :
+                                             1 << FFMIN(abits - 4, 10);
+
+                    for (m = 0; m < 8; m++)
+                        quant[k][l][m] = abits ? (int)(av_random(&rnd) % (2 * range + 1)) - range : 0;
+                }
+
+            dca_subsubframe_float(s, quant);
+            for (i = 0; i < 256 * channels; i++)
+                out_float[i] = float_to_pcm(s->samples[i]);
+
+            dca_subsubframe_fixed(s, quant);
+
+            for (i = 0; i < 256 * channels; i++)
+                sse += (out_float[i] - s->tsamples[i]) * (out_float[i] - s->tsamples[i]);
+        }
+        s->current_subsubframe = 0;
+        dca_subframe_footer(s);
+    }
+
+    av_free(s);
+
+    if (!sse)
+        return 99.99;
+    return 10 * log10(65535.0 * 65535.0 * TEST_SUBFRAMES * DCA_SUBSUBFAMES_MAX *
+                      256 * channels / sse);
+}
+
+int main(void)
+{
+    static const struct {
+        const char *name;
+        int output;
+    } tests[] = {
+        { "3F2R+LFE",       DCA_3F2R | DCA_LFE },
+        { "3F2R to stereo", DCA_STEREO         },
+    };
+    int i, multirate, ret = 0;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+        for (multirate = 0; multirate < 2; multirate++) {
+            double psnr = test_psnr(tests[i].output, multirate);
+            printf("%-14s %s: fixed vs float PSNR %5.2f dB\n", tests[i].name,
+                   multirate ? "perfect    " : "nonperfect ", psnr);
+            if (psnr < TEST_MIN_PSNR)
+                ret = 1;
+        }
+    return ret;
+}
+#endif
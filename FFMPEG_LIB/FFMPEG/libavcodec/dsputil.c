@@ -4186,6 +4186,14 @@ void dsputil_init(DSPContext* c, AVCodecContext *avctx)
 
 #ifdef CONFIG_VORBIS_DECODER
     c->vorbis_inverse_coupling = vorbis_inverse_coupling;
+#endif
+#ifdef CONFIG_FLAC_ENCODER
+    c->flac_compute_autocorr = ff_flac_compute_autocorr;
+#endif
+#ifdef CONFIG_VP6_DECODER
+    c->vp6_block_variance = ff_vp6_block_variance_c;
+    c->vp6_filter_hv4 = ff_vp6_filter_hv4_c;
+    c->vp6_filter_diag4 = ff_vp6_filter_diag4_c;
 #endif
     c->vector_fmul = vector_fmul_c;
     c->vector_fmul_reverse = vector_fmul_reverse_c;
@@ -63,6 +63,12 @@ void ff_h264_lowres_idct_put_c(uint8_t *dst, int stride, DCTELEM *block);
 void ff_vector_fmul_add_add_c(float *dst, const float *src0, const float *src1,
                               const float *src2, int src3, int blocksize, int step);
 void ff_float_to_int16_c(int16_t *dst, const float *src, int len);
+void ff_flac_compute_autocorr(const int32_t *data, int len, int lag, double *autoc);
+int ff_vp6_block_variance_c(uint8_t *src, int stride);
+void ff_vp6_filter_hv4_c(uint8_t *dst, uint8_t *src, int stride,
+                         int delta, const int16_t *weights);
+void ff_vp6_filter_diag4_c(uint8_t *dst, uint8_t *src, int stride,
+                           const int16_t *h_weights, const int16_t *v_weights);
 
 /* encoding scans */
 extern const uint8_t ff_alternate_horizontal_scan[64];
@@ -337,6 +343,9 @@ typedef struct DSPContext {
      * simd versions: convert floats from [-32768.0,32767.0] without rescaling and arrays are 16byte aligned */
     void (*float_to_int16)(int16_t *dst, const float *src, int len);
 
+    /* Welch-windowed autocorrelation of data for lags 0..lag-1, used by the flac encoder */
+    void (*flac_compute_autocorr)(const int32_t *data, int len, int lag, double *autoc);
+
     /* (I)DCT */
     void (*fdct)(DCTELEM *block/* align 16*/);
     void (*fdct248)(DCTELEM *block/* align 16*/);
@@ -409,6 +418,16 @@ typedef struct DSPContext {
      * last argument is actually round value instead of height
      */
     op_pixels_func put_vc1_mspel_pixels_tab[16];
+
+    /* vp6 functions, all work on 8x8 blocks */
+    /* variance of the 16 pixels at even coordinates, used to disable the 4 tap filter */
+    int (*vp6_block_variance)(uint8_t *src, int stride);
+    /* 4 tap filter along delta (1 or stride), taps at -delta, 0, delta and 2*delta */
+    void (*vp6_filter_hv4)(uint8_t *dst, uint8_t *src, int stride,
+                           int delta, const int16_t *weights);
+    /* horizontal then vertical 4 tap filter, each pass clipped to 8 bits */
+    void (*vp6_filter_diag4)(uint8_t *dst, uint8_t *src, int stride,
+                             const int16_t *h_weights, const int16_t *v_weights);
 } DSPContext;
 
 void dsputil_static_init(void);
@@ -39,6 +39,25 @@ static void decode_mb(MpegEncContext *s){
     MPV_decode_mb(s, s->block);
 }
 
+/**
+ * replaces the current MB with the co-located MB of the previous frame.
+ */
+static void copy_mb(MpegEncContext *s, int mb_x, int mb_y)
+{
+    s->mv_dir = MV_DIR_FORWARD;
+    s->mb_intra=0;
+    s->mv_type = MV_TYPE_16X16;
+    s->mb_skipped=0;
+
+    s->dsp.clear_blocks(s->block[0]);
+
+    s->mb_x= mb_x;
+    s->mb_y= mb_y;
+    s->mv[0][0][0]= 0;
+    s->mv[0][0][1]= 0;
+    decode_mb(s);
+}
+
 /**
  * replaces the current MB with a flat dc only version.
  */
@@ -71,14 +90,21 @@ static void put_dc(MpegEncContext *s, uint8_t *dest_y, uint8_t *dest_cb, uint8_t
     }
 }
 
-static void filter181(int16_t *data, int width, int height, int stride){
+/**
+ * filters the dc plane, only the dc of the blocks within x0,y0 - x1,y1 are
+ * guaranteed to match a filter over the whole plane.
+ */
+static void filter181(int16_t *data, int width, int height, int stride, int x0, int y0, int x1, int y1){
     int x,y;
 
-    /* horizontal filter */
-    for(y=1; y<height-1; y++){
-        int prev_dc= data[0 + y*stride];
+    x0= FFMAX(x0, 1); x1= FFMIN(x1, width -1);
+    y0= FFMAX(y0, 1); y1= FFMIN(y1, height-1);
+
+    /* horizontal filter, the vertical one needs an extra row on each side */
+    for(y=FFMAX(y0-1, 1); y<FFMIN(y1+1, height-1); y++){
+        int prev_dc= data[x0-1 + y*stride];
 
-        for(x=1; x<width-1; x++){
+        for(x=x0; x<x1; x++){
             int dc;
 
             dc= - prev_dc
@@ -91,10 +117,10 @@ static void filter181(int16_t *data, int width, int height, int stride){
     }
 
     /* vertical filter */
-    for(x=1; x<width-1; x++){
-        int prev_dc= data[x];
+    for(x=x0; x<x1; x++){
+        int prev_dc= data[x + (y0-1)*stride];
 
-        for(y=1; y<height-1; y++){
+        for(y=y0; y<y1; y++){
             int dc;
 
             dc= - prev_dc
@@ -111,12 +137,13 @@ static void filter181(int16_t *data, int width, int height, int stride){
  * guess the dc of blocks which dont have a undamaged dc
  * @param w     width in 8 pixel blocks
  * @param h     height in 8 pixel blocks
+ * @param x0,y0,x1,y1 blocks to guess, neighbours outside are still used
  */
-static void guess_dc(MpegEncContext *s, int16_t *dc, int w, int h, int stride, int is_luma){
+static void guess_dc(MpegEncContext *s, int16_t *dc, int w, int h, int stride, int is_luma, int x0, int y0, int x1, int y1){
     int b_x, b_y;
 
-    for(b_y=0; b_y<h; b_y++){
-        for(b_x=0; b_x<w; b_x++){
+    for(b_y=y0; b_y<y1; b_y++){
+        for(b_x=x0; b_x<x1; b_x++){
             int color[4]={1024,1024,1024,1024};
             int distance[4]={9999,9999,9999,9999};
             int mb_index, error, j;
@@ -195,13 +222,18 @@ static void guess_dc(MpegEncContext *s, int16_t *dc, int w, int h, int stride, i
  * simple horizontal deblocking filter used for error resilience
  * @param w     width in 8 pixel blocks
  * @param h     height in 8 pixel blocks
+ * @param x0,x1 edges to filter, edge b_x is the one right of block b_x
+ * @param y0,y1 block rows to filter
  */
-static void h_block_filter(MpegEncContext *s, uint8_t *dst, int w, int h, int stride, int is_luma){
+static void h_block_filter(MpegEncContext *s, uint8_t *dst, int w, int h, int stride, int is_luma, int x0, int y0, int x1, int y1){
     int b_x, b_y;
     uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
 
-    for(b_y=0; b_y<h; b_y++){
-        for(b_x=0; b_x<w-1; b_x++){
+    x0= FFMAX(x0, 0);
+    x1= FFMIN(x1, w-1);
+
+    for(b_y=y0; b_y<y1; b_y++){
+        for(b_x=x0; b_x<x1; b_x++){
             int y;
             int left_status = s->error_status_table[( b_x   >>is_luma) + (b_y>>is_luma)*s->mb_stride];
             int right_status= s->error_status_table[((b_x+1)>>is_luma) + (b_y>>is_luma)*s->mb_stride];
@@ -255,13 +287,18 @@ static void h_block_filter(MpegEncContext *s, uint8_t *dst, int w, int h, int st
  * simple vertical deblocking filter used for error resilience
  * @param w     width in 8 pixel blocks
  * @param h     height in 8 pixel blocks
+ * @param x0,x1 block columns to filter
+ * @param y0,y1 edges to filter, edge b_y is the one below block b_y
  */
-static void v_block_filter(MpegEncContext *s, uint8_t *dst, int w, int h, int stride, int is_luma){
+static void v_block_filter(MpegEncContext *s, uint8_t *dst, int w, int h, int stride, int is_luma, int x0, int y0, int x1, int y1){
     int b_x, b_y;
     uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
 
-    for(b_y=0; b_y<h-1; b_y++){
-        for(b_x=0; b_x<w; b_x++){
+    y0= FFMAX(y0, 0);
+    y1= FFMIN(y1, h-1);
+
+    for(b_y=y0; b_y<y1; b_y++){
+        for(b_x=x0; b_x<x1; b_x++){
             int x;
             int top_status   = s->error_status_table[(b_x>>is_luma) + ( b_y   >>is_luma)*s->mb_stride];
             int bottom_status= s->error_status_table[(b_x>>is_luma) + ((b_y+1)>>is_luma)*s->mb_stride];
@@ -311,7 +348,11 @@ static void v_block_filter(MpegEncContext *s, uint8_t *dst, int w, int h, int st
     }
 }
 
-static void guess_mv(MpegEncContext *s){
+/**
+ * guess the MVs of inter MBs with damaged MVs.
+ * @param x0,y0,x1,y1 MBs which can be damaged, all others must have a usable MV
+ */
+static void guess_mv(MpegEncContext *s, int x0, int y0, int x1, int y1){
     uint8_t* fixed = _alloca(s->mb_stride * s->mb_height * sizeof(uint8_t));
 #define MV_FROZEN    3
 #define MV_CHANGED   2
@@ -337,25 +378,14 @@ static void guess_mv(MpegEncContext *s){
     }
 
     if((!(s->avctx->error_concealment&FF_EC_GUESS_MVS)) || num_avail <= mb_width/2){
-        for(mb_y=0; mb_y<s->mb_height; mb_y++){
-            for(mb_x=0; mb_x<s->mb_width; mb_x++){
+        for(mb_y=y0; mb_y<y1; mb_y++){
+            for(mb_x=x0; mb_x<x1; mb_x++){
                 const int mb_xy= mb_x + mb_y*s->mb_stride;
 
                 if(IS_INTRA(s->current_picture.mb_type[mb_xy]))  continue;
                 if(!(s->error_status_table[mb_xy]&MV_ERROR)) continue;
 
-                s->mv_dir = MV_DIR_FORWARD;
-                s->mb_intra=0;
-                s->mv_type = MV_TYPE_16X16;
-                s->mb_skipped=0;
-
-                s->dsp.clear_blocks(s->block[0]);
-
-                s->mb_x= mb_x;
-                s->mb_y= mb_y;
-                s->mv[0][0][0]= 0;
-                s->mv[0][0][1]= 0;
-                decode_mb(s);
+                copy_mb(s, mb_x, mb_y);
             }
         }
         return;
@@ -371,8 +401,8 @@ static void guess_mv(MpegEncContext *s){
 int score_sum=0;
 
             changed=0;
-            for(mb_y=0; mb_y<s->mb_height; mb_y++){
-                for(mb_x=0; mb_x<s->mb_width; mb_x++){
+            for(mb_y=y0; mb_y<y1; mb_y++){
+                for(mb_x=x0; mb_x<x1; mb_x++){
                     const int mb_xy= mb_x + mb_y*s->mb_stride;
                     int mv_predictor[8][2]={{0}};
                     int pred_count=0;
@@ -597,7 +627,155 @@ static int is_intra_more_likely(MpegEncContext *s){
     return is_intra_likely > 0;
 }
 
+/**
+ * sets the dc of the MBs within x0,y0 - x1,y1 to the average of their pixels.
+ */
+static void fill_dc(MpegEncContext *s, int x0, int y0, int x1, int y1){
+    int mb_x, mb_y;
+
+    for(mb_y=y0; mb_y<y1; mb_y++){
+        for(mb_x=x0; mb_x<x1; mb_x++){
+            int dc, dcu, dcv, y, n;
+            int16_t *dc_ptr;
+            uint8_t *dest_y, *dest_cb, *dest_cr;
+            const int mb_xy= mb_x + mb_y * s->mb_stride;
+            const int mb_type= s->current_picture.mb_type[mb_xy];
+
+            if(IS_INTRA(mb_type) && s->partitioned_frame) continue;
+//            if(error&MV_ERROR) continue; //inter data damaged FIXME is this good?
+
+            dest_y = s->current_picture.data[0] + mb_x*16 + mb_y*16*s->linesize;
+            dest_cb= s->current_picture.data[1] + mb_x*8  + mb_y*8 *s->uvlinesize;
+            dest_cr= s->current_picture.data[2] + mb_x*8  + mb_y*8 *s->uvlinesize;
+
+            dc_ptr= &s->dc_val[0][mb_x*2 + mb_y*2*s->b8_stride];
+            for(n=0; n<4; n++){
+                dc=0;
+                for(y=0; y<8; y++){
+                    int x;
+                    for(x=0; x<8; x++){
+                       dc+= dest_y[x + (n&1)*8 + (y + (n>>1)*8)*s->linesize];
+                    }
+                }
+                dc_ptr[(n&1) + (n>>1)*s->b8_stride]= (dc+4)>>3;
+            }
+
+            dcu=dcv=0;
+            for(y=0; y<8; y++){
+                int x;
+                for(x=0; x<8; x++){
+                    dcu+=dest_cb[x + y*(s->uvlinesize)];
+                    dcv+=dest_cr[x + y*(s->uvlinesize)];
+                }
+            }
+            s->dc_val[1][mb_x + mb_y*s->mb_stride]= (dcu+4)>>3;
+            s->dc_val[2][mb_x + mb_y*s->mb_stride]= (dcv+4)>>3;
+        }
+    }
+}
+
+/**
+ * replaces the intra MBs with damaged AC within x0,y0 - x1,y1 by their dc.
+ */
+static void render_dc(MpegEncContext *s, int x0, int y0, int x1, int y1){
+    int mb_x, mb_y;
+
+    for(mb_y=y0; mb_y<y1; mb_y++){
+        for(mb_x=x0; mb_x<x1; mb_x++){
+            uint8_t *dest_y, *dest_cb, *dest_cr;
+            const int mb_xy= mb_x + mb_y * s->mb_stride;
+            const int mb_type= s->current_picture.mb_type[mb_xy];
+            const int error= s->error_status_table[mb_xy];
+
+            if(IS_INTER(mb_type)) continue;
+            if(!(error&AC_ERROR)) continue;              //undamaged
+
+            dest_y = s->current_picture.data[0] + mb_x*16 + mb_y*16*s->linesize;
+            dest_cb= s->current_picture.data[1] + mb_x*8  + mb_y*8 *s->uvlinesize;
+            dest_cr= s->current_picture.data[2] + mb_x*8  + mb_y*8 *s->uvlinesize;
+
+            put_dc(s, dest_y, dest_cb, dest_cr, mb_x, mb_y);
+        }
+    }
+}
+
+#define ER_FILL_DC  0 ///< fill_dc() over the rows
+#define ER_GUESS_DC 1 ///< guess_dc() of the blocks in the rows
+#define ER_PUT_DC   2 ///< render_dc() and horizontal deblocking of the rows
+#define ER_V_FILTER 3 ///< vertical deblocking of the edges above each row
+
+typedef struct ERSliceJob {
+    MpegEncContext *s;
+    int stage;
+    int start_x, end_x;         ///< MB columns to process
+    int start_y, end_y;         ///< MB rows to process
+} ERSliceJob;
+
+static int er_rows_thread(AVCodecContext *avctx, void *arg){
+    ERSliceJob *job= arg;
+    MpegEncContext *s= job->s;
+    const int x0= job->start_x, x1= job->end_x;
+    const int y0= job->start_y, y1= job->end_y;
+    const int w= s->mb_width, h= s->mb_height;
+
+    switch(job->stage){
+    case ER_FILL_DC:
+        fill_dc(s, x0, y0, x1, y1);
+        break;
+    case ER_GUESS_DC:
+        guess_dc(s, s->dc_val[0], w*2, h*2, s->b8_stride, 1, x0*2, y0*2, x1*2, y1*2);
+        guess_dc(s, s->dc_val[1], w  , h  , s->mb_stride, 0, x0  , y0  , x1  , y1  );
+        guess_dc(s, s->dc_val[2], w  , h  , s->mb_stride, 0, x0  , y0  , x1  , y1  );
+        break;
+    case ER_PUT_DC:
+        render_dc(s, x0, y0, x1, y1);
+
+        if(s->avctx->error_concealment&FF_EC_DEBLOCK){
+            /* filter horizontal block boundaries, including the ones left of x0 */
+            h_block_filter(s, s->current_picture.data[0], w*2, h*2, s->linesize  , 1, x0*2-1, y0*2, x1*2, y1*2);
+            h_block_filter(s, s->current_picture.data[1], w  , h  , s->uvlinesize, 0, x0  -1, y0  , x1  , y1  );
+            h_block_filter(s, s->current_picture.data[2], w  , h  , s->uvlinesize, 0, x0  -1, y0  , x1  , y1  );
+        }
+        break;
+    case ER_V_FILTER:
+        /* filter vertical block boundaries, the edges are assigned to the
+         * row below them so the rows never write to the same lines */
+        v_block_filter(s, s->current_picture.data[0], w*2, h*2, s->linesize  , 1, x0*2, y0*2-1, x1*2, y1*2-1);
+        v_block_filter(s, s->current_picture.data[1], w  , h  , s->uvlinesize, 0, x0  , y0  -1, x1  , y1  -1);
+        v_block_filter(s, s->current_picture.data[2], w  , h  , s->uvlinesize, 0, x0  , y0  -1, x1  , y1  -1);
+        break;
+    }
+    return 0;
+}
+
+/**
+ * runs one stage of the concealment over the MB rows y0 - y1, split into
+ * one band of rows per thread.
+ */
+static void execute_rows(MpegEncContext *s, int stage, int x0, int y0, int x1, int y1){
+    ERSliceJob job[MAX_THREADS];
+    void *job_ptr[MAX_THREADS];
+    int count= FFMIN(FFMIN(s->avctx->thread_count, MAX_THREADS), y1 - y0);
+    int i;
+
+    if(count<1)
+        return;
+
+    for(i=0; i<count; i++){
+        job[i].s= s;
+        job[i].stage= stage;
+        job[i].start_x= x0;
+        job[i].end_x  = x1;
+        job[i].start_y= y0 + (y1 - y0)* i   /count;
+        job[i].end_y  = y0 + (y1 - y0)*(i+1)/count;
+        job_ptr[i]= &job[i];
+    }
+    s->avctx->execute(s->avctx, er_rows_thread, job_ptr, NULL, count);
+}
+
 void ff_er_frame_start(MpegEncContext *s){
+    s->avctx->concealed_mbs= 0;
+
     if(!s->error_resilience) return;
 
     memset(s->error_status_table, MV_ERROR|AC_ERROR|DC_ERROR|VP_START|AC_END|DC_END|MV_END, s->mb_stride*s->mb_height*sizeof(uint8_t));
@@ -667,7 +845,8 @@ void ff_er_add_slice(MpegEncContext *s, int startx, int starty, int endx, int en
 }
 
 void ff_er_frame_end(MpegEncContext *s){
-    int i, mb_x, mb_y, error, error_type, dc_error, mv_error, ac_error;
+    int i, mb_x, mb_y, error, error_type, dc_error, mv_error, ac_error, damaged;
+    int x0, y0, x1, y1;
     int distance;
     int threshold_part[4]= {100,100,100};
     int threshold= 50;
@@ -678,6 +857,10 @@ void ff_er_frame_end(MpegEncContext *s){
     if(!s->error_resilience || s->error_count==0 ||
        s->error_count==3*s->mb_width*(s->avctx->skip_top + s->avctx->skip_bottom)) return;
 
+    /* concealment may touch any MB, so the change map is no longer reliable */
+    pic->mb_changed_stride= 0;
+    s->current_picture.mb_changed_stride= 0;
+
     if(s->current_picture.motion_val[0] == NULL){
         av_log(s->avctx, AV_LOG_ERROR, "Warning MVs not available\n");
 
@@ -826,16 +1009,54 @@ void ff_er_frame_end(MpegEncContext *s){
     }
 #endif
 
-    dc_error= ac_error= mv_error=0;
+    /* count the errors and find the rectangle of damaged MBs, nothing outside
+     * of it plus a one MB border is touched by the concealment */
+    dc_error= ac_error= mv_error= damaged= 0;
+    x0= s->mb_width; y0= s->mb_height;
+    x1= y1= 0;
     for(i=0; i<s->mb_num; i++){
         const int mb_xy= s->mb_index2xy[i];
         error= s->error_status_table[mb_xy];
         if(error&DC_ERROR) dc_error ++;
         if(error&AC_ERROR) ac_error ++;
         if(error&MV_ERROR) mv_error ++;
+        if(error&(DC_ERROR|AC_ERROR|MV_ERROR)){
+            mb_x= i % s->mb_width;
+            mb_y= i / s->mb_width;
+            x0= FFMIN(x0, mb_x  );
+            y0= FFMIN(y0, mb_y  );
+            x1= FFMAX(x1, mb_x+1);
+            y1= FFMAX(y1, mb_y+1);
+            damaged++;
+        }
     }
     av_log(s->avctx, AV_LOG_INFO, "concealing %d DC, %d AC, %d MV errors\n", dc_error, ac_error, mv_error);
 
+    s->avctx->concealed_mbs= damaged;
+    s->avctx->concealed_mbs_total+= damaged;
+    if(!damaged)
+        goto ec_clean;
+
+    /* fast mode, copy the damaged MBs from the previous frame */
+    if((s->avctx->error_concealment&FF_EC_COPY_REF) && s->last_picture_ptr && s->last_picture_ptr->data[0]){
+        for(mb_y=y0; mb_y<y1; mb_y++){
+            for(mb_x=x0; mb_x<x1; mb_x++){
+                const int mb_xy= mb_x + mb_y * s->mb_stride;
+                const int mot_index= mb_x*2 + mb_y*2*s->b8_stride;
+
+                if(!(s->error_status_table[mb_xy]&(DC_ERROR|AC_ERROR|MV_ERROR))) continue;
+
+                s->current_picture.mb_type[mb_xy]= MB_TYPE_16x16 | MB_TYPE_L0;
+                for(i=0; i<4; i++){
+                    s->current_picture.motion_val[0][mot_index + (i&1) + (i>>1)*s->b8_stride][0]= 0;
+                    s->current_picture.motion_val[0][mot_index + (i&1) + (i>>1)*s->b8_stride][1]= 0;
+                }
+                copy_mb(s, mb_x, mb_y);
+            }
+        }
+        goto ec_clean;
+    }
+
     is_intra_likely= is_intra_more_likely(s);
 
     /* set unknown mb-type to most likely */
@@ -852,8 +1073,8 @@ void ff_er_frame_end(MpegEncContext *s){
     }
 
     /* handle inter blocks with damaged AC */
-    for(mb_y=0; mb_y<s->mb_height; mb_y++){
-        for(mb_x=0; mb_x<s->mb_width; mb_x++){
+    for(mb_y=y0; mb_y<y1; mb_y++){
+        for(mb_x=x0; mb_x<x1; mb_x++){
             const int mb_xy= mb_x + mb_y * s->mb_stride;
             const int mb_type= s->current_picture.mb_type[mb_xy];
             error= s->error_status_table[mb_xy];
@@ -889,8 +1110,8 @@ void ff_er_frame_end(MpegEncContext *s){
 
     /* guess MVs */
     if(s->pict_type==B_TYPE){
-        for(mb_y=0; mb_y<s->mb_height; mb_y++){
-            for(mb_x=0; mb_x<s->mb_width; mb_x++){
+        for(mb_y=y0; mb_y<y1; mb_y++){
+            for(mb_x=x0; mb_x<x1; mb_x++){
                 int xy= mb_x*2 + mb_y*2*s->b8_stride;
                 const int mb_xy= mb_x + mb_y * s->mb_stride;
                 const int mb_type= s->current_picture.mb_type[mb_xy];
@@ -927,100 +1148,32 @@ void ff_er_frame_end(MpegEncContext *s){
             }
         }
     }else
-        guess_mv(s);
+        guess_mv(s, x0, y0, x1, y1);
 
 #ifdef HAVE_XVMC
     /* the filters below are not XvMC compatible, skip them */
     if(s->avctx->xvmc_acceleration) goto ec_clean;
 #endif
-    /* fill DC for inter blocks */
-    for(mb_y=0; mb_y<s->mb_height; mb_y++){
-        for(mb_x=0; mb_x<s->mb_width; mb_x++){
-            int dc, dcu, dcv, y, n;
-            int16_t *dc_ptr;
-            uint8_t *dest_y, *dest_cb, *dest_cr;
-            const int mb_xy= mb_x + mb_y * s->mb_stride;
-            const int mb_type= s->current_picture.mb_type[mb_xy];
-
-            error= s->error_status_table[mb_xy];
-
-            if(IS_INTRA(mb_type) && s->partitioned_frame) continue;
-//            if(error&MV_ERROR) continue; //inter data damaged FIXME is this good?
-
-            dest_y = s->current_picture.data[0] + mb_x*16 + mb_y*16*s->linesize;
-            dest_cb= s->current_picture.data[1] + mb_x*8  + mb_y*8 *s->uvlinesize;
-            dest_cr= s->current_picture.data[2] + mb_x*8  + mb_y*8 *s->uvlinesize;
-
-            dc_ptr= &s->dc_val[0][mb_x*2 + mb_y*2*s->b8_stride];
-            for(n=0; n<4; n++){
-                dc=0;
-                for(y=0; y<8; y++){
-                    int x;
-                    for(x=0; x<8; x++){
-                       dc+= dest_y[x + (n&1)*8 + (y + (n>>1)*8)*s->linesize];
-                    }
-                }
-                dc_ptr[(n&1) + (n>>1)*s->b8_stride]= (dc+4)>>3;
-            }
-
-            dcu=dcv=0;
-            for(y=0; y<8; y++){
-                int x;
-                for(x=0; x<8; x++){
-                    dcu+=dest_cb[x + y*(s->uvlinesize)];
-                    dcv+=dest_cr[x + y*(s->uvlinesize)];
-                }
-            }
-            s->dc_val[1][mb_x + mb_y*s->mb_stride]= (dcu+4)>>3;
-            s->dc_val[2][mb_x + mb_y*s->mb_stride]= (dcv+4)>>3;
-        }
-    }
+    /* fill DC for inter blocks, guess_dc() and filter181() read the dc of
+     * the undamaged neighbours */
+    execute_rows(s, ER_FILL_DC, FFMAX(x0-1, 0), FFMAX(y0-1, 0),
+                 FFMIN(x1+1, s->mb_width), FFMIN(y1+1, s->mb_height));
 #if 1
     /* guess DC for damaged blocks */
-    guess_dc(s, s->dc_val[0], s->mb_width*2, s->mb_height*2, s->b8_stride, 1);
-    guess_dc(s, s->dc_val[1], s->mb_width  , s->mb_height  , s->mb_stride, 0);
-    guess_dc(s, s->dc_val[2], s->mb_width  , s->mb_height  , s->mb_stride, 0);
+    execute_rows(s, ER_GUESS_DC, x0, y0, x1, y1);
 #endif
     /* filter luma DC */
-    filter181(s->dc_val[0], s->mb_width*2, s->mb_height*2, s->b8_stride);
+    filter181(s->dc_val[0], s->mb_width*2, s->mb_height*2, s->b8_stride, x0*2, y0*2, x1*2, y1*2);
 
-#if 1
-    /* render DC only intra */
-    for(mb_y=0; mb_y<s->mb_height; mb_y++){
-        for(mb_x=0; mb_x<s->mb_width; mb_x++){
-            uint8_t *dest_y, *dest_cb, *dest_cr;
-            const int mb_xy= mb_x + mb_y * s->mb_stride;
-            const int mb_type= s->current_picture.mb_type[mb_xy];
-
-            error= s->error_status_table[mb_xy];
-
-            if(IS_INTER(mb_type)) continue;
-            if(!(error&AC_ERROR)) continue;              //undamaged
-
-            dest_y = s->current_picture.data[0] + mb_x*16 + mb_y*16*s->linesize;
-            dest_cb= s->current_picture.data[1] + mb_x*8  + mb_y*8 *s->uvlinesize;
-            dest_cr= s->current_picture.data[2] + mb_x*8  + mb_y*8 *s->uvlinesize;
-
-            put_dc(s, dest_y, dest_cb, dest_cr, mb_x, mb_y);
-        }
-    }
-#endif
+    /* render DC only intra and filter horizontal block boundaries */
+    execute_rows(s, ER_PUT_DC, x0, y0, x1, y1);
 
     if(s->avctx->error_concealment&FF_EC_DEBLOCK){
-        /* filter horizontal block boundaries */
-        h_block_filter(s, s->current_picture.data[0], s->mb_width*2, s->mb_height*2, s->linesize  , 1);
-        h_block_filter(s, s->current_picture.data[1], s->mb_width  , s->mb_height  , s->uvlinesize, 0);
-        h_block_filter(s, s->current_picture.data[2], s->mb_width  , s->mb_height  , s->uvlinesize, 0);
-
-        /* filter vertical block boundaries */
-        v_block_filter(s, s->current_picture.data[0], s->mb_width*2, s->mb_height*2, s->linesize  , 1);
-        v_block_filter(s, s->current_picture.data[1], s->mb_width  , s->mb_height  , s->uvlinesize, 0);
-        v_block_filter(s, s->current_picture.data[2], s->mb_width  , s->mb_height  , s->uvlinesize, 0);
+        /* filter vertical block boundaries, including the ones below y1 */
+        execute_rows(s, ER_V_FILTER, x0, y0, x1, FFMIN(y1+1, s->mb_height));
     }
 
-#ifdef HAVE_XVMC
 ec_clean:
-#endif
     /* clean a few tables */
     for(i=0; i<s->mb_num; i++){
         const int mb_xy= s->mb_index2xy[i];
@@ -21,6 +21,7 @@
 
 #include "avcodec.h"
 #include "bitstream.h"
+#include "dsputil.h"
 #include "crc.h"
 #include "golomb.h"
 #include "lls.h"
@@ -68,6 +69,7 @@ typedef struct CompressionOptions {
     int prediction_order_method;
     int min_partition_order;
     int max_partition_order;
+    int stereo_search;
 } CompressionOptions;
 
 typedef struct RiceContext {
@@ -107,6 +109,7 @@ typedef struct FlacEncodeContext {
     FlacFrame frame;
     CompressionOptions options;
     AVCodecContext *avctx;
+    DSPContext dsp;
 } FlacEncodeContext;
 
 static const int flac_samplerates[16] = {
@@ -241,6 +244,7 @@ static int flac_encode_init(AVCodecContext *avctx)
                                                    ORDER_METHOD_SEARCH})[level];
     s->options.min_partition_order = ((int[]){  2,  2,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0})[level];
     s->options.max_partition_order = ((int[]){  2,  2,  3,  3,  3,  8,  8,  8,  8,  8,  8,  8,  8})[level];
+    s->options.stereo_search       = ((int[]){  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1})[level];
 
     /* set compression option overrides from AVCodecContext */
     if(avctx->use_lpc >= 0) {
@@ -391,6 +395,8 @@ static int flac_encode_init(AVCodecContext *avctx)
 
     s->frame_count = 0;
 
+    dsputil_init(&s->dsp, avctx);
+
     avctx->coded_frame = avcodec_alloc_frame();
     avctx->coded_frame->key_frame = 1;
 
@@ -447,20 +453,21 @@ static void copy_samples(FlacEncodeContext *s, int16_t *samples)
 
 #define rice_encode_count(sum, n, k) (((n)*((k)+1))+((sum-(n>>1))>>(k)))
 
+/**
+ * Rice parameter for a partition, from the mean of its folded residuals.
+ * The bit count is convex in k with its minimum at log2(mean), so no
+ * search is needed.
+ */
 static int find_optimal_param(uint32_t sum, int n)
 {
-    int k, k_opt;
-    uint32_t nbits[MAX_RICE_PARAM+1];
-
-    k_opt = 0;
-    nbits[0] = UINT32_MAX;
-    for(k=0; k<=MAX_RICE_PARAM; k++) {
-        nbits[k] = rice_encode_count(sum, n, k);
-        if(nbits[k] < nbits[k_opt]) {
-            k_opt = k;
-        }
-    }
-    return k_opt;
+    int k;
+    uint32_t sum2;
+
+    if(sum <= n>>1)
+        return 0;
+    sum2 = sum-(n>>1);
+    k = av_log2(n<256 ? FASTDIV(sum2, n) : sum2/n);
+    return FFMIN(k, MAX_RICE_PARAM);
 }
 
 static uint32_t calc_optimal_rice_params(RiceContext *rc, int porder,
@@ -487,22 +494,24 @@ static uint32_t calc_optimal_rice_params(RiceContext *rc, int porder,
     return all_bits;
 }
 
-static void calc_sums(int pmin, int pmax, uint32_t *data, int n, int pred_order,
+static void calc_sums(int pmin, int pmax, const int32_t *data, int n, int pred_order,
                       uint32_t sums[][MAX_PARTITIONS])
 {
     int i, j;
     int parts;
-    uint32_t *res, *res_end;
+    const int32_t *res, *res_end;
 
-    /* sums for highest level */
+    /* sums for highest level, folding the signed residual on the fly */
     parts = (1 << pmax);
     res = &data[pred_order];
     res_end = &data[n >> pmax];
     for(i=0; i<parts; i++) {
-        sums[pmax][i] = 0;
+        uint32_t sum = 0;
         while(res < res_end){
-            sums[pmax][i] += *(res++);
+            sum += (2 * *res) ^ (*res >> 31);
+            res++;
         }
+        sums[pmax][i] = sum;
         res_end+= n >> pmax;
     }
     /* sums for lower levels */
@@ -521,19 +530,13 @@ static uint32_t calc_rice_params(RiceContext *rc, int pmin, int pmax,
     uint32_t bits[MAX_PARTITION_ORDER+1];
     int opt_porder;
     RiceContext tmp_rc;
-    uint32_t *udata;
     uint32_t sums[MAX_PARTITION_ORDER+1][MAX_PARTITIONS];
 
     assert(pmin >= 0 && pmin <= MAX_PARTITION_ORDER);
     assert(pmax >= 0 && pmax <= MAX_PARTITION_ORDER);
     assert(pmin <= pmax);
 
-    udata = av_malloc(n * sizeof(uint32_t));
-    for(i=0; i<n; i++) {
-        udata[i] = (2*data[i]) ^ (data[i]>>31);
-    }
-
-    calc_sums(pmin, pmax, udata, n, pred_order, sums);
+    calc_sums(pmin, pmax, data, n, pred_order, sums);
 
     opt_porder = pmin;
     bits[pmin] = UINT32_MAX;
@@ -545,7 +548,6 @@ static uint32_t calc_rice_params(RiceContext *rc, int pmin, int pmax,
         }
     }
 
-    av_freep(&udata);
     return bits[opt_porder];
 }
 
@@ -601,27 +603,34 @@ static void apply_welch_window(const int32_t *data, int len, double *w_data)
 }
 
 /**
- * Calculates autocorrelation data from audio samples
+ * Calculates autocorrelation data from audio samples for lags 0..lag-1
  * A Welch window function is applied before calculation.
  */
-static void compute_autocorr(const int32_t *data, int len, int lag,
-                             double *autoc)
+void ff_flac_compute_autocorr(const int32_t *data, int len, int lag,
+                              double *autoc)
 {
-    int i, lag_ptr;
-    double tmp[len + lag];
+    int i, j;
+    double tmp[len + lag + 1];
     double *data1= tmp + lag;
 
     apply_welch_window(data, len, data1);
-
-    for(i=0; i<lag; i++){
-        autoc[i] = 1.0;
-        data1[i-lag]= 0.0;
-    }
-
-    for(i=0; i<len; i++){
-        for(lag_ptr= i-lag; lag_ptr<=i; lag_ptr++){
-            autoc[i-lag_ptr] += data1[i] * data1[lag_ptr];
+    if(len & 1)
+        data1[len >> 1] = 0.0;
+
+    for(j=0; j<lag; j++)
+        data1[j-lag]= 0.0;
+    data1[len] = 0.0;
+
+    /* two lags per pass share the loads of data1[i] */
+    for(j=0; j<lag; j+=2){
+        double sum0 = 1.0, sum1 = 1.0;
+        for(i=j; i<len; i++){
+            sum0 += data1[i] * data1[i-j];
+            sum1 += data1[i] * data1[i-j-1];
         }
+        autoc[j] = sum0;
+        if(j+1 < lag)
+            autoc[j+1] = sum1;
     }
 }
 
@@ -735,7 +744,8 @@ static int estimate_best_order(double *ref, int max_order)
 /**
  * Calculate LPC coefficients for multiple orders
  */
-static int lpc_calc_coefs(const int32_t *samples, int blocksize, int max_order,
+static int lpc_calc_coefs(FlacEncodeContext *s,
+                          const int32_t *samples, int blocksize, int max_order,
                           int precision, int32_t coefs[][MAX_LPC_ORDER],
                           int *shift, int use_lpc, int omethod)
 {
@@ -748,7 +758,7 @@ static int lpc_calc_coefs(const int32_t *samples, int blocksize, int max_order,
     assert(max_order >= MIN_LPC_ORDER && max_order <= MAX_LPC_ORDER);
 
     if(use_lpc == 1){
-        compute_autocorr(samples, blocksize, max_order+1, autoc);
+        s->dsp.flac_compute_autocorr(samples, blocksize, max_order+1, autoc);
 
         compute_lpc_coefs(autoc, max_order, lpc, ref);
     }else{
@@ -843,7 +853,20 @@ static void encode_residual_lpc(int32_t *res, const int32_t *smp, int n,
     for(i=0; i<order; i++) {
         res[i] = smp[i];
     }
-    for(i=order; i<n; i++) {
+    /* two outputs per pass, each sample is loaded once for both */
+    for(i=order; i<n-1; i+=2) {
+        int32_t s = smp[i];
+        int32_t p0 = 0, p1 = 0;
+        for(j=0; j<order; j++) {
+            int32_t c = coefs[j];
+            p1 += c * s;
+            s = smp[i-j-1];
+            p0 += c * s;
+        }
+        res[i  ] = smp[i  ] - (p0 >> shift);
+        res[i+1] = smp[i+1] - (p1 >> shift);
+    }
+    for(; i<n; i++) {
         pred = 0;
         for(j=0; j<order; j++) {
             pred += coefs[j] * smp[i-j-1];
@@ -919,7 +942,7 @@ static int encode_residual(FlacEncodeContext *ctx, int ch)
     }
 
     /* LPC */
-    opt_order = lpc_calc_coefs(smp, n, max_order, precision, coefs, shift, ctx->options.use_lpc, omethod);
+    opt_order = lpc_calc_coefs(ctx, smp, n, max_order, precision, coefs, shift, ctx->options.use_lpc, omethod);
 
     if(omethod == ORDER_METHOD_2LEVEL ||
        omethod == ORDER_METHOD_4LEVEL ||
@@ -1113,6 +1136,102 @@ static void channel_decorrelation(FlacEncodeContext *ctx)
     }
 }
 
+static int encode_residual_thread(AVCodecContext *avctx, void *arg)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacSubframe *sub = arg;
+
+    return encode_residual(s, sub - s->frame.subframes);
+}
+
+/**
+ * Encode the first count subframes, in parallel when threads are available
+ * @param bits if not NULL, receives the estimated bit count of each subframe
+ */
+static void encode_channels(FlacEncodeContext *s, int count, int *bits)
+{
+    AVCodecContext *avctx = s->avctx;
+    void *args[FLAC_MAX_CH];
+    int ch, jobs;
+
+    for(ch=0; ch<count; ch++)
+        args[ch] = &s->frame.subframes[ch];
+
+    for(ch=0; ch<count; ch+=jobs) {
+        jobs = FFMIN(count - ch, FFMAX(avctx->thread_count, 1));
+        avctx->execute(avctx, encode_residual_thread, args + ch,
+                       bits ? bits + ch : NULL, jobs);
+    }
+}
+
+static void copy_subframe(FlacSubframe *dst, const FlacSubframe *src, int n)
+{
+    dst->type      = src->type;
+    dst->type_code = src->type_code;
+    dst->obits     = src->obits;
+    dst->order     = src->order;
+    dst->shift     = src->shift;
+    dst->rc        = src->rc;
+    memcpy(dst->coefs,    src->coefs,    sizeof(dst->coefs));
+    memcpy(dst->samples,  src->samples,  n * sizeof(int32_t));
+    memcpy(dst->residual, src->residual, n * sizeof(int32_t));
+}
+
+/**
+ * Encode a stereo frame by coding left, right, mid and side in parallel
+ * and keeping the cheapest pair, instead of estimating the mode up front
+ */
+static void encode_stereo_search(FlacEncodeContext *s)
+{
+    FlacFrame *frame;
+    FlacSubframe *sub;
+    int32_t *left, *right, *mid, *side;
+    int bits[4];
+    int64_t score[4];
+    int i, n, best;
+
+    frame = &s->frame;
+    sub = frame->subframes;
+    n = frame->blocksize;
+    left  = sub[0].samples;
+    right = sub[1].samples;
+    mid   = sub[2].samples;
+    side  = sub[3].samples;
+
+    for(i=0; i<n; i++) {
+        mid[i]  = (left[i] + right[i]) >> 1;
+        side[i] = left[i] - right[i];
+    }
+    sub[2].obits = 16;
+    sub[3].obits = 17;
+
+    encode_channels(s, 4, bits);
+
+    score[0] = (int64_t)bits[0] + bits[1];
+    score[1] = (int64_t)bits[0] + bits[3];
+    score[2] = (int64_t)bits[3] + bits[1];
+    score[3] = (int64_t)bits[2] + bits[3];
+    best = 0;
+    for(i=1; i<4; i++) {
+        if(score[i] < score[best])
+            best = i;
+    }
+
+    if(best == 0) {
+        frame->ch_mode = FLAC_CHMODE_LEFT_RIGHT;
+    } else if(best == 1) {
+        frame->ch_mode = FLAC_CHMODE_LEFT_SIDE;
+        copy_subframe(&sub[1], &sub[3], n);
+    } else if(best == 2) {
+        frame->ch_mode = FLAC_CHMODE_RIGHT_SIDE;
+        copy_subframe(&sub[0], &sub[3], n);
+    } else {
+        frame->ch_mode = FLAC_CHMODE_MID_SIDE;
+        copy_subframe(&sub[0], &sub[2], n);
+        copy_subframe(&sub[1], &sub[3], n);
+    }
+}
+
 static void put_sbits(PutBitContext *pb, int bits, int32_t val)
 {
     assert(bits >= 0 && bits <= 31);
@@ -1317,10 +1436,11 @@ static int flac_encode_frame(AVCodecContext *avctx, uint8_t *frame,
 
     copy_samples(s, samples);
 
-    channel_decorrelation(s);
-
-    for(ch=0; ch<s->channels; ch++) {
-        encode_residual(s, ch);
+    if(s->channels == 2 && s->options.stereo_search) {
+        encode_stereo_search(s);
+    } else {
+        channel_decorrelation(s);
+        encode_channels(s, s->channels, NULL);
     }
     init_put_bits(&s->pb, frame, buf_size);
     output_frame_header(s);
@@ -5754,7 +5754,6 @@ static int decode_cabac_residual( H264Context *h, DCTELEM *block, int cat, int n
 
     int index[64];
 
-    int last;
     int coeff_count = 0;
 
     int abslevel1 = 1;
@@ -5810,30 +5809,17 @@ static int decode_cabac_residual( H264Context *h, DCTELEM *block, int cat, int n
         + coeff_abs_level_m1_offset[cat];
 
     if( cat == 5 ) {
-#define DECODE_SIGNIFICANCE( coefs, sig_off, last_off ) \
-        for(last= 0; last < coefs; last++) { \
-            uint8_t *sig_ctx = significant_coeff_ctx_base + sig_off; \
-            if( get_cabac( CC, sig_ctx )) { \
-                uint8_t *last_ctx = last_coeff_ctx_base + last_off; \
-                index[coeff_count++] = last; \
-                if( get_cabac( CC, last_ctx ) ) { \
-                    last= max_coeff; \
-                    break; \
-                } \
-            } \
-        }\
-        if( last == max_coeff -1 ) {\
-            index[coeff_count++] = last;\
-        }
         const uint8_t *sig_off = significant_coeff_flag_offset_8x8[MB_FIELD];
 #if defined(ARCH_X86) && defined(CONFIG_7REGS) && defined(HAVE_EBX_AVAILABLE) && !defined(BROKEN_RELOCATIONS)
         coeff_count= decode_significance_8x8_x86(CC, significant_coeff_ctx_base, index, sig_off);
     } else {
         coeff_count= decode_significance_x86(CC, max_coeff, significant_coeff_ctx_base, index);
 #else
-        DECODE_SIGNIFICANCE( 63, sig_off[last], last_coeff_flag_offset_8x8[last] );
+        coeff_count= decode_significance_c(CC, 64, significant_coeff_ctx_base, last_coeff_ctx_base,
+                                           sig_off, last_coeff_flag_offset_8x8, index);
     } else {
-        DECODE_SIGNIFICANCE( max_coeff - 1, last, last );
+        coeff_count= decode_significance_c(CC, max_coeff, significant_coeff_ctx_base, last_coeff_ctx_base,
+                                           NULL, NULL, index);
 #endif
     }
     assert(coeff_count > 0);
@@ -3163,6 +3163,183 @@ static void float_to_int16_sse(int16_t *dst, const float *src, int len){
     asm volatile("emms");
 }
 
+#ifdef CONFIG_FLAC_ENCODER
+static void flac_compute_autocorr_sse2(const int32_t *data, int len, int lag,
+                                       double *autoc)
+{
+    double tmp[len + lag + 3];
+    double *data1;
+    double c, w, sum0, sum1;
+    const double one = 1.0;
+    int i, j, n2;
+
+    /* lag zeros in front, one behind so that the length can be rounded up
+       to a multiple of 2, and the start aligned to 16 bytes */
+    data1 = (double*)(((long)(tmp + lag) + 15) & ~15L);
+
+    n2 = len >> 1;
+    c = 2.0 / (len - 1.0);
+    for(i=0; i<n2; i++) {
+        w = c - i - 1.0;
+        w = 1.0 - (w * w);
+        data1[i] = data[i] * w;
+        data1[len-1-i] = data[len-1-i] * w;
+    }
+    if(len & 1)
+        data1[n2] = 0.0;
+    for(j=0; j<lag; j++)
+        data1[j-lag] = 0.0;
+    data1[len] = 0.0;
+    len = (len + 1) & ~1;
+
+    for(j=0; j<lag; j+=2) {
+        long i = -len*sizeof(double);
+        asm volatile(
+            "movsd     %5,       %%xmm0 \n\t"
+            "movsd     %5,       %%xmm1 \n\t"
+            "1:                         \n\t"
+            "movapd   (%3,%0),   %%xmm2 \n\t"
+            "movapd   (%4,%0),   %%xmm3 \n\t"
+            "movupd -8(%4,%0),   %%xmm4 \n\t"
+            "mulpd     %%xmm2,   %%xmm3 \n\t"
+            "mulpd     %%xmm2,   %%xmm4 \n\t"
+            "addpd     %%xmm3,   %%xmm0 \n\t"
+            "addpd     %%xmm4,   %%xmm1 \n\t"
+            "add       $16,      %0     \n\t"
+            "jl 1b                      \n\t"
+            "movhlps   %%xmm0,   %%xmm2 \n\t"
+            "movhlps   %%xmm1,   %%xmm3 \n\t"
+            "addsd     %%xmm2,   %%xmm0 \n\t"
+            "addsd     %%xmm3,   %%xmm1 \n\t"
+            "movsd     %%xmm0,   %1     \n\t"
+            "movsd     %%xmm1,   %2     \n\t"
+            :"+&r"(i), "=m"(sum0), "=m"(sum1)
+            :"r"(data1+len), "r"(data1+len-j), "m"(one)
+        );
+        autoc[j] = sum0;
+        if(j+1 < lag)
+            autoc[j+1] = sum1;
+    }
+}
+#endif
+
+#ifdef CONFIG_VP6_DECODER
+static int vp6_block_variance_mmx(uint8_t *src, int stride)
+{
+    int sum, square_sum, h = 4;
+
+    asm volatile(
+        "pxor      %%mm5, %%mm5         \n\t"
+        "pxor      %%mm6, %%mm6         \n\t"
+        "pcmpeqw   %%mm7, %%mm7         \n\t"
+        "psrlw        $8, %%mm7         \n\t" /* 0x00FF words */
+        "1:                             \n\t"
+        "movq       (%2), %%mm0         \n\t"
+        "pand      %%mm7, %%mm0         \n\t" /* even pixels as words */
+        "paddw     %%mm0, %%mm5         \n\t"
+        "pmaddwd   %%mm0, %%mm0         \n\t"
+        "paddd     %%mm0, %%mm6         \n\t"
+        "add          %4, %2            \n\t"
+        "decl         %3                \n\t"
+        "jnz 1b                         \n\t"
+        "pmaddwd      %5, %%mm5         \n\t"
+        "movq      %%mm5, %%mm0         \n\t"
+        "movq      %%mm6, %%mm1         \n\t"
+        "psrlq       $32, %%mm5         \n\t"
+        "psrlq       $32, %%mm6         \n\t"
+        "paddd     %%mm0, %%mm5         \n\t"
+        "paddd     %%mm1, %%mm6         \n\t"
+        "movd      %%mm5, %0            \n\t"
+        "movd      %%mm6, %1            \n\t"
+        : "=&r"(sum), "=&r"(square_sum), "+r"(src), "+r"(h)
+        : "g"(2*(long)stride), "m"(mm_wone)
+    );
+    return (16*square_sum - sum*sum) >> 8;
+}
+
+/**
+ * 8 pixels wide 4 tap filter, taps at src-delta, src, src+delta and
+ * src+2*delta. The two partial sums can not overflow with the vp6
+ * weights, the final saturation matches the clipping of the C version.
+ */
+static void vp6_filter4_mmx(uint8_t *dst, long dst_stride,
+                            uint8_t *src, long src_stride,
+                            long delta, const int16_t *weights, int h)
+{
+    DECLARE_ALIGNED_8(uint64_t, w[4]);
+    int i;
+
+    for (i=0; i<4; i++)
+        w[i] = (uint16_t)weights[i] * 0x0001000100010001ULL;
+    src -= delta;
+
+    asm volatile(
+        "pxor      %%mm7, %%mm7         \n\t"
+        "movq         %7, %%mm6         \n\t" /* 64 */
+        "1:                             \n\t"
+        "movq       (%1), %%mm0         \n\t"
+        "movq    (%1,%5), %%mm1         \n\t"
+        "movq      %%mm0, %%mm2         \n\t"
+        "movq      %%mm1, %%mm3         \n\t"
+        "punpcklbw %%mm7, %%mm0         \n\t"
+        "punpcklbw %%mm7, %%mm1         \n\t"
+        "punpckhbw %%mm7, %%mm2         \n\t"
+        "punpckhbw %%mm7, %%mm3         \n\t"
+        "pmullw       %8, %%mm0         \n\t" /* src[x-delta]   * weights[0] */
+        "pmullw       %9, %%mm1         \n\t" /* src[x]         * weights[1] */
+        "pmullw       %8, %%mm2         \n\t"
+        "pmullw       %9, %%mm3         \n\t"
+        "paddw     %%mm1, %%mm0         \n\t"
+        "paddw     %%mm3, %%mm2         \n\t"
+        "movq  (%1,%5,2), %%mm1         \n\t"
+        "movq    (%1,%6), %%mm3         \n\t"
+        "movq      %%mm1, %%mm4         \n\t"
+        "movq      %%mm3, %%mm5         \n\t"
+        "punpcklbw %%mm7, %%mm1         \n\t"
+        "punpcklbw %%mm7, %%mm3         \n\t"
+        "punpckhbw %%mm7, %%mm4         \n\t"
+        "punpckhbw %%mm7, %%mm5         \n\t"
+        "pmullw      %10, %%mm1         \n\t" /* src[x+delta]   * weights[2] */
+        "pmullw      %11, %%mm3         \n\t" /* src[x+2*delta] * weights[3] */
+        "pmullw      %10, %%mm4         \n\t"
+        "pmullw      %11, %%mm5         \n\t"
+        "paddw     %%mm3, %%mm1         \n\t"
+        "paddw     %%mm5, %%mm4         \n\t"
+        "paddsw    %%mm1, %%mm0         \n\t"
+        "paddsw    %%mm4, %%mm2         \n\t"
+        "paddsw    %%mm6, %%mm0         \n\t"
+        "paddsw    %%mm6, %%mm2         \n\t"
+        "psraw        $7, %%mm0         \n\t"
+        "psraw        $7, %%mm2         \n\t"
+        "packuswb  %%mm2, %%mm0         \n\t"
+        "movq      %%mm0, (%0)          \n\t"
+        "add          %4, %1            \n\t"
+        "add          %3, %0            \n\t"
+        "decl         %2                \n\t"
+        "jnz 1b                         \n\t"
+        : "+r"(dst), "+r"(src), "+r"(h)
+        : "g"(dst_stride), "g"(src_stride), "r"(delta), "r"(3*delta),
+          "m"(ff_pw_64), "m"(w[0]), "m"(w[1]), "m"(w[2]), "m"(w[3])
+        : "memory"
+    );
+}
+
+static void vp6_filter_hv4_mmx(uint8_t *dst, uint8_t *src, int stride,
+                               int delta, const int16_t *weights)
+{
+    vp6_filter4_mmx(dst, stride, src, stride, delta, weights, 8);
+}
+
+static void vp6_filter_diag4_mmx(uint8_t *dst, uint8_t *src, int stride,
+                                 const int16_t *h_weights, const int16_t *v_weights)
+{
+    DECLARE_ALIGNED_8(uint8_t, tmp[8*11]);
+
+    vp6_filter4_mmx(tmp, 8, src - stride, stride, 1, h_weights, 11);
+    vp6_filter4_mmx(dst, stride, tmp + 8, 8, 8, v_weights, 8);
+}
+#endif
+
 #ifdef CONFIG_SNOW_DECODER
 extern void ff_snow_horizontal_compose97i_sse2(DWTELEM *b, int width);
 extern void ff_snow_horizontal_compose97i_mmx(DWTELEM *b, int width);
@@ -3349,6 +3526,11 @@ void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
 
         c->h263_v_loop_filter= h263_v_loop_filter_mmx;
         c->h263_h_loop_filter= h263_h_loop_filter_mmx;
+#ifdef CONFIG_VP6_DECODER
+        c->vp6_block_variance= vp6_block_variance_mmx;
+        c->vp6_filter_hv4= vp6_filter_hv4_mmx;
+        c->vp6_filter_diag4= vp6_filter_diag4_mmx;
+#endif
         c->put_h264_chroma_pixels_tab[0]= put_h264_chroma_mc8_mmx;
         c->put_h264_chroma_pixels_tab[1]= put_h264_chroma_mc4_mmx;
 
@@ -3613,6 +3795,11 @@ void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
 #endif
 #endif
 
+#ifdef CONFIG_FLAC_ENCODER
+        if(mm_flags & MM_SSE2)
+            c->flac_compute_autocorr = flac_compute_autocorr_sse2;
+#endif
+
 #ifdef CONFIG_SNOW_DECODER
         if(mm_flags & MM_SSE2){
             c->horizontal_compose97i = ff_snow_horizontal_compose97i_sse2;
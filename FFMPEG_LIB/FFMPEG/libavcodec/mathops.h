@@ -55,11 +55,25 @@ static av_always_inline int MULH(int a, int b){
 #   define MUL64(a,b) ((int64_t)(a) * (int64_t)(b))
 #endif
 
+/* signed 32x32 -> 64 multiply add / subtract accumulate */
+#ifndef MAC64
+#   define MAC64(d, a, b) ((d) += MUL64(a, b))
+#endif
+
+#ifndef MLS64
+#   define MLS64(d, a, b) ((d) -= MUL64(a, b))
+#endif
+
 /* signed 16x16 -> 32 multiply add accumulate */
 #ifndef MAC16
 #   define MAC16(rt, ra, rb) rt += (ra) * (rb)
 #endif
 
+/* signed 16x16 -> 32 multiply subtract accumulate */
+#ifndef MLS16
+#   define MLS16(rt, ra, rb) ((rt) -= (ra) * (rb))
+#endif
+
 /* signed 16x16 -> 32 multiply */
 #ifndef MUL16
 #   define MUL16(ra, rb) ((ra) * (rb))
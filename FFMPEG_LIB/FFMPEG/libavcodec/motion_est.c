@@ -298,6 +298,46 @@ void ff_init_me(MpegEncContext *s){
     c->temp= c->scratchpad;
 }
 
+static void downsample_plane(uint8_t *dst, int dst_stride, uint8_t *src, int src_stride, int w, int h){
+    int x, y;
+
+    for(y=0; y<h; y++){
+        for(x=0; x<w; x++)
+            dst[x]= (src[2*x] + src[2*x+1] + src[2*x+src_stride] + src[2*x+src_stride+1] + 2)>>2;
+        src+= 2*src_stride;
+        dst+=   dst_stride;
+    }
+}
+
+/**
+ * builds the 1/2 and 1/4 size luma planes of the current and the reference
+ * picture used by ME_HIER. Must be called before the motion estimation
+ * threads are started.
+ */
+void ff_init_me_pyramid(MpegEncContext *s){
+    MotionEstContext * const c= &s->me;
+    const int w= s->mb_width *8;
+    const int h= s->mb_height*8;
+    int i;
+
+    if(!c->hier_buffer){
+        c->hier_buffer= av_malloc(2*(w*h + (w/2)*(h/2)));
+        if(!c->hier_buffer)
+            return;
+        c->hier_plane[0][0]= c->hier_buffer;
+        c->hier_plane[1][0]= c->hier_plane[0][0] + w*h;
+        c->hier_plane[0][1]= c->hier_plane[1][0] + w*h;
+        c->hier_plane[1][1]= c->hier_plane[0][1] + (w/2)*(h/2);
+    }
+
+    for(i=0; i<2; i++){
+        uint8_t *src= i ? s->last_picture.data[0] : s->new_picture.data[0];
+
+        downsample_plane(c->hier_plane[i][0], w, src, s->linesize, w, h);
+        downsample_plane(c->hier_plane[i][1], w/2, c->hier_plane[i][0], w, w/2, h/2);
+    }
+}
+
 #if 0
 static int pix_dev(uint8_t * pix, int line_size, int mean)
 {
@@ -1157,6 +1197,88 @@ static inline int check_input_motion(MpegEncContext * s, int mb_x, int mb_y, int
     return d;
 }
 
+static int sad4x4(uint8_t *a, uint8_t *b, int stride){
+    int sum=0, y;
+
+    for(y=0; y<4; y++){
+        sum+= FFABS(a[0]-b[0]) + FFABS(a[1]-b[1]) + FFABS(a[2]-b[2]) + FFABS(a[3]-b[3]);
+        a+= stride;
+        b+= stride;
+    }
+    return sum;
+}
+
+/**
+ * searches the MB on the 1/4 size planes exhaustively, refines the result
+ * on the 1/2 size planes and stores the full pel vector in P_MV1.
+ */
+static void hier_motion_search(MpegEncContext *s, int P[10][2], int mb_x, int mb_y){
+    MotionEstContext * const c= &s->me;
+    const int shift= 1+s->quarter_sample;
+    const int range= (c->avctx->me_range ? c->avctx->me_range>>shift : 32)>>2;
+    int stride, h, x, y, xmin, xmax, ymin, ymax, mx, my, dx, dy, d, dmin;
+    uint8_t *src, *ref;
+
+    /* 1/4 size, the MB is 4x4 */
+    stride= s->mb_width*4;
+    h= s->mb_height*4;
+    x= mb_x*4;
+    y= mb_y*4;
+    xmin= FFMAX(FFMAX(c->xmin>>2, -range), -x);
+    ymin= FFMAX(FFMAX(c->ymin>>2, -range), -y);
+    xmax= FFMIN(FFMIN(c->xmax>>2,  range), stride - 4 - x);
+    ymax= FFMIN(FFMIN(c->ymax>>2,  range), h - 4 - y);
+    src= c->hier_plane[0][1] + y*stride + x;
+    ref= c->hier_plane[1][1] + y*stride + x;
+
+    mx= my= 0;
+    dmin= sad4x4(src, ref, stride);
+    for(dy=ymin; dy<=ymax; dy++){
+        for(dx=xmin; dx<=xmax; dx++){
+            d= sad4x4(src, ref + dy*stride + dx, stride);
+            if(d < dmin){
+                dmin= d;
+                mx= dx;
+                my= dy;
+            }
+        }
+    }
+
+    /* 1/2 size, the MB is 8x8 */
+    stride= s->mb_width*8;
+    h= s->mb_height*8;
+    x= mb_x*8;
+    y= mb_y*8;
+    xmin= FFMAX(c->xmin>>1, -x);
+    ymin= FFMAX(c->ymin>>1, -y);
+    xmax= FFMIN(c->xmax>>1, stride - 8 - x);
+    ymax= FFMIN(c->ymax>>1, h - 8 - y);
+    src= c->hier_plane[0][0] + y*stride + x;
+    ref= c->hier_plane[1][0] + y*stride + x;
+
+    mx*= 2;
+    my*= 2;
+    dmin= INT_MAX;
+    for(dy=my-1; dy<=my+1; dy++){
+        for(dx=mx-1; dx<=mx+1; dx++){
+            if(dx<xmin || dx>xmax || dy<ymin || dy>ymax)
+                continue;
+            d= s->dsp.sad[1](NULL, src, ref + dy*stride + dx, stride, 8);
+            if(d < dmin){
+                dmin= d;
+                P_MV1[0]= dx;
+                P_MV1[1]= dy;
+            }
+        }
+    }
+    if(dmin == INT_MAX){
+        P_MV1[0]= mx;
+        P_MV1[1]= my;
+    }
+    P_MV1[0]= (2*P_MV1[0])<<shift;
+    P_MV1[1]= (2*P_MV1[1])<<shift;
+}
+
 void ff_estimate_p_frame_motion(MpegEncContext * s,
                                 int mb_x, int mb_y)
 {
@@ -1233,6 +1355,7 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
         my-= mb_y*16;
         break;
 #endif
+    case ME_HIER:
     case ME_X1:
     case ME_EPZS:
        {
@@ -1269,7 +1392,12 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
             }
 
         }
+        if(s->me_method == ME_HIER && c->hier_plane[0][0]){
+            hier_motion_search(s, P, mb_x, mb_y);
+            c->hier_search= 1;
+        }
         dmin = ff_epzs_motion_search(s, &mx, &my, P, 0, 0, s->p_mv_table, (1<<16)>>shift, 0, 16);
+        c->hier_search= 0;
 
         break;
     }
@@ -1521,6 +1649,7 @@ static int ff_estimate_motion_b(MpegEncContext * s,
         my-= mb_y*16;
         break;
 #endif
+    case ME_HIER:
     case ME_X1:
     case ME_EPZS:
        {
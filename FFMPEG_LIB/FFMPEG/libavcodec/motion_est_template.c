@@ -1068,6 +1068,8 @@ static av_always_inline int epzs_motion_search_internal(MpegEncContext * s, int
         CHECK_MV(P_TOP[0]     >>shift, P_TOP[1]     >>shift)
         CHECK_MV(P_TOPRIGHT[0]>>shift, P_TOPRIGHT[1]>>shift)
     }
+    if(c->hier_search)
+        CHECK_CLIPPED_MV(P_MV1[0]>>shift, P_MV1[1]>>shift)
     if(dmin>h*h*4){
         if(c->pre_pass){
             CHECK_CLIPPED_MV((last_mv[ref_mv_xy-1][0]*ref_mv_scale + (1<<15))>>16,
@@ -48,6 +48,12 @@
 
 #include "mathops.h"
 
+/* the 64 bit accumulating synthesis filter of USE_HIGHPRECISION can be
+   replaced at init by a 16 bit one with CODEC_FLAG2_FAST */
+#if FRAC_BITS > 15 && !defined(CONFIG_AUDIO_NONSHORT)
+#   define USE_FAST_SYNTH
+#endif
+
 #define FRAC_ONE    (1 << FRAC_BITS)
 
 #define FIX(a)   ((int)((a) * FRAC_ONE))
@@ -109,6 +115,13 @@ typedef struct HuffTable {
 
 static void compute_antialias_integer(MPADecodeContext *s, GranuleDef *g);
 static void compute_antialias_float(MPADecodeContext *s, GranuleDef *g);
+#ifdef USE_FAST_SYNTH
+static void synth_init_fast(MPA_INT *window);
+static void synth_filter_fast(MPA_INT *synth_buf_ptr, int *synth_buf_offset,
+                              MPA_INT *window, int *dither_state,
+                              OUT_INT *samples, int incr,
+                              int32_t sb_samples[SBLIMIT]);
+#endif
 
 /* vlc structure for decoding layer 3 huffman tables */
 static VLC huff_vlc[16];
@@ -144,6 +157,9 @@ static const int32_t scale_factor_mult2[3][3] = {
 };
 
 static DECLARE_ALIGNED_16(MPA_INT, window[512]);
+#ifdef USE_FAST_SYNTH
+static DECLARE_ALIGNED_16(MPA_INT, window_fast[512]);
+#endif
 
 /* layer 1 unscaling */
 /* n = number of bits of the mantissa minus 1 */
@@ -293,6 +309,15 @@ static int decode_init(AVCodecContext * avctx)
     else
         s->compute_antialias= compute_antialias_float;
 
+    s->synth_filter= ff_mpa_synth_filter;
+    s->synth_window= window;
+#ifdef USE_FAST_SYNTH
+    if(avctx->flags2 & CODEC_FLAG2_FAST){
+        s->synth_filter= synth_filter_fast;
+        s->synth_window= window_fast;
+    }
+#endif
+
     if (!init && !avctx->parse_only) {
         /* scale factors table for layer 1/2 */
         for(i=0;i<64;i++) {
@@ -321,6 +346,9 @@ static int decode_init(AVCodecContext * avctx)
         }
 
         ff_mpa_synth_init(window);
+#ifdef USE_FAST_SYNTH
+        synth_init_fast(window_fast);
+#endif
 
         /* huffman decode tables */
         for(i=1;i<16;i++) {
@@ -744,6 +772,9 @@ static inline int round_sample(int *sum)
 /* signed 16x16 -> 32 multiply */
 #define MULS(ra, rb) MUL16(ra, rb)
 
+/* signed 16x16 -> 32 multiply subtract accumulate */
+#define MLSS(rt, ra, rb) MLS16(rt, ra, rb)
+
 #else
 
 static inline int round_sample(int64_t *sum)
@@ -758,48 +789,53 @@ static inline int round_sample(int64_t *sum)
     return sum1;
 }
 
+#   define MACS(rt, ra, rb) MAC64(rt, ra, rb)
 #   define MULS(ra, rb) MUL64(ra, rb)
+#   define MLSS(rt, ra, rb) MLS64(rt, ra, rb)
 #endif
 
-#define SUM8(sum, op, w, p) \
-{                                               \
-    sum op MULS((w)[0 * 64], p[0 * 64]);\
-    sum op MULS((w)[1 * 64], p[1 * 64]);\
-    sum op MULS((w)[2 * 64], p[2 * 64]);\
-    sum op MULS((w)[3 * 64], p[3 * 64]);\
-    sum op MULS((w)[4 * 64], p[4 * 64]);\
-    sum op MULS((w)[5 * 64], p[5 * 64]);\
-    sum op MULS((w)[6 * 64], p[6 * 64]);\
-    sum op MULS((w)[7 * 64], p[7 * 64]);\
+/* op is MACS or MLSS (or MAC16/MLS16 for the fast synthesis), so that */
+/* the compiler is handed multiply accumulates instead of separate */
+/* 64 bit multiplies and additions */
+#define SUM8(op, sum, w, p)               \
+{                                         \
+    op(sum, (w)[0 * 64], p[0 * 64]);      \
+    op(sum, (w)[1 * 64], p[1 * 64]);      \
+    op(sum, (w)[2 * 64], p[2 * 64]);      \
+    op(sum, (w)[3 * 64], p[3 * 64]);      \
+    op(sum, (w)[4 * 64], p[4 * 64]);      \
+    op(sum, (w)[5 * 64], p[5 * 64]);      \
+    op(sum, (w)[6 * 64], p[6 * 64]);      \
+    op(sum, (w)[7 * 64], p[7 * 64]);      \
 }
 
 #define SUM8P2(sum1, op1, sum2, op2, w1, w2, p) \
 {                                               \
     int tmp;\
     tmp = p[0 * 64];\
-    sum1 op1 MULS((w1)[0 * 64], tmp);\
-    sum2 op2 MULS((w2)[0 * 64], tmp);\
+    op1(sum1, (w1)[0 * 64], tmp);\
+    op2(sum2, (w2)[0 * 64], tmp);\
     tmp = p[1 * 64];\
-    sum1 op1 MULS((w1)[1 * 64], tmp);\
-    sum2 op2 MULS((w2)[1 * 64], tmp);\
+    op1(sum1, (w1)[1 * 64], tmp);\
+    op2(sum2, (w2)[1 * 64], tmp);\
     tmp = p[2 * 64];\
-    sum1 op1 MULS((w1)[2 * 64], tmp);\
-    sum2 op2 MULS((w2)[2 * 64], tmp);\
+    op1(sum1, (w1)[2 * 64], tmp);\
+    op2(sum2, (w2)[2 * 64], tmp);\
     tmp = p[3 * 64];\
-    sum1 op1 MULS((w1)[3 * 64], tmp);\
-    sum2 op2 MULS((w2)[3 * 64], tmp);\
+    op1(sum1, (w1)[3 * 64], tmp);\
+    op2(sum2, (w2)[3 * 64], tmp);\
     tmp = p[4 * 64];\
-    sum1 op1 MULS((w1)[4 * 64], tmp);\
-    sum2 op2 MULS((w2)[4 * 64], tmp);\
+    op1(sum1, (w1)[4 * 64], tmp);\
+    op2(sum2, (w2)[4 * 64], tmp);\
     tmp = p[5 * 64];\
-    sum1 op1 MULS((w1)[5 * 64], tmp);\
-    sum2 op2 MULS((w2)[5 * 64], tmp);\
+    op1(sum1, (w1)[5 * 64], tmp);\
+    op2(sum2, (w2)[5 * 64], tmp);\
     tmp = p[6 * 64];\
-    sum1 op1 MULS((w1)[6 * 64], tmp);\
-    sum2 op2 MULS((w2)[6 * 64], tmp);\
+    op1(sum1, (w1)[6 * 64], tmp);\
+    op2(sum2, (w2)[6 * 64], tmp);\
     tmp = p[7 * 64];\
-    sum1 op1 MULS((w1)[7 * 64], tmp);\
-    sum2 op2 MULS((w2)[7 * 64], tmp);\
+    op1(sum1, (w1)[7 * 64], tmp);\
+    op2(sum2, (w2)[7 * 64], tmp);\
 }
 
 void ff_mpa_synth_init(MPA_INT *window)
@@ -866,9 +902,9 @@ void ff_mpa_synth_filter(MPA_INT *synth_buf_ptr, int *synth_buf_offset,
 
     sum = *dither_state;
     p = synth_buf + 16;
-    SUM8(sum, +=, w, p);
+    SUM8(MACS, sum, w, p);
     p = synth_buf + 48;
-    SUM8(sum, -=, w + 32, p);
+    SUM8(MLSS, sum, w + 32, p);
     *samples = round_sample(&sum);
     samples += incr;
     w++;
@@ -878,9 +914,9 @@ void ff_mpa_synth_filter(MPA_INT *synth_buf_ptr, int *synth_buf_offset,
     for(j=1;j<16;j++) {
         sum2 = 0;
         p = synth_buf + 16 + j;
-        SUM8P2(sum, +=, sum2, -=, w, w2, p);
+        SUM8P2(sum, MACS, sum2, MLSS, w, w2, p);
         p = synth_buf + 48 - j;
-        SUM8P2(sum, -=, sum2, -=, w + 32, w2 + 32, p);
+        SUM8P2(sum, MLSS, sum2, MLSS, w + 32, w2 + 32, p);
 
         *samples = round_sample(&sum);
         samples += incr;
@@ -892,7 +928,7 @@ void ff_mpa_synth_filter(MPA_INT *synth_buf_ptr, int *synth_buf_offset,
     }
 
     p = synth_buf + 32;
-    SUM8(sum, -=, w + 32, p);
+    SUM8(MLSS, sum, w + 32, p);
     *samples = round_sample(&sum);
     *dither_state= sum;
 
@@ -900,6 +936,102 @@ void ff_mpa_synth_filter(MPA_INT *synth_buf_ptr, int *synth_buf_offset,
     *synth_buf_offset = offset;
 }
 
+#ifdef USE_FAST_SYNTH
+/* Reduced precision synthesis for CODEC_FLAG2_FAST. The subband samples
+   and the window are rounded to 16 bits and accumulated in 32 bits, which
+   is what a build without USE_HIGHPRECISION does. Only the windowing is
+   affected, the layer 3 stages keep FRAC_BITS. */
+#define FAST_FRAC_BITS  15
+#define FAST_WFRAC_BITS 14
+#define FAST_OUT_SHIFT  (FAST_WFRAC_BITS + FAST_FRAC_BITS - 15)
+
+static void synth_init_fast(MPA_INT *window)
+{
+    int i;
+
+    for(i=0;i<257;i++) {
+        int v;
+        v = ff_mpa_enwindow[i];
+        v = (v + (1 << (16 - FAST_WFRAC_BITS - 1))) >> (16 - FAST_WFRAC_BITS);
+        window[i] = v;
+        if ((i & 63) != 0)
+            v = -v;
+        if (i != 0)
+            window[512 - i] = v;
+    }
+}
+
+static inline int round_sample_fast(int *sum)
+{
+    int sum1;
+    sum1 = (*sum) >> FAST_OUT_SHIFT;
+    *sum &= (1<<FAST_OUT_SHIFT)-1;
+    return av_clip(sum1, OUT_MIN, OUT_MAX);
+}
+
+static void synth_filter_fast(MPA_INT *synth_buf_ptr, int *synth_buf_offset,
+                              MPA_INT *window, int *dither_state,
+                              OUT_INT *samples, int incr,
+                              int32_t sb_samples[SBLIMIT])
+{
+    int32_t tmp[32];
+    register MPA_INT *synth_buf;
+    register const MPA_INT *w, *w2, *p;
+    int j, offset, v;
+    OUT_INT *samples2;
+    int sum, sum2;
+
+    dct32(tmp, sb_samples);
+
+    offset = *synth_buf_offset;
+    synth_buf = synth_buf_ptr + offset;
+
+    for(j=0;j<32;j++) {
+        v = (tmp[j] + (1 << (FRAC_BITS - FAST_FRAC_BITS - 1))) >> (FRAC_BITS - FAST_FRAC_BITS);
+        synth_buf[j] = av_clip(v, -32768, 32767);
+    }
+    /* copy to avoid wrap */
+    memcpy(synth_buf + 512, synth_buf, 32 * sizeof(MPA_INT));
+
+    samples2 = samples + 31 * incr;
+    w = window;
+    w2 = window + 31;
+
+    sum = *dither_state;
+    p = synth_buf + 16;
+    SUM8(MAC16, sum, w, p);
+    p = synth_buf + 48;
+    SUM8(MLS16, sum, w + 32, p);
+    *samples = round_sample_fast(&sum);
+    samples += incr;
+    w++;
+
+    for(j=1;j<16;j++) {
+        sum2 = 0;
+        p = synth_buf + 16 + j;
+        SUM8P2(sum, MAC16, sum2, MLS16, w, w2, p);
+        p = synth_buf + 48 - j;
+        SUM8P2(sum, MLS16, sum2, MLS16, w + 32, w2 + 32, p);
+
+        *samples = round_sample_fast(&sum);
+        samples += incr;
+        sum += sum2;
+        *samples2 = round_sample_fast(&sum);
+        samples2 -= incr;
+        w++;
+        w2--;
+    }
+
+    p = synth_buf + 32;
+    SUM8(MLS16, sum, w + 32, p);
+    *samples = round_sample_fast(&sum);
+    *dither_state= sum;
+
+    offset = (offset - 32) & 511;
+    *synth_buf_offset = offset;
+}
+#endif
+
 #define C3 FIXHR(0.86602540378443864676/2)
 
 /* 0.5 / cos(pi*(2*i+1)/36) */
@@ -2388,10 +2520,10 @@ static int mp_decode_frame(MPADecodeContext *s,
     for(ch=0;ch<s->nb_channels;ch++) {
         samples_ptr = samples + ch;
         for(i=0;i<nb_frames;i++) {
-            ff_mpa_synth_filter(s->synth_buf[ch], &(s->synth_buf_offset[ch]),
-                         window, &s->dither_state,
-                         samples_ptr, s->nb_channels,
-                         s->sb_samples[ch][i]);
+            s->synth_filter(s->synth_buf[ch], &(s->synth_buf_offset[ch]),
+                            s->synth_window, &s->dither_state,
+                            samples_ptr, s->nb_channels,
+                            s->sb_samples[ch][i]);
             samples_ptr += 32 * s->nb_channels;
         }
     }
@@ -2576,6 +2708,8 @@ static int decode_init_mp3on4(AVCodecContext * avctx)
     for (i = 1; i < s->frames; i++) {
         s->mp3decctx[i] = av_mallocz(sizeof(MPADecodeContext));
         s->mp3decctx[i]->compute_antialias = s->mp3decctx[0]->compute_antialias;
+        s->mp3decctx[i]->synth_filter = s->mp3decctx[0]->synth_filter;
+        s->mp3decctx[i]->synth_window = s->mp3decctx[0]->synth_window;
         s->mp3decctx[i]->adu_mode = 1;
         s->mp3decctx[i]->avctx = avctx;
     }
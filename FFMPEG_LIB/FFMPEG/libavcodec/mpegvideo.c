@@ -424,6 +424,7 @@ static int alloc_picture(MpegEncContext *s, Picture *pic, int shared){
         }
 
         CHECKED_ALLOCZ(pic->mbskip_table , mb_array_size * sizeof(uint8_t)+2) //the +2 is for the slice end check
+        CHECKED_ALLOCZ(pic->mb_changed   , mb_array_size * sizeof(uint8_t))
         CHECKED_ALLOCZ(pic->qscale_table , mb_array_size * sizeof(uint8_t))
         CHECKED_ALLOCZ(pic->mb_type_base , big_mb_num    * sizeof(uint32_t))
         pic->mb_type= pic->mb_type_base + s->mb_stride+1;
@@ -474,6 +475,7 @@ static void free_picture(MpegEncContext *s, Picture *pic){
     av_freep(&pic->mc_mb_var);
     av_freep(&pic->mb_mean);
     av_freep(&pic->mbskip_table);
+    av_freep(&pic->mb_changed);
     av_freep(&pic->qscale_table);
     av_freep(&pic->mb_type_base);
     av_freep(&pic->dct_coeff);
@@ -752,6 +754,9 @@ int MPV_common_init(MpegEncContext *s)
         if(s->avctx->noise_reduction){
             CHECKED_ALLOCZ(s->dct_offset, 2 * 64 * sizeof(uint16_t))
         }
+        if(s->wavefront){
+            CHECKED_ALLOCZ(s->wavefront_progress, s->mb_height * sizeof(int))
+        }
     }
     CHECKED_ALLOCZ(s->picture, MAX_PICTURE_COUNT * sizeof(Picture))
 
@@ -827,8 +832,13 @@ int MPV_common_init(MpegEncContext *s)
     for(i=0; i<s->avctx->thread_count; i++){
         if(init_duplicate_context(s->thread_context[i], s) < 0)
            goto fail;
-        s->thread_context[i]->start_mb_y= (s->mb_height*(i  ) + s->avctx->thread_count/2) / s->avctx->thread_count;
-        s->thread_context[i]->end_mb_y  = (s->mb_height*(i+1) + s->avctx->thread_count/2) / s->avctx->thread_count;
+        if(s->wavefront){
+            s->thread_context[i]->start_mb_y= i;
+            s->thread_context[i]->end_mb_y  = s->mb_height;
+        }else{
+            s->thread_context[i]->start_mb_y= (s->mb_height*(i  ) + s->avctx->thread_count/2) / s->avctx->thread_count;
+            s->thread_context[i]->end_mb_y  = (s->mb_height*(i+1) + s->avctx->thread_count/2) / s->avctx->thread_count;
+        }
     }
 
     return 0;
@@ -859,6 +869,8 @@ void MPV_common_end(MpegEncContext *s)
     av_freep(&s->b_bidir_forw_mv_table_base);
     av_freep(&s->b_bidir_back_mv_table_base);
     av_freep(&s->b_direct_mv_table_base);
+    av_freep(&s->wavefront_progress);
+    av_freep(&s->me.hier_buffer);
     s->p_mv_table= NULL;
     s->b_forw_mv_table= NULL;
     s->b_back_mv_table= NULL;
@@ -978,6 +990,7 @@ int MPV_encode_init(AVCodecContext *avctx)
     s->flags= avctx->flags;
     s->flags2= avctx->flags2;
     s->max_b_frames= avctx->max_b_frames;
+    s->rc_lookahead= avctx->rc_lookahead;
     s->codec_id= avctx->codec->id;
     s->luma_elim_threshold  = avctx->luma_elim_threshold;
     s->chroma_elim_threshold= avctx->chroma_elim_threshold;
@@ -1083,6 +1096,18 @@ int MPV_encode_init(AVCodecContext *avctx)
         return -1;
     }
 
+    if(s->rc_lookahead){
+        if(!(avctx->codec->capabilities & CODEC_CAP_DELAY)){
+            av_log(avctx, AV_LOG_ERROR, "rc lookahead not supported by codec\n");
+            return -1;
+        }
+        if(s->rc_lookahead + 2*s->max_b_frames + 6 > MAX_PICTURE_COUNT){
+            av_log(avctx, AV_LOG_ERROR, "rc lookahead too large, at most %d frames with %d b frames\n",
+                   MAX_PICTURE_COUNT - 6 - 2*s->max_b_frames, s->max_b_frames);
+            return -1;
+        }
+    }
+
     if((s->flags & (CODEC_FLAG_INTERLACED_DCT|CODEC_FLAG_INTERLACED_ME|CODEC_FLAG_ALT_SCAN))
        && s->codec_id != CODEC_ID_MPEG4 && s->codec_id != CODEC_ID_MPEG2VIDEO){
         av_log(avctx, AV_LOG_ERROR, "interlacing not supported by codec\n");
@@ -1136,14 +1161,21 @@ int MPV_encode_init(AVCodecContext *avctx)
         }
     }
 
-    if(s->avctx->thread_count > 1 && s->codec_id != CODEC_ID_MPEG4
+#ifdef HAVE_THREADS
+    /* the rows wait for each other, so all jobs must run at the same time */
+    s->wavefront= (s->flags2 & CODEC_FLAG2_WAVEFRONT) && s->avctx->thread_count > 1
+                  && s->avctx->execute != avcodec_default_execute;
+#endif
+    s->wavefront_lag= 2 + avctx->last_predictor_count;
+
+    if(s->avctx->thread_count > 1 && !s->wavefront && s->codec_id != CODEC_ID_MPEG4
        && s->codec_id != CODEC_ID_MPEG1VIDEO && s->codec_id != CODEC_ID_MPEG2VIDEO
        && (s->codec_id != CODEC_ID_H263P || !(s->flags & CODEC_FLAG_H263P_SLICE_STRUCT))){
         av_log(avctx, AV_LOG_ERROR, "multi threaded encoding not supported by codec\n");
         return -1;
     }
 
-    if(s->avctx->thread_count > 1)
+    if(s->avctx->thread_count > 1 && !s->wavefront)
         s->rtp_mode= 1;
 
     if(!avctx->time_base.den || !avctx->time_base.num){
@@ -1347,6 +1379,7 @@ int MPV_encode_init(AVCodecContext *avctx)
     }
 
     avctx->has_b_frames= !s->low_delay;
+    avctx->delay+= s->rc_lookahead;
 
     s->encoding = 1;
 
@@ -1603,6 +1636,15 @@ alloc:
   //      s->current_picture_ptr->quality= s->new_picture_ptr->quality;
     s->current_picture_ptr->key_frame= s->pict_type == I_TYPE;
 
+    /* skipped MBs with a zero vector repeat the previously output picture if
+       that is the forward reference and nothing filters across MB edges */
+    s->current_picture_ptr->mb_changed_stride= 0;
+    if(!s->encoding && s->pict_type == P_TYPE && s->low_delay && s->picture_structure == PICT_FRAME
+       && !s->loop_filter && !s->obmc && s->out_format != FMT_H264){
+        s->current_picture_ptr->mb_changed_stride= s->mb_stride;
+        memset(s->current_picture_ptr->mb_changed, 1, s->mb_stride*s->mb_height);
+    }
+
     copy_picture(&s->current_picture, s->current_picture_ptr);
 
     if (s->pict_type != B_TYPE) {
@@ -1895,6 +1937,7 @@ void ff_print_debug_info(MpegEncContext *s, AVFrame *pict){
         const int mv_sample_log2= 4 - pict->motion_subsample_log2;
         const int mv_stride= (s->mb_width << mv_sample_log2) + (s->codec_id == CODEC_ID_H264 ? 0 : 1);
         s->low_delay=0; //needed to see the vectors without trashing the buffers
+        pict->mb_changed_stride= 0;
 
         avcodec_get_chroma_sub_sample(s->avctx->pix_fmt, &h_chroma_shift, &v_chroma_shift);
         for(i=0; i<3; i++){
@@ -2115,11 +2158,38 @@ static int get_intra_count(MpegEncContext *s, uint8_t *src, uint8_t *ref, int st
 }
 
 
+/**
+ * computes the complexity estimates used by the ratecontrol lookahead.
+ * ref is the previous input picture or NULL, no motion search is done
+ */
+static void get_lookahead_complexity(MpegEncContext *s, Picture *pic, Picture *ref){
+    int mb_x, mb_y;
+    int var_sum=0, mc_var_sum=0;
+
+    for(mb_y=0; mb_y < s->height>>4; mb_y++){
+        for(mb_x=0; mb_x < s->width>>4; mb_x++){
+            int offset= 16*(mb_x + mb_y*s->linesize);
+            uint8_t *pix= pic->data[0] + offset;
+            int sum= s->dsp.pix_sum(pix, s->linesize);
+            int varc= (s->dsp.pix_norm1(pix, s->linesize) - (((unsigned)(sum*sum))>>8) + 500 + 128)>>8;
+
+            var_sum+= varc;
+            if(ref){
+                int vard= (s->dsp.sse[0](NULL, pix, ref->data[0] + offset, s->linesize, 16) + 128)>>8;
+                mc_var_sum+= FFMIN(vard, varc);
+            }else
+                mc_var_sum+= varc;
+        }
+    }
+    pic->lookahead_var_sum   = var_sum;
+    pic->lookahead_mc_var_sum= mc_var_sum;
+}
+
 static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg){
     AVFrame *pic=NULL;
     int64_t pts;
     int i;
-    const int encoding_delay= s->max_b_frames;
+    const int encoding_delay= s->max_b_frames + s->rc_lookahead;
     int direct=1;
 
     if(pic_arg){
@@ -2218,6 +2288,9 @@ static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg){
 
     s->input_picture[encoding_delay]= (Picture*)pic;
 
+    if(pic && s->rc_lookahead)
+        get_lookahead_complexity(s, (Picture*)pic, encoding_delay ? s->input_picture[encoding_delay-1] : NULL);
+
     return 0;
 }
 
@@ -2537,8 +2610,9 @@ int MPV_encode_picture(AVCodecContext *avctx,
     MpegEncContext *s = avctx->priv_data;
     AVFrame *pic_arg = data;
     int i, stuffing_count;
+    int slices= s->wavefront ? 1 : avctx->thread_count;
 
-    for(i=0; i<avctx->thread_count; i++){
+    for(i=0; i<slices; i++){
         int start_y= s->thread_context[i]->start_mb_y;
         int   end_y= s->thread_context[i]->  end_mb_y;
         int h= s->mb_height;
@@ -2601,7 +2675,7 @@ vbv_retry:
                     s->last_non_b_time= s->time - s->pp_time;
                 }
 //                av_log(NULL, AV_LOG_ERROR, "R:%d ", s->next_lambda);
-                for(i=0; i<avctx->thread_count; i++){
+                for(i=0; i<slices; i++){
                     PutBitContext *pb= &s->thread_context[i]->pb;
                     init_put_bits(pb, pb->buf, pb->buf_end - pb->buf);
                 }
@@ -3986,6 +4060,10 @@ static av_always_inline void MPV_decode_mb_internal(MpegEncContext *s, DCTELEM b
                 s->mb_skipped= 0;
                 assert(s->pict_type!=I_TYPE);
 
+                if(s->current_picture.mb_changed_stride && s->mv_type == MV_TYPE_16X16
+                   && !s->mv[0][0][0] && !s->mv[0][0][1])
+                    s->current_picture.mb_changed[mb_xy]= 0;
+
                 (*mbskip_ptr) ++; /* indicate that this time we skipped it */
                 if(*mbskip_ptr >99) *mbskip_ptr= 99;
 
@@ -4852,16 +4930,49 @@ static int sse_mb(MpegEncContext *s){
                +sse(s, s->new_picture.data[2] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,s->dest[2], w>>1, h>>1, s->uvlinesize);
 }
 
+/**
+ * waits until row mb_y of the current motion estimation pass is far enough
+ * ahead of a row which is at its n-th MB. The pass goes from right to left
+ * for the pre pass, n counts in the direction of the pass.
+ */
+static void wavefront_wait(MpegEncContext *s, int mb_y, int n){
+#ifdef HAVE_THREADS
+    const int needed= FFMIN(n + s->wavefront_lag, s->mb_width);
+
+    while(s->wavefront_progress[mb_y] < needed)
+        ff_thread_yield();
+    /* the MBs are read only after their progress */
+    ff_memory_barrier();
+#endif
+}
+
+/**
+ * publishes the progress of row mb_y once its MBs are stored.
+ */
+static void wavefront_done(MpegEncContext *s, int mb_y, int n){
+#ifdef HAVE_THREADS
+    ff_memory_barrier();
+    s->wavefront_progress[mb_y]= n;
+#endif
+}
+
 static int pre_estimate_motion_thread(AVCodecContext *c, void *arg){
     MpegEncContext *s= arg;
-
+    /* in wavefront mode the rows are taken from the bottom, every thread_count-th */
+    const int step       = s->wavefront ? c->thread_count : 1;
+    const int first_mb_y = s->wavefront ? s->mb_height-1 - s->start_mb_y : s->end_mb_y-1;
+    const int last_mb_y  = s->wavefront ? 0 : s->start_mb_y;
 
     s->me.pre_pass=1;
     s->me.dia_size= s->avctx->pre_dia_size;
-    s->first_slice_line=1;
-    for(s->mb_y= s->end_mb_y-1; s->mb_y >= s->start_mb_y; s->mb_y--) {
+    s->first_slice_line= first_mb_y == s->end_mb_y-1;
+    for(s->mb_y= first_mb_y; s->mb_y >= last_mb_y; s->mb_y-= step) {
         for(s->mb_x=s->mb_width-1; s->mb_x >=0 ;s->mb_x--) {
+            if(s->wavefront && s->mb_y < s->mb_height-1)
+                wavefront_wait(s, s->mb_y+1, s->mb_width-1 - s->mb_x);
             ff_pre_estimate_p_frame_motion(s, s->mb_x, s->mb_y);
+            if(s->wavefront)
+                wavefront_done(s, s->mb_y, s->mb_width - s->mb_x);
         }
         s->first_slice_line=0;
     }
@@ -4873,12 +4984,13 @@ static int pre_estimate_motion_thread(AVCodecContext *c, void *arg){
 
 static int estimate_motion_thread(AVCodecContext *c, void *arg){
     MpegEncContext *s= arg;
+    const int step= s->wavefront ? c->thread_count : 1;
 
     ff_check_alignment();
 
     s->me.dia_size= s->avctx->dia_size;
-    s->first_slice_line=1;
-    for(s->mb_y= s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
+    s->first_slice_line= !s->wavefront || s->start_mb_y == 0;
+    for(s->mb_y= s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y+= step) {
         s->mb_x=0; //for block init below
         ff_init_block_index(s);
         for(s->mb_x=0; s->mb_x < s->mb_width; s->mb_x++) {
@@ -4887,11 +4999,18 @@ static int estimate_motion_thread(AVCodecContext *c, void *arg){
             s->block_index[2]+=2;
             s->block_index[3]+=2;
 
+            /* the top right MB and the last predictors must be done */
+            if(s->wavefront && s->mb_y > 0)
+                wavefront_wait(s, s->mb_y-1, s->mb_x);
+
             /* compute motion vector & mb_type and store in context */
             if(s->pict_type==B_TYPE)
                 ff_estimate_b_frame_motion(s, s->mb_x, s->mb_y);
             else
                 ff_estimate_p_frame_motion(s, s->mb_x, s->mb_y);
+
+            if(s->wavefront)
+                wavefront_done(s, s->mb_y, s->mb_x+1);
         }
         s->first_slice_line=0;
     }
@@ -4900,11 +5019,12 @@ static int estimate_motion_thread(AVCodecContext *c, void *arg){
 
 static int mb_var_thread(AVCodecContext *c, void *arg){
     MpegEncContext *s= arg;
+    const int step= s->wavefront ? c->thread_count : 1;
     int mb_x, mb_y;
 
     ff_check_alignment();
 
-    for(mb_y=s->start_mb_y; mb_y < s->end_mb_y; mb_y++) {
+    for(mb_y=s->start_mb_y; mb_y < s->end_mb_y; mb_y+= step) {
         for(mb_x=0; mb_x < s->mb_width; mb_x++) {
             int xx = mb_x * 16;
             int yy = mb_y * 16;
@@ -4922,6 +5042,11 @@ static int mb_var_thread(AVCodecContext *c, void *arg){
     return 0;
 }
 
+static void wavefront_reset(MpegEncContext *s){
+    if(s->wavefront)
+        memset((int*)s->wavefront_progress, 0, s->mb_height*sizeof(int));
+}
+
 static void write_slice_end(MpegEncContext *s){
     if(s->codec_id==CODEC_ID_MPEG4){
         if(s->partitioned_frame){
@@ -5631,7 +5756,7 @@ static int estimate_qp(MpegEncContext *s, int dry_run){
 
 static int encode_picture(MpegEncContext *s, int picture_number)
 {
-    int i;
+    int i, slices;
     int bits;
 
     s->picture_number = picture_number;
@@ -5670,6 +5795,8 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     }
 
     s->mb_intra=0; //for the rate distortion & bit compare functions
+    if(s->pict_type == P_TYPE && s->me_method == ME_HIER)
+        ff_init_me_pyramid(s);
     for(i=1; i<s->avctx->thread_count; i++){
         ff_update_duplicate_context(s->thread_context[i], s);
     }
@@ -5682,10 +5809,12 @@ static int encode_picture(MpegEncContext *s, int picture_number)
         s->lambda2= (s->lambda2* (int64_t)s->avctx->me_penalty_compensation + 128)>>8;
         if(s->pict_type != B_TYPE && s->avctx->me_threshold==0){
             if((s->avctx->pre_me && s->last_non_b_pict_type==I_TYPE) || s->avctx->pre_me==2){
+                wavefront_reset(s);
                 s->avctx->execute(s->avctx, pre_estimate_motion_thread, (void**)&(s->thread_context[0]), NULL, s->avctx->thread_count);
             }
         }
 
+        wavefront_reset(s);
         s->avctx->execute(s->avctx, estimate_motion_thread, (void**)&(s->thread_context[0]), NULL, s->avctx->thread_count);
     }else /* if(s->pict_type == I_TYPE) */{
         /* I-Frame */
@@ -5830,11 +5959,13 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     bits= put_bits_count(&s->pb);
     s->header_bits= bits - s->last_bits;
 
-    for(i=1; i<s->avctx->thread_count; i++){
+    /* in wavefront mode the whole picture is one slice coded by the first context */
+    slices= s->wavefront ? 1 : s->avctx->thread_count;
+    for(i=1; i<slices; i++){
         update_duplicate_context_after_me(s->thread_context[i], s);
     }
-    s->avctx->execute(s->avctx, encode_thread, (void**)&(s->thread_context[0]), NULL, s->avctx->thread_count);
-    for(i=1; i<s->avctx->thread_count; i++){
+    s->avctx->execute(s->avctx, encode_thread, (void**)&(s->thread_context[0]), NULL, slices);
+    for(i=1; i<slices; i++){
         merge_context_after_encode(s, s->thread_context[i]);
     }
     emms_c();
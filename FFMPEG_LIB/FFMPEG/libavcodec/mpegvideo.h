@@ -151,6 +151,8 @@ typedef struct Picture{
     uint8_t *mb_mean;           ///< Table for MB luminance
     int32_t *mb_cmp_score;      ///< Table for MB cmp scores, for mb decision FIXME remove
     int b_frame_score;          /* */
+    int lookahead_var_sum;      ///< MB variance sum of the input picture, for rc lookahead
+    int lookahead_mc_var_sum;   ///< MB variance sum against the previous input, for rc lookahead
 } Picture;
 
 struct MpegEncContext;
@@ -209,6 +211,9 @@ typedef struct MotionEstContext{
                                   int *mx_ptr, int *my_ptr, int dmin,
                                   int src_index, int ref_index,
                                   int size, int h);
+    uint8_t *hier_buffer;
+    uint8_t *hier_plane[2][2];         ///< [cur, ref][1/2, 1/4 size] luma for ME_HIER, shared by the threads
+    int hier_search;                   ///< P_MV1 holds the vector found on the downsampled planes
 }MotionEstContext;
 
 /**
@@ -235,6 +240,7 @@ typedef struct MpegEncContext {
     int flags;        ///< AVCodecContext.flags (HQ, MV4, ...)
     int flags2;       ///< AVCodecContext.flags2
     int max_b_frames; ///< max number of b-frames for encoding
+    int rc_lookahead; ///< number of input frames buffered for ratecontrol lookahead
     int luma_elim_threshold;
     int chroma_elim_threshold;
     int strict_std_compliance; ///< strictly follow the std (MPEG4, ...)
@@ -269,6 +275,9 @@ typedef struct MpegEncContext {
     int start_mb_y;            ///< start mb_y of this thread (so current thread should process start_mb_y <= row < end_mb_y)
     int end_mb_y;              ///< end   mb_y of this thread (so current thread should process start_mb_y <= row < end_mb_y)
     struct MpegEncContext *thread_context[MAX_THREADS];
+    int wavefront;             ///< motion estimation threads take every thread_count-th row starting at start_mb_y, the picture is one slice
+    int wavefront_lag;         ///< number of MBs a row stays behind the row it depends on during motion estimation
+    volatile int *wavefront_progress; ///< number of MBs done in each row by the current motion estimation pass
 
     /**
      * copy of the previous picture structure.
@@ -730,6 +739,8 @@ void ff_write_quant_matrix(PutBitContext *pb, uint16_t *matrix);
 int ff_find_unused_picture(MpegEncContext *s, int shared);
 void ff_denoise_dct(MpegEncContext *s, DCTELEM *block);
 void ff_update_duplicate_context(MpegEncContext *dst, MpegEncContext *src);
+void ff_thread_yield(void);
+void ff_memory_barrier(void);
 const uint8_t *ff_find_start_code(const uint8_t *p, const uint8_t *end, uint32_t *state);
 
 void ff_er_frame_start(MpegEncContext *s);
@@ -774,6 +785,7 @@ void ff_fix_long_p_mvs(MpegEncContext * s);
 void ff_fix_long_mvs(MpegEncContext * s, uint8_t *field_select_table, int field_select,
                      int16_t (*mv_table)[2], int f_code, int type, int truncate);
 void ff_init_me(MpegEncContext *s);
+void ff_init_me_pyramid(MpegEncContext *s);
 int ff_pre_estimate_p_frame_motion(MpegEncContext * s, int mb_x, int mb_y);
 inline int ff_epzs_motion_search(MpegEncContext * s, int *mx_ptr, int *my_ptr,
                              int P[10][2], int src_index, int ref_index, int16_t (*last_mv)[2],
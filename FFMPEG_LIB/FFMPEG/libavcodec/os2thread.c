@@ -110,6 +110,17 @@ int avcodec_thread_execute(AVCodecContext *s, int (*func)(AVCodecContext *c2, vo
     return 0;
 }
 
+/* give up the rest of the time slice while waiting for another job */
+void ff_thread_yield(void){
+    DosSleep(0);
+}
+
+/* order the memory accesses before and after it for the other threads,
+   x86 does not reorder loads or stores among themselves */
+void ff_memory_barrier(void){
+    __asm__ volatile("" ::: "memory");
+}
+
 int avcodec_thread_init(AVCodecContext *s, int thread_count){
     int i;
     ThreadContext *c;
@@ -24,6 +24,7 @@
  */
 #if defined(_GNUC_)
 #include <pthread.h>
+#include <sched.h>
 
 #include "avcodec.h"
 
@@ -130,6 +131,18 @@ int avcodec_thread_execute(AVCodecContext *avctx, action_t* func, void **arg, in
     return 0;
 }
 
+/* give up the rest of the time slice while waiting for another job */
+void ff_thread_yield(void)
+{
+    sched_yield();
+}
+
+/* order the memory accesses before and after it for the other threads */
+void ff_memory_barrier(void)
+{
+    __sync_synchronize();
+}
+
 int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
 {
     int i;
@@ -169,4 +182,4 @@ int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
     return 0;
 }
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -657,6 +657,65 @@ void ff_get_2pass_fcode(MpegEncContext *s){
     s->b_code= rce->b_code;
 }
 
+/**
+ * simulates the vbv buffer over the frames buffered for lookahead and
+ * adjusts q so that none of them is predicted to underflow it and,
+ * with a minimum rate, to waste bits on stuffing.
+ * the predicted sizes of the buffered frames use the zero motion input
+ * complexity, calibrated against the real complexity of the current frame
+ */
+static double lookahead_qscale(MpegEncContext *s, double q, int var){
+    RateControlContext *rcc= &s->rc_context;
+    const double buffer_size= s->avctx->rc_buffer_size;
+    const double fps= 1/av_q2d(s->avctx->time_base);
+    const double min_rate= s->avctx->rc_min_rate / fps;
+    const double max_rate= s->avctx->rc_max_rate / fps;
+    const int pict_type= s->pict_type;
+    double size[2*MAX_PICTURE_COUNT+1];
+    double scale= 1.0;
+    int i, n=0, iter, qmin, qmax, raised=0;
+
+    get_qminmax(&qmin, &qmax, s, pict_type);
+
+    if(pict_type != I_TYPE && s->new_picture.lookahead_mc_var_sum)
+        scale= FFMIN((double)var / s->new_picture.lookahead_mc_var_sum, 1.0);
+
+    size[n++]= predict_size(&rcc->pred[pict_type], 1.0, sqrt(var));
+    for(i=1; i<MAX_PICTURE_COUNT && s->reordered_input_picture[i]; i++)
+        size[n++]= predict_size(&rcc->pred[B_TYPE], 1.0, sqrt(scale*s->reordered_input_picture[i]->lookahead_mc_var_sum));
+    for(i=0; i<MAX_PICTURE_COUNT && s->input_picture[i]; i++)
+        size[n++]= predict_size(&rcc->pred[P_TYPE], 1.0, sqrt(scale*s->input_picture[i]->lookahead_mc_var_sum));
+
+    for(iter=0; iter<32; iter++){
+        double buffer= rcc->buffer_index;
+        double low= buffer_size;
+        double stuffing= 0;
+
+        for(i=0; i<n; i++){
+            buffer-= size[i]/q;
+            low= FFMIN(low, buffer);
+            buffer+= av_clip(buffer_size - buffer - 1, min_rate, max_rate);
+            if(buffer > buffer_size){
+                stuffing+= buffer - buffer_size;
+                buffer= buffer_size;
+            }
+        }
+
+        if(low < buffer_size/8 && q < qmax){
+            q*= 1.1;
+            raised= 1;
+        }else if(min_rate && stuffing > 0 && low > buffer_size/4 && q > qmin && !raised)
+            q/= 1.1;
+        else
+            break;
+    }
+
+    if(s->avctx->debug&FF_DEBUG_RC)
+        av_log(s->avctx, AV_LOG_DEBUG, "lookahead %d frames, q:%f\n", n, q);
+
+    return q;
+}
+
 //FIXME rd or at least approx for dquant
 
 float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
@@ -770,6 +829,9 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
         }
         assert(q>0.0);
 
+        if(s->rc_lookahead && a->rc_buffer_size && a->rc_max_rate)
+            q= lookahead_qscale(s, q, var);
+
         q= modify_qscale(s, rce, q, picture_number);
 
         rcc->pass1_wanted_bits+= s->bit_rate/fps;
@@ -31,7 +31,10 @@ struct AVResampleContext;
 
 struct ReSampleContext {
     struct AVResampleContext *resample_context;
-    short *temp[2];
+    short *buffer;          ///< interleaved filter input, starts with the unconsumed samples of the last call
+    unsigned int buffer_size;
+    short *temp;            ///< interleaved filter output when a channel conversion follows
+    unsigned int temp_size;
     int temp_len;
     float ratio;
     /* channel convert */
@@ -89,35 +92,14 @@ static void mono_to_stereo(short *output, short *input, int n1)
     }
 }
 
-/* XXX: should use more abstract 'N' channels system */
-static void stereo_split(short *output1, short *output2, short *input, int n)
-{
-    int i;
-
-    for(i=0;i<n;i++) {
-        *output1++ = *input++;
-        *output2++ = *input++;
-    }
-}
-
-static void stereo_mux(short *output, short *input1, short *input2, int n)
-{
-    int i;
-
-    for(i=0;i<n;i++) {
-        *output++ = *input1++;
-        *output++ = *input2++;
-    }
-}
-
-static void ac3_5p1_mux(short *output, short *input1, short *input2, int n)
+static void ac3_5p1_mux(short *output, short *input, int n)
 {
     int i;
     short l,r;
 
     for(i=0;i<n;i++) {
-      l=*input1++;
-      r=*input2++;
+      l=*input++;
+      r=*input++;
       *output++ = l;           /* left */
       *output++ = (l/2)+(r/2); /* center */
       *output++ = r;           /* right */
@@ -127,14 +109,40 @@ static void ac3_5p1_mux(short *output, short *input1, short *input2, int n)
     }
 }
 
+/* 5.1 in ac3 order (L C R Ls Rs LFE) to stereo, center and surrounds at -3dB,
+   LFE dropped, scaled so that full scale input cannot clip */
+static void ac3_5p1_to_stereo(short *output, short *input, int n)
+{
+    int i;
+
+    for(i=0;i<n;i++) {
+        int c = input[1] * 75;
+        output[0] = (input[0] * 106 + c + input[3] * 75) >> 8;
+        output[1] = (input[2] * 106 + c + input[4] * 75) >> 8;
+        output += 2;
+        input += 6;
+    }
+}
+
 ReSampleContext *audio_resample_init(int output_channels, int input_channels,
                                       int output_rate, int input_rate)
 {
     ReSampleContext *s;
 
-    if ( input_channels > 2)
+    if (input_channels != output_channels &&
+        !(input_channels == 1 && output_channels == 2) &&
+        !(input_channels == 2 && (output_channels == 1 || output_channels == 6)) &&
+        !(input_channels == 6 && output_channels <= 2))
+      {
+        av_log(NULL, AV_LOG_ERROR, "Resampling from %d to %d channels unsupported.\n",
+               input_channels, output_channels);
+        return NULL;
+      }
+
+    if (input_channels > MAX_RESAMPLE_CHANNELS)
       {
-        av_log(NULL, AV_LOG_ERROR, "Resampling with input channels greater than 2 unsupported.");
+        av_log(NULL, AV_LOG_ERROR, "Resampling with more than %d input channels unsupported.\n",
+               MAX_RESAMPLE_CHANNELS);
         return NULL;
       }
 
@@ -155,11 +163,11 @@ ReSampleContext *audio_resample_init(int output_channels, int input_channels,
         s->filter_channels = s->output_channels;
 
 /*
- * ac3 output is the only case where filter_channels could be greater than 2.
- * input channels can't be greater than 2, so resample the 2 channels and then
- * expand to 6 channels after the resampling.
+ * 5.1 input is downmixed before filtering and 5.1 output is expanded from
+ * stereo after it, so the filter itself never runs on more than 2 channels
+ * unless input and output are both 5.1.
  */
-    if(s->filter_channels>2)
+    if (s->filter_channels > 2 && s->input_channels != s->output_channels)
       s->filter_channels = 2;
 
 #define TAPS 16
@@ -169,14 +177,11 @@ ReSampleContext *audio_resample_init(int output_channels, int input_channels,
 }
 
 /* resample audio. 'nb_samples' is the number of input samples */
-/* XXX: optimize it ! */
 int audio_resample(ReSampleContext *s, short *output, short *input, int nb_samples)
 {
-    int i, nb_samples1;
-    short *bufin[2];
-    short *bufout[2];
-    short *buftmp2[2], *buftmp3[2];
-    int lenout;
+    int ch = s->filter_channels;
+    int nb_samples1, consumed, lenout;
+    short *bufin, *bufout;
 
     if (s->input_channels == s->output_channels && s->ratio == 1.0 && 0) {
         /* nothing to do */
@@ -184,68 +189,56 @@ int audio_resample(ReSampleContext *s, short *output, short *input, int nb_sampl
         return nb_samples;
     }
 
-    /* XXX: move those malloc to resample init code */
-    for(i=0; i<s->filter_channels; i++){
-        bufin[i]= (short*) av_malloc( (nb_samples + s->temp_len) * sizeof(short) );
-        memcpy(bufin[i], s->temp[i], s->temp_len * sizeof(short));
-        buftmp2[i] = bufin[i] + s->temp_len;
-    }
+    /* the unconsumed samples of the previous call are kept at the start,
+       5.1 to mono goes through stereo so leave room for 2 channels */
+    bufin = av_fast_realloc(s->buffer, &s->buffer_size,
+                            (nb_samples + s->temp_len) * FFMAX(ch, 2) * sizeof(short));
+    if (!bufin)
+        return 0;
+    s->buffer = bufin;
 
     /* make some zoom to avoid round pb */
     lenout= (int)(nb_samples * s->ratio) + 16;
-    bufout[0]= (short*) av_malloc( lenout * sizeof(short) );
-    bufout[1]= (short*) av_malloc( lenout * sizeof(short) );
-
-    if (s->input_channels == 2 &&
-        s->output_channels == 1) {
-        buftmp3[0] = output;
-        stereo_to_mono(buftmp2[0], input, nb_samples);
-    } else if (s->output_channels >= 2 && s->input_channels == 1) {
-        buftmp3[0] = bufout[0];
-        memcpy(buftmp2[0], input, nb_samples*sizeof(short));
-    } else if (s->output_channels >= 2) {
-        buftmp3[0] = bufout[0];
-        buftmp3[1] = bufout[1];
-        stereo_split(buftmp2[0], buftmp2[1], input, nb_samples);
+
+    if (s->output_channels == ch) {
+        bufout = output;
     } else {
-        buftmp3[0] = output;
-        memcpy(buftmp2[0], input, nb_samples*sizeof(short));
+        bufout = av_fast_realloc(s->temp, &s->temp_size, lenout * ch * sizeof(short));
+        if (!bufout)
+            return 0;
+        s->temp = bufout;
     }
 
-    nb_samples += s->temp_len;
+    if (s->input_channels == ch) {
+        memcpy(bufin + s->temp_len * ch, input, nb_samples * ch * sizeof(short));
+    } else if (s->input_channels == 2) {
+        stereo_to_mono(bufin + s->temp_len, input, nb_samples);
+    } else {
+        short *q = bufin + s->temp_len * ch;
+        ac3_5p1_to_stereo(q, input, nb_samples);
+        if (ch == 1)
+            stereo_to_mono(q, q, nb_samples);
+    }
 
-    /* resample each channel */
-    nb_samples1 = 0; /* avoid warning */
-    for(i=0;i<s->filter_channels;i++) {
-        int consumed;
-        int is_last= i+1 == s->filter_channels;
+    nb_samples += s->temp_len;
 
-        nb_samples1 = av_resample(s->resample_context, buftmp3[i], bufin[i], &consumed, nb_samples, lenout, is_last);
-        s->temp_len= nb_samples - consumed;
-        s->temp[i]= av_realloc(s->temp[i], s->temp_len*sizeof(short));
-        memcpy(s->temp[i], bufin[i] + consumed, s->temp_len*sizeof(short));
-    }
+    nb_samples1 = av_resample_multi(s->resample_context, bufout, bufin, &consumed, nb_samples, lenout, ch, 1);
+    s->temp_len = nb_samples - consumed;
+    memmove(bufin, bufin + consumed * ch, s->temp_len * ch * sizeof(short));
 
-    if (s->output_channels == 2 && s->input_channels == 1) {
-        mono_to_stereo(output, buftmp3[0], nb_samples1);
-    } else if (s->output_channels == 2) {
-        stereo_mux(output, buftmp3[0], buftmp3[1], nb_samples1);
-    } else if (s->output_channels == 6) {
-        ac3_5p1_mux(output, buftmp3[0], buftmp3[1], nb_samples1);
+    if (s->output_channels == 2 && ch == 1) {
+        mono_to_stereo(output, bufout, nb_samples1);
+    } else if (s->output_channels == 6 && ch == 2) {
+        ac3_5p1_mux(output, bufout, nb_samples1);
     }
 
-    for(i=0; i<s->filter_channels; i++)
-        av_free(bufin[i]);
-
-    av_free(bufout[0]);
-    av_free(bufout[1]);
     return nb_samples1;
 }
 
 void audio_resample_close(ReSampleContext *s)
 {
     av_resample_close(s->resample_context);
-    av_freep(&s->temp[0]);
-    av_freep(&s->temp[1]);
+    av_freep(&s->buffer);
+    av_freep(&s->temp);
     av_free(s);
 }
@@ -71,6 +71,8 @@ typedef struct AVResampleContext{
     int phase_shift;
     int phase_mask;
     int linear;
+    short *planar;              ///< deinterleaved copy of the av_resample_multi() input
+    unsigned int planar_size;
 }AVResampleContext;
 
 /**
@@ -207,6 +209,7 @@ AVResampleContext *av_resample_init(int out_rate, int in_rate, int filter_size,
 
 void av_resample_close(AVResampleContext *c){
     av_freep(&c->filter_bank);
+    av_freep(&c->planar);
     av_freep(&c);
 }
 
@@ -228,6 +231,18 @@ void av_resample_compensate(AVResampleContext *c, int sample_delta, int compensa
     c->dst_incr = c->ideal_dst_incr - c->ideal_dst_incr * (int64_t)sample_delta / compensation_distance;
 }
 
+/**
+ * scales a filter accumulator back to a clipped 16bit sample.
+ */
+static av_always_inline short filter_output(FELEM2 val){
+#ifdef CONFIG_RESAMPLE_AUDIOPHILE_KIDDY_MODE
+    return av_clip(lrintf(val), -32768, 32767);
+#else
+    val = (val + (1<<(FILTER_SHIFT-1)))>>FILTER_SHIFT;
+    return (unsigned)(val + 32768) > 65535 ? (val>>31) ^ 32767 : val;
+#endif
+}
+
 /**
  * resamples.
  * @param src an array of unconsumed samples
@@ -270,7 +285,7 @@ int av_resample(AVResampleContext *c, short *dst, short *src, int *consumed, int
 
         if(sample_index < 0){
             for(i=0; i<c->filter_length; i++)
-                val += src[FFABS(sample_index + i) % src_size] * filter[i];
+                val += src[FFABS(sample_index + i) % src_size] * (FELEM2)filter[i];
         }else if(sample_index + c->filter_length > src_size){
             break;
         }else if(c->linear){
@@ -286,12 +301,7 @@ int av_resample(AVResampleContext *c, short *dst, short *src, int *consumed, int
             }
         }
 
-#ifdef CONFIG_RESAMPLE_AUDIOPHILE_KIDDY_MODE
-        dst[dst_index] = av_clip(lrintf(val), -32768, 32767);
-#else
-        val = (val + (1<<(FILTER_SHIFT-1)))>>FILTER_SHIFT;
-        dst[dst_index] = (unsigned)(val + 32768) > 65535 ? (val>>31) ^ 32767 : val;
-#endif
+        dst[dst_index] = filter_output(val);
 
         frac += dst_incr_frac;
         index += dst_incr;
@@ -330,3 +340,210 @@ av_log(NULL, AV_LOG_DEBUG, "%d %d %d\n", c->dst_incr, c->ideal_dst_incr, c->comp
 
     return dst_index;
 }
+
+/**
+ * applies one filter phase to all channels.
+ * @param src first sample of the first channel, the channels follow each other
+ *            stride samples apart
+ */
+static av_always_inline void filter_multi(FELEM2 *val, const short *src, int stride, const FELEM *filter, int length, int channels){
+    int i, ch;
+
+    for(ch=0; ch<channels; ch++){
+        FELEM2 v=0;
+        for(i=0; i<length; i++)
+            v += src[i] * (FELEM2)filter[i];
+        val[ch]= v;
+        src += stride;
+    }
+}
+
+/**
+ * resamples interleaved audio, all channels at once.
+ * The input is deinterleaved once into a buffer kept in the context, so the
+ * filter runs over contiguous samples as in av_resample(), while the filter
+ * phase is computed once for all channels and the output is written
+ * interleaved.
+ * @param dst interleaved output samples
+ * @param src an array of unconsumed interleaved samples
+ * @param consumed the number of samples per channel of src which have been consumed are returned here
+ * @param src_size the number of unconsumed samples per channel available
+ * @param dst_size the amount of space in samples per channel available in dst
+ * @param channels number of interleaved channels, at most MAX_RESAMPLE_CHANNELS
+ * @param update_ctx if this is 0 then the context wont be modified
+ * @return the number of samples per channel written in dst or -1 if an error occured
+ */
+int av_resample_multi(AVResampleContext *c, short *dst, short *src, int *consumed, int src_size, int dst_size, int channels, int update_ctx){
+    int dst_index, i, ch;
+    int index= c->index;
+    int frac= c->frac;
+    int dst_incr_frac= c->dst_incr % c->src_incr;
+    int dst_incr=      c->dst_incr / c->src_incr;
+    int compensation_distance= c->compensation_distance;
+    FELEM2 val[MAX_RESAMPLE_CHANNELS], v2[MAX_RESAMPLE_CHANNELS];
+    short *planar;
+
+    if(channels == 1)
+        return av_resample(c, dst, src, consumed, src_size, dst_size, update_ctx);
+    if(channels < 1 || channels > MAX_RESAMPLE_CHANNELS)
+        return -1;
+
+    planar= av_fast_realloc(c->planar, &c->planar_size, src_size * channels * sizeof(short));
+    if(!planar)
+        return -1;
+    c->planar= planar;
+    for(ch=0; ch<channels; ch++)
+        for(i=0; i<src_size; i++)
+            planar[ch*src_size + i]= src[i*channels + ch];
+
+    for(dst_index=0; dst_index < dst_size; dst_index++){
+        FELEM *filter= c->filter_bank + c->filter_length*(index & c->phase_mask);
+        int sample_index= index >> c->phase_shift;
+
+        if(sample_index < 0){
+            for(ch=0; ch<channels; ch++){
+                const short *s= planar + ch*src_size;
+                val[ch]= 0;
+                for(i=0; i<c->filter_length; i++)
+                    val[ch] += s[FFABS(sample_index + i) % src_size] * (FELEM2)filter[i];
+            }
+        }else if(sample_index + c->filter_length > src_size){
+            break;
+        }else if(c->linear){
+            filter_multi(val, planar + sample_index, src_size, filter                  , c->filter_length, channels);
+            filter_multi(v2 , planar + sample_index, src_size, filter + c->filter_length, c->filter_length, channels);
+            for(ch=0; ch<channels; ch++)
+                val[ch]+=(v2[ch]-val[ch])*(FELEML)frac / c->src_incr;
+        }else{
+            filter_multi(val, planar + sample_index, src_size, filter, c->filter_length, channels);
+        }
+
+        for(ch=0; ch<channels; ch++)
+            dst[dst_index*channels + ch] = filter_output(val[ch]);
+
+        frac += dst_incr_frac;
+        index += dst_incr;
+        if(frac >= c->src_incr){
+            frac -= c->src_incr;
+            index++;
+        }
+
+        if(dst_index + 1 == compensation_distance){
+            compensation_distance= 0;
+            dst_incr_frac= c->ideal_dst_incr % c->src_incr;
+            dst_incr=      c->ideal_dst_incr / c->src_incr;
+        }
+    }
+    *consumed= FFMAX(index, 0) >> c->phase_shift;
+    if(index>=0) index &= c->phase_mask;
+
+    if(compensation_distance){
+        compensation_distance -= dst_index;
+        assert(compensation_distance > 0);
+    }
+    if(update_ctx){
+        c->frac= frac;
+        c->index= index;
+        c->dst_incr= dst_incr_frac + c->src_incr*dst_incr;
+        c->compensation_distance= compensation_distance;
+    }
+
+    return dst_index;
+}
+
+#ifdef TEST
+#include <stdio.h>
+#include <time.h>
+#undef exit
+#undef printf
+
+#define BENCH_SAMPLES 4096
+
+/* reference: deinterleave, resample each channel with av_resample, reinterleave */
+static int resample_planar(AVResampleContext *c, short *dst, short *src, int *consumed, int src_size, int dst_size, int channels){
+    short *in = av_malloc(src_size * sizeof(short));
+    short *out= av_malloc(dst_size * sizeof(short));
+    int i, ch, n=0;
+
+    for(ch=0; ch<channels; ch++){
+        for(i=0; i<src_size; i++)
+            in[i]= src[i*channels + ch];
+        n= av_resample(c, out, in, consumed, src_size, dst_size, ch+1 == channels);
+        for(i=0; i<n; i++)
+            dst[i*channels + ch]= out[i];
+    }
+    av_free(in);
+    av_free(out);
+    return n;
+}
+
+int main(void)
+{
+    static const int rates[][2]= {{44100, 48000}, {48000, 44100}, {48000, 22050}, {22050, 44100}};
+    static const int layouts[]= {1, 2, 6};
+    short *src, *dst, *ref;
+    int r, l, i, ch, ret= 0;
+
+    src= av_malloc(BENCH_SAMPLES * MAX_RESAMPLE_CHANNELS * sizeof(short));
+    dst= av_malloc(BENCH_SAMPLES * 3 * MAX_RESAMPLE_CHANNELS * sizeof(short));
+    ref= av_malloc(BENCH_SAMPLES * 3 * MAX_RESAMPLE_CHANNELS * sizeof(short));
+
+    for(l=0; l<sizeof(layouts)/sizeof(layouts[0]); l++){
+        int channels= layouts[l];
+        for(i=0; i<BENCH_SAMPLES; i++)
+            for(ch=0; ch<channels; ch++)
+                src[i*channels + ch]= 16000 * sin(i * 0.01 * (ch+1));
+
+        for(r=0; r<sizeof(rates)/sizeof(rates[0]); r++){
+            int in_rate= rates[r][0], out_rate= rates[r][1];
+            int dst_size= BENCH_SAMPLES * 3;
+            AVResampleContext *c1= av_resample_init(out_rate, in_rate, 16, 10, 0, 0.8);
+            AVResampleContext *c2= av_resample_init(out_rate, in_rate, 16, 10, 0, 0.8);
+            int consumed1, consumed2, n1, n2, its, run;
+            clock_t t;
+            double multi, planar;
+
+            n1= av_resample_multi(c1, dst, src, &consumed1, BENCH_SAMPLES, dst_size, channels, 0);
+            n2= resample_planar  (c2, ref, src, &consumed2, BENCH_SAMPLES, dst_size, channels);
+            if(n1 != n2 || consumed1 != consumed2 || memcmp(dst, ref, n1 * channels * sizeof(short))){
+                printf("mismatch: %d ch %d->%d\n", channels, in_rate, out_rate);
+                ret= 1;
+            }
+
+            /* best of 3, the two versions alternate so that they see the same load */
+            multi= planar= 0;
+            for(run=0; run<3; run++){
+                for(its=1;; its*=2){
+                    t= clock();
+                    for(i=0; i<its; i++)
+                        av_resample_multi(c1, dst, src, &consumed1, BENCH_SAMPLES, dst_size, channels, 0);
+                    t= clock() - t;
+                    if(t >= CLOCKS_PER_SEC/4)
+                        break;
+                }
+                multi= FFMAX(multi, (double)n1 * channels * its * CLOCKS_PER_SEC / t);
+
+                for(its=1;; its*=2){
+                    t= clock();
+                    for(i=0; i<its; i++)
+                        resample_planar(c2, ref, src, &consumed2, BENCH_SAMPLES, dst_size, channels);
+                    t= clock() - t;
+                    if(t >= CLOCKS_PER_SEC/4)
+                        break;
+                }
+                planar= FFMAX(planar, (double)n2 * channels * its * CLOCKS_PER_SEC / t);
+            }
+
+            printf("%d ch %5d->%5d: interleaved %10.0f samples/s, planar %10.0f samples/s\n",
+                   channels, in_rate, out_rate, multi, planar);
+
+            av_resample_close(c1);
+            av_resample_close(c2);
+        }
+    }
+    av_free(src);
+    av_free(dst);
+    av_free(ref);
+    return ret;
+}
+#endif
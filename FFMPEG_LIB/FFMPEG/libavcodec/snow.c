@@ -420,6 +420,34 @@ typedef struct Plane{
     SubBand band[MAX_DECOMPOSITIONS][4];
 }Plane;
 
+typedef struct {
+    DWTELEM *b0;
+    DWTELEM *b1;
+    DWTELEM *b2;
+    DWTELEM *b3;
+    int y;
+} dwt_compose_t;
+
+/**
+ * Sliced reconstruction state of one plane in the decoder.
+ * Every plane has its own slice buffer, so the planes can be reconstructed
+ * by different threads.
+ */
+typedef struct SnowSliceState{
+    slice_buffer sb;
+    dwt_compose_t cs[MAX_DECOMPOSITIONS];
+    int decode_state[MAX_DECOMPOSITIONS][4][1]; /* Stored state info for unpack_coeffs. 1 variable per instance. */
+    int yd, yq;
+    int decoded;                                ///< number of block rows dequantized and inverse transformed
+    int predicted;                              ///< number of block rows predicted and released
+}SnowSliceState;
+
+typedef struct SnowSliceJob{
+    struct SnowContext *s;
+    int plane_index;
+    int predict;                                ///< 1 to predict the next block row, 0 to decode it
+}SnowSliceJob;
+
 typedef struct SnowContext{
 //    MpegEncContext m; // needed for motion estimation, should not be used for anything else, the idea is to make the motion estimation eventually independent of MpegEncContext, so this will be removed then (FIXME/XXX)
 
@@ -470,19 +498,13 @@ typedef struct SnowContext{
 #define ME_CACHE_SIZE 1024
     int me_cache[ME_CACHE_SIZE];
     int me_cache_generation;
-    slice_buffer sb;
+    SnowSliceState slice_state[3];
+    SnowSliceJob slice_job[MAX_THREADS];
+    void *slice_job_ptr[MAX_THREADS];
 
     MpegEncContext m; // needed for motion estimation, should not be used for anything else, the idea is to make the motion estimation eventually independent of MpegEncContext, so this will be removed then (FIXME/XXX)
 }SnowContext;
 
-typedef struct {
-    DWTELEM *b0;
-    DWTELEM *b1;
-    DWTELEM *b2;
-    DWTELEM *b3;
-    int y;
-} dwt_compose_t;
-
 #define slice_buffer_get_line(slice_buf, line_num) ((slice_buf)->line[line_num] ? (slice_buf)->line[line_num] : slice_buffer_load_line((slice_buf), (line_num)))
 //#define slice_buffer_get_line(slice_buf, line_num) (slice_buffer_load_line((slice_buf), (line_num)))
 
@@ -4372,17 +4394,208 @@ static int encode_end(AVCodecContext *avctx)
     return 0;
 }
 
+static void get_slice_rows(SnowContext *s, int plane_index, int mb_y, int *slice_starty, int *slice_h){
+    const int block_size = MB_SIZE >> s->block_max_depth;
+    const int block_w    = plane_index ? block_size/2 : block_size;
+
+    *slice_starty = block_w*mb_y;
+    *slice_h = block_w*(mb_y+1);
+    if (!(s->keyframe || s->avctx->debug&512)){
+        *slice_starty = FFMAX(0, *slice_starty - (block_w >> 1));
+        *slice_h -= (block_w >> 1);
+    }
+}
+
+/**
+ * Dequantizes the coefficients of block row mb_y and runs the IDWT up to
+ * its last line.
+ */
+static void decode_slice(SnowContext *s, int plane_index, int mb_y){
+    SnowSliceState *st= &s->slice_state[plane_index];
+    Plane *p= &s->plane[plane_index];
+    const int block_size = MB_SIZE >> s->block_max_depth;
+    const int block_w    = plane_index ? block_size/2 : block_size;
+    int w= p->width;
+    int h= p->height;
+    int level, orientation;
+    int slice_starty, slice_h;
+    int x;
+
+    get_slice_rows(s, plane_index, mb_y, &slice_starty, &slice_h);
+
+        {
+        START_TIMER
+        for(level=0; level<s->spatial_decomposition_count; level++){
+            for(orientation=level ? 1 : 0; orientation<4; orientation++){
+                SubBand *b= &p->band[level][orientation];
+                int start_y;
+                int end_y;
+                int our_mb_start = mb_y;
+                int our_mb_end = (mb_y + 1);
+                const int extra= 3;
+                start_y = (mb_y ? ((block_w * our_mb_start) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra: 0);
+                end_y = (((block_w * our_mb_end) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra);
+                if (!(s->keyframe || s->avctx->debug&512)){
+                    start_y = FFMAX(0, start_y - (block_w >> (1+s->spatial_decomposition_count - level)));
+                    end_y = FFMAX(0, end_y - (block_w >> (1+s->spatial_decomposition_count - level)));
+                }
+                start_y = FFMIN(b->height, start_y);
+                end_y = FFMIN(b->height, end_y);
+
+                if (start_y != end_y){
+                    if (orientation == 0){
+                        SubBand * correlate_band = &p->band[0][0];
+                        int correlate_end_y = FFMIN(b->height, end_y + 1);
+                        int correlate_start_y = FFMIN(b->height, (start_y ? start_y + 1 : 0));
+                        decode_subband_slice_buffered(s, correlate_band, &st->sb, correlate_start_y, correlate_end_y, st->decode_state[0][0]);
+                        correlate_slice_buffered(s, &st->sb, correlate_band, correlate_band->buf, correlate_band->stride, 1, 0, correlate_start_y, correlate_end_y);
+                        dequantize_slice_buffered(s, &st->sb, correlate_band, correlate_band->buf, correlate_band->stride, start_y, end_y);
+                    }
+                    else
+                        decode_subband_slice_buffered(s, b, &st->sb, start_y, end_y, st->decode_state[level][orientation]);
+                }
+            }
+        }
+        STOP_TIMER("decode_subband_slice");
+        }
+
+{   START_TIMER
+        for(; st->yd<slice_h; st->yd+=4){
+            ff_spatial_idwt_buffered_slice(&s->dsp, st->cs, &st->sb, w, h, 1, s->spatial_decomposition_type, s->spatial_decomposition_count, st->yd);
+        }
+    STOP_TIMER("idwt slice");}
+
+
+        if(s->qlog == LOSSLESS_QLOG){
+            for(; st->yq<slice_h && st->yq<h; st->yq++){
+                DWTELEM * line = slice_buffer_get_line(&st->sb, st->yq);
+                for(x=0; x<w; x++){
+                    line[x] <<= FRAC_BITS;
+                }
+            }
+        }
+}
+
+static void release_slice(SnowContext *s, int plane_index, int mb_y){
+    SnowSliceState *st= &s->slice_state[plane_index];
+    Plane *p= &s->plane[plane_index];
+    int slice_starty, slice_h;
+    int y, end_y;
+
+    get_slice_rows(s, plane_index, mb_y, &slice_starty, &slice_h);
+
+    y = FFMIN(p->height, slice_starty);
+    end_y = FFMIN(p->height, slice_h);
+    while(y < end_y)
+        slice_buffer_release(&st->sb, y++);
+}
+
+static int decode_slice_thread(AVCodecContext *avctx, void *arg){
+    SnowSliceJob *job= arg;
+    SnowContext *s= job->s;
+    SnowSliceState *st= &s->slice_state[job->plane_index];
+
+    if(job->predict)
+        predict_slice_buffered(s, &st->sb, s->spatial_dwt_buffer, job->plane_index, 1, st->predicted);
+    else
+        decode_slice(s, job->plane_index, st->decoded);
+
+    emms_c();
+    return 0;
+}
+
+/*
+ * Reconstruct the three planes from the unpacked coefficients.
+ * With several threads, every pass decodes the next block row of each
+ * plane while the row decoded in the previous pass is predicted. The IDWT
+ * of a row never writes to the lines of the rows above it, so only the
+ * slice buffer bookkeeping has to wait for the end of the pass, and the
+ * output does not depend on the number of threads.
+ */
+static void decode_slices(SnowContext *s){
+    AVCodecContext *avctx= s->avctx;
+    const int mb_h= s->b_height << s->block_max_depth;
+    int jobs= FFMIN(avctx->thread_count, MAX_THREADS);
+    int plane_index, mb_y, i, count;
+
+    for(plane_index=0; plane_index<3; plane_index++){
+        SnowSliceState *st= &s->slice_state[plane_index];
+        Plane *p= &s->plane[plane_index];
+
+        ff_spatial_idwt_buffered_init(st->cs, &st->sb, p->width, p->height, 1, s->spatial_decomposition_type, s->spatial_decomposition_count);
+        st->yd= st->yq= 0;
+        st->decoded= st->predicted= 0;
+    }
+
+    if(jobs < 2){
+        for(plane_index=0; plane_index<3; plane_index++){
+            SnowSliceState *st= &s->slice_state[plane_index];
+            START_TIMER
+            for(mb_y=0; mb_y<=mb_h; mb_y++){
+                decode_slice(s, plane_index, mb_y);
+                predict_slice_buffered(s, &st->sb, s->spatial_dwt_buffer, plane_index, 1, mb_y);
+                release_slice(s, plane_index, mb_y);
+            }
+            slice_buffer_flush(&st->sb);
+            STOP_TIMER("idwt + predict_slices")
+        }
+        return;
+    }
+
+    for(;;){
+        count= 0;
+        for(plane_index=0; plane_index<3; plane_index++){
+            SnowSliceState *st= &s->slice_state[plane_index];
+
+            if(st->predicted < st->decoded && count < jobs){
+                s->slice_job[count].plane_index= plane_index;
+                s->slice_job[count++].predict= 1;
+            }
+            /* at most one decoded row waits for its prediction */
+            if(st->decoded <= mb_h && count < jobs){
+                s->slice_job[count].plane_index= plane_index;
+                s->slice_job[count++].predict= 0;
+            }
+        }
+        if(!count)
+            break;
+
+        avctx->execute(avctx, decode_slice_thread, s->slice_job_ptr, NULL, count);
+
+        for(i=0; i<count; i++){
+            SnowSliceJob *job= &s->slice_job[i];
+            SnowSliceState *st= &s->slice_state[job->plane_index];
+
+            if(job->predict)
+                release_slice(s, job->plane_index, st->predicted++);
+            else
+                st->decoded++;
+        }
+    }
+
+    for(plane_index=0; plane_index<3; plane_index++)
+        slice_buffer_flush(&s->slice_state[plane_index].sb);
+}
+
 static int decode_init(AVCodecContext *avctx)
 {
     SnowContext *s = avctx->priv_data;
     int block_size;
+    int plane_index, i;
 
     avctx->pix_fmt= PIX_FMT_YUV420P;
 
     common_init(avctx);
 
     block_size = MB_SIZE >> s->block_max_depth;
-    slice_buffer_init(&s->sb, s->plane[0].height, (block_size) + (s->spatial_decomposition_count * (s->spatial_decomposition_count + 3)) + 1, s->plane[0].width, s->spatial_dwt_buffer);
+    /* the rows of the previous block row stay allocated until they are predicted */
+    for(plane_index=0; plane_index<3; plane_index++)
+        slice_buffer_init(&s->slice_state[plane_index].sb, s->plane[plane_index].height, 2*block_size + (s->spatial_decomposition_count * (s->spatial_decomposition_count + 3)) + 1, s->plane[plane_index].width, s->spatial_dwt_buffer);
+
+    for(i=0; i<MAX_THREADS; i++){
+        s->slice_job[i].s= s;
+        s->slice_job_ptr[i]= &s->slice_job[i];
+    }
 
     return 0;
 }
@@ -4417,7 +4630,6 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
         int w= p->width;
         int h= p->height;
         int x, y;
-        int decode_state[MAX_DECOMPOSITIONS][4][1]; /* Stored state info for unpack_coeffs. 1 variable per instance. */
 
 if(s->avctx->debug&2048){
         memset(s->spatial_dwt_buffer, 0, sizeof(DWTELEM)*w*h);
@@ -4431,6 +4643,8 @@ if(s->avctx->debug&2048){
         }
 }
 
+        /* the range coder is a single stream, so all planes are unpacked
+         * before any of them is reconstructed */
 {   START_TIMER
     for(level=0; level<s->spatial_decomposition_count; level++){
         for(orientation=level ? 1 : 0; orientation<4; orientation++){
@@ -4440,91 +4654,9 @@ if(s->avctx->debug&2048){
     }
     STOP_TIMER("unpack coeffs");
 }
-
-{START_TIMER
-    const int mb_h= s->b_height << s->block_max_depth;
-    const int block_size = MB_SIZE >> s->block_max_depth;
-    const int block_w    = plane_index ? block_size/2 : block_size;
-    int mb_y;
-    dwt_compose_t cs[MAX_DECOMPOSITIONS];
-    int yd=0, yq=0;
-    int y;
-    int end_y;
-
-    ff_spatial_idwt_buffered_init(cs, &s->sb, w, h, 1, s->spatial_decomposition_type, s->spatial_decomposition_count);
-    for(mb_y=0; mb_y<=mb_h; mb_y++){
-
-        int slice_starty = block_w*mb_y;
-        int slice_h = block_w*(mb_y+1);
-        if (!(s->keyframe || s->avctx->debug&512)){
-            slice_starty = FFMAX(0, slice_starty - (block_w >> 1));
-            slice_h -= (block_w >> 1);
-        }
-
-        {
-        START_TIMER
-        for(level=0; level<s->spatial_decomposition_count; level++){
-            for(orientation=level ? 1 : 0; orientation<4; orientation++){
-                SubBand *b= &p->band[level][orientation];
-                int start_y;
-                int end_y;
-                int our_mb_start = mb_y;
-                int our_mb_end = (mb_y + 1);
-                const int extra= 3;
-                start_y = (mb_y ? ((block_w * our_mb_start) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra: 0);
-                end_y = (((block_w * our_mb_end) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra);
-                if (!(s->keyframe || s->avctx->debug&512)){
-                    start_y = FFMAX(0, start_y - (block_w >> (1+s->spatial_decomposition_count - level)));
-                    end_y = FFMAX(0, end_y - (block_w >> (1+s->spatial_decomposition_count - level)));
-                }
-                start_y = FFMIN(b->height, start_y);
-                end_y = FFMIN(b->height, end_y);
-
-                if (start_y != end_y){
-                    if (orientation == 0){
-                        SubBand * correlate_band = &p->band[0][0];
-                        int correlate_end_y = FFMIN(b->height, end_y + 1);
-                        int correlate_start_y = FFMIN(b->height, (start_y ? start_y + 1 : 0));
-                        decode_subband_slice_buffered(s, correlate_band, &s->sb, correlate_start_y, correlate_end_y, decode_state[0][0]);
-                        correlate_slice_buffered(s, &s->sb, correlate_band, correlate_band->buf, correlate_band->stride, 1, 0, correlate_start_y, correlate_end_y);
-                        dequantize_slice_buffered(s, &s->sb, correlate_band, correlate_band->buf, correlate_band->stride, start_y, end_y);
-                    }
-                    else
-                        decode_subband_slice_buffered(s, b, &s->sb, start_y, end_y, decode_state[level][orientation]);
-                }
-            }
-        }
-        STOP_TIMER("decode_subband_slice");
-        }
-
-{   START_TIMER
-        for(; yd<slice_h; yd+=4){
-            ff_spatial_idwt_buffered_slice(&s->dsp, cs, &s->sb, w, h, 1, s->spatial_decomposition_type, s->spatial_decomposition_count, yd);
-        }
-    STOP_TIMER("idwt slice");}
-
-
-        if(s->qlog == LOSSLESS_QLOG){
-            for(; yq<slice_h && yq<h; yq++){
-                DWTELEM * line = slice_buffer_get_line(&s->sb, yq);
-                for(x=0; x<w; x++){
-                    line[x] <<= FRAC_BITS;
-                }
-            }
-        }
-
-        predict_slice_buffered(s, &s->sb, s->spatial_dwt_buffer, plane_index, 1, mb_y);
-
-        y = FFMIN(p->height, slice_starty);
-        end_y = FFMIN(p->height, slice_h);
-        while(y < end_y)
-            slice_buffer_release(&s->sb, y++);
     }
 
-    slice_buffer_flush(&s->sb);
-
-STOP_TIMER("idwt + predict_slices")}
-    }
+    decode_slices(s);
 
     emms_c();
 
@@ -4547,8 +4679,10 @@ else
 static int decode_end(AVCodecContext *avctx)
 {
     SnowContext *s = avctx->priv_data;
+    int plane_index;
 
-    slice_buffer_destroy(&s->sb);
+    for(plane_index=0; plane_index<3; plane_index++)
+        slice_buffer_destroy(&s->slice_state[plane_index].sb);
 
     common_end(s);
 
@@ -4731,3 +4865,130 @@ int64_t g=0;
 }
 #endif
 
+
+#ifdef TEST
+#undef malloc
+#undef free
+#undef printf
+
+#define TEST_WIDTH  176
+#define TEST_HEIGHT 144
+#define TEST_FRAMES 8
+
+/* Run the slice jobs one after the other in reverse order, so that any
+   dependency on the order of the jobs shows up in the output. */
+static int test_execute(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2), void **arg, int *ret, int count){
+    int i;
+
+    assert(count <= c->thread_count);
+    for(i=count-1; i>=0; i--){
+        int r= func(c, arg[i]);
+        if(ret) ret[i]= r;
+    }
+    return 0;
+}
+
+/* Decode the same frames with 1, 2, 4 and 8 threads and compare the planes
+   bitexactly. Only keyframes are coded, the encoder does not handle inter
+   frames in this tree yet. */
+int main(){
+    static const int threads[]= {2, 4, 8};
+    static uint8_t outbuf[1<<20];
+    const int w= TEST_WIDTH, h= TEST_HEIGHT;
+    uint8_t *pkt[TEST_FRAMES], *ref[TEST_FRAMES];
+    int pkt_size[TEST_FRAMES];
+    AVCodecContext *enc, *dec;
+    AVFrame *pic= avcodec_alloc_frame();
+    AVFrame *out= avcodec_alloc_frame();
+    uint8_t *buf= av_malloc(w*h*3/2);
+    int i, t, p, x, y, got, ret= 0;
+
+    avcodec_init();
+    register_avcodec(&snow_encoder);
+    register_avcodec(&snow_decoder);
+
+    enc= avcodec_alloc_context();
+    enc->width= w;
+    enc->height= h;
+    enc->time_base= (AVRational){1, 25};
+    enc->pix_fmt= PIX_FMT_YUV420P;
+    enc->gop_size= 1;
+    enc->flags|= CODEC_FLAG_QSCALE;
+    enc->global_quality= FF_QP2LAMBDA*3;
+    enc->strict_std_compliance= FF_COMPLIANCE_EXPERIMENTAL;
+    if(avcodec_open(enc, &snow_encoder) < 0){
+        printf("cannot open the snow encoder\n");
+        return 1;
+    }
+
+    pic->data[0]= buf;
+    pic->data[1]= buf + w*h;
+    pic->data[2]= buf + w*h*5/4;
+    pic->linesize[0]= w;
+    pic->linesize[1]= pic->linesize[2]= w/2;
+    for(i=0; i<TEST_FRAMES; i++){
+        for(y=0; y<h; y++)
+            for(x=0; x<w; x++)
+                pic->data[0][x + y*w]= x*3 + y*2 + i*5 + (x*y + i*7)%23*3 + ((x/8 + y/8 + i)&1)*40;
+        for(y=0; y<h/2; y++)
+            for(x=0; x<w/2; x++){
+                pic->data[1][x + y*w/2]= 128 + x - y + i*2;
+                pic->data[2][x + y*w/2]= 64 + x*2 + y + i;
+            }
+        pic->pts= i;
+        pkt_size[i]= avcodec_encode_video(enc, outbuf, sizeof(outbuf), pic);
+        pkt[i]= av_mallocz(pkt_size[i] + FF_INPUT_BUFFER_PADDING_SIZE);
+        memcpy(pkt[i], outbuf, pkt_size[i]);
+        ref[i]= av_malloc(w*h*3/2);
+    }
+    avcodec_close(enc);
+
+    for(t=-1; t<(int)(sizeof(threads)/sizeof(threads[0])); t++){
+        int errors= 0;
+
+        dec= avcodec_alloc_context();
+        dec->width= w;
+        dec->height= h;
+        if(t >= 0){
+            dec->thread_count= threads[t];
+            dec->execute= test_execute;
+        }
+        if(avcodec_open(dec, &snow_decoder) < 0){
+            printf("cannot open the snow decoder\n");
+            return 1;
+        }
+        for(i=0; i<TEST_FRAMES; i++){
+            avcodec_decode_video(dec, out, &got, pkt[i], pkt_size[i]);
+            for(p=0; p<3; p++){
+                int pw= p ? w/2 : w, ph= p ? h/2 : h;
+                uint8_t *r= ref[i] + (p ? w*h + (p-1)*w*h/4 : 0);
+
+                for(y=0; y<ph; y++){
+                    if(t < 0)
+                        memcpy(r + y*pw, out->data[p] + y*out->linesize[p], pw);
+                    else if(memcmp(r + y*pw, out->data[p] + y*out->linesize[p], pw))
+                        errors++;
+                }
+            }
+        }
+        avcodec_close(dec);
+        av_free(dec);
+
+        if(t >= 0){
+            printf("%d threads: %s\n", threads[t], errors ? "mismatch" : "ok");
+            if(errors)
+                ret= 1;
+        }
+    }
+
+    for(i=0; i<TEST_FRAMES; i++){
+        av_free(pkt[i]);
+        av_free(ref[i]);
+    }
+    av_free(enc);
+    av_free(buf);
+    av_free(pic);
+    av_free(out);
+    return ret;
+}
+#endif
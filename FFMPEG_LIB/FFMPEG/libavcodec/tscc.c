@@ -61,6 +61,9 @@ typedef struct TsccContext {
     // Decompression buffer
     unsigned char* decomp_buf;
     int height;
+    // 16x16 blocks touched by the current frame
+    uint8_t *mb_changed;
+    int mb_stride;
 #ifdef CONFIG_ZLIB
     z_stream zstream;
 #endif
@@ -73,6 +76,16 @@ typedef struct TsccContext {
  *
  */
 
+static void mark_changed(CamtasiaContext *c, unsigned char *output, int pos, int n)
+{
+    int y = (output - c->pic.data[0]) / c->pic.linesize[0];
+    uint8_t *mb = c->mb_changed + (y >> 4) * c->mb_stride;
+    int x;
+
+    for(x = pos >> 4; x <= (pos + n - 1) >> 4 && x < c->mb_stride; x++)
+        mb[x] = 1;
+}
+
 static int decode_rle(CamtasiaContext *c, unsigned int srcsize)
 {
     unsigned char *src = c->decomp_buf;
@@ -110,6 +123,7 @@ static int decode_rle(CamtasiaContext *c, unsigned int srcsize)
                 src += p2 * (c->bpp / 8);
                 continue;
             }
+            mark_changed(c, output, pos, p2);
             if ((c->bpp == 8) || (c->bpp == 24)) {
                 for(i = 0; i < p2 * (c->bpp / 8); i++) {
                     *output++ = *src++;
@@ -154,6 +168,7 @@ static int decode_rle(CamtasiaContext *c, unsigned int srcsize)
             }
             if (output + p1 * (c->bpp / 8) > output_end)
                 continue;
+            mark_changed(c, output, pos, p1);
             for(i = 0; i < p1; i++) {
                 switch(c->bpp){
                 case  8: *output++ = pix[0];
@@ -204,6 +219,8 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
     }
 
     outptr = c->pic.data[0]; // Output image pointer
+    memset(c->mb_changed, 0, c->mb_stride * ((c->height + 15) >> 4));
+    c->pic.palette_has_changed = 0;
 
 #ifdef CONFIG_ZLIB
     zret = inflateReset(&(c->zstream));
@@ -235,6 +252,12 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
         }
     }
 
+    /* only runs and copies were drawn if we got our previous picture back */
+    if(c->pic.age != 1 || c->pic.palette_has_changed)
+        memset(c->mb_changed, 1, c->mb_stride * ((c->height + 15) >> 4));
+    c->pic.mb_changed = c->mb_changed;
+    c->pic.mb_changed_stride = c->mb_stride;
+
 #else
     av_log(avctx, AV_LOG_ERROR, "BUG! Zlib support not compiled in frame decoder.\n");
     return -1;
@@ -286,6 +309,9 @@ static int decode_init(AVCodecContext *avctx)
              return -1;
     }
     c->bpp = avctx->bits_per_sample;
+    c->mb_stride = (avctx->width + 15) >> 4;
+    if (!(c->mb_changed = av_mallocz(c->mb_stride * ((c->height + 15) >> 4))))
+        return 1;
     c->decomp_size = (avctx->width * c->bpp + (avctx->width + 254) / 255 + 2) * avctx->height + 2;//RLE in the 'best' case
 
     /* Allocate decompression buffer */
@@ -322,6 +348,7 @@ static int decode_end(AVCodecContext *avctx)
     CamtasiaContext * const c = avctx->priv_data;
 
     av_freep(&c->decomp_buf);
+    av_freep(&c->mb_changed);
 
     if (c->pic.data[0])
         avctx->release_buffer(avctx, &c->pic);
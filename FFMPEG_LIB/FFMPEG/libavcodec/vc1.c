@@ -403,13 +403,53 @@ static int vop_dquant_decoding(VC1Context *v)
     return 0;
 }
 
+/** Put 8x8 block (or its reduced size version in lowres mode) onto picture
+ */
+static void vc1_put_pixels_clamped(VC1Context *v, const DCTELEM *block, uint8_t *dst, int stride)
+{
+    const int bs = 8 >> v->s.avctx->lowres;
+    uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
+    int i, j;
+
+    if(bs == 8) {
+        v->s.dsp.put_pixels_clamped(block, dst, stride);
+        return;
+    }
+    for(j = 0; j < bs; j++) {
+        for(i = 0; i < bs; i++)
+            dst[i] = cm[block[i]];
+        block += 8;
+        dst += stride;
+    }
+}
+
+/** Add 8x8 block (or its reduced size version in lowres mode) to picture
+ */
+static void vc1_add_pixels_clamped(VC1Context *v, const DCTELEM *block, uint8_t *dst, int stride)
+{
+    const int bs = 8 >> v->s.avctx->lowres;
+    uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
+    int i, j;
+
+    if(bs == 8) {
+        v->s.dsp.add_pixels_clamped(block, dst, stride);
+        return;
+    }
+    for(j = 0; j < bs; j++) {
+        for(i = 0; i < bs; i++)
+            dst[i] = cm[dst[i] + block[i]];
+        block += 8;
+        dst += stride;
+    }
+}
+
 /** Put block onto picture
  */
 static void vc1_put_block(VC1Context *v, DCTELEM block[6][64])
 {
     uint8_t *Y;
     int ys, us, vs;
-    DSPContext *dsp = &v->s.dsp;
+    const int bs = 8 >> v->s.avctx->lowres;
 
     if(v->rangeredfrm) {
         int i, j, k;
@@ -424,18 +464,67 @@ static void vc1_put_block(VC1Context *v, DCTELEM block[6][64])
     vs = v->s.current_picture.linesize[2];
     Y = v->s.dest[0];
 
-    dsp->put_pixels_clamped(block[0], Y, ys);
-    dsp->put_pixels_clamped(block[1], Y + 8, ys);
-    Y += ys * 8;
-    dsp->put_pixels_clamped(block[2], Y, ys);
-    dsp->put_pixels_clamped(block[3], Y + 8, ys);
+    vc1_put_pixels_clamped(v, block[0], Y, ys);
+    vc1_put_pixels_clamped(v, block[1], Y + bs, ys);
+    Y += ys * bs;
+    vc1_put_pixels_clamped(v, block[2], Y, ys);
+    vc1_put_pixels_clamped(v, block[3], Y + bs, ys);
 
     if(!(v->s.flags & CODEC_FLAG_GRAY)) {
-        dsp->put_pixels_clamped(block[4], v->s.dest[1], us);
-        dsp->put_pixels_clamped(block[5], v->s.dest[2], vs);
+        vc1_put_pixels_clamped(v, block[4], v->s.dest[1], us);
+        vc1_put_pixels_clamped(v, block[5], v->s.dest[2], vs);
     }
 }
 
+/** Do bilinear motion compensation of one block in lowres mode
+ * @param x horizontal block position in full resolution quarter pels
+ * @param y vertical block position in full resolution quarter pels
+ * @param bs reduced block size
+ * @param lut intensity compensation table or NULL
+ */
+static void vc1_mc_block_lowres(VC1Context *v, uint8_t *dst, uint8_t *src, int stride,
+                                int x, int y, int bs, int h_edge_pos, int v_edge_pos,
+                                const uint8_t *lut, int avg)
+{
+    MpegEncContext *s = &v->s;
+    const int lowres = s->avctx->lowres;
+    const int s_mask = (4 << lowres) - 1;
+    int src_x, src_y, sx, sy;
+
+    src_x = x >> (lowres + 2);
+    src_y = y >> (lowres + 2);
+    sx = ((x & s_mask) << 1) >> lowres;
+    sy = ((y & s_mask) << 1) >> lowres;
+    h_edge_pos >>= lowres;
+    v_edge_pos >>= lowres;
+
+    src += src_y * stride + src_x;
+    if(v->rangeredfrm || lut
+       || (unsigned)src_x > h_edge_pos - bs - 1
+       || (unsigned)src_y > v_edge_pos - bs - 1){
+        int i, j;
+        uint8_t *p;
+
+        ff_emulated_edge_mc(s->edge_emu_buffer, src, stride, bs+1, bs+1,
+                            src_x, src_y, h_edge_pos, v_edge_pos);
+        src = s->edge_emu_buffer;
+        /* range reduction and intensity compensation are applied to source pixels */
+        p = src;
+        for(j = 0; j <= bs; j++) {
+            if(v->rangeredfrm)
+                for(i = 0; i <= bs; i++) p[i] = ((p[i] - 128) >> 1) + 128;
+            if(lut)
+                for(i = 0; i <= bs; i++) p[i] = lut[p[i]];
+            p += stride;
+        }
+    }
+
+    if(avg)
+        s->dsp.avg_h264_chroma_pixels_tab[3 - av_log2(bs)](dst, src, stride, bs, sx, sy);
+    else
+        s->dsp.put_h264_chroma_pixels_tab[3 - av_log2(bs)](dst, src, stride, bs, sx, sy);
+}
+
 /** Do motion compensation over 1 macroblock
  * Mostly adapted hpel_motion and qpel_motion from mpegvideo.c
  */
@@ -489,6 +578,20 @@ static void vc1_mc_1mv(VC1Context *v, int dir)
         uvsrc_y = av_clip(uvsrc_y,  -8, s->avctx->coded_height >> 1);
     }
 
+    if(s->avctx->lowres) {
+        const uint8_t *luty  = (v->mv_mode == MV_PMODE_INTENSITY_COMP) ? v->luty  : NULL;
+        const uint8_t *lutuv = (v->mv_mode == MV_PMODE_INTENSITY_COMP) ? v->lutuv : NULL;
+
+        vc1_mc_block_lowres(v, s->dest[0], srcY, s->linesize, src_x * 4 + (mx & (s->mspel ? 3 : 2)), src_y * 4 + (my & (s->mspel ? 3 : 2)),
+                            16 >> s->avctx->lowres, s->h_edge_pos, s->v_edge_pos, luty, 0);
+        if(s->flags & CODEC_FLAG_GRAY) return;
+        vc1_mc_block_lowres(v, s->dest[1], srcU, s->uvlinesize, uvsrc_x * 4 + (uvmx & 3), uvsrc_y * 4 + (uvmy & 3),
+                            8 >> s->avctx->lowres, s->h_edge_pos >> 1, s->v_edge_pos >> 1, lutuv, 0);
+        vc1_mc_block_lowres(v, s->dest[2], srcV, s->uvlinesize, uvsrc_x * 4 + (uvmx & 3), uvsrc_y * 4 + (uvmy & 3),
+                            8 >> s->avctx->lowres, s->h_edge_pos >> 1, s->v_edge_pos >> 1, lutuv, 0);
+        return;
+    }
+
     srcY += src_y * s->linesize + src_x;
     srcU += uvsrc_y * s->uvlinesize + uvsrc_x;
     srcV += uvsrc_y * s->uvlinesize + uvsrc_x;
@@ -615,6 +718,16 @@ static void vc1_mc_4mv_luma(VC1Context *v, int n)
         src_y   = av_clip(  src_y, -18, s->avctx->coded_height + 1);
     }
 
+    if(s->avctx->lowres) {
+        const int bs = 8 >> s->avctx->lowres;
+
+        vc1_mc_block_lowres(v, s->dest[0] + s->linesize * (bs >> 1) * (n&2) + (n&1) * bs, srcY, s->linesize,
+                            src_x * 4 + (mx & (s->mspel ? 3 : 2)), src_y * 4 + (my & (s->mspel ? 3 : 2)),
+                            bs, s->h_edge_pos, s->v_edge_pos,
+                            (v->mv_mode == MV_PMODE_INTENSITY_COMP) ? v->luty : NULL, 0);
+        return;
+    }
+
     srcY += src_y * s->linesize + src_x;
 
     if(v->rangeredfrm || (v->mv_mode == MV_PMODE_INTENSITY_COMP)
@@ -750,6 +863,16 @@ static void vc1_mc_4mv_chroma(VC1Context *v)
         uvsrc_y = av_clip(uvsrc_y,  -8, s->avctx->coded_height >> 1);
     }
 
+    if(s->avctx->lowres) {
+        const uint8_t *lutuv = (v->mv_mode == MV_PMODE_INTENSITY_COMP) ? v->lutuv : NULL;
+
+        vc1_mc_block_lowres(v, s->dest[1], s->last_picture.data[1], s->uvlinesize, uvsrc_x * 4 + (uvmx & 3), uvsrc_y * 4 + (uvmy & 3),
+                            8 >> s->avctx->lowres, s->h_edge_pos >> 1, s->v_edge_pos >> 1, lutuv, 0);
+        vc1_mc_block_lowres(v, s->dest[2], s->last_picture.data[2], s->uvlinesize, uvsrc_x * 4 + (uvmx & 3), uvsrc_y * 4 + (uvmy & 3),
+                            8 >> s->avctx->lowres, s->h_edge_pos >> 1, s->v_edge_pos >> 1, lutuv, 0);
+        return;
+    }
+
     srcU = s->last_picture.data[1] + uvsrc_y * s->uvlinesize + uvsrc_x;
     srcV = s->last_picture.data[2] + uvsrc_y * s->uvlinesize + uvsrc_x;
     if(v->rangeredfrm || (v->mv_mode == MV_PMODE_INTENSITY_COMP)
@@ -934,6 +1057,8 @@ static int decode_sequence_header(AVCodecContext *avctx, GetBitContext *gb)
 
 static int decode_sequence_header_adv(VC1Context *v, GetBitContext *gb)
 {
+    int w, h;
+
     v->res_rtm_flag = 1;
     v->level = get_bits(gb, 3);
     if(v->level >= 5)
@@ -954,10 +1079,9 @@ static int decode_sequence_header_adv(VC1Context *v, GetBitContext *gb)
     v->bitrtq_postproc = get_bits(gb, 5); //common
     v->postprocflag = get_bits(gb, 1); //common
 
-    v->s.avctx->coded_width = (get_bits(gb, 12) + 1) << 1;
-    v->s.avctx->coded_height = (get_bits(gb, 12) + 1) << 1;
-    v->s.avctx->width = v->s.avctx->coded_width;
-    v->s.avctx->height = v->s.avctx->coded_height;
+    w = (get_bits(gb, 12) + 1) << 1;
+    h = (get_bits(gb, 12) + 1) << 1;
+    avcodec_set_dimensions(v->s.avctx, w, h);
     v->broadcast = get_bits1(gb);
     v->interlace = get_bits1(gb);
     v->tfcntrflag = get_bits1(gb);
@@ -983,10 +1107,12 @@ static int decode_sequence_header_adv(VC1Context *v, GetBitContext *gb)
     }
     v->s.max_b_frames = v->s.avctx->max_b_frames = 7;
     if(get_bits1(gb)) { //Display Info - decoding is not affected by it
-        int w, h, ar = 0;
+        int ar = 0;
         av_log(v->s.avctx, AV_LOG_DEBUG, "Display extended info:\n");
-        v->s.avctx->width  = v->s.width  = w = get_bits(gb, 14) + 1;
-        v->s.avctx->height = v->s.height = h = get_bits(gb, 14) + 1;
+        v->s.width  = w = get_bits(gb, 14) + 1;
+        v->s.height = h = get_bits(gb, 14) + 1;
+        v->s.avctx->width  = -((-w) >> v->s.avctx->lowres);
+        v->s.avctx->height = -((-h) >> v->s.avctx->lowres);
         av_log(v->s.avctx, AV_LOG_DEBUG, "Display dimensions: %ix%i\n", w, h);
         if(get_bits1(gb))
             ar = get_bits(gb, 4);
@@ -1821,6 +1947,17 @@ static void vc1_interp_mc(VC1Context *v)
         uvsrc_y = av_clip(uvsrc_y,  -8, s->avctx->coded_height >> 1);
     }
 
+    if(s->avctx->lowres) {
+        vc1_mc_block_lowres(v, s->dest[0], srcY, s->linesize, src_x * 4 + (mx & 2), src_y * 4 + (my & 2),
+                            16 >> s->avctx->lowres, s->h_edge_pos, s->v_edge_pos, NULL, 1);
+        if(s->flags & CODEC_FLAG_GRAY) return;
+        vc1_mc_block_lowres(v, s->dest[1], srcU, s->uvlinesize, uvsrc_x * 4 + (uvmx & 3), uvsrc_y * 4 + (uvmy & 3),
+                            8 >> s->avctx->lowres, s->h_edge_pos >> 1, s->v_edge_pos >> 1, NULL, 1);
+        vc1_mc_block_lowres(v, s->dest[2], srcV, s->uvlinesize, uvsrc_x * 4 + (uvmx & 3), uvsrc_y * 4 + (uvmy & 3),
+                            8 >> s->avctx->lowres, s->h_edge_pos >> 1, s->v_edge_pos >> 1, NULL, 1);
+        return;
+    }
+
     srcY += src_y * s->linesize + src_x;
     srcU += uvsrc_y * s->uvlinesize + uvsrc_x;
     srcV += uvsrc_y * s->uvlinesize + uvsrc_x;
@@ -2935,6 +3072,25 @@ static int vc1_decode_intra_block(VC1Context *v, DCTELEM block[64], int n, int c
     return 0;
 }
 
+/** Average residual block down to lowres size, result is put into
+ * the top left corner of the block
+ */
+static void vc1_downscale_block(DCTELEM block[64], int lowres)
+{
+    const int bs = 8 >> lowres;
+    const int n = 1 << lowres;
+    int i, j, k, l, sum;
+
+    for(j = 0; j < bs; j++)
+        for(i = 0; i < bs; i++) {
+            sum = 0;
+            for(l = 0; l < n; l++)
+                for(k = 0; k < n; k++)
+                    sum += block[(j * n + l) * 8 + i * n + k];
+            block[j * 8 + i] = (sum + (n * n >> 1)) >> (2 * lowres);
+        }
+}
+
 /** Decode P block
  */
 static int vc1_decode_p_block(VC1Context *v, DCTELEM block[64], int n, int mquant, int ttmb, int first_block)
@@ -2983,7 +3139,8 @@ static int vc1_decode_p_block(VC1Context *v, DCTELEM block[64], int n, int mquan
             if(!v->pquantizer)
                 block[idx] += (block[idx] < 0) ? -mquant : mquant;
         }
-        s->dsp.vc1_inv_trans_8x8(block);
+        if(!v->skip_residual)
+            s->dsp.vc1_inv_trans_8x8(block);
         break;
     case TT_4X4:
         for(j = 0; j < 4; j++) {
@@ -3000,7 +3157,7 @@ static int vc1_decode_p_block(VC1Context *v, DCTELEM block[64], int n, int mquan
                 if(!v->pquantizer)
                     block[idx + off] += (block[idx + off] < 0) ? -mquant : mquant;
             }
-            if(!(subblkpat & (1 << (3 - j))))
+            if(!(subblkpat & (1 << (3 - j))) && !v->skip_residual)
                 s->dsp.vc1_inv_trans_4x4(block, j);
         }
         break;
@@ -3022,7 +3179,7 @@ static int vc1_decode_p_block(VC1Context *v, DCTELEM block[64], int n, int mquan
                 if(!v->pquantizer)
                     block[idx + off] += (block[idx + off] < 0) ? -mquant : mquant;
             }
-            if(!(subblkpat & (1 << (1 - j))))
+            if(!(subblkpat & (1 << (1 - j))) && !v->skip_residual)
                 s->dsp.vc1_inv_trans_8x4(block, j);
         }
         break;
@@ -3044,11 +3201,15 @@ static int vc1_decode_p_block(VC1Context *v, DCTELEM block[64], int n, int mquan
                 if(!v->pquantizer)
                     block[idx + off] += (block[idx + off] < 0) ? -mquant : mquant;
             }
-            if(!(subblkpat & (1 << (1 - j))))
+            if(!(subblkpat & (1 << (1 - j))) && !v->skip_residual)
                 s->dsp.vc1_inv_trans_4x8(block, j);
         }
         break;
     }
+    /* 8x8 transform is reduced by the DSP function itself,
+       subblock ones are done at full size and scaled down here */
+    if(s->avctx->lowres && ttblk != TT_8X8 && !v->skip_residual)
+        vc1_downscale_block(block, s->avctx->lowres);
     return 0;
 }
 
@@ -3065,6 +3226,7 @@ static int vc1_decode_p_mb(VC1Context *v)
     int mqdiff, mquant; /* MB quantization */
     int ttmb = v->ttfrm; /* MB Transform type */
     int status;
+    const int bs = 8 >> s->avctx->lowres;
 
     static const int size_table[6] = { 0, 2, 3, 4, 5, 8 },
       offset_table[6] = { 0, 1, 3, 7, 15, 31 };
@@ -3132,7 +3294,7 @@ static int vc1_decode_p_mb(VC1Context *v)
                 s->dc_val[0][s->block_index[i]] = 0;
                 dst_idx += i >> 2;
                 val = ((cbp >> (5 - i)) & 1);
-                off = (i & 4) ? 0 : ((i & 1) * 8 + (i & 2) * 4 * s->linesize);
+                off = (i & 4) ? 0 : ((i & 1) * bs + (i & 2) * (bs >> 1) * s->linesize);
                 v->mb_type[0][s->block_index[i]] = s->mb_intra;
                 if(s->mb_intra) {
                     /* check if prediction blocks A and C are available */
@@ -3148,8 +3310,8 @@ static int vc1_decode_p_mb(VC1Context *v)
                     if(v->rangeredfrm) for(j = 0; j < 64; j++) s->block[i][j] <<= 1;
                     for(j = 0; j < 64; j++) s->block[i][j] += 128;
                     if(!v->res_fasttx && v->res_x8) for(j = 0; j < 64; j++) s->block[i][j] += 16;
-                    s->dsp.put_pixels_clamped(s->block[i], s->dest[dst_idx] + off, s->linesize >> ((i & 4) >> 2));
-                    if(v->pq >= 9 && v->overlap) {
+                    vc1_put_pixels_clamped(v, s->block[i], s->dest[dst_idx] + off, s->linesize >> ((i & 4) >> 2));
+                    if(v->pq >= 9 && v->overlap && !v->skip_overlap) {
                         if(v->c_avail)
                             s->dsp.vc1_h_overlap(s->dest[dst_idx] + off, s->linesize >> ((i & 4) >> 2));
                         if(v->a_avail)
@@ -3159,8 +3321,8 @@ static int vc1_decode_p_mb(VC1Context *v)
                     vc1_decode_p_block(v, s->block[i], i, mquant, ttmb, first_block);
                     if(!v->ttmbf && ttmb < 8) ttmb = -1;
                     first_block = 0;
-                    if((i<4) || !(s->flags & CODEC_FLAG_GRAY))
-                        s->dsp.add_pixels_clamped(s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
+                    if(!v->skip_residual && ((i<4) || !(s->flags & CODEC_FLAG_GRAY)))
+                        vc1_add_pixels_clamped(v, s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
                 }
             }
         }
@@ -3175,6 +3337,8 @@ static int vc1_decode_p_mb(VC1Context *v)
             s->current_picture.qscale_table[mb_pos] = 0;
             vc1_pred_mv(s, 0, 0, 0, 1, v->range_x, v->range_y, v->mb_type[0]);
             vc1_mc_1mv(v, 0);
+            if(s->current_picture.mb_changed_stride && !s->mv[0][0][0] && !s->mv[0][0][1])
+                s->current_picture.mb_changed[mb_pos] = 0;
             return 0;
         }
     } //1MV mode
@@ -3236,7 +3400,7 @@ static int vc1_decode_p_mb(VC1Context *v)
             for (i=0; i<6; i++)
             {
                 dst_idx += i >> 2;
-                off = (i & 4) ? 0 : ((i & 1) * 8 + (i & 2) * 4 * s->linesize);
+                off = (i & 4) ? 0 : ((i & 1) * bs + (i & 2) * (bs >> 1) * s->linesize);
                 s->mb_intra = is_intra[i];
                 if (is_intra[i]) {
                     /* check if prediction blocks A and C are available */
@@ -3252,8 +3416,8 @@ static int vc1_decode_p_mb(VC1Context *v)
                     if(v->rangeredfrm) for(j = 0; j < 64; j++) s->block[i][j] <<= 1;
                     for(j = 0; j < 64; j++) s->block[i][j] += 128;
                     if(!v->res_fasttx && v->res_x8) for(j = 0; j < 64; j++) s->block[i][j] += 16;
-                    s->dsp.put_pixels_clamped(s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
-                    if(v->pq >= 9 && v->overlap) {
+                    vc1_put_pixels_clamped(v, s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
+                    if(v->pq >= 9 && v->overlap && !v->skip_overlap) {
                         if(v->c_avail)
                             s->dsp.vc1_h_overlap(s->dest[dst_idx] + off, s->linesize >> ((i & 4) >> 2));
                         if(v->a_avail)
@@ -3263,8 +3427,8 @@ static int vc1_decode_p_mb(VC1Context *v)
                     status = vc1_decode_p_block(v, s->block[i], i, mquant, ttmb, first_block);
                     if(!v->ttmbf && ttmb < 8) ttmb = -1;
                     first_block = 0;
-                    if((i<4) || !(s->flags & CODEC_FLAG_GRAY))
-                        s->dsp.add_pixels_clamped(s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
+                    if(!v->skip_residual && ((i<4) || !(s->flags & CODEC_FLAG_GRAY)))
+                        vc1_add_pixels_clamped(v, s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
                 }
             }
             return status;
@@ -3284,6 +3448,10 @@ static int vc1_decode_p_mb(VC1Context *v)
             }
             vc1_mc_4mv_chroma(v);
             s->current_picture.qscale_table[mb_pos] = 0;
+            if(s->current_picture.mb_changed_stride &&
+               !(s->mv[0][0][0] | s->mv[0][0][1] | s->mv[0][1][0] | s->mv[0][1][1] |
+                 s->mv[0][2][0] | s->mv[0][2][1] | s->mv[0][3][0] | s->mv[0][3][1]))
+                s->current_picture.mb_changed[mb_pos] = 0;
             return 0;
         }
     }
@@ -3303,6 +3471,7 @@ static void vc1_decode_b_mb(VC1Context *v)
     int cbp = 0; /* cbp decoding stuff */
     int mqdiff, mquant; /* MB quantization */
     int ttmb = v->ttfrm; /* MB Transform type */
+    const int bs = 8 >> s->avctx->lowres;
 
     static const int size_table[6] = { 0, 2, 3, 4, 5, 8 },
       offset_table[6] = { 0, 1, 3, 7, 15, 31 };
@@ -3418,7 +3587,7 @@ static void vc1_decode_b_mb(VC1Context *v)
         s->dc_val[0][s->block_index[i]] = 0;
         dst_idx += i >> 2;
         val = ((cbp >> (5 - i)) & 1);
-        off = (i & 4) ? 0 : ((i & 1) * 8 + (i & 2) * 4 * s->linesize);
+        off = (i & 4) ? 0 : ((i & 1) * bs + (i & 2) * (bs >> 1) * s->linesize);
         v->mb_type[0][s->block_index[i]] = s->mb_intra;
         if(s->mb_intra) {
             /* check if prediction blocks A and C are available */
@@ -3433,13 +3602,13 @@ static void vc1_decode_b_mb(VC1Context *v)
             s->dsp.vc1_inv_trans_8x8(s->block[i]);
             if(v->rangeredfrm) for(j = 0; j < 64; j++) s->block[i][j] <<= 1;
             for(j = 0; j < 64; j++) s->block[i][j] += 128;
-            s->dsp.put_pixels_clamped(s->block[i], s->dest[dst_idx] + off, s->linesize >> ((i & 4) >> 2));
+            vc1_put_pixels_clamped(v, s->block[i], s->dest[dst_idx] + off, s->linesize >> ((i & 4) >> 2));
         } else if(val) {
             vc1_decode_p_block(v, s->block[i], i, mquant, ttmb, first_block);
             if(!v->ttmbf && ttmb < 8) ttmb = -1;
             first_block = 0;
-            if((i<4) || !(s->flags & CODEC_FLAG_GRAY))
-                s->dsp.add_pixels_clamped(s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
+            if(!v->skip_residual && ((i<4) || !(s->flags & CODEC_FLAG_GRAY)))
+                vc1_add_pixels_clamped(v, s->block[i], s->dest[dst_idx] + off, (i&4)?s->uvlinesize:s->linesize);
         }
     }
 }
@@ -3453,6 +3622,8 @@ static void vc1_decode_i_blocks(VC1Context *v)
     int cbp, val;
     uint8_t *coded_val;
     int mb_pos;
+    const int bs = 8 >> s->avctx->lowres;
+    const int mb_size = 16 >> s->avctx->lowres;
 
     /* select codingmode used for VLC tables selection */
     switch(v->y_ac_table_index){
@@ -3523,27 +3694,27 @@ static void vc1_decode_i_blocks(VC1Context *v)
             }
 
             vc1_put_block(v, s->block);
-            if(v->pq >= 9 && v->overlap) {
+            if(v->pq >= 9 && v->overlap && !v->skip_overlap) {
                 if(s->mb_x) {
                     s->dsp.vc1_h_overlap(s->dest[0], s->linesize);
-                    s->dsp.vc1_h_overlap(s->dest[0] + 8 * s->linesize, s->linesize);
+                    s->dsp.vc1_h_overlap(s->dest[0] + bs * s->linesize, s->linesize);
                     if(!(s->flags & CODEC_FLAG_GRAY)) {
                         s->dsp.vc1_h_overlap(s->dest[1], s->uvlinesize);
                         s->dsp.vc1_h_overlap(s->dest[2], s->uvlinesize);
                     }
                 }
-                s->dsp.vc1_h_overlap(s->dest[0] + 8, s->linesize);
-                s->dsp.vc1_h_overlap(s->dest[0] + 8 * s->linesize + 8, s->linesize);
+                s->dsp.vc1_h_overlap(s->dest[0] + bs, s->linesize);
+                s->dsp.vc1_h_overlap(s->dest[0] + bs * s->linesize + bs, s->linesize);
                 if(!s->first_slice_line) {
                     s->dsp.vc1_v_overlap(s->dest[0], s->linesize);
-                    s->dsp.vc1_v_overlap(s->dest[0] + 8, s->linesize);
+                    s->dsp.vc1_v_overlap(s->dest[0] + bs, s->linesize);
                     if(!(s->flags & CODEC_FLAG_GRAY)) {
                         s->dsp.vc1_v_overlap(s->dest[1], s->uvlinesize);
                         s->dsp.vc1_v_overlap(s->dest[2], s->uvlinesize);
                     }
                 }
-                s->dsp.vc1_v_overlap(s->dest[0] + 8 * s->linesize, s->linesize);
-                s->dsp.vc1_v_overlap(s->dest[0] + 8 * s->linesize + 8, s->linesize);
+                s->dsp.vc1_v_overlap(s->dest[0] + bs * s->linesize, s->linesize);
+                s->dsp.vc1_v_overlap(s->dest[0] + bs * s->linesize + bs, s->linesize);
             }
 
             if(get_bits_count(&s->gb) > v->bits) {
@@ -3551,7 +3722,7 @@ static void vc1_decode_i_blocks(VC1Context *v)
                 return;
             }
         }
-        ff_draw_horiz_band(s, s->mb_y * 16, 16);
+        ff_draw_horiz_band(s, s->mb_y * mb_size, mb_size);
         s->first_slice_line = 0;
     }
 }
@@ -3569,6 +3740,8 @@ static void vc1_decode_i_blocks_adv(VC1Context *v)
     int mqdiff;
     int overlap;
     GetBitContext *gb = &s->gb;
+    const int bs = 8 >> s->avctx->lowres;
+    const int mb_size = 16 >> s->avctx->lowres;
 
     /* select codingmode used for VLC tables selection */
     switch(v->y_ac_table_index){
@@ -3652,27 +3825,27 @@ static void vc1_decode_i_blocks_adv(VC1Context *v)
             }
 
             vc1_put_block(v, s->block);
-            if(overlap) {
+            if(overlap && !v->skip_overlap) {
                 if(s->mb_x) {
                     s->dsp.vc1_h_overlap(s->dest[0], s->linesize);
-                    s->dsp.vc1_h_overlap(s->dest[0] + 8 * s->linesize, s->linesize);
+                    s->dsp.vc1_h_overlap(s->dest[0] + bs * s->linesize, s->linesize);
                     if(!(s->flags & CODEC_FLAG_GRAY)) {
                         s->dsp.vc1_h_overlap(s->dest[1], s->uvlinesize);
                         s->dsp.vc1_h_overlap(s->dest[2], s->uvlinesize);
                     }
                 }
-                s->dsp.vc1_h_overlap(s->dest[0] + 8, s->linesize);
-                s->dsp.vc1_h_overlap(s->dest[0] + 8 * s->linesize + 8, s->linesize);
+                s->dsp.vc1_h_overlap(s->dest[0] + bs, s->linesize);
+                s->dsp.vc1_h_overlap(s->dest[0] + bs * s->linesize + bs, s->linesize);
                 if(!s->first_slice_line) {
                     s->dsp.vc1_v_overlap(s->dest[0], s->linesize);
-                    s->dsp.vc1_v_overlap(s->dest[0] + 8, s->linesize);
+                    s->dsp.vc1_v_overlap(s->dest[0] + bs, s->linesize);
                     if(!(s->flags & CODEC_FLAG_GRAY)) {
                         s->dsp.vc1_v_overlap(s->dest[1], s->uvlinesize);
                         s->dsp.vc1_v_overlap(s->dest[2], s->uvlinesize);
                     }
                 }
-                s->dsp.vc1_v_overlap(s->dest[0] + 8 * s->linesize, s->linesize);
-                s->dsp.vc1_v_overlap(s->dest[0] + 8 * s->linesize + 8, s->linesize);
+                s->dsp.vc1_v_overlap(s->dest[0] + bs * s->linesize, s->linesize);
+                s->dsp.vc1_v_overlap(s->dest[0] + bs * s->linesize + bs, s->linesize);
             }
 
             if(get_bits_count(&s->gb) > v->bits) {
@@ -3680,7 +3853,7 @@ static void vc1_decode_i_blocks_adv(VC1Context *v)
                 return;
             }
         }
-        ff_draw_horiz_band(s, s->mb_y * 16, 16);
+        ff_draw_horiz_band(s, s->mb_y * mb_size, mb_size);
         s->first_slice_line = 0;
     }
 }
@@ -3688,6 +3861,7 @@ static void vc1_decode_i_blocks_adv(VC1Context *v)
 static void vc1_decode_p_blocks(VC1Context *v)
 {
     MpegEncContext *s = &v->s;
+    const int mb_size = 16 >> s->avctx->lowres;
 
     /* select codingmode used for VLC tables selection */
     switch(v->c_ac_table_index){
@@ -3728,7 +3902,7 @@ static void vc1_decode_p_blocks(VC1Context *v)
                 return;
             }
         }
-        ff_draw_horiz_band(s, s->mb_y * 16, 16);
+        ff_draw_horiz_band(s, s->mb_y * mb_size, mb_size);
         s->first_slice_line = 0;
     }
 }
@@ -3736,6 +3910,7 @@ static void vc1_decode_p_blocks(VC1Context *v)
 static void vc1_decode_b_blocks(VC1Context *v)
 {
     MpegEncContext *s = &v->s;
+    const int mb_size = 16 >> s->avctx->lowres;
 
     /* select codingmode used for VLC tables selection */
     switch(v->c_ac_table_index){
@@ -3776,7 +3951,7 @@ static void vc1_decode_b_blocks(VC1Context *v)
                 return;
             }
         }
-        ff_draw_horiz_band(s, s->mb_y * 16, 16);
+        ff_draw_horiz_band(s, s->mb_y * mb_size, mb_size);
         s->first_slice_line = 0;
     }
 }
@@ -3784,6 +3959,7 @@ static void vc1_decode_b_blocks(VC1Context *v)
 static void vc1_decode_skip_blocks(VC1Context *v)
 {
     MpegEncContext *s = &v->s;
+    const int mb_size = 16 >> s->avctx->lowres;
 
     ff_er_add_slice(s, 0, 0, s->mb_width - 1, s->mb_height - 1, (AC_END|DC_END|MV_END));
     s->first_slice_line = 1;
@@ -3791,10 +3967,10 @@ static void vc1_decode_skip_blocks(VC1Context *v)
         s->mb_x = 0;
         ff_init_block_index(s);
         ff_update_block_index(s);
-        memcpy(s->dest[0], s->last_picture.data[0] + s->mb_y * 16 * s->linesize, s->linesize * 16);
-        memcpy(s->dest[1], s->last_picture.data[1] + s->mb_y * 8 * s->uvlinesize, s->uvlinesize * 8);
-        memcpy(s->dest[2], s->last_picture.data[2] + s->mb_y * 8 * s->uvlinesize, s->uvlinesize * 8);
-        ff_draw_horiz_band(s, s->mb_y * 16, 16);
+        memcpy(s->dest[0], s->last_picture.data[0] + s->mb_y * mb_size * s->linesize, s->linesize * mb_size);
+        memcpy(s->dest[1], s->last_picture.data[1] + s->mb_y * (mb_size >> 1) * s->uvlinesize, s->uvlinesize * (mb_size >> 1));
+        memcpy(s->dest[2], s->last_picture.data[2] + s->mb_y * (mb_size >> 1) * s->uvlinesize, s->uvlinesize * (mb_size >> 1));
+        ff_draw_horiz_band(s, s->mb_y * mb_size, mb_size);
         s->first_slice_line = 0;
     }
     s->pict_type = P_TYPE;
@@ -3876,6 +4052,10 @@ static int vc1_decode_init(AVCodecContext *avctx)
     GetBitContext gb;
 
     if (!avctx->extradata_size || !avctx->extradata) return -1;
+    if (avctx->lowres > 2) {
+        av_log(avctx, AV_LOG_ERROR, "Lowres %i is not supported, maximum is 2\n", avctx->lowres);
+        return -1;
+    }
     if (!(avctx->flags & CODEC_FLAG_GRAY))
         avctx->pix_fmt = PIX_FMT_YUV420P;
     else
@@ -3888,8 +4068,11 @@ static int vc1_decode_init(AVCodecContext *avctx)
         return -1;
     if (vc1_init_common(v) < 0) return -1;
 
-    avctx->coded_width = avctx->width;
-    avctx->coded_height = avctx->height;
+    /* in lowres mode width and height are already reduced by avcodec_open() */
+    if (!avctx->lowres) {
+        avctx->coded_width = avctx->width;
+        avctx->coded_height = avctx->height;
+    }
     if (avctx->codec_id == CODEC_ID_WMV3)
     {
         int count = 0;
@@ -4119,6 +4302,18 @@ static int vc1_decode_frame(AVCodecContext *avctx,
         return -1;
     }
 
+    /* skipped MBs are only a copy of the reference if it is not rescaled
+       and no overlap smoothing from intra neighbours can reach them */
+    if(v->rangeredfrm || v->mv_mode == MV_PMODE_INTENSITY_COMP || (v->overlap && v->pq >= 9))
+        s->current_picture.mb_changed_stride = s->current_picture_ptr->mb_changed_stride = 0;
+
+    v->skip_overlap =  avctx->skip_loop_filter >= AVDISCARD_ALL
+                    || (avctx->skip_loop_filter >= AVDISCARD_NONKEY && s->pict_type != I_TYPE)
+                    || (avctx->skip_loop_filter >= AVDISCARD_NONREF && s->pict_type == B_TYPE);
+    /* intra blocks are always reconstructed, so I frames are not affected */
+    v->skip_residual =  avctx->skip_idct >= AVDISCARD_NONKEY
+                     || (avctx->skip_idct >= AVDISCARD_NONREF && s->pict_type == B_TYPE);
+
     ff_er_frame_start(s);
 
     v->bits = buf_size * 8;
@@ -4126,7 +4321,9 @@ static int vc1_decode_frame(AVCodecContext *avctx,
 //av_log(s->avctx, AV_LOG_INFO, "Consumed %i/%i bits\n", get_bits_count(&s->gb), buf_size*8);
 //  if(get_bits_count(&s->gb) > buf_size * 8)
 //      return -1;
-    ff_er_frame_end(s);
+    /* error concealment works on full resolution MBs only */
+    if(!avctx->lowres)
+        ff_er_frame_end(s);
 
     MPV_frame_end(s);
 
@@ -299,4 +299,6 @@ typedef struct VC1Context{
 
     int p_frame_skipped;
     int bi_type;
+    int skip_overlap;     ///< overlap smoothing is disabled for current frame (skip_loop_filter)
+    int skip_residual;    ///< inter blocks residual is not added for current frame (skip_idct)
 } VC1Context;
@@ -322,6 +322,90 @@ static void vc1_inv_trans_4x4_c(DCTELEM block[64], int n)
     }
 }
 
+/* reduced resolution (lowres) functions */
+
+/** Do inverse transform of the low 4x4 coefficients into a 4x4 block
+ * Basis functions are the VC-1 8-point ones summed over pixel pairs. This
+ * approximates the 2x2 average of the full transform output: coefficients
+ * 5-7 also have nonzero pair sums but are dropped, so the result is only
+ * exact when they are zero.
+ */
+static void vc1_inv_trans_8x8_lowres1_c(DCTELEM block[64])
+{
+    static const int basis[4][4] = {
+        { 24,  24,  24,  24 },
+        { 31,  13, -13, -31 },
+        { 22, -22, -22,  22 },
+        { 11, -25,  25, -11 },
+    };
+    int tmp[4][4];
+    int i, j;
+
+    for(i = 0; i < 4; i++)
+        for(j = 0; j < 4; j++)
+            tmp[i][j] = block[i*8 + 0] * basis[0][j] + block[i*8 + 1] * basis[1][j]
+                      + block[i*8 + 2] * basis[2][j] + block[i*8 + 3] * basis[3][j];
+
+    for(i = 0; i < 4; i++)
+        for(j = 0; j < 4; j++)
+            block[i*8 + j] = (tmp[0][j] * basis[0][i] + tmp[1][j] * basis[1][i]
+                            + tmp[2][j] * basis[2][i] + tmp[3][j] * basis[3][i] + 2048) >> 12;
+}
+
+/** Do inverse transform of the low 2x2 coefficients into a 2x2 block
+ */
+static void vc1_inv_trans_8x8_lowres2_c(DCTELEM block[64])
+{
+    int t0, t1, t2, t3;
+
+    t0 = 48 * block[0] + 44 * block[1];
+    t1 = 48 * block[0] - 44 * block[1];
+    t2 = 48 * block[8] + 44 * block[9];
+    t3 = 48 * block[8] - 44 * block[9];
+
+    block[0] = (48 * t0 + 44 * t2 + 8192) >> 14;
+    block[1] = (48 * t1 + 44 * t3 + 8192) >> 14;
+    block[8] = (48 * t0 - 44 * t2 + 8192) >> 14;
+    block[9] = (48 * t1 - 44 * t3 + 8192) >> 14;
+}
+
+/** Smooth block edge at reduced resolution
+ * Only the pixel next to the edge remains of the two the overlap transform
+ * modifies, it is pulled towards its neighbour by the amount the full
+ * resolution filter moves the pixel average on a linear ramp.
+ */
+static av_always_inline void vc1_overlap_lowres(uint8_t *src, int step, int stride, int lowres)
+{
+    int i, delta;
+
+    for(i = 0; i < 8 >> lowres; i++) {
+        delta = (7 * (src[-step] - src[0]) + (4 << (2 * lowres))) >> (3 + 2 * lowres);
+        src[-step] -= delta;
+        src[0]     += delta;
+        src += stride;
+    }
+}
+
+static void vc1_v_overlap_lowres1_c(uint8_t* src, int stride)
+{
+    vc1_overlap_lowres(src, stride, 1, 1);
+}
+
+static void vc1_h_overlap_lowres1_c(uint8_t* src, int stride)
+{
+    vc1_overlap_lowres(src, 1, stride, 1);
+}
+
+static void vc1_v_overlap_lowres2_c(uint8_t* src, int stride)
+{
+    vc1_overlap_lowres(src, stride, 1, 2);
+}
+
+static void vc1_h_overlap_lowres2_c(uint8_t* src, int stride)
+{
+    vc1_overlap_lowres(src, 1, stride, 2);
+}
+
 /* motion compensation functions */
 
 /** Filter used to interpolate fractional pel values
@@ -444,6 +528,16 @@ void ff_vc1dsp_init(DSPContext* dsp, AVCodecContext *avctx) {
     dsp->vc1_h_overlap = vc1_h_overlap_c;
     dsp->vc1_v_overlap = vc1_v_overlap_c;
 
+    if(avctx->lowres==1){
+        dsp->vc1_inv_trans_8x8 = vc1_inv_trans_8x8_lowres1_c;
+        dsp->vc1_h_overlap = vc1_h_overlap_lowres1_c;
+        dsp->vc1_v_overlap = vc1_v_overlap_lowres1_c;
+    }else if(avctx->lowres==2){
+        dsp->vc1_inv_trans_8x8 = vc1_inv_trans_8x8_lowres2_c;
+        dsp->vc1_h_overlap = vc1_h_overlap_lowres2_c;
+        dsp->vc1_v_overlap = vc1_v_overlap_lowres2_c;
+    }
+
     dsp->put_vc1_mspel_pixels_tab[ 0] = ff_put_vc1_mspel_mc00_c;
     dsp->put_vc1_mspel_pixels_tab[ 1] = ff_put_vc1_mspel_mc10_c;
     dsp->put_vc1_mspel_pixels_tab[ 2] = ff_put_vc1_mspel_mc20_c;
@@ -68,6 +68,11 @@ typedef struct VmncContext {
     int cur_hx, cur_hy;
     uint8_t* curbits, *curmask;
     uint8_t* screendta;
+
+    /* 16x16 blocks touched by the current frame */
+    uint8_t *mb_changed;
+    int mb_stride;
+    int changes_pending;        ///< mb_changed holds marks of a frame that failed to decode
 } VmncContext;
 
 /* read pixel value from stream */
@@ -83,6 +88,17 @@ static av_always_inline int vmnc_get_pixel(uint8_t* buf, int bpp, int be) {
     }
 }
 
+static void mark_changed(VmncContext *c, int dx, int dy, int w, int h)
+{
+    int x, y;
+
+    if(w <= 0 || h <= 0)
+        return;
+    for(y = dy >> 4; y <= (dy + h - 1) >> 4; y++)
+        for(x = dx >> 4; x <= (dx + w - 1) >> 4; x++)
+            c->mb_changed[x + y * c->mb_stride] = 1;
+}
+
 static void load_cursor(VmncContext *c, uint8_t *src)
 {
     int i, j, p;
@@ -290,6 +306,7 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
     uint8_t *outptr;
     uint8_t *src = buf;
     int dx, dy, w, h, depth, enc, chunks, res, size_left;
+    int new_pic = !c->pic.data[0];
 
     c->pic.reference = 1;
     c->pic.buffer_hints = FF_BUFFER_HINTS_VALID | FF_BUFFER_HINTS_PRESERVE | FF_BUFFER_HINTS_REUSABLE;
@@ -300,6 +317,10 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
 
     c->pic.key_frame = 0;
     c->pic.pict_type = FF_P_TYPE;
+    /* a failed frame may have drawn into the picture, keep its marks */
+    if(!c->changes_pending)
+        memset(c->mb_changed, 0, c->mb_stride * ((c->height + 15) >> 4));
+    c->changes_pending = 1;
 
     //restore screen after cursor
     if(c->screendta) {
@@ -319,6 +340,7 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
             dy = 0;
         }
         if((w > 0) && (h > 0)) {
+            mark_changed(c, dx, dy, w, h);
             outptr = c->pic.data[0] + dx * c->bpp2 + dy * c->pic.linesize[0];
             for(i = 0; i < h; i++) {
                 memcpy(outptr, c->screendta + i * c->cur_w * c->bpp2, w * c->bpp2);
@@ -399,6 +421,7 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
                 return -1;
             }
             paint_raw(outptr, w, h, src, c->bpp2, c->bigendian, c->pic.linesize[0]);
+            mark_changed(c, dx, dy, w, h);
             src += w * h * c->bpp2;
             break;
         case 0x00000005: // HexTile encoded rectangle
@@ -406,6 +429,8 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
                 av_log(avctx, AV_LOG_ERROR, "Incorrect frame size: %ix%i+%ix%i of %ix%i\n", w, h, dx, dy, c->width, c->height);
                 return -1;
             }
+            /* tiles painted before a decoding error still change the picture */
+            mark_changed(c, dx, dy, w, h);
             res = decode_hextile(c, outptr, src, size_left, w, h, c->pic.linesize[0]);
             if(res < 0)
                 return -1;
@@ -441,8 +466,14 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
             }
             outptr = c->pic.data[0];
             put_cursor(outptr, c->pic.linesize[0], c, c->cur_x, c->cur_y);
+            mark_changed(c, dx, dy, w, h);
         }
     }
+    if(new_pic || c->pic.key_frame)
+        memset(c->mb_changed, 1, c->mb_stride * ((c->height + 15) >> 4));
+    c->pic.mb_changed = c->mb_changed;
+    c->pic.mb_changed_stride = c->mb_stride;
+    c->changes_pending = 0;
     *data_size = sizeof(AVFrame);
     *(AVFrame*)data = c->pic;
 
@@ -472,6 +503,10 @@ static int decode_init(AVCodecContext *avctx)
     }
     c->bpp = avctx->bits_per_sample;
     c->bpp2 = c->bpp/8;
+    c->mb_stride = (c->width + 15) >> 4;
+    c->mb_changed = av_mallocz(c->mb_stride * ((c->height + 15) >> 4));
+    if(!c->mb_changed)
+        return -1;
 
     switch(c->bpp){
     case 8:
@@ -507,6 +542,7 @@ static int decode_end(AVCodecContext *avctx)
     av_free(c->curbits);
     av_free(c->curmask);
     av_free(c->screendta);
+    av_free(c->mb_changed);
     return 0;
 }
 
@@ -221,6 +221,14 @@ static int ModeAlphabet[7][CODING_MODE_COUNT] =
 
 #define MIN_DEQUANT_VAL 2
 
+/* work of one thread in the reconstruction / loop filter pipeline */
+typedef struct Vp3SliceJob {
+    struct Vp3DecodeContext *s;
+    int slice;                      ///< macroblock row to reconstruct, -1 if none
+    int filter_start, filter_end;   ///< macroblock rows to loop filter
+    uint8_t *edge_emu_buffer;
+} Vp3SliceJob;
+
 typedef struct Vp3DecodeContext {
     AVCodecContext *avctx;
     int theora, theora_tables;
@@ -319,6 +327,8 @@ typedef struct Vp3DecodeContext {
     int last_coded_c_fragment;
 
     uint8_t edge_emu_buffer[9*2048]; //FIXME dynamic alloc
+    Vp3SliceJob slice_job[MAX_THREADS];
+    void *slice_job_ptr[MAX_THREADS];
     int8_t qscale_table[2048]; //FIXME dynamic alloc (width+15)/16
 
     /* Huffman decode */
@@ -1497,8 +1507,10 @@ static void vertical_filter(unsigned char *first_pixel, int stride,
 /*
  * Perform the final rendering for a particular slice of data.
  * The slice number ranges from 0..(macroblock_height - 1).
+ * Only the previous and golden frames are read, so different slices
+ * can be rendered concurrently, each with its own edge_emu_buffer.
  */
-static void render_slice(Vp3DecodeContext *s, int slice)
+static void render_slice(Vp3DecodeContext *s, int slice, uint8_t *edge_emu_buffer)
 {
     int x;
     int m, n;
@@ -1509,6 +1521,8 @@ static void render_slice(Vp3DecodeContext *s, int slice)
     uint8_t *motion_source;
     int plane;
     int current_macroblock_entry = slice * s->macroblock_width * 6;
+    /* keyframes only have intra fragments, which cannot be skipped */
+    int skip_idct = s->avctx->skip_idct >= AVDISCARD_NONKEY;
 
     if (slice >= s->macroblock_height)
         return;
@@ -1578,7 +1592,7 @@ static void render_slice(Vp3DecodeContext *s, int slice)
                         motion_source += ((motion_y >> 1) * stride);
 
                         if(src_x<0 || src_y<0 || src_x + 9 >= plane_width || src_y + 9 >= plane_height){
-                            uint8_t *temp= s->edge_emu_buffer;
+                            uint8_t *temp= edge_emu_buffer;
                             if(stride<0) temp -= 9*stride;
                             else temp += 9*stride;
 
@@ -1608,6 +1622,11 @@ static void render_slice(Vp3DecodeContext *s, int slice)
                                 stride, 8);
                         }
                         dequantizer = s->qmat[1][plane];
+
+                        /* keep the prediction only, degrades quality until
+                           the next keyframe but saves dequantization and idct */
+                        if (skip_idct)
+                            continue;
                     }else{
                         dequantizer = s->qmat[0][plane];
                     }
@@ -1751,42 +1770,32 @@ static void vertical_filter(unsigned char *first_pixel, int stride,
     }
 }
 
-static void apply_loop_filter(Vp3DecodeContext *s)
+/*
+ * Loop filter one slice (macroblock row) of all planes. The fragments are
+ * filtered in the same raster order as a whole frame pass would use, so
+ * calling this for slices 0..(macroblock_height - 1) in order is bit exact
+ * with it. The filter reaches 2 pixels into the next slice, which must be
+ * rendered already.
+ */
+static void apply_loop_filter(Vp3DecodeContext *s, int slice)
 {
     int plane;
     int x, y;
     int *bounding_values= s->bounding_values_array+127;
 
-#if 0
-    int bounding_values_array[256];
-    int filter_limit;
-
-    /* find the right loop limit value */
-    for (x = 63; x >= 0; x--) {
-        if (vp31_ac_scale_factor[x] >= s->quality_index)
-            break;
-    }
-    filter_limit = vp31_filter_limit_values[s->quality_index];
-
-    /* set up the bounding values */
-    memset(bounding_values_array, 0, 256 * sizeof(int));
-    for (x = 0; x < filter_limit; x++) {
-        bounding_values[-x - filter_limit] = -filter_limit + x;
-        bounding_values[-x] = -x;
-        bounding_values[x] = x;
-        bounding_values[x + filter_limit] = filter_limit - x;
-    }
-#endif
-
     for (plane = 0; plane < 3; plane++) {
         int width           = s->fragment_width  >> !!plane;
         int height          = s->fragment_height >> !!plane;
-        int fragment        = s->fragment_start        [plane];
+        int y_end           = FFMIN((slice + 1) << !plane, height);
+        int fragment;
         int stride          = s->current_frame.linesize[plane];
         uint8_t *plane_data = s->current_frame.data    [plane];
         if (!s->flipped_image) stride = -stride;
 
-        for (y = 0; y < height; y++) {
+        y        = slice << !plane;
+        fragment = s->fragment_start[plane] + y * width;
+
+        for (; y < y_end; y++) {
 
             for (x = 0; x < width; x++) {
 START_TIMER
@@ -1835,6 +1844,72 @@ STOP_TIMER("loop filter")
     }
 }
 
+static int render_slice_thread(AVCodecContext *avctx, void *arg)
+{
+    Vp3SliceJob *job = arg;
+    int i;
+
+    for (i = job->filter_start; i < job->filter_end; i++)
+        apply_loop_filter(job->s, i);
+    if (job->slice >= 0)
+        render_slice(job->s, job->slice, job->edge_emu_buffer);
+
+    return 0;
+}
+
+/*
+ * Reconstruct all slices and loop filter each one as soon as the slice
+ * below it is rendered, while its pixels are still in the cache.
+ * With several threads, every pass renders the next thread_count - 1
+ * slices while one job filters the slices finished in the previous pass.
+ * The filter runs in order, so the output does not depend on the number
+ * of threads.
+ */
+static void render_frame(Vp3DecodeContext *s, int loop_filter)
+{
+    AVCodecContext *avctx = s->avctx;
+    int jobs = FFMIN(avctx->thread_count, MAX_THREADS);
+    int rendered = 0;
+    int filtered = loop_filter ? 0 : s->macroblock_height;
+    int i, count;
+
+    for (i = 1; i < jobs; i++) {
+        if (!s->slice_job[i].edge_emu_buffer)
+            s->slice_job[i].edge_emu_buffer = av_malloc(9*2048);
+        if (!s->slice_job[i].edge_emu_buffer)
+            jobs = i;
+    }
+
+    if (jobs < 2) {
+        for (i = 0; i < s->macroblock_height; i++) {
+            render_slice(s, i, s->edge_emu_buffer);
+            if (loop_filter && i > 0)
+                apply_loop_filter(s, i - 1);
+        }
+        if (loop_filter)
+            apply_loop_filter(s, s->macroblock_height - 1);
+        return;
+    }
+
+    while (rendered < s->macroblock_height || filtered < s->macroblock_height) {
+        count = 0;
+        if (filtered < s->macroblock_height) {
+            /* the last slice has nothing below it to wait for */
+            Vp3SliceJob *job = &s->slice_job[count++];
+            job->slice = -1;
+            job->filter_start = filtered;
+            job->filter_end   = rendered == s->macroblock_height ? rendered : FFMAX(rendered - 1, 0);
+            filtered = job->filter_end;
+        }
+        for (; count < jobs && rendered < s->macroblock_height; count++) {
+            Vp3SliceJob *job = &s->slice_job[count];
+            job->slice = rendered++;
+            job->filter_start = job->filter_end = 0;
+        }
+        avctx->execute(avctx, render_slice_thread, s->slice_job_ptr, NULL, count);
+    }
+}
+
 /*
  * This function computes the first pixel addresses for each fragment.
  * This function needs to be invoked after the first frame is allocated
@@ -2014,6 +2089,12 @@ static int vp3_decode_init(AVCodecContext *avctx)
     s->coded_fragment_list = av_malloc(s->fragment_count * sizeof(int));
     s->pixel_addresses_inited = 0;
 
+    for (i = 0; i < MAX_THREADS; i++) {
+        s->slice_job[i].s = s;
+        s->slice_job_ptr[i] = &s->slice_job[i];
+    }
+    s->slice_job[0].edge_emu_buffer = s->edge_emu_buffer;
+
     if (!s->theora_tables)
     {
         for (i = 0; i < 64; i++) {
@@ -2134,7 +2215,6 @@ static int vp3_decode_frame(AVCodecContext *avctx,
     Vp3DecodeContext *s = avctx->priv_data;
     GetBitContext gb;
     static int counter = 0;
-    int i;
 
     init_get_bits(&gb, buf, buf_size * 8);
 
@@ -2283,13 +2363,9 @@ if (!s->keyframe) {
     STOP_TIMER("reverse_dc_prediction")}
     {START_TIMER
 
-    for (i = 0; i < s->macroblock_height; i++)
-        render_slice(s, i);
-    STOP_TIMER("render_fragments")}
-
-    {START_TIMER
-    apply_loop_filter(s);
-    STOP_TIMER("apply_loop_filter")}
+    render_frame(s, avctx->skip_loop_filter < AVDISCARD_ALL &&
+                    (avctx->skip_loop_filter < AVDISCARD_NONKEY || s->keyframe));
+    STOP_TIMER("render_frame")}
 #if KEYFRAMES_ONLY
 }
 #endif
@@ -2316,6 +2392,7 @@ if (!s->keyframe) {
 static int vp3_decode_end(AVCodecContext *avctx)
 {
     Vp3DecodeContext *s = avctx->priv_data;
+    int i;
 
     av_free(s->all_fragments);
     av_free(s->coeffs);
@@ -2324,6 +2401,8 @@ static int vp3_decode_end(AVCodecContext *avctx)
     av_free(s->superblock_macroblocks);
     av_free(s->macroblock_fragments);
     av_free(s->macroblock_coding);
+    for (i = 1; i < MAX_THREADS; i++)
+        av_freep(&s->slice_job[i].edge_emu_buffer);
 
     /* release all frames */
     if (s->golden_frame.data[0] && s->golden_frame.data[0] != s->last_frame.data[0])
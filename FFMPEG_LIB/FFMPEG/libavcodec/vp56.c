@@ -401,6 +401,8 @@ static void vp56_decode_mb(vp56_context_t *s, int row, int col)
     vp56_mb_t mb_type;
     vp56_frame_t ref_frame;
     int b, plan, off;
+    /* only inter blocks may lose their residual, intra ones have no prediction */
+    int skip_idct = s->avctx->skip_idct >= AVDISCARD_NONKEY;
 
     if (s->framep[VP56_FRAME_CURRENT]->key_frame)
         mb_type = VP56_MB_INTRA;
@@ -434,8 +436,9 @@ static void vp56_decode_mb(vp56_context_t *s, int row, int col)
                 s->dsp.put_pixels_tab[1][0](frame_current->data[plan] + off,
                                             frame_ref->data[plan] + off,
                                             s->stride[plan], 8);
-                s->dsp.idct_add(frame_current->data[plan] + off,
-                                s->stride[plan], s->block_coeff[b]);
+                if (!skip_idct)
+                    s->dsp.idct_add(frame_current->data[plan] + off,
+                                    s->stride[plan], s->block_coeff[b]);
             }
             break;
 
@@ -452,8 +455,9 @@ static void vp56_decode_mb(vp56_context_t *s, int row, int col)
                 plan = vp56_b6to3[b];
                 vp56_mc(s, b, frame_ref->data[plan], s->stride[plan],
                         16*col+x_off, 16*row+y_off);
-                s->dsp.idct_add(frame_current->data[plan] + s->block_offset[b],
-                                s->stride[plan], s->block_coeff[b]);
+                if (!skip_idct)
+                    s->dsp.idct_add(frame_current->data[plan] + s->block_offset[b],
+                                    s->stride[plan], s->block_coeff[b]);
             }
             break;
     }
@@ -187,9 +187,10 @@ static inline void vp56_init_range_decoder(vp56_range_coder_t *c,
 
 static inline int vp56_rac_get_prob(vp56_range_coder_t *c, uint8_t prob)
 {
-    unsigned int low = 1 + (((c->high - 1) * prob) / 256);
+    unsigned int low = 1 + (((c->high - 1) * prob) >> 8);
     unsigned int low_shift = low << 8;
     int bit = c->code_word >= low_shift;
+    int shift;
 
     if (bit) {
         c->high -= low;
@@ -198,14 +199,15 @@ static inline int vp56_rac_get_prob(vp56_range_coder_t *c, uint8_t prob)
         c->high = low;
     }
 
-    /* normalize */
-    while (c->high < 128) {
-        c->high <<= 1;
-        c->code_word <<= 1;
-        if (--c->bits == 0) {
-            c->bits = 8;
-            c->code_word |= *c->buffer++;
-        }
+    /* normalize, high is at least 1 so at most 7 bits are consumed and */
+    /* at most one new byte is needed */
+    shift = vp56_norm_shift[c->high];
+    c->high <<= shift;
+    c->code_word <<= shift;
+    c->bits -= shift;
+    if (c->bits <= 0) {
+        c->code_word |= *c->buffer++ << -c->bits;
+        c->bits += 8;
     }
     return bit;
 }
@@ -26,6 +26,18 @@
 const uint8_t vp56_b6to3[] = { 0, 0, 0, 0, 1, 2 };
 const uint8_t vp56_b6to4[] = { 0, 0, 1, 1, 2, 3 };
 
+/* number of left shifts bringing a range coder high value back to >= 128 */
+const uint8_t vp56_norm_shift[256] = {
+    8,7,6,6,5,5,5,5,4,4,4,4,4,4,4,4,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,
+    2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+};
+
 const uint8_t vp56_coeff_parse_table[6][11] = {
     { 159,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0 },
     { 145, 165,   0,   0,   0,   0,   0,   0,   0,   0,   0 },
@@ -53,6 +53,7 @@ typedef struct {
 
 extern const uint8_t vp56_b6to3[];
 extern const uint8_t vp56_b6to4[];
+extern const uint8_t vp56_norm_shift[256];
 extern const uint8_t vp56_coeff_parse_table[6][11];
 extern const uint8_t vp56_def_mb_types_stats[3][10][2];
 extern const vp56_tree_t vp56_pva_tree[];
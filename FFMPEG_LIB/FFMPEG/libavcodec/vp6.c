@@ -280,7 +280,10 @@ static void vp6_parse_vector_adjustment(vp56_context_t *s, vp56_mv_t *vect)
 
 static void vp6_parse_coeff(vp56_context_t *s)
 {
-    vp56_range_coder_t *c = s->ccp;
+    /* work on a local copy of the coder state, so that it can stay in */
+    /* registers across the block_coeff stores */
+    vp56_range_coder_t cl = *s->ccp;
+    vp56_range_coder_t *c = &cl;
     uint8_t *permute = s->scantable.permutated;
     uint8_t *model, *model2, *model3;
     int coeff, sign, coeff_idx;
@@ -347,6 +350,8 @@ static void vp6_parse_coeff(vp56_context_t *s)
         s->left_block[vp56_b6to4[b]].not_null_dc =
         s->above_blocks[s->above_block_idx[b]].not_null_dc = !!s->block_coeff[b][0];
     }
+
+    *s->ccp = cl;
 }
 
 static int vp6_adjust(int v, int t)
@@ -362,7 +367,7 @@ static int vp6_adjust(int v, int t)
     return V;
 }
 
-static int vp6_block_variance(uint8_t *src, int stride)
+int ff_vp6_block_variance_c(uint8_t *src, int stride)
 {
     int sum = 0, square_sum = 0;
     int y, x;
@@ -377,8 +382,8 @@ static int vp6_block_variance(uint8_t *src, int stride)
     return (16*square_sum - sum*sum) >> 8;
 }
 
-static void vp6_filter_hv4(uint8_t *dst, uint8_t *src, int stride,
-                           int delta, const int16_t *weights)
+void ff_vp6_filter_hv4_c(uint8_t *dst, uint8_t *src, int stride,
+                         int delta, const int16_t *weights)
 {
     int x, y;
 
@@ -402,8 +407,8 @@ static void vp6_filter_diag2(vp56_context_t *s, uint8_t *dst, uint8_t *src,
     s->dsp.put_h264_chroma_pixels_tab[0](dst, tmp, stride, 8, 0, v_weight);
 }
 
-static void vp6_filter_diag4(uint8_t *dst, uint8_t *src, int stride,
-                             const int16_t *h_weights,const int16_t *v_weights)
+void ff_vp6_filter_diag4_c(uint8_t *dst, uint8_t *src, int stride,
+                           const int16_t *h_weights, const int16_t *v_weights)
 {
     int x, y;
     int tmp[8*11];
@@ -453,7 +458,7 @@ static void vp6_filter(vp56_context_t *s, uint8_t *dst, uint8_t *src,
                  FFABS(mv.y) > s->max_vector_length)) {
                 filter4 = 0;
             } else if (s->sample_variance_threshold
-                       && (vp6_block_variance(src+offset1, stride)
+                       && (s->dsp.vp6_block_variance(src+offset1, stride)
                            < s->sample_variance_threshold)) {
                 filter4 = 0;
             }
@@ -466,15 +471,15 @@ static void vp6_filter(vp56_context_t *s, uint8_t *dst, uint8_t *src,
 
     if (filter4) {
         if (!y8) {                      /* left or right combine */
-            vp6_filter_hv4(dst, src+offset1, stride, 1,
-                           vp6_block_copy_filter[select][x8]);
+            s->dsp.vp6_filter_hv4(dst, src+offset1, stride, 1,
+                                  vp6_block_copy_filter[select][x8]);
         } else if (!x8) {               /* above or below combine */
-            vp6_filter_hv4(dst, src+offset1, stride, stride,
-                           vp6_block_copy_filter[select][y8]);
+            s->dsp.vp6_filter_hv4(dst, src+offset1, stride, stride,
+                                  vp6_block_copy_filter[select][y8]);
         } else {
-            vp6_filter_diag4(dst, src+offset1 + ((mv.x^mv.y)>>31), stride,
-                             vp6_block_copy_filter[select][x8],
-                             vp6_block_copy_filter[select][y8]);
+            s->dsp.vp6_filter_diag4(dst, src+offset1 + ((mv.x^mv.y)>>31), stride,
+                                    vp6_block_copy_filter[select][x8],
+                                    vp6_block_copy_filter[select][y8]);
         }
     } else {
         if (!x8 || !y8) {
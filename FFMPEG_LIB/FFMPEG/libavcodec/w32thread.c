@@ -103,6 +103,22 @@ int avcodec_thread_execute(AVCodecContext *s, int (*func)(AVCodecContext *c2, vo
     return 0;
 }
 
+/* give up the rest of the time slice while waiting for another job */
+void ff_thread_yield(void){
+    Sleep(0);
+}
+
+/* order the memory accesses before and after it for the other threads */
+void ff_memory_barrier(void){
+#ifdef MemoryBarrier
+    MemoryBarrier();
+#else
+    /* interlocked operations are full barriers */
+    LONG tmp;
+    InterlockedExchange(&tmp, 0);
+#endif
+}
+
 int avcodec_thread_init(AVCodecContext *s, int thread_count){
     int i;
     ThreadContext *c;
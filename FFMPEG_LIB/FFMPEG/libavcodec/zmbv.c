@@ -68,6 +68,8 @@ typedef struct ZmbvContext {
     int flags;
     int bw, bh, bx, by;
     int decomp_len;
+    uint8_t *mb_changed; ///< 16x16 blocks differing from the previous frame
+    int mb_stride;
 #ifdef CONFIG_ZLIB
     z_stream zstream;
 #endif
@@ -75,6 +77,33 @@ typedef struct ZmbvContext {
     int (*decode_xor)(struct ZmbvContext *c);
 } ZmbvContext;
 
+/**
+ * Build the 16x16 change map of an inter frame from its motion vectors,
+ * a block only differs from the previous frame if it was moved or XOR'ed
+ */
+static void zmbv_mark_changed(ZmbvContext *c)
+{
+    int8_t *mvec = (int8_t*)c->decomp_buf;
+    int x, y, i, j;
+
+    if(c->fmt == ZMBV_FMT_8BPP && (c->flags & ZMBV_DELTAPAL)) {
+        memset(c->mb_changed, 1, c->mb_stride * ((c->height + 15) >> 4));
+        return;
+    }
+    memset(c->mb_changed, 0, c->mb_stride * ((c->height + 15) >> 4));
+    for(y = 0; y < c->height; y += c->bh) {
+        int y2 = FFMIN(y + c->bh, c->height) - 1;
+        for(x = 0; x < c->width; x += c->bw, mvec += 2) {
+            int x2 = FFMIN(x + c->bw, c->width) - 1;
+            if(!mvec[0] && !mvec[1])
+                continue;
+            for(j = y >> 4; j <= y2 >> 4; j++)
+                for(i = x >> 4; i <= x2 >> 4; i++)
+                    c->mb_changed[i + j * c->mb_stride] = 1;
+        }
+    }
+}
+
 /**
  * Decode XOR'ed frame - 8bpp version
  */
@@ -517,11 +546,15 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, uint8
         c->pic.key_frame = 1;
         c->pic.pict_type = FF_I_TYPE;
         c->decode_intra(c);
+        memset(c->mb_changed, 1, c->mb_stride * ((c->height + 15) >> 4));
     } else {
         c->pic.key_frame = 0;
         c->pic.pict_type = FF_P_TYPE;
         c->decode_xor(c);
+        zmbv_mark_changed(c);
     }
+    c->pic.mb_changed = c->mb_changed;
+    c->pic.mb_changed_stride = c->mb_stride;
 
     /* update frames */
     {
@@ -629,6 +662,9 @@ static int decode_init(AVCodecContext *avctx)
 #endif
     avctx->pix_fmt = PIX_FMT_RGB24;
     c->decomp_size = (avctx->width + 255) * 4 * (avctx->height + 64);
+    c->mb_stride = (c->width + 15) >> 4;
+    if (!(c->mb_changed = av_mallocz(c->mb_stride * ((c->height + 15) >> 4))))
+        return 1;
 
     /* Allocate decompression buffer */
     if (c->decomp_size) {
@@ -672,6 +708,7 @@ static int decode_end(AVCodecContext *avctx)
 #endif
     av_freep(&c->cur);
     av_freep(&c->prev);
+    av_freep(&c->mb_changed);
 
     return 0;
 }
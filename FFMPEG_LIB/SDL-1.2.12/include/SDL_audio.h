@@ -112,6 +112,15 @@ extern DECLSPEC char * SDLCALL SDL_AudioDriverName(char *namebuf, int maxlen);
 //ms999
 extern DECLSPEC int SDLCALL SDL_SetVolume(int procent);
 
+/*
+ * This function returns the number of sample frames that have been handed
+ * to the audio device but not played yet, or -1 if the driver can't tell.
+ * Applications use it to time their audio clock against what is audible.
+ * It takes the audio lock, and must not be called while another thread may
+ * be closing the audio device; calling it from the audio callback is safe.
+ */
+extern DECLSPEC int SDLCALL SDL_GetAudioLatency(void);
+
 /*
  * This function opens the audio device with the desired parameters, and
  * returns 0 if successful, placing the actual hardware parameters in the
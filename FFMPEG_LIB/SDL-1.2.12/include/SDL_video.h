@@ -769,6 +769,15 @@ extern DECLSPEC void SDLCALL SDL_UnlockYUVOverlay(SDL_Overlay *overlay);
 */
 extern DECLSPEC int SDLCALL SDL_DisplayYUVOverlay(SDL_Overlay *overlay, SDL_Rect *dstrect);
 
+/* Same as SDL_DisplayYUVOverlay(), but only the 'numrects' rectangles in
+   'rects' (in overlay coordinates) have changed since the overlay was last
+   displayed at the same destination rectangle.  Software overlays convert
+   and update only the rows covering them, hardware overlays are displayed
+   as a whole.  Pass NULL rects to display the whole overlay.
+*/
+extern DECLSPEC int SDLCALL SDL_DisplayYUVOverlayRects(SDL_Overlay *overlay,
+				SDL_Rect *dstrect, int numrects, SDL_Rect *rects);
+
 /* Free a video overlay */
 extern DECLSPEC void SDLCALL SDL_FreeYUVOverlay(SDL_Overlay *overlay);
 
@@ -406,6 +406,21 @@ int SDL_SetVolume(int procent){
 		audio->SetVolume(audio,procent); 
 	}
 }
+
+int SDL_GetAudioLatency(void)
+{
+	SDL_AudioDevice *audio = current_audio;
+	int latency = -1;
+
+	if ( audio && audio->opened && audio->GetLatency ) {
+		/* Don't race the mixing thread updating the driver state */
+		SDL_LockAudio();
+		latency = audio->GetLatency(audio);
+		SDL_UnlockAudio();
+	}
+	return(latency);
+}
+
 int SDL_OpenAudio(SDL_AudioSpec *desired, SDL_AudioSpec *obtained)
 {
 	SDL_AudioDevice *audio;
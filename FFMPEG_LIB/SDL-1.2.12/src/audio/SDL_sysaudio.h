@@ -54,6 +54,7 @@ struct SDL_AudioDevice {
 	void (*WaitDone)(_THIS);
 	void (*CloseAudio)(_THIS);
 	void (*SetVolume)(_THIS,int proc);//ms999 
+	int  (*GetLatency)(_THIS);	/* Sample frames queued, or -1 */
 
 	/* * * */
 	/* Lock / Unlock functions added for the Mac port */
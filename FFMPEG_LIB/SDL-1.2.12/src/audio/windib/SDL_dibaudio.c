@@ -47,6 +47,7 @@ static void DIB_CloseAudio(_THIS);
 
 //ms999
 static int DIB_SetVolume(_THIS, int nProc);
+static int DIB_GetLatency(_THIS);
 
 /* Audio driver bootstrap functions */
 
@@ -90,6 +91,7 @@ static SDL_AudioDevice *Audio_CreateDevice(int devindex)
 	this->WaitDone = DIB_WaitDone;
 	this->CloseAudio = DIB_CloseAudio;
 	this->SetVolume = DIB_SetVolume;//ms999 
+	this->GetLatency = DIB_GetLatency;
 
 	this->free = Audio_DeleteDevice;
 
@@ -116,7 +118,8 @@ static void CALLBACK FillSound(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance,
 #if defined(_WIN32_WCE) && (_WIN32_WCE < 300)
 	ReleaseSemaphoreCE(audio_sem, 1, NULL);
 #else
-	Sleep(100);
+	if ( ! lowlatency )
+		Sleep(100);
 	ReleaseSemaphore(audio_sem, 1, NULL);
 #endif
 }
@@ -185,10 +188,24 @@ static int DIB_SetVolume(_THIS, int nVol){
 }
 
 
+/* The device position tells how much of what was queued has been played */
+static int DIB_GetLatency(_THIS)
+{
+	MMTIME pos;
+
+	pos.wType = TIME_BYTES;
+	if ( waveOutGetPosition(sound, &pos, sizeof(pos)) != MMSYSERR_NOERROR ||
+	     pos.wType != TIME_BYTES ) {
+		return(-1);
+	}
+	return((int)(written - pos.u.cb) / frame_size);
+}
+
 void DIB_PlayAudio(_THIS)
 {
 	/* Queue it up */
 	waveOutWrite(sound, &wavebuf[next_buffer], sizeof(wavebuf[0]));
+	written += wavebuf[next_buffer].dwBufferLength;
 	next_buffer = (next_buffer+1)%NUM_BUFFERS;
 }
 
@@ -245,6 +262,7 @@ int DIB_OpenAudio(_THIS, SDL_AudioSpec *spec)
 	MMRESULT result;
 	int i;
 	WAVEFORMATEX waveformat;
+	const char *env;
 
 	/* Initialize the wavebuf structures for closing */
 	sound = NULL;
@@ -252,6 +270,7 @@ int DIB_OpenAudio(_THIS, SDL_AudioSpec *spec)
 	for ( i = 0; i < NUM_BUFFERS; ++i )
 		wavebuf[i].dwUser = 0xFFFF;
 	mixbuf = NULL;
+	written = 0;
 
 	/* Set basic WAVE format parameters */
 	SDL_memset(&waveformat, 0, sizeof(waveformat));
@@ -280,8 +299,17 @@ int DIB_OpenAudio(_THIS, SDL_AudioSpec *spec)
 	waveformat.nAvgBytesPerSec = 
 		waveformat.nSamplesPerSec * waveformat.nBlockAlign;
 
-	/* Check the buffer size -- minimum of 1/4 second (word aligned) */
-	if ( spec->samples < (spec->freq/4) )
+	frame_size = waveformat.nBlockAlign;
+
+	/* Check the buffer size -- minimum of 1/4 second (word aligned).
+	   Applications that keep the device fed on time can ask for short
+	   fragments with SDL_AUDIO_LOWLATENCY, down to 5 ms. */
+	env = SDL_getenv("SDL_AUDIO_LOWLATENCY");
+	lowlatency = (env && SDL_atoi(env));
+	if ( lowlatency ) {
+		if ( spec->samples < (spec->freq/200) )
+			spec->samples = ((spec->freq/200)+3)&~3;
+	} else if ( spec->samples < (spec->freq/4) )
 		spec->samples = ((spec->freq/4)+3)&~3;
 
 	/* Update the fragment size as size in bytes */
@@ -37,6 +37,9 @@ struct SDL_PrivateAudioData {
 	Uint8 *mixbuf;		/* The raw allocated mixing buffer */
 	WAVEHDR wavebuf[NUM_BUFFERS];	/* Wave audio fragments */
 	int next_buffer;
+	int lowlatency;		/* Allow short fragments, see DIB_OpenAudio() */
+	int frame_size;		/* Bytes per sample frame */
+	DWORD written;		/* Bytes queued with waveOutWrite() */
 };
 
 /* Old variable names */
@@ -45,5 +48,8 @@ struct SDL_PrivateAudioData {
 #define mixbuf			(this->hidden->mixbuf)
 #define wavebuf			(this->hidden->wavebuf)
 #define next_buffer		(this->hidden->next_buffer)
+#define lowlatency		(this->hidden->lowlatency)
+#define frame_size		(this->hidden->frame_size)
+#define written			(this->hidden->written)
 
 #endif /* _SDL_lowaudio_h */
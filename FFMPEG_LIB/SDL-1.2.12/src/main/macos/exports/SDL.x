@@ -18,6 +18,7 @@
 	SDL_LockAudio
 	SDL_UnlockAudio
 	SDL_CloseAudio
+	SDL_GetAudioLatency
 	SDL_CDNumDrives
 	SDL_CDName
 	SDL_CDOpen
@@ -172,6 +173,7 @@
 	SDL_LockYUVOverlay
 	SDL_UnlockYUVOverlay
 	SDL_DisplayYUVOverlay
+	SDL_DisplayYUVOverlayRects
 	SDL_FreeYUVOverlay
 	SDL_GL_LoadLibrary
 	SDL_GL_GetProcAddress
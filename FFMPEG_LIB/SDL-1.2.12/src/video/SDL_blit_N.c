@@ -1211,6 +1211,82 @@ static void Blit_RGB888_RGB565(SDL_BlitInfo *info)
 #endif /* SDL_HERMES_BLITTERS */
 
 
+/* Portable 16-bit converters, handling two pixels in one 32-bit word.
+   The masks keep every channel inside its own half of the word, so the
+   same macros work on single pixels and on either byte order.
+*/
+#define RGB565_RGB555_TWO(p)	((((p) & 0xFFC0FFC0) >> 1) | ((p) & 0x001F001F))
+#define RGB555_RGB565_TWO(p)	((((p) & 0x7FE07FE0) << 1) | ((p) & 0x001F001F))
+#define RGB565_BGR565_TWO(p)	((((p) & 0xF800F800) >> 11) | \
+				 (((p) & 0x001F001F) << 11) | ((p) & 0x07E007E0))
+#define RGB555_BGR555_TWO(p)	((((p) & 0x7C007C00) >> 10) | \
+				 (((p) & 0x001F001F) << 10) | ((p) & 0x03E003E0))
+
+#define DEFINE_BLIT16_TWO(name, conv)					\
+static void name(SDL_BlitInfo *info)					\
+{									\
+	int width = info->d_width;					\
+	int height = info->d_height;					\
+	Uint16 *src = (Uint16 *)info->s_pixels;				\
+	int srcskip = info->s_skip/2;					\
+	Uint16 *dst = (Uint16 *)info->d_pixels;				\
+	int dstskip = info->d_skip/2;					\
+									\
+	while ( height-- ) {						\
+		int n = width;						\
+		/* Pixel pairs need the same alignment on both sides */	\
+		if ( ((unsigned long)src ^ (unsigned long)dst) & 2 ) {	\
+			DUFFS_LOOP(					\
+				*dst++ = (Uint16)conv(*src);		\
+				++src;					\
+			, n);						\
+		} else {						\
+			if ( ((unsigned long)dst & 2) && n ) {		\
+				*dst++ = (Uint16)conv(*src);		\
+				++src;					\
+				--n;					\
+			}						\
+			for ( ; n > 1; n -= 2 ) {			\
+				*(Uint32 *)dst = conv(*(Uint32 *)src);	\
+				src += 2;				\
+				dst += 2;				\
+			}						\
+			if ( n ) {					\
+				*dst++ = (Uint16)conv(*src);		\
+				++src;					\
+			}						\
+		}							\
+		src += srcskip;						\
+		dst += dstskip;						\
+	}								\
+}
+DEFINE_BLIT16_TWO(Blit_RGB565_RGB555, RGB565_RGB555_TWO)
+DEFINE_BLIT16_TWO(Blit_RGB555_RGB565, RGB555_RGB565_TWO)
+DEFINE_BLIT16_TWO(Blit_RGB565_BGR565, RGB565_BGR565_TWO)
+DEFINE_BLIT16_TWO(Blit_RGB555_BGR555, RGB555_BGR555_TWO)
+
+/* Special optimized blit for RGB 8-8-8 <--> BGR 8-8-8 32-bit surfaces */
+#define RGB888_BGR888(p)	((((p) & 0x00FF0000) >> 16) | \
+				 ((p) & 0x0000FF00) | (((p) & 0x000000FF) << 16))
+static void Blit_RGB888_BGR888(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint32 *src = (Uint32 *)info->s_pixels;
+	int srcskip = info->s_skip/4;
+	Uint32 *dst = (Uint32 *)info->d_pixels;
+	int dstskip = info->d_skip/4;
+
+	while ( height-- ) {
+		DUFFS_LOOP(
+			*dst++ = RGB888_BGR888(*src);
+			++src;
+		, width);
+		src += srcskip;
+		dst += dstskip;
+	}
+}
+
 /* Special optimized blit for RGB 5-6-5 --> 32-bit RGB surfaces */
 #define RGB565_32(dst, src, map) (map[src[LO]*2] + map[src[HI]*2+1])
 static void Blit_RGB565_32(SDL_BlitInfo *info, const Uint32 *map)
@@ -2298,6 +2374,18 @@ static const struct blit_table normal_blit_2[] = {
     { 0x00007C00,0x000003E0,0x0000001F, 4, 0x00000000,0x00000000,0x00000000,
       2, NULL, Blit_RGB555_32Altivec, NO_ALPHA | COPY_ALPHA | SET_ALPHA },
 #endif
+    { 0x0000F800,0x000007E0,0x0000001F, 2, 0x00007C00,0x000003E0,0x0000001F,
+      0, NULL, Blit_RGB565_RGB555, NO_ALPHA },
+    { 0x00007C00,0x000003E0,0x0000001F, 2, 0x0000F800,0x000007E0,0x0000001F,
+      0, NULL, Blit_RGB555_RGB565, NO_ALPHA },
+    { 0x0000F800,0x000007E0,0x0000001F, 2, 0x0000001F,0x000007E0,0x0000F800,
+      0, NULL, Blit_RGB565_BGR565, NO_ALPHA },
+    { 0x0000001F,0x000007E0,0x0000F800, 2, 0x0000F800,0x000007E0,0x0000001F,
+      0, NULL, Blit_RGB565_BGR565, NO_ALPHA },
+    { 0x00007C00,0x000003E0,0x0000001F, 2, 0x0000001F,0x000003E0,0x00007C00,
+      0, NULL, Blit_RGB555_BGR555, NO_ALPHA },
+    { 0x0000001F,0x000003E0,0x00007C00, 2, 0x00007C00,0x000003E0,0x0000001F,
+      0, NULL, Blit_RGB555_BGR555, NO_ALPHA },
     { 0x0000F800,0x000007E0,0x0000001F, 4, 0x00FF0000,0x0000FF00,0x000000FF,
       0, NULL, Blit_RGB565_ARGB8888, SET_ALPHA },
     { 0x0000F800,0x000007E0,0x0000001F, 4, 0x000000FF,0x0000FF00,0x00FF0000,
@@ -2359,6 +2447,10 @@ static const struct blit_table normal_blit_4[] = {
     { 0x00FF0000,0x0000FF00,0x000000FF, 2, 0x00007C00,0x000003E0,0x0000001F,
       0, NULL, Blit_RGB888_RGB555, NO_ALPHA },
 #endif
+    { 0x00FF0000,0x0000FF00,0x000000FF, 4, 0x000000FF,0x0000FF00,0x00FF0000,
+      0, NULL, Blit_RGB888_BGR888, NO_ALPHA },
+    { 0x000000FF,0x0000FF00,0x00FF0000, 4, 0x00FF0000,0x0000FF00,0x000000FF,
+      0, NULL, Blit_RGB888_BGR888, NO_ALPHA },
 	/* Default for 32-bit RGB source, used if no other blitter matches */
 	{ 0,0,0, 0, 0,0,0, 0, NULL, BlitNtoN, 0 }
 };
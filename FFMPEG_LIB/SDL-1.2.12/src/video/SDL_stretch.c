@@ -139,9 +139,48 @@ void name(type *src, int src_w, type *dst, int dst_w)	\
 	}						\
 }
 DEFINE_COPY_ROW(copy_row1, Uint8)
-DEFINE_COPY_ROW(copy_row2, Uint16)
 DEFINE_COPY_ROW(copy_row4, Uint32)
 
+/* Store two 16-bit pixels at a time, once the destination is aligned */
+#define FETCH_PIXEL(pixel)				\
+	while ( pos >= 0x10000L ) {			\
+		pixel = *src++;				\
+		pos -= 0x10000L;			\
+	}						\
+	pos += inc;
+void copy_row2(Uint16 *src, int src_w, Uint16 *dst, int dst_w)
+{
+	int i;
+	int pos, inc;
+	Uint16 pixel = 0;
+	Uint16 pixel2;
+
+	pos = 0x10000;
+	inc = (src_w << 16) / dst_w;
+	i = dst_w;
+	if ( ((unsigned long)dst & 2) && (i > 0) ) {
+		FETCH_PIXEL(pixel);
+		*dst++ = pixel;
+		--i;
+	}
+	for ( ; i > 1; i -= 2 ) {
+		FETCH_PIXEL(pixel);
+		pixel2 = pixel;
+		FETCH_PIXEL(pixel);
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+		*(Uint32 *)dst = pixel2 | ((Uint32)pixel << 16);
+#else
+		*(Uint32 *)dst = ((Uint32)pixel2 << 16) | pixel;
+#endif
+		dst += 2;
+	}
+	if ( i ) {
+		FETCH_PIXEL(pixel);
+		*dst = pixel;
+	}
+}
+#undef FETCH_PIXEL
+
 #endif /* USE_ASM_STRETCH */
 
 /* The ASM code doesn't handle 24-bpp stretch blits */
@@ -167,11 +206,97 @@ void copy_row3(Uint8 *src, int src_w, Uint8 *dst, int dst_w)
 	}
 }
 
+/* Bilinear filtering, all channels of a pixel are blended at once.
+   For 16-bit pixels the channels are spread over 32 bits with 5 spare
+   bits above each of them, which leaves room for 5-bit weights.
+*/
+#define SPREAD16(p, mask)	((((Uint32)(p) << 16) | (p)) & (mask))
+#define BLEND16(a, b, f, mask)	((((a) * (32 - (f)) + (b) * (f)) >> 5) & (mask))
+
+static void smooth_row2(Uint16 *src0, Uint16 *src1, int src_w,
+                        Uint16 *dst, int dst_w, int fy, Uint32 mask)
+{
+	int i;
+	int pos, inc;
+
+	pos = 0;
+	inc = (src_w << 16) / dst_w;
+	for ( i=dst_w; i>0; --i ) {
+		int x = pos >> 16;
+		int x1 = (x + 1 < src_w) ? x + 1 : x;
+		int fx = (pos >> 11) & 31;
+		Uint32 top, bottom, pixel;
+
+		top = BLEND16(SPREAD16(src0[x], mask), SPREAD16(src0[x1], mask), fx, mask);
+		bottom = BLEND16(SPREAD16(src1[x], mask), SPREAD16(src1[x1], mask), fx, mask);
+		pixel = BLEND16(top, bottom, fy, mask);
+		*dst++ = (Uint16)(pixel | (pixel >> 16));
+		pos += inc;
+	}
+}
+
+/* 32-bit pixels are blended as two pairs of 8-bit channels */
+#define BLEND32(a, b, f) \
+	(((((a) & 0x00FF00FF) * (256 - (f)) + ((b) & 0x00FF00FF) * (f)) >> 8) & 0x00FF00FF) | \
+	(((((a) >> 8) & 0x00FF00FF) * (256 - (f)) + (((b) >> 8) & 0x00FF00FF) * (f)) & 0xFF00FF00)
+
+static void smooth_row4(Uint32 *src0, Uint32 *src1, int src_w,
+                        Uint32 *dst, int dst_w, int fy)
+{
+	int i;
+	int pos, inc;
+
+	pos = 0;
+	inc = (src_w << 16) / dst_w;
+	for ( i=dst_w; i>0; --i ) {
+		int x = pos >> 16;
+		int x1 = (x + 1 < src_w) ? x + 1 : x;
+		int fx = (pos >> 8) & 255;
+		Uint32 top, bottom;
+
+		top = BLEND32(src0[x], src0[x1], fx);
+		bottom = BLEND32(src1[x], src1[x1], fx);
+		*dst++ = BLEND32(top, bottom, fy);
+		pos += inc;
+	}
+}
+
+static void smooth_stretch(SDL_Surface *src, SDL_Rect *srcrect,
+                           SDL_Surface *dst, SDL_Rect *dstrect,
+                           int first, int count, Uint32 mask16)
+{
+	const int bpp = dst->format->BytesPerPixel;
+	int inc = (srcrect->h << 16) / dstrect->h;
+	int row;
+
+	for ( row = first; row < first+count; ++row ) {
+		int sy = row * inc;
+		int y0 = srcrect->y + (sy >> 16);
+		int y1 = (y0 + 1 < srcrect->y + srcrect->h) ? y0 + 1 : y0;
+		Uint8 *src0 = (Uint8 *)src->pixels + (y0*src->pitch)
+		                                   + (srcrect->x*bpp);
+		Uint8 *src1 = (Uint8 *)src->pixels + (y1*src->pitch)
+		                                   + (srcrect->x*bpp);
+		Uint8 *dstp = (Uint8 *)dst->pixels + ((dstrect->y+row)*dst->pitch)
+		                                   + (dstrect->x*bpp);
+		if ( bpp == 2 ) {
+			smooth_row2((Uint16 *)src0, (Uint16 *)src1, srcrect->w,
+			            (Uint16 *)dstp, dstrect->w,
+			            (sy >> 11) & 31, mask16);
+		} else {
+			smooth_row4((Uint32 *)src0, (Uint32 *)src1, srcrect->w,
+			            (Uint32 *)dstp, dstrect->w,
+			            (sy >> 8) & 255);
+		}
+	}
+}
+
 /* Perform a stretch blit between two surfaces of the same format.
    NOTE:  This function is not safe to call from multiple threads!
 */
-int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
-                    SDL_Surface *dst, SDL_Rect *dstrect)
+int SDL_SoftStretchRows(SDL_Surface *src, SDL_Rect *srcrect,
+                        SDL_Surface *dst, SDL_Rect *dstrect,
+                        int first, int count, int smooth)
 {
 	int src_locked;
 	int dst_locked;
@@ -187,6 +312,7 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 	int u1, u2;
 #endif
 	const int bpp = dst->format->BytesPerPixel;
+	Uint32 mask16 = 0;
 
 	if ( src->format->BitsPerPixel != dst->format->BitsPerPixel ) {
 		SDL_SetError("Only works with same format surfaces");
@@ -246,12 +372,33 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 	}
 
 	/* Set up the data... */
-	pos = 0x10000;
 	inc = (srcrect->h << 16) / dstrect->h;
-	src_row = srcrect->y;
-	dst_row = dstrect->y;
+	if ( count < 0 || first + count > dstrect->h ) {
+		count = dstrect->h - first;
+	}
+	/* Start where a full stretch would be on row 'first' */
+	pos = 0x10000 + ((first * inc) & 0xFFFF);
+	src_row = srcrect->y + ((first * inc) >> 16);
+	dst_row = dstrect->y + first;
 	dst_width = dstrect->w*bpp;
 
+	/* Bilinear filtering is done for 5-6-5, 5-5-5 and 32-bit pixels */
+	if ( smooth && bpp == 2 ) {
+		if ( dst->format->Gmask == 0x07E0 ) {
+			mask16 = 0x07E0F81F;
+		} else if ( dst->format->Gmask == 0x03E0 ) {
+			mask16 = 0x03E07C1F;
+		} else {
+			smooth = 0;
+		}
+	} else if ( bpp != 4 ) {
+		smooth = 0;
+	}
+	if ( smooth ) {
+		smooth_stretch(src, srcrect, dst, dstrect, first, count, mask16);
+		count = 0;
+	}
+
 #ifdef USE_ASM_STRETCH
 	/* Write the opcodes for this stretch */
 	if ( (bpp != 3) &&
@@ -261,7 +408,7 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 #endif
 
 	/* Perform the stretch blit */
-	for ( dst_maxrow = dst_row+dstrect->h; dst_row<dst_maxrow; ++dst_row ) {
+	for ( dst_maxrow = dst_row+count; dst_row<dst_maxrow; ++dst_row ) {
 		dstp = (Uint8 *)dst->pixels + (dst_row*dst->pitch)
 		                            + (dstrect->x*bpp);
 		while ( pos >= 0x10000L ) {
@@ -332,3 +479,8 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 	return(0);
 }
 
+int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
+                    SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	return SDL_SoftStretchRows(src, srcrect, dst, dstrect, 0, -1, 0);
+}
@@ -27,3 +27,12 @@
 extern int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
                            SDL_Surface *dst, SDL_Rect *dstrect);
 
+/* Same as SDL_SoftStretch(), but only writes 'count' rows of the destination
+   rectangle starting at row 'first', exactly as a full stretch would.
+   A negative count stretches to the bottom of the rectangle.
+   If 'smooth' is set, 16-bit 5-6-5/5-5-5 and 32-bit pixels are filtered
+   bilinearly, other formats are always stretched without filtering.
+*/
+extern int SDL_SoftStretchRows(SDL_Surface *src, SDL_Rect *srcrect,
+                               SDL_Surface *dst, SDL_Rect *dstrect,
+                               int first, int count, int smooth);
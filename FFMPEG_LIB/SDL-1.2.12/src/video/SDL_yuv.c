@@ -81,6 +81,12 @@ void SDL_UnlockYUVOverlay(SDL_Overlay *overlay)
 }
 
 int SDL_DisplayYUVOverlay(SDL_Overlay *overlay, SDL_Rect *dstrect)
+{
+	return SDL_DisplayYUVOverlayRects(overlay, dstrect, 0, NULL);
+}
+
+int SDL_DisplayYUVOverlayRects(SDL_Overlay *overlay, SDL_Rect *dstrect,
+				int numrects, SDL_Rect *rects)
 {
 	SDL_Rect src, dst;
 	int srcx, srcy, srcw, srch;
@@ -135,6 +141,10 @@ int SDL_DisplayYUVOverlay(SDL_Overlay *overlay, SDL_Rect *dstrect)
 	dst.y = dsty;
 	dst.w = dstw;
 	dst.h = dsth;
+	if ( rects && overlay->hwfuncs->Display == SDL_DisplayYUV_SW ) {
+		return SDL_DisplayYUV_SWRects(current_video, overlay, &src, &dst,
+		                              numrects, rects);
+	}
 	return overlay->hwfuncs->Display(current_video, overlay, &src, &dst);
 }
 
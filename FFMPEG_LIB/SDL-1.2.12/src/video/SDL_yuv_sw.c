@@ -101,6 +101,7 @@ static struct private_yuvhwfuncs sw_yuvfuncs = {
 struct private_yuvhwdata {
 	SDL_Surface *stretch;
 	SDL_Surface *display;
+	int smooth;
 	Uint8 *pixels;
 	int *colortab;
 	Uint32 *rgb_2_pix;
@@ -985,6 +986,7 @@ SDL_Overlay *SDL_CreateYUV_SW(_THIS, int width, int height, Uint32 format, SDL_S
 	}
 	swdata->stretch = NULL;
 	swdata->display = display;
+	swdata->smooth = (SDL_getenv("SDL_VIDEO_YUV_SMOOTH") != NULL);
 	swdata->pixels = (Uint8 *) SDL_malloc(width*height*2);
 	swdata->colortab = (int *)SDL_malloc(4*256*sizeof(int));
 	Cr_r_tab = &swdata->colortab[0*256];
@@ -1165,6 +1167,11 @@ void SDL_UnlockYUV_SW(_THIS, SDL_Overlay *overlay)
 }
 
 int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
+{
+	return SDL_DisplayYUV_SWRects(_this, overlay, src, dst, 0, NULL);
+}
+
+int SDL_DisplayYUV_SWRects(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst, int numrects, SDL_Rect *rects)
 {
 	struct private_yuvhwdata *swdata;
 	int stretch;
@@ -1173,6 +1180,10 @@ int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 	Uint8 *lum, *Cr, *Cb;
 	Uint8 *dstp;
 	int mod;
+	int planar;
+	SDL_Rect full;
+	SDL_Rect *updates;
+	int i, n;
 
 	swdata = overlay->hwdata;
 	stretch = 0;
@@ -1184,6 +1195,8 @@ int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 		   slow them down in the general unclipped case.
 		*/
 		stretch = 1;
+		/* Only whole overlays are converted band by band */
+		rects = NULL;
 	} else if ( (src->w != dst->w) || (src->h != dst->h) ) {
 		if ( (dst->w == 2*src->w) &&
 		     (dst->h == 2*src->h) ) {
@@ -1210,6 +1223,7 @@ int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 	} else {
 		display = swdata->display;
 	}
+	planar = 1;
 	switch (overlay->format) {
 	    case SDL_YV12_OVERLAY:
 		lum = overlay->pixels[0];
@@ -1222,16 +1236,19 @@ int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 		Cb =  overlay->pixels[1];
 		break;
 	    case SDL_YUY2_OVERLAY:
+		planar = 0;
 		lum = overlay->pixels[0];
 		Cr = lum + 3;
 		Cb = lum + 1;
 		break;
 	    case SDL_UYVY_OVERLAY:
+		planar = 0;
 		lum = overlay->pixels[0]+1;
 		Cr = lum + 1;
 		Cb = lum - 1;
 		break;
 	    case SDL_YVYU_OVERLAY:
+		planar = 0;
 		lum = overlay->pixels[0];
 		Cr = lum + 1;
 		Cb = lum + 3;
@@ -1253,24 +1270,102 @@ int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 			+ dst->y * display->pitch;
 	}
 	mod = (display->pitch / display->format->BytesPerPixel);
-
-	if ( scale_2x ) {
-		mod -= (overlay->w * 2);
-		swdata->Display2X(swdata->colortab, swdata->rgb_2_pix,
-		                  lum, Cr, Cb, dstp, overlay->h, overlay->w, mod);
-	} else {
-		mod -= overlay->w;
-		swdata->Display1X(swdata->colortab, swdata->rgb_2_pix,
-		                  lum, Cr, Cb, dstp, overlay->h, overlay->w, mod);
+	mod -= overlay->w * (scale_2x ? 2 : 1);
+
+	if ( ! rects ) {
+		full.x = 0;
+		full.y = 0;
+		full.w = overlay->w;
+		full.h = overlay->h;
+		rects = &full;
+		numrects = 1;
+	}
+	updates = SDL_stack_alloc(SDL_Rect, numrects);
+	n = 0;
+
+	/* The converters work on whole rows (pairs of rows for 4:2:0), so
+	   every changed rectangle is converted as a full width band and
+	   only the changed part of it is sent to the screen.
+	*/
+	for ( i = 0; i < numrects; ++i ) {
+		int y0 = rects[i].y & ~1;
+		int y1 = (rects[i].y + rects[i].h + 1) & ~1;
+		int x0 = rects[i].x;
+		int x1 = rects[i].x + rects[i].w;
+		int offset, coffset;
+		Uint8 *out;
+
+		if ( y1 > overlay->h ) {
+			y1 = overlay->h;
+		}
+		if ( x1 > overlay->w ) {
+			x1 = overlay->w;
+		}
+		if ( y0 >= y1 || x0 >= x1 ) {
+			continue;
+		}
+		offset = y0 * overlay->pitches[0];
+		coffset = planar ? (y0 / 2) * overlay->pitches[1] : offset;
+		out = dstp + y0 * (scale_2x ? 2 : 1) * display->pitch;
+		if ( scale_2x ) {
+			swdata->Display2X(swdata->colortab, swdata->rgb_2_pix,
+			                  lum + offset, Cr + coffset, Cb + coffset,
+			                  out, y1 - y0, overlay->w, mod);
+		} else {
+			swdata->Display1X(swdata->colortab, swdata->rgb_2_pix,
+			                  lum + offset, Cr + coffset, Cb + coffset,
+			                  out, y1 - y0, overlay->w, mod);
+		}
+		if ( stretch ) {
+			/* Dirty destination rows, padded by one for rounding
+			   and by one source pixel for the filter */
+			int r0 = ((y0 - swdata->smooth) * dst->h) / overlay->h - 1;
+			int r1 = (y1 * dst->h + overlay->h - 1) / overlay->h + 1;
+			int c0 = ((x0 - swdata->smooth) * dst->w) / overlay->w - 1;
+			int c1 = (x1 * dst->w + overlay->w - 1) / overlay->w + 1;
+			if ( r0 < 0 ) r0 = 0;
+			if ( r1 > dst->h ) r1 = dst->h;
+			if ( c0 < 0 ) c0 = 0;
+			if ( c1 > dst->w ) c1 = dst->w;
+			updates[n].x = dst->x + c0;
+			updates[n].y = dst->y + r0;
+			updates[n].w = c1 - c0;
+			updates[n].h = r1 - r0;
+		} else if ( scale_2x ) {
+			updates[n].x = dst->x + x0 * 2;
+			updates[n].y = dst->y + y0 * 2;
+			updates[n].w = (x1 - x0) * 2;
+			updates[n].h = (y1 - y0) * 2;
+		} else {
+			updates[n].x = dst->x + x0;
+			updates[n].y = dst->y + y0;
+			updates[n].w = x1 - x0;
+			updates[n].h = y1 - y0;
+		}
+		++n;
 	}
 	if ( SDL_MUSTLOCK(display) ) {
 		SDL_UnlockSurface(display);
 	}
 	if ( stretch ) {
 		display = swdata->display;
-		SDL_SoftStretch(swdata->stretch, src, display, dst);
+		if ( rects == &full ) {
+			SDL_SoftStretchRows(swdata->stretch, src, display, dst,
+			                    0, -1, swdata->smooth);
+		} else {
+			for ( i = 0; i < n; ++i ) {
+				SDL_SoftStretchRows(swdata->stretch, src, display, dst,
+				                    updates[i].y - dst->y, updates[i].h,
+				                    swdata->smooth);
+			}
+		}
+	}
+	if ( rects == &full ) {
+		SDL_UpdateRects(display, 1, dst);
+	} else {
+		SDL_UpdateRects(display, n, updates);
 	}
-	SDL_UpdateRects(display, 1, dst);
+	SDL_stack_free(updates);
 
 	return(0);
 }